@@ -0,0 +1,701 @@
+#!/usr/bin/python
+
+###############################################################################
+# Copyright (C) 2009, 2010, 2011, 2012 by Kapil Arya, Gene Cooperman,         #
+#                                        Tyler Denniston, and Ana-Maria Visan #
+# {kapil,gene,tyler,amvisan}@ccs.neu.edu                                      #
+#                                                                             #
+# This file is part of FReD.                                                  #
+#                                                                             #
+# FReD is free software: you can redistribute it and/or modify                #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# FReD is distributed in the hope that it will be useful,                     #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with FReD.  If not, see <http://www.gnu.org/licenses/>.               #
+###############################################################################
+
+"""
+This file should be executable from the command line to run benchmarks of
+the record/replay module (fredhijack.so) on the programs in test/.
+
+Record-only benchmarks run the test program directly under
+dmtcp_checkpoint. Benchmarks that need replay drive a gdb session the same
+way fredtest.py does. Wall-clock times are reported.
+
+To add a new benchmark:
+
+1) Define the benchmark function. Follow bench_record_scaling() as a
+   template.
+2) Add the new benchmark function to the gd_benchmarks dictionary in the
+   initialize_benchmarks() function.
+"""
+from optparse import OptionParser
+from random import randint
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import traceback
+
+import fredapp
+import fred.fredutil
+import fred.dmtcpmanager
+import fred.fredmanager
+import fred.fredio
+
+# XXX this path shouldn't be hardcoded.
+GS_TEST_PROGRAMS_DIRECTORY = "test"
+
+gs_dmtcp_port = ""
+gn_num_iters = 1
+gd_benchmarks = {}
+gn_coordinator_port = -1
+g_debugger = None
+
+def start_session(l_cmd):
+    """Start the given command line as a fred session."""
+    global g_debugger
+    g_debugger = fredapp.fred_setup_as_module(l_cmd, gs_dmtcp_port, False)
+
+def end_session():
+    """End the current debugger session."""
+    global g_debugger
+    fred.dmtcpmanager.kill_peers()
+    fred.fredmanager.destroy()
+    fred.fredutil.fred_teardown()
+    g_debugger.destroy()
+    g_debugger = None
+
+def time_commands(l_cmds):
+    """Execute the given debugger commands and return elapsed seconds."""
+    f_start = time.time()
+    fredapp.source_from_list(l_cmds)
+    return time.time() - f_start
+
+def run_under_fred(l_cmd, d_env={}):
+    """Run l_cmd under dmtcp_checkpoint with fredhijack.so, recording from
+    the first exec. Extra environment variables are taken from d_env.
+    Return (elapsed seconds, DMTCP_TMPDIR of the run, program output)."""
+    s_tmpdir = tempfile.mkdtemp(prefix="fredbench-")
+    d_run_env = dict(os.environ)
+    d_run_env["DMTCP_PORT"] = gs_dmtcp_port
+    d_run_env["DMTCP_TMPDIR"] = s_tmpdir
+    d_run_env["DMTCP_CHECKPOINT_DIR"] = s_tmpdir
+    d_run_env["DMTCP_QUIET"] = "2"
+    d_run_env["DMTCP_LOG_REPLAY"] = "1"
+    d_run_env.update(d_env)
+    l_argv = ["dmtcp_checkpoint", "--quiet", "--with-module",
+              fred.fredmanager.get_fredhijack_path()] + l_cmd
+    f_start = time.time()
+    p = subprocess.Popen(l_argv, env=d_run_env, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT)
+    s_output = p.communicate()[0]
+    f_elapsed = time.time() - f_start
+    if p.returncode != 0:
+        fred.fredutil.fred_error("'%s' exited with status %d." %
+                                 (" ".join(l_cmd), p.returncode))
+    return (f_elapsed, s_tmpdir, s_output)
+
+def best_of(f_run, n_count):
+    """Call f_run() n_count times and return the smallest result."""
+    return min([f_run() for i in range(0, n_count)])
+
+def print_header(l_columns):
+    print " | ".join(["%-14s" % s for s in l_columns])
+    print "-+-".join(["-" * 14 for s in l_columns])
+
+def print_row(l_values):
+    print " | ".join(["%-14s" % str(v) for v in l_values])
+    sys.stdout.flush()
+
+def bench_record_scaling(n_count=1):
+    """Record throughput of test/many-threads at 1, 4, 16 and 64 threads,
+    with one shared log tail and with per-thread log chunks."""
+    n_iterations = 20000
+    print_header(["threads", "log mode", "seconds", "events/sec"])
+    for n_threads in [1, 4, 16, 64]:
+        l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/many-threads",
+                 str(n_threads), str(n_iterations)]
+        # Each iteration logs malloc, free, lock and unlock.
+        n_events = n_threads * n_iterations * 4
+        for (s_mode, d_env) in [("shared", {"DMTCP_LOG_PER_THREAD_CHUNKS":
+                                            "0"}),
+                                ("per-thread", {"DMTCP_LOG_PER_THREAD_CHUNKS":
+                                                "1"})]:
+            def run():
+                (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd, d_env)
+                shutil.rmtree(s_tmpdir, ignore_errors=True)
+                return f_elapsed
+            f_elapsed = best_of(run, n_count)
+            print_row([n_threads, s_mode, "%.3f" % f_elapsed,
+                       "%d" % (n_events / f_elapsed)])
+
+def find_sync_log(s_tmpdir):
+    """Return the path of the synchronization log in s_tmpdir."""
+    l_logs = [s for s in
+              glob.glob(os.path.join(s_tmpdir, "synchronization-log-*"))
+              if not s.endswith(".idx")]
+    fred.fredutil.fred_assert(len(l_logs) == 1)
+    return l_logs[0]
+
+def read_log_metadata(s_tmpdir):
+    """Return (format, dataSize, numEntries) of the synchronization log in
+    s_tmpdir, as printed by fred_read_log."""
+    # Only the metadata line is needed, not the entries.
+    p = subprocess.Popen(["record-replay/fred_read_log", "-n", "0",
+                          find_sync_log(s_tmpdir)],
+                         stdout=subprocess.PIPE)
+    s_line = p.stdout.readline()
+    p.wait()
+    m = re.search("format=(\w+), dataSize=(\d+), numEntries=(\d+)", s_line)
+    fred.fredutil.fred_assert(m != None)
+    return (m.group(1), int(m.group(2)), int(m.group(3)))
+
+def bench_log_size(n_count=1):
+    """Synchronization log size of a few test programs, with fixed-size and
+    compact entries on the shared log tail, and with compact entries in
+    per-thread chunks (which are re-encoded when merged). The ratio is the
+    size with fixed-size entries over the size of each other row."""
+    print_header(["program", "format", "entries", "bytes", "bytes/entry",
+                  "ratio"])
+    for l_cmd in [["pthread-test"], ["pthread-cond-var"], ["test-list"],
+                  ["many-threads", "4", "2000"]]:
+        l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/" + l_cmd[0]] + l_cmd[1:]
+        n_fixed = 0
+        for (s_format, s_chunks) in [("0", "0"), ("1", "0"), ("1", "1")]:
+            (f_elapsed, s_tmpdir, s_output) = \
+                run_under_fred(l_cmd, {"DMTCP_LOG_FORMAT": s_format,
+                                       "DMTCP_LOG_PER_THREAD_CHUNKS":
+                                           s_chunks})
+            (s_name, n_bytes, n_entries) = read_log_metadata(s_tmpdir)
+            shutil.rmtree(s_tmpdir, ignore_errors=True)
+            if s_format == "0":
+                n_fixed = n_bytes
+            if s_chunks == "1":
+                s_name += "+chunks"
+            print_row([os.path.basename(l_cmd[0]), s_name, n_entries, n_bytes,
+                       "%.1f" % (float(n_bytes) / max(n_entries, 1)),
+                       "%.2fx" % (float(n_fixed) / max(n_bytes, 1))])
+
+def bench_log_index(n_count=1):
+    """Disk space of the entry index (<log>.idx) next to that of the
+    synchronization log, for a few test programs recorded with per-thread
+    chunks, which fill in the index while recording. Both are counted in
+    allocated blocks: the index file grows 2^20 records at a time."""
+    print_header(["program", "entries", "log bytes/ent", "index bytes/ent",
+                  "index/log"])
+    for l_cmd in [["pthread-test"], ["test-list"],
+                  ["many-threads", "4", "2000"],
+                  ["many-threads", "4", "50000"]]:
+        l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/" + l_cmd[0]] + l_cmd[1:]
+        (f_elapsed, s_tmpdir, s_output) = \
+            run_under_fred(l_cmd, {"DMTCP_LOG_PER_THREAD_CHUNKS": "1"})
+        (s_name, n_bytes, n_entries) = read_log_metadata(s_tmpdir)
+        s_log = find_sync_log(s_tmpdir)
+        n_log = os.stat(s_log).st_blocks * 512
+        n_index = os.stat(s_log + ".idx").st_blocks * 512
+        shutil.rmtree(s_tmpdir, ignore_errors=True)
+        print_row([os.path.basename(l_cmd[0]), n_entries,
+                   "%.1f" % (float(n_log) / max(n_entries, 1)),
+                   "%.1f" % (float(n_index) / max(n_entries, 1)),
+                   "%.2f" % (float(n_index) / max(n_log, 1))])
+
+def bench_log_dispatch(n_count=1):
+    """Cost per entry of appending to and replaying the synchronization log,
+    by event type (record-replay/fred_log_bench), in both entry formats."""
+    for s_format in ["0", "1"]:
+        d_env = dict(os.environ)
+        d_env["DMTCP_LOG_FORMAT"] = s_format
+        print "DMTCP_LOG_FORMAT=%s" % s_format
+        sys.stdout.flush()
+        subprocess.call(["record-replay/fred_log_bench", "100000"], env=d_env)
+
+def bench_replay_handoff(n_count=1):
+    """Record and replay time of test/pthread-cond-var and test/many-threads,
+    measured from a checkpoint at main() to program exit."""
+    print_header(["program", "threads", "record (s)", "replay (s)"])
+    for (s_prog, l_args) in [("pthread-cond-var", []),
+                             ("many-threads", ["4", "2000"]),
+                             ("many-threads", ["16", "2000"])]:
+        l_cmd = ["gdb", "--args",
+                 GS_TEST_PROGRAMS_DIRECTORY + "/" + s_prog] + l_args
+        def run():
+            start_session(l_cmd)
+            fredapp.source_from_list(["b main", "r", "fred-ckpt"])
+            f_record = time_commands(["c"])
+            fredapp.source_from_list(["fred-restart"])
+            f_replay = time_commands(["c"])
+            end_session()
+            return (f_record, f_replay)
+        (f_record, f_replay) = best_of(run, n_count)
+        print_row([s_prog, l_args and l_args[0] or "16",
+                   "%.3f" % f_record, "%.3f" % f_replay])
+
+def bench_malloc_arena(n_count=1):
+    """Record time of test/many-threads (malloc/free and lock/unlock in every
+    thread) with logged malloc wrappers and with the deterministic malloc
+    arena."""
+    n_iterations = 20000
+    print_header(["threads", "malloc mode", "seconds", "iters/sec"])
+    for n_threads in [1, 4, 16]:
+        l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/many-threads",
+                 str(n_threads), str(n_iterations)]
+        for (s_mode, d_env) in [("logged", {"DMTCP_MALLOC_ARENA": "0"}),
+                                ("arena", {"DMTCP_MALLOC_ARENA": "1"})]:
+            def run():
+                (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd, d_env)
+                shutil.rmtree(s_tmpdir, ignore_errors=True)
+                return f_elapsed
+            f_elapsed = best_of(run, n_count)
+            print_row([n_threads, s_mode, "%.3f" % f_elapsed,
+                       "%d" % (n_threads * n_iterations / f_elapsed)])
+
+def bench_read_data(n_count=1):
+    """Record time of dd reading a 64 MB file at several block sizes. The
+    data of every read() goes to the read-data log."""
+    n_size = 64 * 1024 * 1024
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredbench-input-")
+    os.write(n_fd, os.urandom(n_size))
+    os.close(n_fd)
+    print_header(["block size", "reads", "seconds", "MB/sec"])
+    for n_bs in [256, 4096, 65536]:
+        l_cmd = ["dd", "if=" + s_input, "of=/dev/null", "bs=%d" % n_bs]
+        def run():
+            (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd)
+            shutil.rmtree(s_tmpdir, ignore_errors=True)
+            return f_elapsed
+        f_elapsed = best_of(run, n_count)
+        print_row([n_bs, n_size / n_bs, "%.3f" % f_elapsed,
+                   "%.1f" % (n_size / f_elapsed / (1024 * 1024))])
+    os.remove(s_input)
+
+def bench_stdio_getc(n_count=1):
+    """Log size and record time of test/getc-file reading a 4 MB text file
+    one character at a time, with getc(), fgetc() and getc_unlocked(), next
+    to the time without FReD. With one thread only refills of the stream
+    buffer are logged; with two, every getc() and fgetc() is."""
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredbench-input-")
+    os.write(n_fd, "".join(["%d\n" % i for i in range(0, 600000)]))
+    os.close(n_fd)
+    f_null = open(os.devnull, "w")
+    print_header(["function", "threads", "entries", "log bytes",
+                  "read data", "native (s)", "record (s)"])
+    for (s_function, n_threads) in [("getc", 1), ("fgetc", 1),
+                                    ("getc_unlocked", 1), ("getc", 2)]:
+        l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/getc-file", s_input,
+                 s_function, str(n_threads)]
+        def run_native():
+            f_start = time.time()
+            subprocess.call(l_cmd, stdout=f_null)
+            return time.time() - f_start
+        def run():
+            (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd)
+            (s_name, n_bytes, n_entries) = read_log_metadata(s_tmpdir)
+            n_read_data = sum([os.stat(s).st_blocks * 512 for s in
+                               glob.glob(os.path.join(s_tmpdir,
+                                         "synchronization-read-log-*"))])
+            shutil.rmtree(s_tmpdir, ignore_errors=True)
+            return (f_elapsed, n_entries, n_bytes, n_read_data)
+        f_native = best_of(run_native, n_count)
+        (f_elapsed, n_entries, n_bytes, n_read_data) = best_of(run, n_count)
+        print_row([s_function, n_threads, n_entries, n_bytes, n_read_data,
+                   "%.3f" % f_native, "%.3f" % f_elapsed])
+    f_null.close()
+    os.remove(s_input)
+
+def bench_fscanf(n_count=1):
+    """test/fscanf-numbers parsing 200000 lines of four fields, one fscanf()
+    per line: time without FReD, entries and read data logged, and record
+    and replay time from a checkpoint at main() to the end of the parse.
+    Replay must give the same sums as record."""
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredbench-input-")
+    os.write(n_fd, "".join(["%d %.3f %x w%d\n" % (i - 1000, i / 7.0, i * 3, i)
+                            for i in range(0, 200000)]))
+    os.close(n_fd)
+    l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/fscanf-numbers", s_input]
+    f_null = open(os.devnull, "w")
+    def run_native():
+        f_start = time.time()
+        subprocess.call(l_cmd, stdout=f_null)
+        return time.time() - f_start
+    def run_log():
+        (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd)
+        (s_name, n_bytes, n_entries) = read_log_metadata(s_tmpdir)
+        n_read_data = sum([os.stat(s).st_blocks * 512 for s in
+                           glob.glob(os.path.join(s_tmpdir,
+                                     "synchronization-read-log-*"))])
+        shutil.rmtree(s_tmpdir, ignore_errors=True)
+        return (n_entries, n_read_data)
+    def run():
+        start_session(["gdb", "--args"] + l_cmd)
+        fredapp.source_from_list(["b main", "b print_sums", "r", "fred-ckpt"])
+        f_record = time_commands(["c"])
+        s_record = g_debugger.evaluate_expression("int_sum")
+        fredapp.source_from_list(["fred-restart"])
+        f_replay = time_commands(["c"])
+        s_replay = g_debugger.evaluate_expression("int_sum")
+        end_session()
+        fred.fredutil.fred_assert(s_record == s_replay)
+        return (f_record, f_replay)
+    f_native = best_of(run_native, n_count)
+    (n_entries, n_read_data) = run_log()
+    (f_record, f_replay) = best_of(run, n_count)
+    print_header(["lines", "entries", "read data", "native (s)",
+                  "record (s)", "replay (s)"])
+    print_row([200000, n_entries, n_read_data, "%.3f" % f_native,
+               "%.3f" % f_record, "%.3f" % f_replay])
+    f_null.close()
+    os.remove(s_input)
+
+def bench_replay_read_data(n_count=1):
+    """Record and replay time of test/read-file reading a 16 MB file,
+    measured from a checkpoint at main() to program exit. Replay serves the
+    data of every read() from the read-data log."""
+    n_size = 16 * 1024 * 1024
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredbench-input-")
+    os.write(n_fd, os.urandom(n_size))
+    os.close(n_fd)
+    print_header(["block size", "threads", "record (s)", "replay (s)",
+                  "replay MB/sec"])
+    for (n_bs, n_threads) in [(256, 1), (4096, 1), (4096, 4), (65536, 4)]:
+        l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/read-file",
+                 s_input, str(n_bs), str(n_threads)]
+        def run():
+            start_session(l_cmd)
+            fredapp.source_from_list(["b main", "r", "fred-ckpt"])
+            f_record = time_commands(["c"])
+            fredapp.source_from_list(["fred-restart"])
+            f_replay = time_commands(["c"])
+            end_session()
+            return (f_record, f_replay)
+        (f_record, f_replay) = best_of(run, n_count)
+        print_row([n_bs, n_threads, "%.3f" % f_record, "%.3f" % f_replay,
+                   "%.1f" % (n_size * n_threads / f_replay /
+                             (1024 * 1024))])
+    os.remove(s_input)
+
+def bench_wrapper_overhead(n_count=1):
+    """Per-call cost of malloc+free and read() in test/wrapper-overhead, run
+    natively and under fred with logging off (DMTCP_LOG_REPLAY=0). The
+    difference is the cost of the wrappers on calls they don't log."""
+    l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/wrapper-overhead"]
+    def parse(s_output):
+        return dict([(m.group(1), float(m.group(2))) for m in
+                     re.finditer("^(.*): ([\d.]+) ns$", s_output, re.M)])
+    def run_native():
+        p = subprocess.Popen(l_cmd, stdout=subprocess.PIPE)
+        return parse(p.communicate()[0])
+    def run_noop():
+        (f_elapsed, s_tmpdir, s_output) = \
+            run_under_fred(l_cmd, {"DMTCP_LOG_REPLAY": "0"})
+        shutil.rmtree(s_tmpdir, ignore_errors=True)
+        return parse(s_output)
+    l_native = [run_native() for i in range(0, n_count)]
+    l_noop = [run_noop() for i in range(0, n_count)]
+    print_header(["call", "native (ns)", "fred noop (ns)", "overhead (ns)"])
+    for s_call in sorted(l_native[0].keys()):
+        f_native = min([d[s_call] for d in l_native])
+        f_noop = min([d[s_call] for d in l_noop])
+        print_row([s_call, "%.1f" % f_native, "%.1f" % f_noop,
+                   "%.1f" % (f_noop - f_native)])
+
+def bench_relaxed_replay(n_count=1):
+    """Replay time of test/many-threads with one mutex per thread, with the
+    single log order and with relaxed replay (DMTCP_RELAXED_REPLAY=1),
+    measured from a checkpoint at main() to program exit. The malloc arena
+    is on in both, so the threads share no resource."""
+    n_iterations = 2000
+    d_saved_env = dict(os.environ)
+    print_header(["threads", "replay mode", "record (s)", "replay (s)"])
+    for n_threads in [1, 4, 16]:
+        l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/many-threads",
+                 str(n_threads), str(n_iterations), str(n_threads)]
+        for (s_mode, s_relaxed) in [("log order", "0"), ("relaxed", "1")]:
+            # Read by the recorded process when recording starts.
+            os.environ["DMTCP_MALLOC_ARENA"] = "1"
+            os.environ["DMTCP_RELAXED_REPLAY"] = s_relaxed
+            def run():
+                start_session(l_cmd)
+                fredapp.source_from_list(["b main", "r", "fred-ckpt"])
+                f_record = time_commands(["c"])
+                fredapp.source_from_list(["fred-restart"])
+                f_replay = time_commands(["c"])
+                end_session()
+                return (f_record, f_replay)
+            (f_record, f_replay) = best_of(run, n_count)
+            print_row([n_threads, s_mode, "%.3f" % f_record,
+                       "%.3f" % f_replay])
+    os.environ.clear()
+    os.environ.update(d_saved_env)
+
+def bench_replay_scaling(n_count=1):
+    """Replay cost per event of test/many-threads at 1, 4, 16 and 64 threads
+    with the same total number of events, measured from a checkpoint at
+    main() to program exit. Each thread only compares its own next entry
+    with the head of the log until its turn, so the cost per event should
+    not grow with the number of threads."""
+    n_events = 320000
+    print_header(["threads", "record (us)", "replay (us)"])
+    for n_threads in [1, 4, 16, 64]:
+        # Each iteration logs malloc, free, lock and unlock.
+        n_iterations = n_events / 4 / n_threads
+        l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/many-threads",
+                 str(n_threads), str(n_iterations)]
+        def run():
+            start_session(l_cmd)
+            fredapp.source_from_list(["b main", "r", "fred-ckpt"])
+            f_record = time_commands(["c"])
+            fredapp.source_from_list(["fred-restart"])
+            f_replay = time_commands(["c"])
+            end_session()
+            return (f_record, f_replay)
+        (f_record, f_replay) = best_of(run, n_count)
+        print_row([n_threads, "%.2f" % (f_record * 1e6 / n_events),
+                   "%.2f" % (f_replay * 1e6 / n_events)])
+
+def bench_log_faults(n_count=1):
+    """Page faults and peak RSS of test/many-threads (4 threads, 4000000
+    events), on record and on replay from a checkpoint at main(), with the
+    synchronization log on normal pages and with DMTCP_LOG_HUGEPAGES=1.
+    Huge pages only take effect if DMTCP_TMPDIR is on a tmpfs mounted with
+    huge=advise (or always). Replay should not grow with the log, as pages
+    behind the head are dropped."""
+    l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/many-threads",
+             "4", "250000"]
+    d_saved_env = dict(os.environ)
+    def measure():
+        fredapp.source_from_list(["c"])
+        return (int(g_debugger.evaluate_expression("minor_faults")),
+                int(g_debugger.evaluate_expression("major_faults")),
+                int(g_debugger.evaluate_expression("max_rss_kb")))
+    print_header(["log pages", "mode", "minor faults", "major faults",
+                  "peak RSS (MB)"])
+    for (s_pages, s_hugepages) in [("normal", "0"), ("huge", "1")]:
+        # Read by the recorded process when recording starts.
+        os.environ["DMTCP_LOG_HUGEPAGES"] = s_hugepages
+        def run():
+            start_session(l_cmd)
+            fredapp.source_from_list(["b main", "b print_stats", "r",
+                                      "fred-ckpt"])
+            t_record = measure()
+            fredapp.source_from_list(["fred-restart"])
+            t_replay = measure()
+            end_session()
+            return (t_record, t_replay)
+        (t_record, t_replay) = best_of(run, n_count)
+        for (s_mode, t) in [("record", t_record), ("replay", t_replay)]:
+            print_row([s_pages, s_mode, t[0], t[1], "%.1f" % (t[2] / 1024.0)])
+    os.environ.clear()
+    os.environ.update(d_saved_env)
+
+def bench_thread_churn(n_count=1):
+    """Record and replay cost per thread of test/many-threads without
+    arguments, which creates and joins 250 short-lived threads one at a
+    time, measured from a checkpoint at main() to program exit."""
+    n_threads = 250
+    l_cmd = ["gdb", GS_TEST_PROGRAMS_DIRECTORY + "/many-threads"]
+    def run():
+        start_session(l_cmd)
+        fredapp.source_from_list(["b main", "r", "fred-ckpt"])
+        f_record = time_commands(["c"])
+        fredapp.source_from_list(["fred-restart"])
+        f_replay = time_commands(["c"])
+        end_session()
+        return (f_record, f_replay)
+    (f_record, f_replay) = best_of(run, n_count)
+    print_header(["threads", "record (us/thr)", "replay (us/thr)"])
+    print_row([n_threads, "%.0f" % (f_record * 1e6 / n_threads),
+               "%.0f" % (f_replay * 1e6 / n_threads)])
+
+def bench_signal_replay(n_count=1):
+    """Signal delivery in test/signal-storm, on record and on replay from a
+    checkpoint at main(): time to program exit, latency from pthread_kill()
+    to the handler, and CPU time of the process (on replay, that includes
+    the thread delivering the signals)."""
+    l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/signal-storm",
+             "5000"]
+    def measure():
+        f_elapsed = time_commands(["c"])
+        return (f_elapsed, float(g_debugger.evaluate_expression("latency_avg_us")),
+                float(g_debugger.evaluate_expression("cpu_s")))
+    def run():
+        start_session(l_cmd)
+        fredapp.source_from_list(["b main", "b print_solution", "r",
+                                  "fred-ckpt"])
+        t_record = measure()
+        fredapp.source_from_list(["fred-restart"])
+        t_replay = measure()
+        end_session()
+        return (t_record, t_replay)
+    (t_record, t_replay) = best_of(run, n_count)
+    print_header(["mode", "time (s)", "latency (us)", "cpu (s)"])
+    for (s_mode, t) in [("record", t_record), ("replay", t_replay)]:
+        print_row([s_mode, "%.3f" % t[0], "%.1f" % t[1], "%.3f" % t[2]])
+
+def bench_thread_join(n_count=1):
+    """Thread bookkeeping in test/thread-join, which creates and joins 2000
+    threads one at a time, on record and on replay from a checkpoint at
+    main(): latency from the thread function returning to pthread_join()
+    returning, and the time of a whole create/join cycle."""
+    l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/thread-join",
+             "2000"]
+    def measure():
+        fredapp.source_from_list(["c"])
+        return (float(g_debugger.evaluate_expression("join_avg_us")),
+                float(g_debugger.evaluate_expression("join_max_us")),
+                float(g_debugger.evaluate_expression("cycle_avg_us")))
+    def run():
+        start_session(l_cmd)
+        fredapp.source_from_list(["b main", "b print_solution", "r",
+                                  "fred-ckpt"])
+        t_record = measure()
+        fredapp.source_from_list(["fred-restart"])
+        t_replay = measure()
+        end_session()
+        return (t_record, t_replay)
+    (t_record, t_replay) = best_of(run, n_count)
+    print_header(["mode", "join avg (us)", "join max (us)", "cycle (us)"])
+    for (s_mode, t) in [("record", t_record), ("replay", t_replay)]:
+        print_row([s_mode, "%.1f" % t[0], "%.1f" % t[1], "%.1f" % t[2]])
+
+def bench_read_log(n_count=1):
+    """Time of fred_read_log on the log of test/many-threads (4 threads,
+    800000 entries): printing every entry with 1 and with all CPUs, only the
+    pthread_mutex_lock entries of one thread, and the summary."""
+    l_cmd = [GS_TEST_PROGRAMS_DIRECTORY + "/many-threads", "4", "50000"]
+    (f_elapsed, s_tmpdir, s_output) = run_under_fred(l_cmd)
+    s_log = find_sync_log(s_tmpdir)
+    s_jobs = str(os.sysconf("SC_NPROCESSORS_ONLN"))
+    f_null = open(os.devnull, "w")
+    # fred_read_log leaves the log as it is: the log has not been replayed,
+    # so every run indexes it in memory first.
+    print_header(["output", "jobs", "seconds"])
+    for (s_output, l_args) in [("all", ["-j", "1"]),
+                               ("all", ["-j", s_jobs]),
+                               ("one thread",
+                                ["-j", s_jobs, "-t", "2",
+                                 "-e", "pthread_mutex_lock"]),
+                               ("summary", ["-j", s_jobs, "-S"])]:
+        def run():
+            f_start = time.time()
+            subprocess.call(["record-replay/fred_read_log"] + l_args +
+                            [s_log], stdout=f_null)
+            return time.time() - f_start
+        print_row([s_output, l_args[1], "%.3f" % best_of(run, n_count)])
+    f_null.close()
+    shutil.rmtree(s_tmpdir, ignore_errors=True)
+
+def run_benchmarks(ls_bench_list):
+    """Run given list of benchmarks, or all benchmarks if None."""
+    global gd_benchmarks, gn_num_iters
+    if ls_bench_list == None:
+        ls_bench_list = sorted(gd_benchmarks.keys())
+    for b in ls_bench_list:
+        if b not in gd_benchmarks:
+            # If you've added a new benchmark and are seeing this error
+            # message, you probably forgot to update gd_benchmarks in
+            # initialize_benchmarks().
+            print "Unknown benchmark '%s'. Skipping." % b
+            continue
+        print "\n%s: %s" % (b, gd_benchmarks[b].__doc__)
+        # Hide fred_info() messages of the debugger sessions.
+        fred.fredio.gb_hide_output = True
+        gd_benchmarks[b](gn_num_iters)
+
+def parse_fredbench_args():
+    """Parse command line args, and return list of benchmarks to run."""
+    global gs_dmtcp_port, gn_coordinator_port, gn_num_iters
+    parser = OptionParser()
+    parser.disable_interspersed_args()
+    # Note that '-h' and '--help' are supported automatically.
+    parser.add_option("-p", "--port", dest="dmtcp_port",
+                      help="Use PORT for DMTCP port number. If unspecified, "
+                      "starts a background coordinator on a random port.",
+                      metavar="PORT")
+    parser.add_option("-l", "--list-benchmarks", dest="list_benchmarks",
+                      default=False, action="store_true",
+                      help="List available benchmarks and exit.")
+    parser.add_option("-b", "--benchmarks", dest="bench_list",
+                      help="Comma delimited list of benchmarks to run.")
+    parser.add_option("-i", "--iters", dest="num_iters", default=1,
+                      metavar="N",
+                      help="Run each measurement N times and keep the best.")
+    (options, l_args) = parser.parse_args()
+    if options.list_benchmarks:
+        list_benchmarks()
+        sys.exit(1)
+    if options.dmtcp_port == None:
+        n_new_port = randint(2000,10000)
+        gs_dmtcp_port = str(n_new_port)
+        status = fred.dmtcpmanager.start_coordinator(n_new_port)
+        fred.fredutil.fred_assert(status)
+        gn_coordinator_port = n_new_port
+    else:
+        gs_dmtcp_port = str(options.dmtcp_port)
+    if options.num_iters:
+        gn_num_iters = int(options.num_iters)
+    return options.bench_list.split(",") \
+        if options.bench_list != None else None
+
+def list_benchmarks():
+    """Displays a list of all available benchmarks."""
+    global gd_benchmarks
+    print "Available benchmarks:"
+    for k in sorted(gd_benchmarks.keys()):
+        print k
+
+def initialize_benchmarks():
+    """Initializes the list of known benchmarks.
+    This must be called before running any benchmarks."""
+    global gd_benchmarks
+    # When you add a new benchmark, update this map from name -> function.
+    gd_benchmarks = { "fscanf"         : bench_fscanf,
+                      "log-dispatch"   : bench_log_dispatch,
+                      "log-faults"     : bench_log_faults,
+                      "log-index"      : bench_log_index,
+                      "log-size"       : bench_log_size,
+                      "malloc-arena"   : bench_malloc_arena,
+                      "read-data"      : bench_read_data,
+                      "read-log"       : bench_read_log,
+                      "record-scaling" : bench_record_scaling,
+                      "replay-handoff" : bench_replay_handoff,
+                      "replay-read-data" : bench_replay_read_data,
+                      "replay-scaling" : bench_replay_scaling,
+                      "wrapper-overhead" : bench_wrapper_overhead,
+                      "relaxed-replay" : bench_relaxed_replay,
+                      "signal-replay"  : bench_signal_replay,
+                      "stdio-getc"     : bench_stdio_getc,
+                      "thread-churn"   : bench_thread_churn,
+                      "thread-join"    : bench_thread_join }
+
+def main():
+    """Program execution starts here."""
+    global gn_coordinator_port
+    fredapp.setup_critical_files()
+    # Don't do anything if we can't find DMTCP.
+    fredapp.verify_critical_files_present()
+
+    initialize_benchmarks()
+
+    ls_bench_list = parse_fredbench_args()
+    try:
+        run_benchmarks(ls_bench_list)
+    except:
+        traceback.print_exc()
+
+    if gn_coordinator_port != -1:
+        fred.dmtcpmanager.kill_coordinator(gn_coordinator_port)
+
+if __name__ == "__main__":
+    main()
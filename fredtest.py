@@ -29,6 +29,7 @@ from optparse import OptionParser
 from random import randint
 import os
 import sys
+import tempfile
 import traceback
 
 import fredapp
@@ -157,6 +158,98 @@ def gdb_record_replay_pthread_cond(n_count=1):
             print GS_FAILED_STRING
         end_session()
 
+def gdb_record_replay_signals(n_count=1):
+    """Run a test on deterministic record/replay on signal-storm example,
+    which sends many SIGUSR1 to the main thread."""
+    global GS_TEST_PROGRAMS_DIRECTORY
+    l_cmd = ["gdb", GS_TEST_PROGRAMS_DIRECTORY + "/signal-storm"]
+    for i in range(0, n_count):
+        print_test_name("gdb record/replay signals %d" % i)
+        start_session(l_cmd)
+        execute_commands(["b main", "b print_solution", "r", "fred-ckpt", "c"])
+        store_variable("solution")
+        execute_commands(["fred-restart", "c"])
+        if check_stored_variable("solution"):
+            print GS_PASSED_STRING
+        else:
+            print GS_FAILED_STRING
+        end_session()
+
+def gdb_record_replay_thread_join(n_count=1):
+    """Run a test on deterministic record/replay on thread-join example,
+    which joins each thread while it is usually still running."""
+    global GS_TEST_PROGRAMS_DIRECTORY
+    l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/thread-join",
+             "200"]
+    for i in range(0, n_count):
+        print_test_name("gdb record/replay thread join %d" % i)
+        start_session(l_cmd)
+        execute_commands(["b main", "b print_solution", "r", "fred-ckpt", "c"])
+        store_variable("solution")
+        execute_commands(["fred-restart", "c"])
+        if check_stored_variable("solution"):
+            print GS_PASSED_STRING
+        else:
+            print GS_FAILED_STRING
+        end_session()
+
+def gdb_record_replay_getc(n_count=1):
+    """Run a test on deterministic record/replay on getc-file example, which
+    reads a file one character at a time. Single threaded, only buffer
+    refills are logged; interleaved fgets() and ungetc() hand the stream
+    back to the logged calls."""
+    global GS_TEST_PROGRAMS_DIRECTORY
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredtest-input-")
+    os.write(n_fd, "".join(["%d\n" % i for i in range(0, 20000)]))
+    os.close(n_fd)
+    for (s_function, n_threads) in [("getc", 1), ("fgetc", 1),
+                                    ("getc_unlocked", 1), ("mixed", 1),
+                                    ("getc", 2), ("mixed", 2)]:
+        l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/getc-file",
+                 s_input, s_function, str(n_threads)]
+        for i in range(0, n_count):
+            print_test_name("gdb record/replay %s %d thr %d" %
+                            (s_function, n_threads, i))
+            start_session(l_cmd)
+            execute_commands(["b main", "b print_solution", "r", "fred-ckpt",
+                              "c"])
+            store_variable("solution")
+            execute_commands(["fred-restart", "c"])
+            if check_stored_variable("solution"):
+                print GS_PASSED_STRING
+            else:
+                print GS_FAILED_STRING
+            end_session()
+    os.remove(s_input)
+
+def gdb_record_replay_fscanf(n_count=1):
+    """Run a test on deterministic record/replay on fscanf-formats example,
+    which scans a file with fscanf() formats using most conversions, some
+    of them only partly matching."""
+    global GS_TEST_PROGRAMS_DIRECTORY
+    (n_fd, s_input) = tempfile.mkstemp(prefix="fredtest-input-")
+    os.write(n_fd, "-12 -300 4000000000 -5000000000 77 88 -99 ff 17 0x1f\n"
+                   "1.5 2.25 3.125 4e2 5.5 0x1p3\n"
+                   "abcdeword_one 42 rest wide\n"
+                   "7 x y\n" * 1000)
+    os.close(n_fd)
+    l_cmd = ["gdb", "--args", GS_TEST_PROGRAMS_DIRECTORY + "/fscanf-formats",
+             s_input]
+    for i in range(0, n_count):
+        print_test_name("gdb record/replay fscanf %d" % i)
+        start_session(l_cmd)
+        execute_commands(["b main", "b print_solution", "r", "fred-ckpt", "c"])
+        store_variable("solution")
+        store_variable("rounds_read")
+        execute_commands(["fred-restart", "c"])
+        if check_stored_variable("solution") and \
+           check_stored_variable("rounds_read"):
+            print GS_PASSED_STRING
+        else:
+            print GS_FAILED_STRING
+        end_session()
+    os.remove(s_input)
+
 def gdb_record_replay_time(n_count=1):
     """Run a test on deterministic record/replay on time.c example."""
     global GS_TEST_PROGRAMS_DIRECTORY
@@ -366,6 +459,9 @@ def run_integration_tests(n_iters):
     gdb_record_replay_past_end(n_iters)
     gdb_record_replay_pthread_cond(n_iters)
     gdb_record_replay_time(n_iters)
+    gdb_record_replay_thread_join(n_iters)
+    gdb_record_replay_getc(n_iters)
+    gdb_record_replay_fscanf(n_iters)
     gdb_multiple_checkpoints_record_st(n_iters)
     gdb_multiple_checkpoints_replay_st(n_iters)
     gdb_syscall_tester(n_iters)
@@ -456,6 +552,11 @@ def initialize_tests():
     gd_tests = { "gdb-record-replay" : gdb_record_replay,
                  "gdb-record-replay-past-end" : gdb_record_replay_past_end,
                  "gdb-record-replay-time" : gdb_record_replay_time,
+                 "gdb-record-replay-signals" : gdb_record_replay_signals,
+                 "gdb-record-replay-fscanf" : gdb_record_replay_fscanf,
+                 "gdb-record-replay-getc" : gdb_record_replay_getc,
+                 "gdb-record-replay-thread-join" :
+                     gdb_record_replay_thread_join,
                  "gdb-multiple-checkpoints-record-st" :
                      gdb_multiple_checkpoints_record_st,
                  "gdb-multiple-checkpoints-replay-st" :
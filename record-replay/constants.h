@@ -38,6 +38,29 @@
 
 #define ENABLE_MALLOC_WRAPPER
 #define ENV_VAR_LOG_REPLAY "DMTCP_LOG_REPLAY"
+/* If set to non-zero when recording starts, every thread appends to its own
+   chunk of the log. See LOG_FLAG_PER_THREAD_CHUNKS in log.h. */
+#define ENV_VAR_LOG_PER_THREAD_CHUNKS "DMTCP_LOG_PER_THREAD_CHUNKS"
+/* Entry format of a new log, one of the LOG_FORMAT_* values in log.h.
+   Defaults to LOG_FORMAT_COMPACT. */
+#define ENV_VAR_LOG_FORMAT "DMTCP_LOG_FORMAT"
+/* If set to non-zero when recording starts, entries before each record-mode
+   checkpoint are retired. See LOG_FLAG_RING in log.h. */
+#define ENV_VAR_LOG_RING "DMTCP_LOG_RING"
+/* If set to non-zero while recording, large read-data payloads are
+   deduplicated and compressed. See READ_DATA_STORE_THRESHOLD in
+   synchronizationlogging.cpp. */
+#define ENV_VAR_READ_DATA_STORE "DMTCP_READ_DATA_STORE"
+/* If set to non-zero when recording starts, the malloc family is served by a
+   deterministic per-thread arena instead of being logged. See
+   LOG_FLAG_MALLOC_ARENA in log.h. */
+#define ENV_VAR_MALLOC_ARENA "DMTCP_MALLOC_ARENA"
+/* If set to non-zero when recording starts, replay only keeps the order of
+   entries on the same resource. See LOG_FLAG_RELAXED_REPLAY in log.h. */
+#define ENV_VAR_RELAXED_REPLAY "DMTCP_RELAXED_REPLAY"
+/* If set to non-zero when recording starts, the log segments are mapped
+   with transparent huge pages. See LOG_FLAG_HUGEPAGES in log.h. */
+#define ENV_VAR_LOG_HUGEPAGES "DMTCP_LOG_HUGEPAGES"
 
 #endif
 
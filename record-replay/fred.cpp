@@ -68,11 +68,7 @@ static void recordReplayInit()
   global_clone_counter = GLOBAL_CLONE_COUNTER_INIT;
   my_clone_id = global_clone_counter;
 
-  clone_id_to_tid_table = new dmtcp::map<clone_id_t, pthread_t>;
-  tid_to_clone_id_table = new dmtcp::map<pthread_t, clone_id_t>;
-
-  clone_id_to_tid_table->clear();
-  tid_to_clone_id_table->clear();
+  clearThreadTable();
 
   initialize_thread();
 
@@ -84,7 +80,9 @@ static void recordReplayInit()
     // FIXME: setenv is known to cause issues when interacting with bash.
     setenv(ENV_VAR_LOG_REPLAY, "0", 1);
   }
-  sync_logging_branch = atoi(getenv(ENV_VAR_LOG_REPLAY));
+  set_sync_mode(atoi(getenv(ENV_VAR_LOG_REPLAY)));
+  // The libraries of the new program image.
+  initSyncAddresses();
   /* Synchronize this constructor, if this is not the very first exec. */
   log_entry_t my_entry = create_exec_barrier_entry();
   if (SYNC_IS_REPLAY) {
@@ -144,23 +142,15 @@ void fred_post_suspend ()
   set_sync_mode(SYNC_NOOP);
   log_all_allocs = 0;
 
+  if (sync_mode_pre_ckpt == SYNC_RECORD && global_log.usesRing()) {
+    global_log.retireEntries();
+    retireReadData();
+  }
   global_log.destroy(sync_mode_pre_ckpt);
+  unmapReadDataLog();
 
   // Remove the threads which aren't alive anymore.
-  {
-    dmtcp::map<clone_id_t, pthread_t>::iterator it;
-    dmtcp::vector<clone_id_t> stale_clone_ids;
-    for (it = clone_id_to_tid_table->begin();
-         it != clone_id_to_tid_table->end();
-         it++) {
-      if (_real_pthread_kill(it->second, 0) != 0) {
-        stale_clone_ids.push_back(it->first);
-      }
-    }
-    for (size_t i = 0; i < stale_clone_ids.size(); i++) {
-      clone_id_to_tid_table->erase(stale_clone_ids[i]);
-    }
-  }
+  unregisterExitedThreads();
 }
 
 void fred_post_checkpoint_resume()
@@ -174,13 +164,15 @@ void fred_post_checkpoint_resume()
 
 void fred_post_restart_resume()
 {
-  log_entry_t temp_entry;
+  log_entry_header_t header;
   initSyncAddresses();
   set_sync_mode(SYNC_REPLAY);
   sync_mode_pre_ckpt = SYNC_NOOP;
   initLogsForRecordReplay();
-  if (global_log.getCurrentEntry(temp_entry) == 0) {
+  if (global_log.getCurrentHeader(header) == 0) {
     // If no log entries, go back to RECORD.
+    moveReadDataToEnd();
+    stdioSwitchToRecord();
     set_sync_mode(SYNC_RECORD);
   }
   log_all_allocs = 1;
@@ -212,8 +204,7 @@ static void initialize_thread()
   pid_t clone_id = my_clone_id;
   pthread_t pthread_id = pthread_self();
 
-  (*clone_id_to_tid_table)[clone_id] = pthread_id;
-  (*tid_to_clone_id_table)[pthread_id] = clone_id;
+  registerThread(clone_id, pthread_id);
 
   if (SYNC_IS_RECORD) {
     global_log.incrementNumberThreads();
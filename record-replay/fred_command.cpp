@@ -29,13 +29,15 @@
 #include <getopt.h>
 #include <string.h>
 #include "fred_interface.h"
+#include "log.h"
 
 typedef enum {
   FRED_COMMAND_INVALID,
   FRED_COMMAND_INFO,
   FRED_COMMAND_STATUS,
   FRED_COMMAND_BREAK,
-  FRED_COMMAND_CONTINUE
+  FRED_COMMAND_CONTINUE,
+  FRED_COMMAND_ENTRY
 } fred_command_type_t;
 
 typedef struct {
@@ -45,6 +47,11 @@ typedef struct {
 
 #define EMPTY_FRED_COMMAND {FRED_COMMAND_INVALID, 0}
 
+#define EVENT_NAME(name, ...) #name,
+static const char *event_name_table[numTotalEvents] = {
+  "empty", FOREACH_EVENT(EVENT_NAME)
+};
+
 static const char *file_name = NULL;
 
 static void print_usage(char *name)
@@ -60,6 +67,9 @@ static void print_usage(char *name)
   fprintf(stderr,
           "  -b X, --break=X: Set a \"breakpoint\" on log entry index X.\n");
   fprintf(stderr, "  -c, --continue : Continue paused replay execution.\n");
+  fprintf(stderr,
+          "  -e X, --entry=X: Displays the thread and event of log entry"
+          " index X.\n");
 }
 
 static void handle_info_command(fred_interface_info_t *info)
@@ -98,6 +108,43 @@ static void handle_continue_command(fred_interface_info_t *info)
   printf("Removed breakpoint and continuing execution.\n");
 }
 
+/* Looks the entry up in the log's entry index, without reading the log. */
+static void handle_entry_command(fred_interface_info_t *info,
+                                 fred_command_t *cmd)
+{
+  size_t entry_num = (size_t)(long)cmd->arg;
+  char path[RECORD_LOG_PATH_MAX + sizeof(LOG_INDEX_SUFFIX)];
+  LogIndexHeader header;
+  LogIndexEntry entry;
+
+  snprintf(path, sizeof(path), "%s%s", info->log_path, LOG_INDEX_SUFFIX);
+  int fd = open(path, O_RDONLY, 0);
+  if (fd == -1) {
+    perror("open");
+    exit(1);
+  }
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      header.magic != LOG_INDEX_MAGIC) {
+    fprintf(stderr, "%s is not a log index.\n", path);
+    exit(1);
+  }
+  if (entry_num >= header.numEntries) {
+    printf("Entry %Zu is not indexed (%Zu entries are).\n", entry_num,
+           (size_t) header.numEntries);
+  } else if (pread(fd, &entry, sizeof(entry), sizeof(header) +
+                   entry_num * sizeof(entry)) != sizeof(entry)) {
+    perror("pread");
+    exit(1);
+  } else {
+    printf("Entry %Zu clone id = %d\n", entry_num, entry.cloneId);
+    printf("Entry %Zu event = %s\n", entry_num,
+           entry.event < numTotalEvents ? event_name_table[entry.event]
+                                        : "unknown");
+    printf("Entry %Zu offset = %Zu\n", entry_num, (size_t) entry.offset);
+  }
+  close(fd);
+}
+
 static void execute_command(fred_command_t *cmd)
 {
   fred_interface_info_t *info = NULL;
@@ -127,6 +174,9 @@ static void execute_command(fred_command_t *cmd)
   case FRED_COMMAND_CONTINUE:
     handle_continue_command(info);
     break;
+  case FRED_COMMAND_ENTRY:
+    handle_entry_command(info, cmd);
+    break;
   default:
     break;
   }
@@ -149,10 +199,11 @@ int main(int argc, char **argv)
       {"info",      no_argument,       0, 'i'},
       {"break",     required_argument, 0, 'b'},
       {"continue",  no_argument,       0, 'c'},
+      {"entry",     required_argument, 0, 'e'},
       {0, 0, 0, 0} // required (see man getopt)
     };
 
-  while ((opt = getopt_long(argc, argv, "p:sib:c", long_options,
+  while ((opt = getopt_long(argc, argv, "p:sib:ce:", long_options,
                             &option_index)) != -1) {
     switch (opt) {
     case 's':
@@ -168,6 +219,10 @@ int main(int argc, char **argv)
     case 'c':
       cmd.type = FRED_COMMAND_CONTINUE;
       break;
+    case 'e':
+      cmd.type = FRED_COMMAND_ENTRY;
+      cmd.arg = (void *)strtol(optarg, NULL, 10);
+      break;
     default:
       break;
     }
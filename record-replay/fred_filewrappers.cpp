@@ -23,6 +23,7 @@
 // Remove this, and see the compile error.
 #define read _libc_read
 #include <stdarg.h>
+#include <wchar.h>
 #include <stdlib.h>
 #include <vector>
 #include <list>
@@ -57,6 +58,174 @@
 #undef openat
 #undef read
 
+/* Character reads from stdio streams. While the process has a single
+   thread, getc() and fgetc() take the characters already in the buffer of
+   the stream from there without a log entry, as getc_unlocked() does
+   inline. Only refilling the buffer is logged, by stdio_refill(), with the
+   bytes the buffer holds afterwards; replay puts them back in place, so the
+   same characters are found there. That holds while nothing else consumes
+   from the buffer: the other wrappers on a stream release it with
+   stdio_release_buffer(), and the next character read is a refill again.
+   Once a second thread exists, the order in which threads take characters
+   from a shared buffer is not known, so every getc() and fgetc() is logged
+   again.
+
+   Replay sets up the buffer of the stream as the refill left it, in the
+   buffer that memory-accurate replay allocated at the same address, but
+   does not read the file. When recording resumes, stdioSwitchToRecord()
+   moves the file descriptors of the held streams to where the refills left
+   them, so that libc goes on with the buffer and then reads from the right
+   place. */
+#define STDIO_HELD_BUFFERS 16
+#ifndef _IO_IN_BACKUP
+# define _IO_IN_BACKUP 0x100
+#endif
+
+static FILE *stdio_held_buffers[STDIO_HELD_BUFFERS];
+/* For a buffer held on replay, the file offset after its refill; else -1. */
+static off_t stdio_held_offsets[STDIO_HELD_BUFFERS];
+static int stdio_next_held_buffer = 0;
+static bool stdio_single_threaded = true;
+
+/* Called by pthread_create() (on record and on replay) before it creates a
+   thread. */
+void stdioThreadCreated()
+{
+  stdio_single_threaded = false;
+}
+
+static inline bool stdio_holds_buffer(FILE *stream)
+{
+  for (int i = 0; i < STDIO_HELD_BUFFERS; i++) {
+    if (stdio_held_buffers[i] == stream) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void stdio_hold_buffer(FILE *stream, off_t offset)
+{
+  for (int i = 0; i < STDIO_HELD_BUFFERS; i++) {
+    if (stdio_held_buffers[i] == stream) {
+      stdio_held_offsets[i] = offset;
+      return;
+    }
+  }
+  stdio_held_buffers[stdio_next_held_buffer] = stream;
+  stdio_held_offsets[stdio_next_held_buffer] = offset;
+  stdio_next_held_buffer = (stdio_next_held_buffer + 1) % STDIO_HELD_BUFFERS;
+}
+
+static void stdio_release_buffer(FILE *stream)
+{
+  for (int i = 0; i < STDIO_HELD_BUFFERS; i++) {
+    if (stdio_held_buffers[i] == stream) {
+      stdio_held_buffers[i] = NULL;
+    }
+  }
+}
+
+/* Moves the file descriptors of the streams whose buffers were set up by
+   replay to where recording left them. Called when replay runs out of
+   entries and recording resumes. */
+void stdioSwitchToRecord()
+{
+  for (int i = 0; i < STDIO_HELD_BUFFERS; i++) {
+    if (stdio_held_buffers[i] != NULL && stdio_held_offsets[i] != -1) {
+      _real_lseek(stdio_held_buffers[i]->_fileno, stdio_held_offsets[i],
+                  SEEK_SET);
+      stdio_held_offsets[i] = -1;
+    }
+  }
+}
+
+/* The offset of the file descriptor of the stream; libc keeps it once it
+   knows it. */
+static off_t stdio_file_offset(FILE *stream)
+{
+  if (stream->_offset != -1) {
+    return stream->_offset;
+  }
+  return _real_lseek(stream->_fileno, 0, SEEK_CUR);
+}
+
+/* Returns the next character of the stream, refilling its buffer if it is
+   empty, like __uflow(). Logged as a getc entry, with the bytes left in the
+   buffer after the call. A stream left reading from its ungetc() backup
+   area logs no bytes and is not held, since that area is not allocated on
+   replay; its next character is logged on its own. */
+static int stdio_refill(FILE *stream)
+{
+  int retval;
+  off_t file_offset = -1;
+  log_entry_t my_entry = create_getc_entry(my_clone_id, getc_event, stream);
+  if (SYNC_IS_REPLAY) {
+    WRAPPER_REPLAY_START_TYPED(int, getc);
+    char *read_ptr = GET_FIELD(my_entry, getc, read_ptr);
+    size_t buffered = GET_FIELD(my_entry, getc, buffered);
+    char *buf_base = GET_FIELD(my_entry, getc, buf_base);
+    file_offset = GET_FIELD(my_entry, getc, file_offset);
+    if (buffered > 0) {
+      WRAPPER_REPLAY_READ_FROM_READ_LOG(getc, read_ptr, buffered);
+    }
+    if (buf_base != NULL) {
+      // As the refill by libc left them, see _IO_file_underflow().
+      stream->_IO_buf_base = buf_base;
+      stream->_IO_buf_end = GET_FIELD(my_entry, getc, buf_end);
+      stream->_IO_read_base = buf_base;
+      stream->_IO_read_ptr = read_ptr;
+      stream->_IO_read_end = read_ptr + buffered;
+      stream->_IO_write_base = buf_base;
+      stream->_IO_write_ptr = buf_base;
+      stream->_IO_write_end = buf_base;
+    }
+    WRAPPER_REPLAY_END(getc);
+    if (buf_base == NULL) {
+      return retval;
+    }
+  } else if (SYNC_IS_RECORD) {
+    isOptionalEvent = true;
+    retval = _real_getc(stream);
+    isOptionalEvent = false;
+    char *read_ptr = stream->_IO_read_ptr;
+    size_t buffered = stream->_IO_read_end > read_ptr ?
+                      stream->_IO_read_end - read_ptr : 0;
+    bool backup = (stream->_flags & _IO_IN_BACKUP) != 0;
+    if (backup) {
+      buffered = 0;
+    }
+    file_offset = stdio_file_offset(stream);
+    SET_FIELD2(my_entry, getc, read_ptr, read_ptr);
+    SET_FIELD2(my_entry, getc, buffered, buffered);
+    SET_FIELD2(my_entry, getc, buf_base,
+               backup ? NULL : stream->_IO_buf_base);
+    SET_FIELD2(my_entry, getc, buf_end, backup ? NULL : stream->_IO_buf_end);
+    SET_FIELD2(my_entry, getc, file_offset, file_offset);
+    if (buffered > 0) {
+      WRAPPER_LOG_WRITE_INTO_READ_LOG(getc, read_ptr, buffered);
+    }
+    WRAPPER_LOG_WRITE_ENTRY(my_entry);
+    if (backup) {
+      return retval;
+    }
+    // The file descriptor is where it should be.
+    file_offset = -1;
+  }
+  stdio_hold_buffer(stream, file_offset);
+  return retval;
+}
+
+/* getc() and fgetc() while single threaded. */
+static inline int stdio_getc(FILE *stream)
+{
+  if (stdio_holds_buffer(stream) &&
+      stream->_IO_read_ptr < stream->_IO_read_end) {
+    return *(unsigned char *) stream->_IO_read_ptr++;
+  }
+  return stdio_refill(stream);
+}
+
 extern "C" int close ( int fd )
 {
   BASIC_SYNC_WRAPPER(int, close, _real_close, fd);
@@ -64,6 +233,7 @@ extern "C" int close ( int fd )
 
 extern "C" int fclose(FILE *fp)
 {
+  stdio_release_buffer(fp);
   WRAPPER_HEADER(int, fclose, _real_fclose, fp);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, fclose);
@@ -202,6 +372,7 @@ extern "C" int closedir(DIR *dirp)
 # if __GLIBC_PREREQ (2,4)
 extern "C" ssize_t getline(char **lineptr, size_t *n, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(ssize_t, getline, _real_getline, lineptr, n, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START_TYPED(ssize_t, getline);
@@ -228,160 +399,231 @@ extern "C" ssize_t getline(char **lineptr, size_t *n, FILE *stream)
 #  error getline() is already defined as inline in <stdio.h>.  Wrapper fails.
 # endif
 
-/* The list of strings: each string is a format, like for example %d or %lf.
- * This function deals with the following possible formats:
- * with or without whitespace delimited, eg: "%d%d" or "%d   %d".  */
-static void parse_format (const char *format, dmtcp::list<dmtcp::string> *formats)
-{
-  int start = 0;
-  size_t i;
-  /* An argument format is delimited by expecting_start and expecting_end.
-   * When expecting_start is true, that means we are about to begin a new
-   * argument format. When expecting_end is true, we are expecting the
-   * end of the argument format. expecting_start and expecting_end have
-   * always opposite values. */
-  bool expecting_start = true;
-  bool expecting_end = false;
-  char tmp[128];
-
-  for ( i = 0; i < strlen(format); i++) {
-    if (format[i] == '%') {
-      if (expecting_end) {
-        memset(tmp, 0, 128);
-        memcpy(tmp, &format[start], i - start);
-        formats->push_back(dmtcp::string(tmp));
-        start = i;
-      } else {
-        start = i;
-        expecting_end = true;
-        expecting_start = false;
-      }
+/* A scanf format, compiled once into the list of its assigning conversions
+ * (those without '*'), in the order of their arguments. */
+#define SCANF_MAX_CONVERSIONS 32
+#define SCANF_FORMAT_TEXT_MAX 96
+#define SCANF_FORMAT_CACHE_SIZE 8
+
+enum {
+  SCANF_VALUE,   // Fixed size value: integer, floating point, pointer, %n.
+  SCANF_CHARS,   // %c: exactly width characters, no terminator.
+  SCANF_STRING,  // %s and %[: NUL-terminated.
+  SCANF_WSTRING  // %ls and %l[: wide, L'\0'-terminated.
+};
+
+typedef struct {
+  unsigned char kind;
+  unsigned char size;     // Of the value, or of one character.
+  unsigned short width;   // Number of characters, for SCANF_CHARS.
+  bool counted;           // False for %n, which the return value skips.
+} scanf_conversion_t;
+
+typedef struct {
+  const char *format;
+  char text[SCANF_FORMAT_TEXT_MAX];
+  int num_conversions;
+  scanf_conversion_t conversions[SCANF_MAX_CONVERSIONS];
+} scanf_format_t;
+
+/* Most programs call fscanf with a handful of literal formats, so each thread
+ * keeps the last few compiled ones, keyed by the format pointer. The text is
+ * kept as well, in case the pointer is a buffer that was reused. */
+static __thread scanf_format_t scanf_format_cache[SCANF_FORMAT_CACHE_SIZE];
+static __thread int scanf_format_cache_next = 0;
+
+/* Size of an integer argument of length modifier len (see below). */
+static unsigned char scanf_integer_size (char len)
+{
+  switch (len) {
+    case 'H': return sizeof(char);
+    case 'h': return sizeof(short);
+    case 'l': return sizeof(long);
+    case 'L': return sizeof(long long);
+    case 'j': return sizeof(intmax_t);
+    case 'z': return sizeof(size_t);
+    case 't': return sizeof(ptrdiff_t);
+    default:  return sizeof(int);
+  }
+}
+
+static void scanf_compile_format (const char *format, scanf_format_t *compiled)
+{
+  const char *p = format;
+  compiled->num_conversions = 0;
+  while (*p != '\0') {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      p++;
       continue;
     }
-    /* For formats like "%.2lf". */
-    if (isdigit(format[i]) || format[i] == '.') continue;
-    if (format[i] == ' ' || format[i] == '\t') {
-      if (expecting_end) {
-        expecting_end = false;
-        expecting_start = true;
-        memset(tmp, 0, 128);
-        memcpy(tmp, &format[start], i - start);
-        formats->push_back(dmtcp::string(tmp));
-      }
-      continue;
+    bool suppressed = false;
+    if (*p == '*') {
+      suppressed = true;
+      p++;
+    }
+    int width = 0;
+    while (isdigit(*p)) {
+      width = width * 10 + (*p++ - '0');
+    }
+    JASSERT (*p != '$') (format)
+      .Text("Positional fscanf arguments are not supported.");
+    JASSERT (*p != 'm') (format)
+      .Text("Allocating fscanf conversions (%m) are not supported.");
+    /* The length modifier, with 'H' for hh and 'L' for ll, q and L. */
+    char len = '\0';
+    if (p[0] == 'h' && p[1] == 'h') {
+      len = 'H';
+      p += 2;
+    } else if (p[0] == 'l' && p[1] == 'l') {
+      len = 'L';
+      p += 2;
+    } else if (*p == 'q' || *p == 'L') {
+      len = 'L';
+      p++;
+    } else if (strchr("hljzt", *p) != NULL && *p != '\0') {
+      len = *p++;
+    }
+    char conv = *p;
+    if (conv == '\0') break;
+    p++;
+    if (conv == '[') {
+      // A ']' right after "[" or "[^" is part of the set.
+      if (*p == '^') p++;
+      if (*p == ']') p++;
+      while (*p != '\0' && *p != ']') p++;
+      if (*p == ']') p++;
+    }
+    if (suppressed) continue;
+
+    JASSERT (compiled->num_conversions < SCANF_MAX_CONVERSIONS) (format)
+      .Text("Too many fscanf conversions.");
+    scanf_conversion_t *c = &compiled->conversions[compiled->num_conversions++];
+    c->kind = SCANF_VALUE;
+    c->width = 0;
+    c->counted = true;
+    switch (conv) {
+      case 'n':
+        c->counted = false;
+        // Fall through.
+      case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+        c->size = scanf_integer_size(len);
+        break;
+      case 'a': case 'A': case 'e': case 'E': case 'f': case 'F':
+      case 'g': case 'G':
+        c->size = len == 'l' ? sizeof(double) :
+                  len == 'L' ? sizeof(long double) : sizeof(float);
+        break;
+      case 'p':
+        c->size = sizeof(void *);
+        break;
+      case 'C':
+        len = 'l';
+        // Fall through.
+      case 'c':
+        c->kind = SCANF_CHARS;
+        c->size = len == 'l' ? sizeof(wchar_t) : sizeof(char);
+        c->width = width == 0 ? 1 : width;
+        break;
+      case 'S':
+        len = 'l';
+        // Fall through.
+      case 's': case '[':
+        c->kind = len == 'l' ? SCANF_WSTRING : SCANF_STRING;
+        c->size = len == 'l' ? sizeof(wchar_t) : sizeof(char);
+        break;
+      default:
+        JASSERT (false) (format) (conv).Text("Unknown fscanf conversion.");
     }
   }
-  /* This is for the last argument format in the list */
-  if (!expecting_start && expecting_end) {
-    memset(tmp, 0, 128);
-    memcpy(tmp, &format[start], i - start);
-    formats->push_back(dmtcp::string(tmp));
-  }
 }
 
-/* For fscanf, for %5c like formats.
- * This function returns the number of characters read. */
-static int get_how_many_characters (const char *str)
+/* Returns the compiled format, from the cache of the calling thread if it is
+ * there. Formats too long to be cached are compiled into *scratch. */
+static const scanf_format_t *scanf_get_format (const char *format,
+                                               scanf_format_t *scratch)
 {
-  /* The format has no integer conversion specifier, if the size of str is 2. */
-  if (strlen(str) == 2) return 1;
-  char tmp[512] = {'\0'};
-  for (size_t i = 1; i < strlen(str) - 1; i++)
-    tmp[i-1] = str[i];
-  return atoi(tmp);
+  for (int i = 0; i < SCANF_FORMAT_CACHE_SIZE; i++) {
+    scanf_format_t *f = &scanf_format_cache[i];
+    if (f->format == format && strcmp(f->text, format) == 0) {
+      return f;
+    }
+  }
+  if (strlen(format) >= SCANF_FORMAT_TEXT_MAX) {
+    scanf_compile_format(format, scratch);
+    return scratch;
+  }
+  scanf_format_t *f = &scanf_format_cache[scanf_format_cache_next];
+  scanf_format_cache_next =
+    (scanf_format_cache_next + 1) % SCANF_FORMAT_CACHE_SIZE;
+  scanf_compile_format(format, f);
+  strcpy(f->text, format);
+  f->format = format;
+  return f;
+}
+
+/* Number of conversions that fscanf returning retval assigned to: all of them
+ * up to the (retval+1)th counted one. A %n among them that fscanf did not
+ * reach still holds the value it had, which is harmless to log. */
+static int scanf_assigned_conversions (const scanf_format_t *f, int retval)
+{
+  int assigned = 0;
+  int i;
+  for (i = 0; i < f->num_conversions; i++) {
+    if (f->conversions[i].counted && assigned++ == retval) break;
+  }
+  return i;
 }
 
-/* TODO: not all formats are mapped.
- * This function parses the given argument list and logs the values of the
- * arguments in the list to read_data_fd. Returns the number of bytes written. */
-static int parse_va_list_and_log (va_list arg, const char *format)
+/* Bytes of the value fscanf stored at ptr for conversion c. */
+static size_t scanf_value_size (const scanf_conversion_t *c, const void *ptr)
 {
-  dmtcp::list<dmtcp::string> formats;
-  parse_format (format, &formats);
+  switch (c->kind) {
+    case SCANF_CHARS:   return c->width * c->size;
+    case SCANF_STRING:  return strlen((const char *)ptr) + 1;
+    case SCANF_WSTRING: return (wcslen((const wchar_t *)ptr) + 1) * c->size;
+    default:            return c->size;
+  }
+}
 
-  dmtcp::list<dmtcp::string>::iterator it;
+/* Logs the values that fscanf returning retval assigned to the arguments in
+ * arg, as one piece of read data straight from the variables. Returns the
+ * number of bytes logged, and sets *offset to where they are. */
+static int parse_va_list_and_log (va_list arg, const char *format, int retval,
+                                  off_t *offset)
+{
+  scanf_format_t scratch;
+  const scanf_format_t *f = scanf_get_format(format, &scratch);
+  int n = scanf_assigned_conversions(f, retval);
+  struct iovec iov[SCANF_MAX_CONVERSIONS];
   int bytes = 0;
 
   /* The list arg is made up of pointers to variables because the list arg
-   * resulted as a call to fscanf. Thus we need to extract the address for
-   * each argument and cast it to the corresponding type. */
-  for (it = formats.begin(); it != formats.end(); it++) {
-    /* Get next argument in the list. */
-    long int *val = va_arg(arg, long int *);
-    if (it->find("lf") != dmtcp::string::npos) {
-      logReadData ((double *)val, sizeof(double));
-      bytes += sizeof(double);
-    }
-    else if (it->find("d") != dmtcp::string::npos) {
-      logReadData ((int *)val, sizeof(int));
-      bytes += sizeof(int);
-    }
-    else if (it->find("c") != dmtcp::string::npos) {
-      int nr_chars = get_how_many_characters(it->c_str());
-      logReadData ((char *)val, nr_chars * sizeof(char));
-      bytes += nr_chars * sizeof(char);
-    }
-    else if (it->find("s") != dmtcp::string::npos) {
-      logReadData ((char *)val, strlen((char *)val)+ 1);
-      bytes += strlen((char *)val) + 1;
-    }
-    else {
-      JTRACE ("Format to add: ") (it->c_str());
-      JASSERT (false).Text("format not added.");
-    }
+   * resulted as a call to fscanf. */
+  for (int i = 0; i < n; i++) {
+    void *val = va_arg(arg, void *);
+    iov[i].iov_base = val;
+    iov[i].iov_len = scanf_value_size(&f->conversions[i], val);
+    bytes += iov[i].iov_len;
   }
+  *offset = logReadDataVector(iov, n);
   return bytes;
 }
 
-/* Parses the format string and reads into the given va_list of arguments.
-  */
-static void read_data_from_log_into_va_list (va_list arg, const char *format)
+/* Copies the values logged at data into the arguments in arg, for fscanf
+ * returning retval. */
+static void read_data_from_log_into_va_list (va_list arg, const char *format,
+                                             int retval, const char *data)
 {
-  dmtcp::list<dmtcp::string>::iterator it;
-  dmtcp::list<dmtcp::string> formats;
+  scanf_format_t scratch;
+  const scanf_format_t *f = scanf_get_format(format, &scratch);
+  int n = scanf_assigned_conversions(f, retval);
 
-  parse_format (format, &formats);
-  /* The list arg is made up of pointers to variables because the list arg
-   * resulted as a call to fscanf. Thus we need to extract the address for
-   * each argument and cast it to the corresponding type. */
-  for (it = formats.begin(); it != formats.end(); it++) {
-    /* Get next argument in the list. */
-    long int *val = va_arg(arg, long int *);
-    if (it->find("lf") != dmtcp::string::npos) {
-      _real_read(read_data_fd, (void *)val, sizeof(double));
-    }
-    else if (it->find("d") != dmtcp::string::npos) {
-      _real_read(read_data_fd, (void *)val, sizeof(int));
-    }
-    else if (it->find("c") != dmtcp::string::npos) {
-      int nr_chars = get_how_many_characters(it->c_str());
-      _real_read(read_data_fd, (void *)val, nr_chars * sizeof(char));
-    }
-    else if (it->find("s") != dmtcp::string::npos) {
-      bool terminate = false;
-      int offset = 0;
-      int i;
-      char tmp[1024] = {'\0'};
-      while (!terminate) {
-        _real_read(read_data_fd, &tmp[offset], 128);
-        for (i = 0; i < 128; i++) {
-          if (tmp[i] == '\0') {
-            terminate = true;
-            break;
-          }
-        }
-        if (!terminate) {
-          offset += 128;
-        }
-      }
-      /* We want to copy \0 at the end. */
-      memcpy((void *)val, tmp, offset + i + 1);
-      /* We want to be located one position to the right of \0. */
-      _real_lseek(read_data_fd, i - 128 - 1, SEEK_CUR);
-    }
-    else {
-      JASSERT (false).Text("format not added.");
-    }
+  for (int i = 0; i < n; i++) {
+    void *val = va_arg(arg, void *);
+    size_t len = scanf_value_size(&f->conversions[i], data);
+    memcpy(val, data, len);
+    data += len;
   }
 }
 
@@ -391,6 +633,7 @@ extern "C" int __isoc99_fscanf (FILE *stream, const char *format, ...)
   va_list arg;
   va_start (arg, format);
 
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fscanf, vfscanf, stream, format, arg);
 
   if (SYNC_IS_REPLAY) {
@@ -399,9 +642,9 @@ extern "C" int __isoc99_fscanf (FILE *stream, const char *format, ...)
       if (__builtin_expect(read_data_fd == -1, 0)) {
         read_data_fd = _real_open(RECORD_READ_DATA_LOG_PATH, O_RDONLY, 0);
       }
-      JASSERT ( read_data_fd != -1 );
-      lseek(read_data_fd, GET_FIELD(my_entry,fscanf,data_offset), SEEK_SET);
-      read_data_from_log_into_va_list (arg, format);
+      read_data_from_log_into_va_list (arg, format, retval,
+          getReadData(GET_FIELD(my_entry, fscanf, data_offset),
+                      GET_FIELD(my_entry, fscanf, bytes)));
       va_end(arg);
     }
     WRAPPER_REPLAY_END(fscanf);
@@ -411,13 +654,12 @@ extern "C" int __isoc99_fscanf (FILE *stream, const char *format, ...)
     int saved_errno = errno;
     va_end (arg);
     if (retval != EOF) {
-      _real_pthread_mutex_lock(&read_data_mutex);
-      SET_FIELD2(my_entry, fscanf, data_offset, read_log_pos);
+      off_t data_offset;
       va_start (arg, format);
-      int bytes = parse_va_list_and_log(arg, format);
+      int bytes = parse_va_list_and_log(arg, format, retval, &data_offset);
       va_end (arg);
+      SET_FIELD(my_entry, fscanf, data_offset);
       SET_FIELD(my_entry, fscanf, bytes);
-      _real_pthread_mutex_unlock(&read_data_mutex);
     }
     errno = saved_errno;
     WRAPPER_LOG_WRITE_ENTRY(my_entry);
@@ -429,6 +671,7 @@ extern "C" int __isoc99_fscanf (FILE *stream, const char *format, ...)
    to store/replay the data for fgets() calls. */
 extern "C" char *fgets(char *s, int size, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(char *, fgets, _real_fgets, s, size, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START_TYPED(char*, fgets);
@@ -476,6 +719,7 @@ extern "C" int __fprintf_chk (FILE *stream, int flag, const char *format, ...)
 {
   va_list arg;
   va_start (arg, format);
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fprintf, _fprintf, stream, format, arg);
 
   if (SYNC_IS_REPLAY) {
@@ -505,6 +749,7 @@ extern "C" int fprintf (FILE *stream, const char *format, ...)
 {
   va_list arg;
   va_start (arg, format);
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fprintf, _fprintf, stream, format, arg);
 
   if (SYNC_IS_REPLAY) {
@@ -530,6 +775,7 @@ extern "C" int fprintf (FILE *stream, const char *format, ...)
 
 extern "C" int fseek(FILE *stream, long offset, int whence)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fseek, _real_fseek, stream, offset, whence);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, fseek);
@@ -544,7 +790,12 @@ extern "C" int fseek(FILE *stream, long offset, int whence)
 
 extern "C" int _IO_getc(FILE *stream)
 {
-  WRAPPER_HEADER(int, getc, _real_getc, stream);
+  WRAPPER_HEADER_RAW(int, getc, _real_getc, stream);
+  if (stdio_single_threaded) {
+    return stdio_getc(stream);
+  }
+  int retval;
+  log_entry_t my_entry = create_getc_entry(my_clone_id, getc_event, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, getc);
   } else if (SYNC_IS_RECORD) {
@@ -556,16 +807,24 @@ extern "C" int _IO_getc(FILE *stream)
   return retval;
 }
 
+/* Called by getc_unlocked() and the like, inlined in the program, when the
+   buffer of the stream is empty. The program takes the characters from the
+   buffer itself until then, so this is a refill with any number of
+   threads. */
 extern "C" int __uflow(FILE *stream)
 {
-  JASSERT(isProcessGDB()). Text("Not Implemented: *_unlocked fstream functions");
-  ok_to_log_next_func = true;
-  return _IO_getc(stream);
+  WRAPPER_HEADER_RAW(int, getc, _real_getc, stream);
+  return stdio_refill(stream);
 }
 
 extern "C" int fgetc(FILE *stream)
 {
-  WRAPPER_HEADER(int, fgetc, _real_fgetc, stream);
+  WRAPPER_HEADER_RAW(int, fgetc, _real_fgetc, stream);
+  if (stdio_single_threaded) {
+    return stdio_getc(stream);
+  }
+  int retval;
+  log_entry_t my_entry = create_fgetc_entry(my_clone_id, fgetc_event, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, fgetc);
   } else if (SYNC_IS_RECORD) {
@@ -579,6 +838,7 @@ extern "C" int fgetc(FILE *stream)
 
 extern "C" int ungetc(int c, FILE *stream)
 {
+  stdio_release_buffer(stream);
   BASIC_SYNC_WRAPPER(int, ungetc, _real_ungetc, c, stream);
 }
 
@@ -617,6 +877,7 @@ extern "C" char *getcwd(char *buf, size_t size)
 
 extern "C" int fputs(const char *s, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fputs, _real_fputs, s, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, fputs);
@@ -631,6 +892,7 @@ extern "C" int fputs(const char *s, FILE *stream)
 
 extern "C" int fputc(int c, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fputc, _real_fputc, c, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(int, fputc);
@@ -645,6 +907,7 @@ extern "C" int fputc(int c, FILE *stream)
 
 extern "C" int _IO_putc(int c, FILE *stream)
 {
+  stdio_release_buffer(stream);
   BASIC_SYNC_WRAPPER(int, putc, _real_putc, c, stream);
 }
 
@@ -662,6 +925,7 @@ extern "C" int putchar(int c)
 extern "C" size_t fwrite(const void *ptr, size_t size, size_t nmemb,
     FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(size_t, fwrite, _real_fwrite, ptr, size, nmemb, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_TYPED(size_t, fwrite);
@@ -676,6 +940,7 @@ extern "C" size_t fwrite(const void *ptr, size_t size, size_t nmemb,
 
 extern "C" size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(size_t, fread, _real_fread, ptr, size, nmemb, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START_TYPED(size_t, fread);
@@ -699,6 +964,7 @@ extern "C" size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
 
 extern "C" void rewind(FILE *stream)
 {
+  stdio_release_buffer(stream);
   BASIC_SYNC_WRAPPER_VOID(rewind, _real_rewind, stream);
 }
 
@@ -789,6 +1055,7 @@ extern "C" FILE *fopen64 (const char* path, const char* mode)
 
 extern "C" FILE *freopen(const char* path, const char* mode, FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(FILE *, freopen, _real_freopen, path, mode, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START_TYPED(FILE *, freopen);
@@ -1138,7 +1405,7 @@ extern "C" ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
   } else if (SYNC_IS_RECORD) {
     retval = _real_readv(fd, iov, iovcnt);
     if (retval > 0) {
-      WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(readv, iov, iovcnt, retval);
+      WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(readv, iov, iovcnt);
     }
     WRAPPER_LOG_WRITE_ENTRY(my_entry);
   }
@@ -1170,7 +1437,7 @@ extern "C" ssize_t preadv(int fd, const struct iovec *iov, int iovcnt,
   } else if (SYNC_IS_RECORD) {
     retval = _real_preadv(fd, iov, iovcnt, offset);
     if (retval > 0) {
-      WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(preadv, iov, iovcnt, retval);
+      WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(preadv, iov, iovcnt);
     }
     WRAPPER_LOG_WRITE_ENTRY(my_entry);
   }
@@ -1281,8 +1548,7 @@ extern "C" struct dirent * /*__attribute__ ((optimize(0)))*/ readdir(DIR *dirp)
   //WRAPPER_HEADER(struct dirent*, readdir, _real_readdir, dirp);
   void *return_addr = GET_RETURN_ADDRESS();
   do {
-    if (!shouldSynchronize(return_addr) ||
-        jalib::Filesystem::GetProgramName() == "gdb") {
+    if (!shouldSynchronize(return_addr)) {
       return _real_readdir(dirp);
     }
   } while(0);
@@ -1318,8 +1584,7 @@ extern "C" int readdir_r(DIR *dirp, struct dirent *entry,
                          struct dirent **result)
 {
   void *return_addr = GET_RETURN_ADDRESS();
-  if (!shouldSynchronize(return_addr) ||
-      jalib::Filesystem::GetProgramName() == "gdb") {
+  if (!shouldSynchronize(return_addr)) {
     return _real_readdir_r(dirp, entry, result);
   }
   int retval;
@@ -1357,6 +1622,7 @@ extern "C" int mkstemp(char *temp)
 
 extern "C" int fflush(FILE *stream)
 {
+  stdio_release_buffer(stream);
   WRAPPER_HEADER(int, fflush, _real_fflush, stream);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY(fflush);
@@ -1395,9 +1661,9 @@ extern "C" void setlinebuf(FILE *stream)
 
 extern "C" int setvbuf(FILE *stream, char *buf, int mode, size_t size)
 {
+  stdio_release_buffer(stream);
   void *return_addr = GET_RETURN_ADDRESS();
-  if (!shouldSynchronize(return_addr) ||
-      jalib::Filesystem::GetProgramName() == "gdb") {
+  if (!shouldSynchronize(return_addr)) {
     return _real_setvbuf(stream, buf, mode, size);
   }
   int retval;
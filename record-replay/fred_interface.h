@@ -30,6 +30,8 @@ typedef struct {
   size_t total_entries;
   size_t total_threads;
   ssize_t breakpoint_at_index;
+  /* The entry index of the log is at log_path LOG_INDEX_SUFFIX. */
+  char log_path[RECORD_LOG_PATH_MAX];
 } fred_interface_info_t;
 
 #define FRED_INTERFACE_SHM_SIZE sizeof(fred_interface_info_t)
@@ -0,0 +1,227 @@
+/****************************************************************************
+ * Copyright (C) 2009, 2010, 2011, 2012 by Kapil Arya, Gene Cooperman,      *
+ *                                     Tyler Denniston, and Ana-Maria Visan *
+ * {kapil,gene,tyler,amvisan}@ccs.neu.edu                                   *
+ *                                                                          *
+ * This file is part of FReD.                                               *
+ *                                                                          *
+ * FReD is free software: you can redistribute it and/or modify             *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, either version 3 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * FReD is distributed in the hope that it will be useful,                  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with FReD.  If not, see <http://www.gnu.org/licenses/>.            *
+ ****************************************************************************/
+
+/*
+ * Microbenchmark of the synchronization log: for each event type, appends
+ * a number of entries of that type to a scratch log, then walks them the
+ * way replay does, and prints the cost per entry of both. The walk is timed
+ * twice: decoding each entry in full, and reading only the headers, as turn
+ * checks do. Last, it times going straight to random entries through the
+ * entry index, as fred_read_log --start does.
+ *
+ * USAGE: fred_log_bench [iterations [event_name ...]]
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "constants.h"
+#include "jalib.h"
+#include "dmtcpalloc.h"
+#include "synchronizationlogging.h"
+#include "log.h"
+#include "util.h"
+
+#define DEFAULT_ITERATIONS 100000
+
+#define EVENT_NAME(name, ...) #name,
+static const char *event_name_table[numTotalEvents] = {
+  "empty", FOREACH_EVENT(EVENT_NAME)
+};
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the cost in nanoseconds per entry of walking the 'iterations'
+   entries of the log at 'path', either in full or only their headers. */
+static double walkLog(const char *path, event_code_t event, long iterations,
+                      bool headerOnly)
+{
+  log_entry_t entry = EMPTY_LOG_ENTRY;
+  log_entry_header_t header;
+
+  /* Replay opens the log afresh; that includes merging per-thread chunks,
+     which isn't timed. */
+  sync_logging_branch = SYNC_REPLAY;
+  dmtcp::SynchronizationLog log;
+  log.initialize(path, MAX_LOG_LENGTH);
+  JASSERT(log.numEntries() == (size_t) iterations) (log.numEntries());
+  double start = now();
+  for (long i = 0; i < iterations; i++) {
+    if (headerOnly) {
+      JASSERT(log.getCurrentHeader(header) > 0) (i);
+      JASSERT(header.event == event);
+    } else {
+      JASSERT(log.getCurrentEntry(entry) > 0) (i);
+      JASSERT(GET_COMMON(entry, event) == event);
+    }
+    log.advanceToNextEntry();
+  }
+  double ns = (now() - start) * 1e9 / iterations;
+  log.destroy(SYNC_REPLAY);
+  return ns;
+}
+
+/* Returns the cost in nanoseconds of moving the head of the log at 'path'
+   to one of its 'iterations' entries, picked at random. */
+static double seekLog(const char *path, event_code_t event, long iterations)
+{
+  log_entry_header_t header;
+
+  sync_logging_branch = SYNC_REPLAY;
+  dmtcp::SynchronizationLog log;
+  log.initialize(path, MAX_LOG_LENGTH);
+  unsigned int seed = 1;
+  double start = now();
+  for (long i = 0; i < iterations; i++) {
+    log.seekToEntry(rand_r(&seed) % iterations);
+    JASSERT(log.getCurrentHeader(header) > 0) (i);
+    JASSERT(header.event == event);
+  }
+  double ns = (now() - start) * 1e9 / iterations;
+  log.destroy(SYNC_REPLAY);
+  return ns;
+}
+
+/* Returns the cost in nanoseconds per entry of appending, walking, and
+   seeking to 'iterations' entries of the given event. */
+static void benchEvent(const char *path, const char *indexPath,
+                       event_code_t event, long iterations,
+                       double *append_ns, double *read_ns, double *peek_ns,
+                       double *seek_ns)
+{
+  log_entry_t entry = EMPTY_LOG_ENTRY;
+  double start;
+
+  unlink(path);
+  unlink(indexPath);
+  sync_logging_branch = SYNC_RECORD;
+  dmtcp::SynchronizationLog log;
+  log.initialize(path, MAX_LOG_LENGTH);
+  start = now();
+  for (long i = 0; i < iterations; i++) {
+    entry = EMPTY_LOG_ENTRY;
+    SET_COMMON2(entry, event, event);
+    SET_COMMON2(entry, clone_id, 1);
+    SET_COMMON2(entry, retval, (void *) i);
+    log.appendEntry(entry);
+  }
+  *append_ns = (now() - start) * 1e9 / iterations;
+  log.destroy(SYNC_RECORD);
+
+  *read_ns = walkLog(path, event, iterations, false);
+  *peek_ns = walkLog(path, event, iterations, true);
+  *seek_ns = seekLog(path, event, iterations);
+  unlink(path);
+  unlink(indexPath);
+}
+
+static void initializeJalib()
+{
+  jalib::JalibFuncPtrs jalibFuncPtrs;
+
+#define INIT_JALIB_FPTR(name) jalibFuncPtrs.name = name;
+
+  jalibFuncPtrs.dmtcp_get_tmpdir = dmtcp_get_tmpdir;
+  jalibFuncPtrs.dmtcp_get_uniquepid_str = dmtcp_get_uniquepid_str;
+  jalibFuncPtrs.writeAll = dmtcp::Util::writeAll;
+  jalibFuncPtrs.readAll = dmtcp::Util::readAll;
+
+  INIT_JALIB_FPTR(open);
+  INIT_JALIB_FPTR(fopen);
+  INIT_JALIB_FPTR(close);
+  INIT_JALIB_FPTR(fclose);
+
+  INIT_JALIB_FPTR(syscall);
+
+  INIT_JALIB_FPTR(read);
+  INIT_JALIB_FPTR(write);
+  INIT_JALIB_FPTR(select);
+
+  INIT_JALIB_FPTR(socket);
+  INIT_JALIB_FPTR(connect);
+  INIT_JALIB_FPTR(bind);
+  INIT_JALIB_FPTR(listen);
+  INIT_JALIB_FPTR(accept);
+
+  INIT_JALIB_FPTR(pthread_mutex_lock);
+  INIT_JALIB_FPTR(pthread_mutex_trylock);
+  INIT_JALIB_FPTR(pthread_mutex_unlock);
+
+  jalib_init(jalibFuncPtrs, STDERR_FILENO, -1, 99);
+  JASSERT_INIT("");
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+  char path[PATH_MAX];
+  char indexPath[PATH_MAX + sizeof(LOG_INDEX_SUFFIX)];
+  double append_total = 0, read_total = 0, peek_total = 0, seek_total = 0;
+  int count = 0;
+
+  if (iterations <= 0) {
+    fprintf(stderr, "USAGE: %s [iterations [event_name ...]]\n", argv[0]);
+    return 1;
+  }
+  initializeJalib();
+  snprintf(path, sizeof(path), "%s/fred-log-bench-%d",
+           dmtcp_get_tmpdir(), getpid());
+  snprintf(indexPath, sizeof(indexPath), "%s%s", path, LOG_INDEX_SUFFIX);
+
+  printf("%-24s %12s %12s %12s %12s\n", "event", "append (ns)", "read (ns)",
+         "peek (ns)", "seek (ns)");
+  for (int e = accept_event; e < numTotalEvents; e++) {
+    if (argc > 2) {
+      bool selected = false;
+      for (int i = 2; i < argc; i++) {
+        selected = selected || strcmp(argv[i], event_name_table[e]) == 0;
+      }
+      if (!selected) {
+        continue;
+      }
+    }
+    double append_ns, read_ns, peek_ns, seek_ns;
+    benchEvent(path, indexPath, (event_code_t) e, iterations, &append_ns,
+               &read_ns, &peek_ns, &seek_ns);
+    printf("%-24s %12.1f %12.1f %12.1f %12.1f\n", event_name_table[e],
+           append_ns, read_ns, peek_ns, seek_ns);
+    append_total += append_ns;
+    read_total += read_ns;
+    peek_total += peek_ns;
+    seek_total += seek_ns;
+    count++;
+  }
+  if (count > 0) {
+    printf("%-24s %12.1f %12.1f %12.1f %12.1f\n", "average",
+           append_total / count, read_total / count, peek_total / count,
+           seek_total / count);
+  }
+  return 0;
+}
@@ -41,6 +41,8 @@
 #include <sys/syscall.h>
 #include <malloc.h>
 #include <execinfo.h>
+#include <stdint.h>
+#include <algorithm>
 #include "constants.h"
 #include "fred_wrappers.h"
 #include "util.h"
@@ -208,8 +210,8 @@ static void my_free_hook (void *ptr, const void *caller)
 
 #define MMAP_WRAPPER_HEADER(name, ...)                                  \
   void *return_addr = GET_RETURN_ADDRESS();                             \
-  if ((!shouldSynchronize(return_addr) && !log_all_allocs) ||           \
-      jalib::Filesystem::GetProgramName() == "gdb") {                   \
+  if (!sync_wrappers_active ||                                          \
+      (!shouldSynchronize(return_addr) && !log_all_allocs)) {           \
     void *retval = _real_ ## name (__VA_ARGS__);                        \
     UNSET_IN_MMAP_WRAPPER();                                            \
     return retval;                                                      \
@@ -229,8 +231,8 @@ static void my_free_hook (void *ptr, const void *caller)
 
 #define MALLOC_FAMILY_WRAPPER_HEADER_TYPED(ret_type, name, ...)             \
   void *return_addr = GET_RETURN_ADDRESS();                                 \
-  if ((!shouldSynchronize(return_addr) && !log_all_allocs) ||               \
-      jalib::Filesystem::GetProgramName() == "gdb") {                       \
+  if (!sync_wrappers_active ||                                              \
+      (!shouldSynchronize(return_addr) && !log_all_allocs)) {               \
     ret_type retval = _real_ ## name (__VA_ARGS__);                         \
     return retval;                                                          \
   }                                                                         \
@@ -278,17 +280,287 @@ static void my_free_hook (void *ptr, const void *caller)
 	 the malloc entry appears before the mmap entry in the log and      \
 	 replay can proceed as normal. On replay, _real_alloc will be       \
 	 called again, and it will again be promoted to mmap. */            \
-      WRAPPER_LOG_WRITE_ENTRY(my_entry);                                    \
+      WRAPPER_LOG_RESERVE_ENTRY(my_entry);                                  \
       retval = _real_ ## name(__VA_ARGS__);                                 \
-      SET_COMMON2(my_entry, retval, (void *)retval);			    \
-      SET_COMMON2(my_entry, my_errno, errno);				    \
-      /* Patch in the real return value. */				    \
-      WRAPPER_LOG_UPDATE_ENTRY(my_entry);                                   \
+      /* Fill in the real return value. */                                  \
+      WRAPPER_LOG_COMMIT_ENTRY(my_entry);                                   \
       _real_pthread_mutex_unlock(&allocation_lock);                         \
     }                                                                       \
   } while(0)
 
 
+/* Arena mode (LOG_FLAG_MALLOC_ARENA in log.h). Synchronized calls to the
+ * malloc family are served from an arena instead of libc, without taking
+ * allocation_lock and without a log entry. The arena is one reservation of
+ * MALLOC_ARENA_SIZE bytes, at the same address in record and replay (it is
+ * kept in the log metadata), divided into spans. A thread carves chunks out
+ * of its own span, and keeps the chunks it frees, whoever allocated them, on
+ * the free lists of its span. Both depend only on the calls made by the
+ * thread itself, so every address it gets is a pure function of its own
+ * sequence of calls, and replays without being logged.
+ *
+ * The main thread has span 0. Every other thread is given a span by
+ * pthread_create(), and the span goes back to a pool when the thread is
+ * reaped, both under the logged create/destroy lock (like the thread
+ * stacks), so replay hands out the same spans. The next thread carries on
+ * where the dead one stopped, with its free lists; chunks of the span still
+ * in use are on no free list.
+ *
+ * Chunks are powers of two from MALLOC_ARENA_MIN_CHUNK to
+ * MALLOC_ARENA_MAX_CHUNK bytes, and start with a MallocArenaHeader. A request
+ * the arena can't serve (too large, span used up, thread without a span)
+ * goes through the logged libc path as before. A call forced through the log
+ * with ok_to_log_next_func bypasses the arena.
+ */
+#define MALLOC_ARENA_SIZE ((size_t)1 << (sizeof(void *) == 8 ? 40 : 29))
+#define MALLOC_ARENA_SPAN_SIZE ((size_t)1 << (sizeof(void *) == 8 ? 30 : 23))
+#define MALLOC_ARENA_NUM_SPANS (MALLOC_ARENA_SIZE / MALLOC_ARENA_SPAN_SIZE)
+#define MALLOC_ARENA_MIN_CHUNK ((size_t)32)
+#define MALLOC_ARENA_MAX_CHUNK (MALLOC_ARENA_SPAN_SIZE / 4)
+#define MALLOC_ARENA_NUM_CLASSES (sizeof(void *) == 8 ? 24 : 17)
+/* A span is made accessible this many bytes at a time. */
+#define MALLOC_ARENA_COMMIT_SIZE ((size_t)1024 * 1024)
+/* The pages of free chunks of at least this size are given back. */
+#define MALLOC_ARENA_RELEASE_SIZE ((size_t)1024 * 1024)
+
+typedef struct MallocArenaHeader {
+  uint32_t sizeClass;
+  // Bytes from the start of the chunk to this header (see arenaMalloc()).
+  uint32_t alignOffset;
+  size_t size;
+} __attribute__ ((aligned (16))) MallocArenaHeader;
+
+typedef struct MallocArenaThread {
+  char *next;
+  char *committed;
+  char *end;
+  // A free chunk links to the next one right after its header.
+  char *freeLists[MALLOC_ARENA_NUM_CLASSES];
+} MallocArenaThread;
+
+static char *malloc_arena = NULL;
+static pthread_mutex_t malloc_arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static MallocArenaThread malloc_arena_spans[MALLOC_ARENA_NUM_SPANS];
+// Spans of reaped threads, and the number of spans ever handed out. Only
+// used under the create/destroy lock (see pthreadwrappers.cpp).
+static dmtcp::vector<int> malloc_arena_free_spans;
+static int malloc_arena_spans_used = 1;
+static __thread MallocArenaThread *malloc_arena_thread = NULL;
+
+static inline bool useMallocArena(void *return_addr)
+{
+  return sync_wrappers_active && global_log.usesMallocArena() &&
+         !ok_to_log_next_func &&
+         (shouldSynchronize(return_addr) || log_all_allocs);
+}
+
+static inline bool isArenaPointer(void *ptr)
+{
+  return malloc_arena != NULL && (char *) ptr >= malloc_arena &&
+         (char *) ptr < malloc_arena + MALLOC_ARENA_SIZE;
+}
+
+static inline MallocArenaHeader *arenaHeader(void *ptr)
+{
+  return (MallocArenaHeader *) ptr - 1;
+}
+
+/* Returns the span of the calling thread, or NULL if it has none. */
+static inline MallocArenaThread *arenaThread()
+{
+  if (malloc_arena_thread == NULL &&
+      my_clone_id == GLOBAL_CLONE_COUNTER_INIT) {
+    malloc_arena_thread = &malloc_arena_spans[0];
+  }
+  return malloc_arena_thread;
+}
+
+static inline size_t arenaCapacity(MallocArenaHeader *header)
+{
+  return (MALLOC_ARENA_MIN_CHUNK << header->sizeClass) -
+         header->alignOffset - sizeof(MallocArenaHeader);
+}
+
+/* Returns a span for a new thread, or -1 if all are taken. The most
+   recently released comes first: its pages are the likeliest to be
+   resident. Caller holds the create/destroy lock. */
+LIB_PRIVATE int mallocArenaTakeSpan()
+{
+  if (!malloc_arena_free_spans.empty()) {
+    int span = malloc_arena_free_spans.back();
+    malloc_arena_free_spans.pop_back();
+    return span;
+  }
+  if ((size_t) malloc_arena_spans_used == MALLOC_ARENA_NUM_SPANS) {
+    return -1;
+  }
+  return malloc_arena_spans_used++;
+}
+
+/* Caller holds the create/destroy lock, and the thread that had the span
+   is gone. */
+LIB_PRIVATE void mallocArenaReleaseSpan(int span)
+{
+  if (span > 0) {
+    malloc_arena_free_spans.push_back(span);
+  }
+}
+
+/* Called by a new thread, before anything else, with the span its creator
+   took for it. */
+LIB_PRIVATE void mallocArenaSetThreadSpan(int span)
+{
+  malloc_arena_thread = span > 0 ? &malloc_arena_spans[span] : NULL;
+}
+
+static void mapMallocArena()
+{
+  _real_pthread_mutex_lock(&malloc_arena_lock);
+  if (malloc_arena == NULL) {
+    void *addr = global_log.getMallocArenaAddr();
+    void *arena = _real_mmap(addr, MALLOC_ARENA_SIZE, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                             -1, 0);
+    JASSERT(arena != MAP_FAILED) (JASSERT_ERRNO);
+    JASSERT(addr == NULL || arena == addr) (arena) (addr)
+      .Text("Could not map the malloc arena at its recorded address.");
+    global_log.setMallocArenaAddr(arena);
+    malloc_arena = (char *) arena;
+  }
+  _real_pthread_mutex_unlock(&malloc_arena_lock);
+}
+
+/* Returns a free chunk of at least 'total' bytes and its size class, or NULL
+   if the thread's span can't provide one. */
+static char *arenaAllocChunk(size_t total, uint32_t *sizeClass)
+{
+  MallocArenaThread *t = arenaThread();
+  if (t == NULL || total > MALLOC_ARENA_MAX_CHUNK) {
+    return NULL;
+  }
+  uint32_t c = 0;
+  while ((MALLOC_ARENA_MIN_CHUNK << c) < total) {
+    c++;
+  }
+  *sizeClass = c;
+  char *chunk = t->freeLists[c];
+  if (chunk != NULL) {
+    memcpy(&t->freeLists[c], chunk + sizeof(MallocArenaHeader),
+           sizeof(char *));
+    return chunk;
+  }
+
+  if (t->end == NULL) {
+    if (malloc_arena == NULL) {
+      mapMallocArena();
+    }
+    t->next = malloc_arena + (t - malloc_arena_spans) * MALLOC_ARENA_SPAN_SIZE;
+    t->committed = t->next;
+    t->end = t->next + MALLOC_ARENA_SPAN_SIZE;
+  }
+  size_t size = MALLOC_ARENA_MIN_CHUNK << c;
+  if (size > (size_t) (t->end - t->next)) {
+    return NULL;
+  }
+  if (t->next + size > t->committed) {
+    size_t commit = std::max(size, MALLOC_ARENA_COMMIT_SIZE);
+    commit = std::min(commit, (size_t) (t->end - t->committed));
+    JASSERT(_real_syscall(SYS_mprotect, t->committed, commit,
+                          PROT_READ | PROT_WRITE) == 0)
+      (JASSERT_ERRNO) (commit);
+    t->committed += commit;
+  }
+  chunk = t->next;
+  t->next += size;
+  return chunk;
+}
+
+/* Returns size bytes aligned to boundary, a power of two, or NULL. */
+static void *arenaMalloc(size_t size, size_t boundary)
+{
+  const size_t headerSize = sizeof(MallocArenaHeader);
+  if ((boundary & (boundary - 1)) != 0 || size > MALLOC_ARENA_MAX_CHUNK) {
+    return NULL;
+  }
+  boundary = std::max(boundary, headerSize);
+  uint32_t c;
+  char *chunk = arenaAllocChunk(size + headerSize + boundary - headerSize, &c);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  char *ptr = (char *) (((uintptr_t) chunk + headerSize + boundary - 1) &
+                        ~(uintptr_t) (boundary - 1));
+  MallocArenaHeader *header = arenaHeader(ptr);
+  header->sizeClass = c;
+  header->alignOffset = (char *) header - chunk;
+  header->size = size;
+  return ptr;
+}
+
+static void *arenaCalloc(size_t nmemb, size_t size)
+{
+  if (size != 0 && nmemb > MALLOC_ARENA_MAX_CHUNK / size) {
+    return NULL;
+  }
+  void *ptr = arenaMalloc(nmemb * size, sizeof(MallocArenaHeader));
+  if (ptr != NULL) {
+    memset(ptr, 0, nmemb * size);
+  }
+  return ptr;
+}
+
+static void arenaFree(void *ptr)
+{
+  MallocArenaThread *t = arenaThread();
+  if (t == NULL) {
+    // No free list to put it on, and another thread's can't be touched
+    // without a lock: the chunk is lost.
+    return;
+  }
+  MallocArenaHeader *header = arenaHeader(ptr);
+  char *chunk = (char *) header - header->alignOffset;
+  uint32_t c = header->sizeClass;
+  size_t size = MALLOC_ARENA_MIN_CHUNK << c;
+  if (size >= MALLOC_ARENA_RELEASE_SIZE) {
+    // Keep the page holding the link.
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t) chunk + sizeof(MallocArenaHeader) +
+                       sizeof(char *) + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t) chunk + size) & ~(pageSize - 1);
+    _real_syscall(SYS_madvise, begin, end - begin, MADV_DONTNEED);
+  }
+  memcpy(chunk + sizeof(MallocArenaHeader), &t->freeLists[c], sizeof(char *));
+  t->freeLists[c] = chunk;
+}
+
+/* Resizes in place if the chunk is large enough, else moves the data to a
+   new arena chunk. Returns NULL, leaving ptr alone, if there is none. */
+static void *arenaRealloc(void *ptr, size_t size)
+{
+  MallocArenaHeader *header = arenaHeader(ptr);
+  if (size <= arenaCapacity(header)) {
+    header->size = size;
+    return ptr;
+  }
+  void *newPtr = arenaMalloc(size, sizeof(MallocArenaHeader));
+  if (newPtr != NULL) {
+    memcpy(newPtr, ptr, header->size);
+    arenaFree(ptr);
+  }
+  return newPtr;
+}
+
+/* In arena mode, returns from the wrapper with the result of the arena
+   allocation 'call', unless that fails and the call goes on through the
+   logged libc path. */
+#define MALLOC_FAMILY_ARENA_WRAPPER(call)                                   \
+  if (useMallocArena(GET_RETURN_ADDRESS())) {                               \
+    void *arena_retval = call;                                              \
+    if (arena_retval != NULL) {                                             \
+      return arena_retval;                                                  \
+    }                                                                       \
+  }
+
 /* This buffer (wrapper_init_buf) is used to pass on to dlsym() while it is
  * initializing the dmtcp wrappers. See comments in syscallsreal.c for more
  * details.
@@ -305,6 +577,7 @@ extern "C" void *calloc(size_t nmemb, size_t size)
     mem_allocated_for_initializing_wrappers = true;
     return (void*) wrapper_init_buf;
   }
+  MALLOC_FAMILY_ARENA_WRAPPER(arenaCalloc(nmemb, size));
   MALLOC_FAMILY_BASIC_SYNC_WRAPPER(void*, calloc, nmemb, size);
   return retval;
 }
@@ -314,6 +587,7 @@ extern "C" void *malloc(size_t size)
   if (fred_wrappers_initializing) {
     return calloc(1, size);
   }
+  MALLOC_FAMILY_ARENA_WRAPPER(arenaMalloc(size, sizeof(MallocArenaHeader)));
   MALLOC_FAMILY_BASIC_SYNC_WRAPPER(void*, malloc, size);
   return retval;
 }
@@ -321,6 +595,7 @@ extern "C" void *malloc(size_t size)
 extern "C" void *__libc_memalign(size_t boundary, size_t size)
 {
   JASSERT (my_clone_id != 0);
+  MALLOC_FAMILY_ARENA_WRAPPER(arenaMalloc(size, boundary));
   MALLOC_FAMILY_BASIC_SYNC_WRAPPER(void*, libc_memalign, boundary, size);
   return retval;
 }
@@ -339,10 +614,15 @@ extern "C" void free(void *ptr)
     JASSERT(ptr == wrapper_init_buf);
     return;
   }
+  // Arena chunks go back to the arena, whoever frees them.
+  if (isArenaPointer(ptr)) {
+    arenaFree(ptr);
+    return;
+  }
   void *return_addr = GET_RETURN_ADDRESS();
-  if ((!shouldSynchronize(return_addr) && !log_all_allocs) ||
-      ptr == NULL ||
-      jalib::Filesystem::GetProgramName() == "gdb") {
+  if (!sync_wrappers_active ||
+      (!shouldSynchronize(return_addr) && !log_all_allocs) ||
+      ptr == NULL) {
     _real_pthread_mutex_lock(&allocation_lock);
     _real_free(ptr);
     _real_pthread_mutex_unlock(&allocation_lock);
@@ -369,10 +649,60 @@ extern "C" void free(void *ptr)
 
 extern "C" void *realloc(void *ptr, size_t size)
 {
+  if (isArenaPointer(ptr)) {
+    if (size == 0) {
+      arenaFree(ptr);
+      return NULL;
+    }
+    void *retval = arenaRealloc(ptr, size);
+    if (retval == NULL) {
+      // Too large for the arena: move the data to a logged allocation.
+      ok_to_log_next_func = global_log.usesMallocArena();
+      retval = malloc(size);
+      if (retval != NULL) {
+        memcpy(retval, ptr, arenaHeader(ptr)->size);
+        arenaFree(ptr);
+      }
+    }
+    return retval;
+  }
+  if (ptr == NULL) {
+    MALLOC_FAMILY_ARENA_WRAPPER(arenaMalloc(size, sizeof(MallocArenaHeader)));
+  }
   MALLOC_FAMILY_BASIC_SYNC_WRAPPER(void*, realloc, ptr, size);
   return retval;
 }
 
+/* Not logged: the answer depends only on the chunk, which replay hands out
+ * at the same address. Arena chunks have no glibc header in front of them. */
+extern "C" size_t malloc_usable_size(void *ptr)
+{
+  if (isArenaPointer(ptr)) {
+    return arenaCapacity(arenaHeader(ptr));
+  }
+  return _real_malloc_usable_size(ptr);
+}
+
+/* Loading or unloading a library changes which return addresses belong to
+ * untracked code; rebuild the classifier (see initSyncAddresses()). */
+extern "C" void *dlopen(const char *filename, int flag)
+{
+  void *handle = _real_dlopen(filename, flag);
+  if (handle != NULL) {
+    initSyncAddresses();
+  }
+  return handle;
+}
+
+extern "C" int dlclose(void *handle)
+{
+  int retval = _real_dlclose(handle);
+  if (retval == 0) {
+    initSyncAddresses();
+  }
+  return retval;
+}
+
 /* mmap/mmap64
  * TODO: Remove the PROT_WRITE flag on REPLAY phase if it was not part of
  *       original flags.
@@ -30,9 +30,14 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <assert.h>
+#include <getopt.h>
+#include <algorithm>
 #include <string>
 #include <map>
+#include <vector>
 #include "constants.h"
 #include "jalib.h"
 #include "dmtcpalloc.h"
@@ -45,1054 +50,1292 @@
 // Must be in sync with synchronizationlogging.h definition.
 //#define READLINK_MAX_LENGTH 256
 
-#define IFNAME_PRINT_ENTRY(name, idx, entry)                                   \
-  do {                                                                         \
-    if (GET_COMMON_PTR(entry, event) == name##_event)                          \
-      print_log_entry_##name(idx, entry);                                      \
-  } while(0)
-
-#define TOSTRING(name) #name
-
-#define IFNAME_EVENT_TO_STRING(name, event_type, e)                            \
-  do {                                                                         \
-    if (e == name##_event)                                                     \
-      event_type.assign(TOSTRING(name));                                       \
-  } while(0)
+#define EVENT_NAME(name, ...) #name,
+static const char *event_name_table[numTotalEvents] = {
+  "empty", FOREACH_EVENT(EVENT_NAME)
+};
 
 #define EVENT_TO_STRING(event_type, e)                                         \
   do {                                                                         \
-    FOREACH_NAME(IFNAME_EVENT_TO_STRING, event_type, e);                       \
+    if ((unsigned int) (e) < (unsigned int) numTotalEvents)                    \
+      event_type.assign(event_name_table[e]);                                  \
   } while(0)
 
-#define PRINT_ENTRIES(idx, entry)                                              \
-  do {                                                                         \
-    FOREACH_NAME(IFNAME_PRINT_ENTRY, idx, entry);                              \
-  } while(0)
 
-
-void print_log_entry_common(int idx, log_entry_t *entry) {
+void print_log_entry_common(FILE *out, size_t idx, log_entry_t *entry) {
   std::string event_type;
   EVENT_TO_STRING(event_type, GET_COMMON_PTR(entry, event));
-  printf("%2d: clone_id=%ld, [%-20.20s]: ",
-         idx, GET_COMMON_PTR(entry, clone_id), event_type.c_str());
+  fprintf(out, "%2zu: clone_id=%ld, [%-20.20s]: ",
+               idx, GET_COMMON_PTR(entry, clone_id), event_type.c_str());
 
   switch ((long) (unsigned long) GET_COMMON_PTR(entry, retval)) {
     case 0:
-      printf("retval=  0     , "); break;
+      fprintf(out, "retval=  0     , "); break;
     case -1:
-      printf("retval= -1     , "); break;
+      fprintf(out, "retval= -1     , "); break;
     default:
-      printf("retval=%p, ", GET_COMMON_PTR(entry, retval)); break;
+      fprintf(out, "retval=%p, ", GET_COMMON_PTR(entry, retval)); break;
   }
-  printf("log_offset=%2ld, my_errno=%d, isOptional=%d",
-         GET_COMMON_PTR(entry, log_offset), GET_COMMON_PTR(entry, my_errno),
-         GET_COMMON_PTR(entry, isOptional));
+  fprintf(out, "log_offset=%2ld, my_errno=%d, isOptional=%d",
+               GET_COMMON_PTR(entry, log_offset),
+               GET_COMMON_PTR(entry, my_errno),
+               GET_COMMON_PTR(entry, isOptional));
 }
 
-void print_log_entry_accept(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, sockaddr=%p, addrlen=%p\n",
-         GET_FIELD_PTR(entry, accept, sockfd),
-         GET_FIELD_PTR(entry, accept, addr),
-         GET_FIELD_PTR(entry, accept, addrlen));
+void print_log_entry_accept(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, sockaddr=%p, addrlen=%p\n",
+               GET_FIELD_PTR(entry, accept, sockfd),
+               GET_FIELD_PTR(entry, accept, addr),
+               GET_FIELD_PTR(entry, accept, addrlen));
 }
 
-void print_log_entry_accept4(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, sockaddr=%p, addrlen=%p, flags:%d\n",
-         GET_FIELD_PTR(entry, accept4, sockfd),
-         GET_FIELD_PTR(entry, accept4, addr),
-         GET_FIELD_PTR(entry, accept4, addrlen),
-         GET_FIELD_PTR(entry, accept4, flags));
+void print_log_entry_accept4(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, sockaddr=%p, addrlen=%p, flags:%d\n",
+               GET_FIELD_PTR(entry, accept4, sockfd),
+               GET_FIELD_PTR(entry, accept4, addr),
+               GET_FIELD_PTR(entry, accept4, addrlen),
+               GET_FIELD_PTR(entry, accept4, flags));
 }
 
-void print_log_entry_access(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p, mode=%d\n",
-         GET_FIELD_PTR(entry, access, pathname),
-         GET_FIELD_PTR(entry, access, mode));
+void print_log_entry_access(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p, mode=%d\n",
+               GET_FIELD_PTR(entry, access, pathname),
+               GET_FIELD_PTR(entry, access, mode));
 }
 
-void print_log_entry_bind(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, my_addr=%p, addrlen=%d\n",
-         GET_FIELD_PTR(entry, bind, sockfd),
-         GET_FIELD_PTR(entry, bind, addr),
-         GET_FIELD_PTR(entry, bind, addrlen));
+void print_log_entry_bind(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, my_addr=%p, addrlen=%d\n",
+               GET_FIELD_PTR(entry, bind, sockfd),
+               GET_FIELD_PTR(entry, bind, addr),
+               GET_FIELD_PTR(entry, bind, addrlen));
 }
 
-void print_log_entry_calloc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", nmemb=%Zu, size=%Zu\n",
-         GET_FIELD_PTR(entry, calloc, nmemb),
-         GET_FIELD_PTR(entry, calloc, size));
+void print_log_entry_calloc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", nmemb=%Zu, size=%Zu\n",
+               GET_FIELD_PTR(entry, calloc, nmemb),
+               GET_FIELD_PTR(entry, calloc, size));
 }
 
-void print_log_entry_connect(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, serv_addr=%p, addrlen=%d\n",
-         GET_FIELD_PTR(entry, connect, sockfd),
-         GET_FIELD_PTR(entry, connect, serv_addr),
-         GET_FIELD_PTR(entry, connect, addrlen));
+void print_log_entry_connect(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, serv_addr=%p, addrlen=%d\n",
+               GET_FIELD_PTR(entry, connect, sockfd),
+               GET_FIELD_PTR(entry, connect, serv_addr),
+               GET_FIELD_PTR(entry, connect, addrlen));
 }
 
-void print_log_entry_dup(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldfd=%d\n",
-         GET_FIELD_PTR(entry, dup, oldfd));
+void print_log_entry_dup(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldfd=%d\n",
+               GET_FIELD_PTR(entry, dup, oldfd));
 }
 
-void print_log_entry_dup2(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldfd=%d, newfd:%d\n",
-         GET_FIELD_PTR(entry, dup2, oldfd),
-         GET_FIELD_PTR(entry, dup2, newfd));
+void print_log_entry_dup2(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldfd=%d, newfd:%d\n",
+               GET_FIELD_PTR(entry, dup2, oldfd),
+               GET_FIELD_PTR(entry, dup2, newfd));
 }
 
-void print_log_entry_dup3(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldfd=%d, newfd:%d, flags:0x%x\n",
-         GET_FIELD_PTR(entry, dup3, oldfd),
-         GET_FIELD_PTR(entry, dup3, newfd),
-         GET_FIELD_PTR(entry, dup3, flags));
+void print_log_entry_dup3(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldfd=%d, newfd:%d, flags:0x%x\n",
+               GET_FIELD_PTR(entry, dup3, oldfd),
+               GET_FIELD_PTR(entry, dup3, newfd),
+               GET_FIELD_PTR(entry, dup3, flags));
 }
 
-void print_log_entry_close(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d\n", GET_FIELD_PTR(entry, close, fd));
+void print_log_entry_close(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d\n", GET_FIELD_PTR(entry, close, fd));
 }
 
-void print_log_entry_chmod(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", path=%p, mode=%u\n",
-         GET_FIELD_PTR(entry, chmod, path),
-         GET_FIELD_PTR(entry, chmod, mode));
+void print_log_entry_chmod(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", path=%p, mode=%u\n",
+               GET_FIELD_PTR(entry, chmod, path),
+               GET_FIELD_PTR(entry, chmod, mode));
 }
 
-void print_log_entry_chown(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", path=%p, owner=%u, group=%u\n",
-         GET_FIELD_PTR(entry, chown, path),
-         GET_FIELD_PTR(entry, chown, owner),
-         GET_FIELD_PTR(entry, chown, group));
+void print_log_entry_chown(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", path=%p, owner=%u, group=%u\n",
+               GET_FIELD_PTR(entry, chown, path),
+               GET_FIELD_PTR(entry, chown, owner),
+               GET_FIELD_PTR(entry, chown, group));
 }
 
-void print_log_entry_closedir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", dirp=%p\n", GET_FIELD_PTR(entry, closedir, dirp));
+void print_log_entry_closedir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", dirp=%p\n", GET_FIELD_PTR(entry, closedir, dirp));
 }
 
-void print_log_entry_exec_barrier(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf("\n");
+void print_log_entry_exec_barrier(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, "\n");
 }
 
-void print_log_entry_fclose(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fp=%p\n",
-         GET_FIELD_PTR(entry, fclose, fp));
+void print_log_entry_fclose(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fp=%p\n",
+               GET_FIELD_PTR(entry, fclose, fp));
 }
 
-void print_log_entry_fchdir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d\n",
-         GET_FIELD_PTR(entry, fchdir, fd));
+void print_log_entry_fchdir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d\n",
+               GET_FIELD_PTR(entry, fchdir, fd));
 }
 
-void print_log_entry_fcntl(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, cmd=%d, arg_3_l=%ld, arg_3_f=%p\n",
-         GET_FIELD_PTR(entry, fcntl, fd),
-         GET_FIELD_PTR(entry, fcntl, cmd),
-         GET_FIELD_PTR(entry, fcntl, arg_3_l),
-         GET_FIELD_PTR(entry, fcntl, arg_3_f));
+void print_log_entry_fcntl(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, cmd=%d, arg_3_l=%ld, arg_3_f=%p\n",
+               GET_FIELD_PTR(entry, fcntl, fd),
+               GET_FIELD_PTR(entry, fcntl, cmd),
+               GET_FIELD_PTR(entry, fcntl, arg_3_l),
+               GET_FIELD_PTR(entry, fcntl, arg_3_f));
 }
 
-void print_log_entry_fdatasync(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d\n",
-         GET_FIELD_PTR(entry, fdatasync, fd));
+void print_log_entry_fdatasync(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d\n",
+               GET_FIELD_PTR(entry, fdatasync, fd));
 }
 
-void print_log_entry_fdopen(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, mode=%p\n",
-         GET_FIELD_PTR(entry, fdopen, fd),
-         GET_FIELD_PTR(entry, fdopen, mode));
+void print_log_entry_fdopen(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, mode=%p\n",
+               GET_FIELD_PTR(entry, fdopen, fd),
+               GET_FIELD_PTR(entry, fdopen, mode));
 }
 
-void print_log_entry_fdopendir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d\n",
-         GET_FIELD_PTR(entry, fdopendir, fd));
+void print_log_entry_fdopendir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d\n",
+               GET_FIELD_PTR(entry, fdopendir, fd));
 }
 
-void print_log_entry_fgets(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", s=%p, size=%d, stream=%p\n",
-         GET_FIELD_PTR(entry, fgets, s),
-         GET_FIELD_PTR(entry, fgets, size),
-         GET_FIELD_PTR(entry, fgets, stream));
+void print_log_entry_fgets(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", s=%p, size=%d, stream=%p\n",
+               GET_FIELD_PTR(entry, fgets, s),
+               GET_FIELD_PTR(entry, fgets, size),
+               GET_FIELD_PTR(entry, fgets, stream));
 }
 
-void print_log_entry_ferror(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, ferror, stream));
+void print_log_entry_ferror(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n",
+               GET_FIELD_PTR(entry, ferror, stream));
 }
 
-void print_log_entry_feof(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, feof, stream));
+void print_log_entry_feof(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n",
+               GET_FIELD_PTR(entry, feof, stream));
 }
 
-void print_log_entry_fileno(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, fileno, stream));
+void print_log_entry_fileno(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n",
+               GET_FIELD_PTR(entry, fileno, stream));
 }
 
-void print_log_entry_fopen(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", name=%p, mode=%p\n",
-         GET_FIELD_PTR(entry, fopen, name),
-         GET_FIELD_PTR(entry, fopen, mode));
+void print_log_entry_fopen(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", name=%p, mode=%p\n",
+               GET_FIELD_PTR(entry, fopen, name),
+               GET_FIELD_PTR(entry, fopen, mode));
 }
 
-void print_log_entry_fprintf(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p, format=%p\n",
-         GET_FIELD_PTR(entry, fprintf, stream),
-         GET_FIELD_PTR(entry, fprintf, format));
+void print_log_entry_fprintf(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p, format=%p\n",
+               GET_FIELD_PTR(entry, fprintf, stream),
+               GET_FIELD_PTR(entry, fprintf, format));
 }
 
-void print_log_entry_fputs(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", s=%p, stream=%p\n",
-         GET_FIELD_PTR(entry, fputs, s),
-         GET_FIELD_PTR(entry, fputs, stream));
+void print_log_entry_fputs(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", s=%p, stream=%p\n",
+               GET_FIELD_PTR(entry, fputs, s),
+               GET_FIELD_PTR(entry, fputs, stream));
 }
 
-void print_log_entry_fputc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", c=%d, stream=%p\n",
-         GET_FIELD_PTR(entry, fputc, c),
-         GET_FIELD_PTR(entry, fputc, stream));
+void print_log_entry_fputc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", c=%d, stream=%p\n",
+               GET_FIELD_PTR(entry, fputc, c),
+               GET_FIELD_PTR(entry, fputc, stream));
 }
 
-void print_log_entry_free(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", ptr=%p\n", GET_FIELD_PTR(entry, free, ptr));
+void print_log_entry_free(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", ptr=%p\n", GET_FIELD_PTR(entry, free, ptr));
 }
 
-void print_log_entry_ftell(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n", GET_FIELD_PTR(entry, ftell, stream));
+void print_log_entry_ftell(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n", GET_FIELD_PTR(entry, ftell, stream));
 }
 
-void print_log_entry_fwrite(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", ptr=%p, size=%Zu, nmemb=%Zu, stream=%p\n",
-         GET_FIELD_PTR(entry, fwrite, ptr),
-         GET_FIELD_PTR(entry, fwrite, size),
-         GET_FIELD_PTR(entry, fwrite, nmemb),
-         GET_FIELD_PTR(entry, fwrite, stream));
+void print_log_entry_fwrite(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", ptr=%p, size=%Zu, nmemb=%Zu, stream=%p\n",
+               GET_FIELD_PTR(entry, fwrite, ptr),
+               GET_FIELD_PTR(entry, fwrite, size),
+               GET_FIELD_PTR(entry, fwrite, nmemb),
+               GET_FIELD_PTR(entry, fwrite, stream));
 }
 
-void print_log_entry_fsync(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d\n", GET_FIELD_PTR(entry, fsync, fd));
+void print_log_entry_fsync(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d\n", GET_FIELD_PTR(entry, fsync, fd));
 }
 
-void print_log_entry_fseek(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n, offset=%ld, whence=%d\n",
-         GET_FIELD_PTR(entry, fseek, stream),
-         GET_FIELD_PTR(entry, fseek, offset),
-         GET_FIELD_PTR(entry, fseek, whence));
+void print_log_entry_fseek(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n, offset=%ld, whence=%d\n",
+               GET_FIELD_PTR(entry, fseek, stream),
+               GET_FIELD_PTR(entry, fseek, offset),
+               GET_FIELD_PTR(entry, fseek, whence));
 }
 
-void print_log_entry_fread(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", ptr=%p\n, size=%Zu, nmemb=%Zu, stream=%p\n",
-         GET_FIELD_PTR(entry, fread, ptr),
-         GET_FIELD_PTR(entry, fread, size),
-         GET_FIELD_PTR(entry, fread, nmemb),
-         GET_FIELD_PTR(entry, fread, stream));
+void print_log_entry_fread(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", ptr=%p\n, size=%Zu, nmemb=%Zu, stream=%p\n",
+               GET_FIELD_PTR(entry, fread, ptr),
+               GET_FIELD_PTR(entry, fread, size),
+               GET_FIELD_PTR(entry, fread, nmemb),
+               GET_FIELD_PTR(entry, fread, stream));
 }
 
-void print_log_entry_freopen(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", path=%p, mode=%p, stream=%p\n",
-         GET_FIELD_PTR(entry, freopen, path),
-         GET_FIELD_PTR(entry, freopen, mode),
-         GET_FIELD_PTR(entry, freopen, stream));
+void print_log_entry_freopen(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", path=%p, mode=%p, stream=%p\n",
+               GET_FIELD_PTR(entry, freopen, path),
+               GET_FIELD_PTR(entry, freopen, mode),
+               GET_FIELD_PTR(entry, freopen, stream));
 }
 
-void print_log_entry_fxstat(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, fd=%d\n",
-         GET_FIELD_PTR(entry, fxstat, vers),
-         GET_FIELD_PTR(entry, fxstat, fd));
+void print_log_entry_fxstat(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, fd=%d\n",
+               GET_FIELD_PTR(entry, fxstat, vers),
+               GET_FIELD_PTR(entry, fxstat, fd));
 }
 
-void print_log_entry_fxstat64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, fd=%d\n",
-         GET_FIELD_PTR(entry, fxstat64, vers),
-         GET_FIELD_PTR(entry, fxstat64, fd));
+void print_log_entry_fxstat64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, fd=%d\n",
+               GET_FIELD_PTR(entry, fxstat64, vers),
+               GET_FIELD_PTR(entry, fxstat64, fd));
 }
 
-void print_log_entry_getpeername(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, sockaddr=%p, addrlen=%p\n",
-         GET_FIELD_PTR(entry, getpeername, sockfd),
-         GET_FIELD_PTR(entry, getpeername, addr),
-         GET_FIELD_PTR(entry, getpeername, addrlen));
+void print_log_entry_getpeername(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, sockaddr=%p, addrlen=%p\n",
+               GET_FIELD_PTR(entry, getpeername, sockfd),
+               GET_FIELD_PTR(entry, getpeername, addr),
+               GET_FIELD_PTR(entry, getpeername, addrlen));
 }
 
-void print_log_entry_getsockname(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, sockaddr=%p, addrlen=%p\n",
-         GET_FIELD_PTR(entry, getsockname, sockfd),
-         GET_FIELD_PTR(entry, getsockname, addr),
-         GET_FIELD_PTR(entry, getsockname, addrlen));
+void print_log_entry_getsockname(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, sockaddr=%p, addrlen=%p\n",
+               GET_FIELD_PTR(entry, getsockname, sockfd),
+               GET_FIELD_PTR(entry, getsockname, addr),
+               GET_FIELD_PTR(entry, getsockname, addrlen));
 }
 
-void print_log_entry_getcwd(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", buf=%p, size=%Zu\n",
-         GET_FIELD_PTR(entry, getcwd, buf),
-         GET_FIELD_PTR(entry, getcwd, size));
+void print_log_entry_getcwd(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", buf=%p, size=%Zu\n",
+               GET_FIELD_PTR(entry, getcwd, buf),
+               GET_FIELD_PTR(entry, getcwd, size));
 }
 
-void print_log_entry_libc_memalign(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", boundary=%Zu, size=%Zu, return_ptr=%p\n",
-         GET_FIELD_PTR(entry, libc_memalign, boundary),
-         GET_FIELD_PTR(entry, libc_memalign, size),
-         (void *)GET_FIELD_PTR(entry, libc_memalign, return_ptr));
+void print_log_entry_libc_memalign(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", boundary=%Zu, size=%Zu, return_ptr=%p\n",
+               GET_FIELD_PTR(entry, libc_memalign, boundary),
+               GET_FIELD_PTR(entry, libc_memalign, size),
+               (void *)GET_FIELD_PTR(entry, libc_memalign, return_ptr));
 }
 
-void print_log_entry_lseek(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, offset=%Zu, whence=%d\n",
-         GET_FIELD_PTR(entry, lseek, fd),
-         GET_FIELD_PTR(entry, lseek, offset),
-         GET_FIELD_PTR(entry, lseek, whence));
+void print_log_entry_lseek(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, offset=%Zu, whence=%d\n",
+               GET_FIELD_PTR(entry, lseek, fd),
+               GET_FIELD_PTR(entry, lseek, offset),
+               GET_FIELD_PTR(entry, lseek, whence));
 }
 
-void print_log_entry_lseek64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, offset=%Zu, whence=%d\n",
-         GET_FIELD_PTR(entry, lseek64, fd),
-         GET_FIELD_PTR(entry, lseek64, offset),
-         GET_FIELD_PTR(entry, lseek64, whence));
+void print_log_entry_lseek64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, offset=%Zu, whence=%d\n",
+               GET_FIELD_PTR(entry, lseek64, fd),
+               GET_FIELD_PTR(entry, lseek64, offset),
+               GET_FIELD_PTR(entry, lseek64, whence));
 }
 
-void print_log_entry_llseek(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, offset=%Zu, whence=%d\n",
-         GET_FIELD_PTR(entry, llseek, fd),
-         GET_FIELD_PTR(entry, llseek, offset),
-         GET_FIELD_PTR(entry, llseek, whence));
+void print_log_entry_llseek(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, offset=%Zu, whence=%d\n",
+               GET_FIELD_PTR(entry, llseek, fd),
+               GET_FIELD_PTR(entry, llseek, offset),
+               GET_FIELD_PTR(entry, llseek, whence));
 }
 
-void print_log_entry_link(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldpath=%p, newpath=%p\n",
-         GET_FIELD_PTR(entry, link, oldpath),
-         GET_FIELD_PTR(entry, link, newpath));
+void print_log_entry_link(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldpath=%p, newpath=%p\n",
+               GET_FIELD_PTR(entry, link, oldpath),
+               GET_FIELD_PTR(entry, link, newpath));
 }
 
-void print_log_entry_symlink(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldpath=%p, newpath=%p\n",
-         GET_FIELD_PTR(entry, symlink, oldpath),
-         GET_FIELD_PTR(entry, symlink, newpath));
+void print_log_entry_symlink(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldpath=%p, newpath=%p\n",
+               GET_FIELD_PTR(entry, symlink, oldpath),
+               GET_FIELD_PTR(entry, symlink, newpath));
 }
 
-void print_log_entry_listen(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, backlog=%d\n",
-         GET_FIELD_PTR(entry, listen, sockfd),
-         GET_FIELD_PTR(entry, listen, backlog));
+void print_log_entry_listen(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, backlog=%d\n",
+               GET_FIELD_PTR(entry, listen, sockfd),
+               GET_FIELD_PTR(entry, listen, backlog));
 }
 
-void print_log_entry_localtime(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", timep=%p\n",
-         GET_FIELD_PTR(entry, localtime, timep));
+void print_log_entry_localtime(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", timep=%p\n",
+               GET_FIELD_PTR(entry, localtime, timep));
 }
 
-void print_log_entry_lxstat(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, path=%p\n",
-         GET_FIELD_PTR(entry, lxstat, vers),
-         GET_FIELD_PTR(entry, lxstat, path));
+void print_log_entry_lxstat(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, path=%p\n",
+               GET_FIELD_PTR(entry, lxstat, vers),
+               GET_FIELD_PTR(entry, lxstat, path));
 }
 
-void print_log_entry_lxstat64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, path=%p\n",
-         GET_FIELD_PTR(entry, lxstat64, vers),
-         GET_FIELD_PTR(entry, lxstat64, path));
+void print_log_entry_lxstat64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, path=%p\n",
+               GET_FIELD_PTR(entry, lxstat64, vers),
+               GET_FIELD_PTR(entry, lxstat64, path));
 }
 
-void print_log_entry_malloc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", size=%Zu\n",
-         GET_FIELD_PTR(entry, malloc, size));
+void print_log_entry_malloc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", size=%Zu\n",
+               GET_FIELD_PTR(entry, malloc, size));
 }
 
-void print_log_entry_mkdir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p, mode=%d",
-         GET_FIELD_PTR(entry, mkdir, pathname),
-         GET_FIELD_PTR(entry, mkdir, mode));
+void print_log_entry_mkdir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p, mode=%d",
+               GET_FIELD_PTR(entry, mkdir, pathname),
+               GET_FIELD_PTR(entry, mkdir, mode));
 }
 
-void print_log_entry_mkstemp(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", temp=%p\n",
-         GET_FIELD_PTR(entry, mkstemp, temp));
+void print_log_entry_mkstemp(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", temp=%p\n",
+               GET_FIELD_PTR(entry, mkstemp, temp));
 }
 
-void print_log_entry_mmap(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", addr=%p, length=%Zu, prot=%d, flags=%d, fd=%d, offset=%ld\n",
-         GET_FIELD_PTR(entry, mmap, addr),
-         GET_FIELD_PTR(entry, mmap, length),
-         GET_FIELD_PTR(entry, mmap, prot),
-         GET_FIELD_PTR(entry, mmap, flags),
-         GET_FIELD_PTR(entry, mmap, fd),
-         GET_FIELD_PTR(entry, mmap, offset));
+void print_log_entry_mmap(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", addr=%p, length=%Zu, prot=%d, flags=%d, fd=%d, offset=%ld\n",
+               GET_FIELD_PTR(entry, mmap, addr),
+               GET_FIELD_PTR(entry, mmap, length),
+               GET_FIELD_PTR(entry, mmap, prot),
+               GET_FIELD_PTR(entry, mmap, flags),
+               GET_FIELD_PTR(entry, mmap, fd),
+               GET_FIELD_PTR(entry, mmap, offset));
 }
 
-void print_log_entry_mmap64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", addr=%p, length=%Zu, prot=%d, flags=%d, fd=%d, offset=%ld\n",
-         GET_FIELD_PTR(entry, mmap64, addr),
-         GET_FIELD_PTR(entry, mmap64, length),
-         GET_FIELD_PTR(entry, mmap64, prot),
-         GET_FIELD_PTR(entry, mmap64, flags),
-         GET_FIELD_PTR(entry, mmap64, fd),
-         GET_FIELD_PTR(entry, mmap64, offset));
+void print_log_entry_mmap64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", addr=%p, length=%Zu, prot=%d, flags=%d, fd=%d, offset=%ld\n",
+               GET_FIELD_PTR(entry, mmap64, addr),
+               GET_FIELD_PTR(entry, mmap64, length),
+               GET_FIELD_PTR(entry, mmap64, prot),
+               GET_FIELD_PTR(entry, mmap64, flags),
+               GET_FIELD_PTR(entry, mmap64, fd),
+               GET_FIELD_PTR(entry, mmap64, offset));
 }
 
-void print_log_entry_mremap(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", old_address=%p, old_size=%Zu, new_size=%Zu, flags=%d\n",
-         GET_FIELD_PTR(entry, mremap, old_address),
-         GET_FIELD_PTR(entry, mremap, old_size),
-         GET_FIELD_PTR(entry, mremap, new_size),
-         GET_FIELD_PTR(entry, mremap, flags));
+void print_log_entry_mremap(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", old_address=%p, old_size=%Zu, new_size=%Zu, flags=%d\n",
+               GET_FIELD_PTR(entry, mremap, old_address),
+               GET_FIELD_PTR(entry, mremap, old_size),
+               GET_FIELD_PTR(entry, mremap, new_size),
+               GET_FIELD_PTR(entry, mremap, flags));
 }
 
-void print_log_entry_munmap(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", addr=%p, length=%Zu\n",
-         GET_FIELD_PTR(entry, munmap, addr),
-         GET_FIELD_PTR(entry, munmap, length));
+void print_log_entry_munmap(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", addr=%p, length=%Zu\n",
+               GET_FIELD_PTR(entry, munmap, addr),
+               GET_FIELD_PTR(entry, munmap, length));
 }
 
-void print_log_entry_open(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p, flags=%d, mode=%d\n",
-         GET_FIELD_PTR(entry, open, path),
-         GET_FIELD_PTR(entry, open, flags),
-         GET_FIELD_PTR(entry, open, open_mode));
+void print_log_entry_open(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p, flags=%d, mode=%d\n",
+               GET_FIELD_PTR(entry, open, path),
+               GET_FIELD_PTR(entry, open, flags),
+               GET_FIELD_PTR(entry, open, open_mode));
 }
 
-void print_log_entry_open64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p, flags=%d, mode=%d\n",
-         GET_FIELD_PTR(entry, open64, path),
-         GET_FIELD_PTR(entry, open64, flags),
-         GET_FIELD_PTR(entry, open64, open_mode));
+void print_log_entry_open64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p, flags=%d, mode=%d\n",
+               GET_FIELD_PTR(entry, open64, path),
+               GET_FIELD_PTR(entry, open64, flags),
+               GET_FIELD_PTR(entry, open64, open_mode));
 }
 
-void print_log_entry_openat(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", dirfd=%d, pathname=%p, flags=%d\n",
-         GET_FIELD_PTR(entry, openat, dirfd),
-         GET_FIELD_PTR(entry, openat, pathname),
-         GET_FIELD_PTR(entry, openat, flags));
+void print_log_entry_openat(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", dirfd=%d, pathname=%p, flags=%d\n",
+               GET_FIELD_PTR(entry, openat, dirfd),
+               GET_FIELD_PTR(entry, openat, pathname),
+               GET_FIELD_PTR(entry, openat, flags));
 }
 
-void print_log_entry_opendir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", name=%p\n",
-         GET_FIELD_PTR(entry, opendir, name));
+void print_log_entry_opendir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", name=%p\n",
+               GET_FIELD_PTR(entry, opendir, name));
 }
 
-void print_log_entry_pread(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, buf=%p, count=%Zu, offset=%ld\n",
-         GET_FIELD_PTR(entry, pread, fd),
-         GET_FIELD_PTR(entry, pread, buf),
-         GET_FIELD_PTR(entry, pread, count),
-         GET_FIELD_PTR(entry, pread, offset));
+void print_log_entry_pread(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, buf=%p, count=%Zu, offset=%ld\n",
+               GET_FIELD_PTR(entry, pread, fd),
+               GET_FIELD_PTR(entry, pread, buf),
+               GET_FIELD_PTR(entry, pread, count),
+               GET_FIELD_PTR(entry, pread, offset));
 }
 
-void print_log_entry_preadv(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, iov=%p, iovcnt=%d, offset=%ld\n",
-         GET_FIELD_PTR(entry, preadv, fd),
-         GET_FIELD_PTR(entry, preadv, iov),
-         GET_FIELD_PTR(entry, preadv, iovcnt),
-         GET_FIELD_PTR(entry, preadv, offset));
+void print_log_entry_preadv(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, iov=%p, iovcnt=%d, offset=%ld\n",
+               GET_FIELD_PTR(entry, preadv, fd),
+               GET_FIELD_PTR(entry, preadv, iov),
+               GET_FIELD_PTR(entry, preadv, iovcnt),
+               GET_FIELD_PTR(entry, preadv, offset));
 }
 
-void print_log_entry_putc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", c=%d, stream=%p\n",
-         GET_FIELD_PTR(entry, putc, c),
-         GET_FIELD_PTR(entry, putc, stream));
+void print_log_entry_putc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", c=%d, stream=%p\n",
+               GET_FIELD_PTR(entry, putc, c),
+               GET_FIELD_PTR(entry, putc, stream));
 }
 
-void print_log_entry_pwrite(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, buf=%p, count=%ld, offset=%Zu\n",
-         GET_FIELD_PTR(entry, pwrite, fd),
-         GET_FIELD_PTR(entry, pwrite, buf),
-         GET_FIELD_PTR(entry, pwrite, count),
-         GET_FIELD_PTR(entry, pwrite, offset));
+void print_log_entry_pwrite(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, buf=%p, count=%ld, offset=%Zu\n",
+               GET_FIELD_PTR(entry, pwrite, fd),
+               GET_FIELD_PTR(entry, pwrite, buf),
+               GET_FIELD_PTR(entry, pwrite, count),
+               GET_FIELD_PTR(entry, pwrite, offset));
 }
 
-void print_log_entry_pwritev(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, iov=%p, iovcnt=%d, offset=%ld\n",
-         GET_FIELD_PTR(entry, pwritev, fd),
-         GET_FIELD_PTR(entry, pwritev, iov),
-         GET_FIELD_PTR(entry, pwritev, iovcnt),
-         GET_FIELD_PTR(entry, pwritev, offset));
+void print_log_entry_pwritev(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, iov=%p, iovcnt=%d, offset=%ld\n",
+               GET_FIELD_PTR(entry, pwritev, fd),
+               GET_FIELD_PTR(entry, pwritev, iov),
+               GET_FIELD_PTR(entry, pwritev, iovcnt),
+               GET_FIELD_PTR(entry, pwritev, offset));
 }
 
-void print_log_entry_pthread_detach(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", thread=%lu\n", GET_FIELD_PTR(entry, pthread_detach, thread));
+void print_log_entry_pthread_detach(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", thread=%lu\n", GET_FIELD_PTR(entry, pthread_detach, thread));
 }
 
-void print_log_entry_pthread_create(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", thread=%p, attr=%p, start_routine=%p, arg=%p, stack_addr=%p\n",
-         GET_FIELD_PTR(entry, pthread_create, thread),
-         GET_FIELD_PTR(entry, pthread_create, attr),
-         GET_FIELD_PTR(entry, pthread_create, start_routine),
-         GET_FIELD_PTR(entry, pthread_create, arg),
-         GET_FIELD_PTR(entry, pthread_create, stack_addr));
+void print_log_entry_pthread_create(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", thread=%p, attr=%p, start_routine=%p, arg=%p, stack_addr=%p\n",
+          GET_FIELD_PTR(entry, pthread_create, thread),
+          GET_FIELD_PTR(entry, pthread_create, attr),
+          GET_FIELD_PTR(entry, pthread_create, start_routine),
+          GET_FIELD_PTR(entry, pthread_create, arg),
+          GET_FIELD_PTR(entry, pthread_create, stack_addr));
 }
 
-void print_log_entry_pthread_cond_broadcast(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", cond_addr=%p, signal_target=%d\n",
-         GET_FIELD_PTR(entry, pthread_cond_broadcast, addr),
-         GET_FIELD_PTR(entry, pthread_cond_broadcast, signal_target));
+void print_log_entry_pthread_cond_broadcast(FILE *out, size_t idx,
+                                            log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", cond_addr=%p, signal_target=%d\n",
+               GET_FIELD_PTR(entry, pthread_cond_broadcast, addr),
+               GET_FIELD_PTR(entry, pthread_cond_broadcast, signal_target));
 }
 
-void print_log_entry_pthread_cond_signal(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", cond_addr=%p, signal_target=%d\n",
-         GET_FIELD_PTR(entry, pthread_cond_signal, addr),
-         GET_FIELD_PTR(entry, pthread_cond_signal, signal_target));
+void print_log_entry_pthread_cond_signal(FILE *out, size_t idx,
+                                         log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", cond_addr=%p, signal_target=%d\n",
+               GET_FIELD_PTR(entry, pthread_cond_signal, addr),
+               GET_FIELD_PTR(entry, pthread_cond_signal, signal_target));
 }
 
-void print_log_entry_pthread_mutex_lock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_lock, addr));
+void print_log_entry_pthread_mutex_lock(FILE *out, size_t idx,
+                                        log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_lock, addr));
 }
 
-void print_log_entry_pthread_mutex_trylock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_trylock, addr));
+void print_log_entry_pthread_mutex_trylock(FILE *out, size_t idx,
+                                           log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_trylock, addr));
 }
 
-void print_log_entry_pthread_mutex_unlock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_unlock, addr));
+void print_log_entry_pthread_mutex_unlock(FILE *out, size_t idx,
+                                          log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", mutex=%p\n", GET_FIELD_PTR(entry, pthread_mutex_unlock, addr));
 }
 
-void print_log_entry_pthread_cond_wait(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", mutex_addr=%p, cond_addr=%p\n",
-         GET_FIELD_PTR(entry, pthread_cond_wait, mutex_addr),
-         GET_FIELD_PTR(entry, pthread_cond_wait, cond_addr));
+void print_log_entry_pthread_cond_wait(FILE *out, size_t idx,
+                                      log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", mutex_addr=%p, cond_addr=%p\n",
+               GET_FIELD_PTR(entry, pthread_cond_wait, mutex_addr),
+               GET_FIELD_PTR(entry, pthread_cond_wait, cond_addr));
 }
 
-void print_log_entry_pthread_cond_timedwait(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", mutex_addr=%p, cond_addr=%p, abstime=%p\n",
-         GET_FIELD_PTR(entry, pthread_cond_timedwait, mutex_addr),
-         GET_FIELD_PTR(entry, pthread_cond_timedwait, cond_addr),
-         GET_FIELD_PTR(entry, pthread_cond_timedwait, abstime));
+void print_log_entry_pthread_cond_timedwait(FILE *out, size_t idx,
+                                            log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", mutex_addr=%p, cond_addr=%p, abstime=%p\n",
+               GET_FIELD_PTR(entry, pthread_cond_timedwait, mutex_addr),
+               GET_FIELD_PTR(entry, pthread_cond_timedwait, cond_addr),
+               GET_FIELD_PTR(entry, pthread_cond_timedwait, abstime));
 }
 
-void print_log_entry_pthread_exit(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", value_ptr=%p\n", GET_FIELD_PTR(entry, pthread_exit, value_ptr));
+void print_log_entry_pthread_exit(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", value_ptr=%p\n", GET_FIELD_PTR(entry, pthread_exit, value_ptr));
 }
 
-void print_log_entry_pthread_join(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", thread=%lu, value_ptr=%p\n",
-         GET_FIELD_PTR(entry, pthread_join, thread),
-         GET_FIELD_PTR(entry, pthread_join, value_ptr));
+void print_log_entry_pthread_join(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", thread=%lu, value_ptr=%p\n",
+               GET_FIELD_PTR(entry, pthread_join, thread),
+               GET_FIELD_PTR(entry, pthread_join, value_ptr));
 }
 
-void print_log_entry_pthread_kill(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", thread=%lu, sig=%d\n",
-         GET_FIELD_PTR(entry, pthread_kill, thread),
-         GET_FIELD_PTR(entry, pthread_kill, sig));
+void print_log_entry_pthread_kill(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", thread=%lu, sig=%d\n",
+               GET_FIELD_PTR(entry, pthread_kill, thread),
+               GET_FIELD_PTR(entry, pthread_kill, sig));
 }
 
-void print_log_entry_pthread_rwlock_unlock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", rwlock=%p\n",
-         GET_FIELD_PTR(entry, pthread_rwlock_unlock, addr));
+void print_log_entry_pthread_rwlock_unlock(FILE *out, size_t idx,
+                                           log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", rwlock=%p\n",
+               GET_FIELD_PTR(entry, pthread_rwlock_unlock, addr));
 }
 
-void print_log_entry_pthread_rwlock_rdlock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", rwlock=%p\n",
-         GET_FIELD_PTR(entry, pthread_rwlock_rdlock, addr));
+void print_log_entry_pthread_rwlock_rdlock(FILE *out, size_t idx,
+                                           log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", rwlock=%p\n",
+               GET_FIELD_PTR(entry, pthread_rwlock_rdlock, addr));
 }
 
-void print_log_entry_pthread_rwlock_wrlock(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", rwlock=%p\n",
-         GET_FIELD_PTR(entry, pthread_rwlock_wrlock, addr));
+void print_log_entry_pthread_rwlock_wrlock(FILE *out, size_t idx,
+                                           log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", rwlock=%p\n",
+               GET_FIELD_PTR(entry, pthread_rwlock_wrlock, addr));
 }
 
-void print_log_entry_rand(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf("\n");
+void print_log_entry_rand(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, "\n");
 }
 
-void print_log_entry_read(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, buf_addr=%p, count=%Zu, data_offset=%ld\n",
-         GET_FIELD_PTR(entry, read, fd),
-         GET_FIELD_PTR(entry, read, buf_addr),
-         GET_FIELD_PTR(entry, read, count),
-         GET_FIELD_PTR(entry, read, data_offset));
+void print_log_entry_read(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, buf_addr=%p, count=%Zu, data_offset=%ld\n",
+               GET_FIELD_PTR(entry, read, fd),
+               GET_FIELD_PTR(entry, read, buf_addr),
+               GET_FIELD_PTR(entry, read, count),
+               GET_FIELD_PTR(entry, read, data_offset));
 }
 
-void print_log_entry_readv(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, iov=%p, iovcnt=%d, data_offset=%ld\n",
-         GET_FIELD_PTR(entry, readv, fd),
-         GET_FIELD_PTR(entry, readv, iov),
-         GET_FIELD_PTR(entry, readv, iovcnt),
-         GET_FIELD_PTR(entry, readv, data_offset));
+void print_log_entry_readv(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, iov=%p, iovcnt=%d, data_offset=%ld\n",
+               GET_FIELD_PTR(entry, readv, fd),
+               GET_FIELD_PTR(entry, readv, iov),
+               GET_FIELD_PTR(entry, readv, iovcnt),
+               GET_FIELD_PTR(entry, readv, data_offset));
 }
 
-void print_log_entry_readdir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", dirp=%p\n",
-         GET_FIELD_PTR(entry, readdir, dirp));
+void print_log_entry_readdir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", dirp=%p\n",
+               GET_FIELD_PTR(entry, readdir, dirp));
 }
 
-void print_log_entry_readdir_r(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", dirp=%p, result=%p\n",
-         GET_FIELD_PTR(entry, readdir_r, dirp),
-         GET_FIELD_PTR(entry, readdir_r, result));
+void print_log_entry_readdir_r(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", dirp=%p, result=%p\n",
+               GET_FIELD_PTR(entry, readdir_r, dirp),
+               GET_FIELD_PTR(entry, readdir_r, result));
 }
 
-void print_log_entry_readlink(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", path=%p, bufsiz=%Zu\n",
-         GET_FIELD_PTR(entry, readlink, path),
-         GET_FIELD_PTR(entry, readlink, bufsiz));
+void print_log_entry_readlink(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", path=%p, bufsiz=%Zu\n",
+               GET_FIELD_PTR(entry, readlink, path),
+               GET_FIELD_PTR(entry, readlink, bufsiz));
 }
 
-void print_log_entry_realloc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", size=%Zu, ptr=%p\n",
-         GET_FIELD_PTR(entry, realloc, size),
-         GET_FIELD_PTR(entry, realloc, ptr));
+void print_log_entry_realloc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", size=%Zu, ptr=%p\n",
+               GET_FIELD_PTR(entry, realloc, size),
+               GET_FIELD_PTR(entry, realloc, ptr));
 }
 
-void print_log_entry_rename(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", oldpath=%p, newpath=%p\n",
-         GET_FIELD_PTR(entry, rename, oldpath),
-         GET_FIELD_PTR(entry, rename, newpath));
+void print_log_entry_rename(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", oldpath=%p, newpath=%p\n",
+               GET_FIELD_PTR(entry, rename, oldpath),
+               GET_FIELD_PTR(entry, rename, newpath));
 }
 
-void print_log_entry_rewind(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, rewind, stream));
+void print_log_entry_rewind(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n",
+               GET_FIELD_PTR(entry, rewind, stream));
 }
 
-void print_log_entry_rmdir(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p\n",
-         GET_FIELD_PTR(entry, rmdir, pathname));
+void print_log_entry_rmdir(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p\n",
+               GET_FIELD_PTR(entry, rmdir, pathname));
 }
 
-void print_log_entry_select(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", nfds=%d, exceptfds=%p, timeout=%p\n",
-         GET_FIELD_PTR(entry, select, nfds),
-         GET_FIELD_PTR(entry, select, exceptfds),
-         GET_FIELD_PTR(entry, select, timeout));
+void print_log_entry_select(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", nfds=%d, exceptfds=%p, timeout=%p\n",
+               GET_FIELD_PTR(entry, select, nfds),
+               GET_FIELD_PTR(entry, select, exceptfds),
+               GET_FIELD_PTR(entry, select, timeout));
 }
 
-void print_log_entry_ppoll(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fds=%p, timeout_ts=%p, sigmask=%p\n",
-         GET_FIELD_PTR(entry, ppoll, fds),
-         GET_FIELD_PTR(entry, ppoll, timeout_ts),
-         GET_FIELD_PTR(entry, ppoll, sigmask));
+void print_log_entry_ppoll(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fds=%p, timeout_ts=%p, sigmask=%p\n",
+               GET_FIELD_PTR(entry, ppoll, fds),
+               GET_FIELD_PTR(entry, ppoll, timeout_ts),
+               GET_FIELD_PTR(entry, ppoll, sigmask));
 }
 
-void print_log_entry_signal_handler(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sig=%d\n",
-         GET_FIELD_PTR(entry, signal_handler, sig));
+void print_log_entry_signal_handler(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sig=%d\n",
+               GET_FIELD_PTR(entry, signal_handler, sig));
 }
 
-void print_log_entry_sigwait(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", set=%p, sigwait_sig=%p\n",
-         GET_FIELD_PTR(entry, sigwait, set),
-         GET_FIELD_PTR(entry, sigwait, sigwait_sig));
+void print_log_entry_sigwait(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", set=%p, sigwait_sig=%p\n",
+               GET_FIELD_PTR(entry, sigwait, set),
+               GET_FIELD_PTR(entry, sigwait, sigwait_sig));
 }
 
-void print_log_entry_setsockopt(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, level=%d, optname=%d, optval=%p\n",
-         GET_FIELD_PTR(entry, setsockopt, sockfd),
-         GET_FIELD_PTR(entry, setsockopt, level),
-         GET_FIELD_PTR(entry, setsockopt, optname),
-         GET_FIELD_PTR(entry, setsockopt, optval));
+void print_log_entry_setsockopt(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, level=%d, optname=%d, optval=%p\n",
+               GET_FIELD_PTR(entry, setsockopt, sockfd),
+               GET_FIELD_PTR(entry, setsockopt, level),
+               GET_FIELD_PTR(entry, setsockopt, optname),
+               GET_FIELD_PTR(entry, setsockopt, optval));
 }
 
-void print_log_entry_getsockopt(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd=%d, level=%d, optname=%d, optval=%p\n",
-         GET_FIELD_PTR(entry, getsockopt, sockfd),
-         GET_FIELD_PTR(entry, getsockopt, level),
-         GET_FIELD_PTR(entry, getsockopt, optname),
-         GET_FIELD_PTR(entry, getsockopt, optval));
+void print_log_entry_getsockopt(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd=%d, level=%d, optname=%d, optval=%p\n",
+               GET_FIELD_PTR(entry, getsockopt, sockfd),
+               GET_FIELD_PTR(entry, getsockopt, level),
+               GET_FIELD_PTR(entry, getsockopt, optname),
+               GET_FIELD_PTR(entry, getsockopt, optval));
 }
 
-void print_log_entry_ioctl(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", d=%d, request=%d, arg=%p\n",
-         GET_FIELD_PTR(entry, ioctl, d),
-         GET_FIELD_PTR(entry, ioctl, request),
-         GET_FIELD_PTR(entry, ioctl, arg));
+void print_log_entry_ioctl(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", d=%d, request=%d, arg=%p\n",
+               GET_FIELD_PTR(entry, ioctl, d),
+               GET_FIELD_PTR(entry, ioctl, request),
+               GET_FIELD_PTR(entry, ioctl, arg));
 }
 
-void print_log_entry_srand(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", seed=%d\n", GET_FIELD_PTR(entry, srand, seed));
+void print_log_entry_srand(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", seed=%d\n", GET_FIELD_PTR(entry, srand, seed));
 }
 
-void print_log_entry_socket(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", domain=%d, type=%d, protocol=%d\n",
-         GET_FIELD_PTR(entry, socket, domain),
-         GET_FIELD_PTR(entry, socket, type),
-         GET_FIELD_PTR(entry, socket, protocol));
+void print_log_entry_socket(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", domain=%d, type=%d, protocol=%d\n",
+               GET_FIELD_PTR(entry, socket, domain),
+               GET_FIELD_PTR(entry, socket, type),
+               GET_FIELD_PTR(entry, socket, protocol));
 }
 
-void print_log_entry_socketpair(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", domain=%d, type=%d, protocol=%d, sv:%p\n",
-         GET_FIELD_PTR(entry, socketpair, domain),
-         GET_FIELD_PTR(entry, socketpair, type),
-         GET_FIELD_PTR(entry, socketpair, protocol),
-         GET_FIELD_PTR(entry, socketpair, sv));
+void print_log_entry_socketpair(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", domain=%d, type=%d, protocol=%d, sv:%p\n",
+               GET_FIELD_PTR(entry, socketpair, domain),
+               GET_FIELD_PTR(entry, socketpair, type),
+               GET_FIELD_PTR(entry, socketpair, protocol),
+               GET_FIELD_PTR(entry, socketpair, sv));
 }
 
-void print_log_entry_xstat(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, path=%p\n",
-         GET_FIELD_PTR(entry, xstat, vers),
-         GET_FIELD_PTR(entry, xstat, path));
+void print_log_entry_xstat(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, path=%p\n",
+               GET_FIELD_PTR(entry, xstat, vers),
+               GET_FIELD_PTR(entry, xstat, path));
 }
 
-void print_log_entry_xstat64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", vers=%d, path=%p\n",
-         GET_FIELD_PTR(entry, xstat64, vers),
-         GET_FIELD_PTR(entry, xstat64, path));
+void print_log_entry_xstat64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", vers=%d, path=%p\n",
+               GET_FIELD_PTR(entry, xstat64, vers),
+               GET_FIELD_PTR(entry, xstat64, path));
 }
 
-void print_log_entry_time(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", tloc=%p\n", GET_FIELD_PTR(entry, time, tloc));
+void print_log_entry_time(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", tloc=%p\n", GET_FIELD_PTR(entry, time, tloc));
 }
 
-void print_log_entry_tmpfile(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf("\n");
+void print_log_entry_tmpfile(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, "\n");
 }
 
-void print_log_entry_gettimeofday(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", tv=%p, tz=%p\n", GET_FIELD_PTR(entry, gettimeofday, tv),
-         GET_FIELD_PTR(entry, gettimeofday, tz));
+void print_log_entry_gettimeofday(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", tv=%p, tz=%p\n", GET_FIELD_PTR(entry, gettimeofday, tv),
+               GET_FIELD_PTR(entry, gettimeofday, tz));
 }
 
-void print_log_entry_fflush(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n", GET_FIELD_PTR(entry, fflush, stream));
+void print_log_entry_fflush(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n", GET_FIELD_PTR(entry, fflush, stream));
 }
 
-void print_log_entry_setvbuf(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p, buf:%p, mode:%d, size:%zu\n",
-         GET_FIELD_PTR(entry, setvbuf, stream),
-         GET_FIELD_PTR(entry, setvbuf, buf),
-         GET_FIELD_PTR(entry, setvbuf, mode),
-         GET_FIELD_PTR(entry, setvbuf, size));
+void print_log_entry_setvbuf(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p, buf:%p, mode:%d, size:%zu\n",
+               GET_FIELD_PTR(entry, setvbuf, stream),
+               GET_FIELD_PTR(entry, setvbuf, buf),
+               GET_FIELD_PTR(entry, setvbuf, mode),
+               GET_FIELD_PTR(entry, setvbuf, size));
 }
 
-void print_log_entry_unlink(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pathname=%p\n",
-         GET_FIELD_PTR(entry, unlink, pathname));
+void print_log_entry_unlink(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pathname=%p\n",
+               GET_FIELD_PTR(entry, unlink, pathname));
 }
 
-void print_log_entry_truncate(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", path=%p, length=%zu\n",
-         GET_FIELD_PTR(entry, truncate, path),
-         GET_FIELD_PTR(entry, truncate, length));
+void print_log_entry_truncate(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", path=%p, length=%zu\n",
+               GET_FIELD_PTR(entry, truncate, path),
+               GET_FIELD_PTR(entry, truncate, length));
 }
 
-void print_log_entry_user(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf("\n");
+void print_log_entry_user(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, "\n");
 }
 
-void print_log_entry_write(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, buf_addr=%p, count=%Zu\n",
-         GET_FIELD_PTR(entry, write, fd),
-         GET_FIELD_PTR(entry, write, buf_addr),
-         GET_FIELD_PTR(entry, write, count));
+void print_log_entry_write(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, buf_addr=%p, count=%Zu\n",
+               GET_FIELD_PTR(entry, write, fd),
+               GET_FIELD_PTR(entry, write, buf_addr),
+               GET_FIELD_PTR(entry, write, count));
 }
 
-void print_log_entry_writev(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", fd=%d, iov=%p, iovcnt=%d\n",
-         GET_FIELD_PTR(entry, writev, fd),
-         GET_FIELD_PTR(entry, writev, iov),
-         GET_FIELD_PTR(entry, writev, iovcnt));
+void print_log_entry_writev(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", fd=%d, iov=%p, iovcnt=%d\n",
+               GET_FIELD_PTR(entry, writev, fd),
+               GET_FIELD_PTR(entry, writev, iov),
+               GET_FIELD_PTR(entry, writev, iovcnt));
 }
 
-void print_log_entry_getline(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", lineptr=%d, n=%Zu, stream=%p\n",
-         *(GET_FIELD_PTR(entry, getline, lineptr)),
-         GET_FIELD_PTR(entry, getline, n),
-         GET_FIELD_PTR(entry, getline, stream));
+void print_log_entry_getline(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", lineptr=%d, n=%Zu, stream=%p\n",
+               *(GET_FIELD_PTR(entry, getline, lineptr)),
+               GET_FIELD_PTR(entry, getline, n),
+               GET_FIELD_PTR(entry, getline, stream));
 }
 
-void print_log_entry_fscanf(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p, format=%p\n",
-         GET_FIELD_PTR(entry, fscanf, stream),
-         GET_FIELD_PTR(entry, fscanf, format));
+void print_log_entry_fscanf(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p, format=%p\n",
+               GET_FIELD_PTR(entry, fscanf, stream),
+               GET_FIELD_PTR(entry, fscanf, format));
 }
 
-void print_log_entry_getc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, getc, stream));
+void print_log_entry_getc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p, read_ptr=%p, buffered=%Zu, buf_base=%p,"
+               " buf_end=%p, file_offset=%ld\n",
+               GET_FIELD_PTR(entry, getc, stream),
+               GET_FIELD_PTR(entry, getc, read_ptr),
+               GET_FIELD_PTR(entry, getc, buffered),
+               GET_FIELD_PTR(entry, getc, buf_base),
+               GET_FIELD_PTR(entry, getc, buf_end),
+               (long) GET_FIELD_PTR(entry, getc, file_offset));
 }
 
-void print_log_entry_fgetc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", stream=%p\n",
-         GET_FIELD_PTR(entry, fgetc, stream));
+void print_log_entry_fgetc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", stream=%p\n",
+               GET_FIELD_PTR(entry, fgetc, stream));
 }
 
-void print_log_entry_ungetc(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", c=%d, stream=%p\n",
-         GET_FIELD_PTR(entry, ungetc, c),
-         GET_FIELD_PTR(entry, ungetc, stream));
+void print_log_entry_ungetc(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", c=%d, stream=%p\n",
+               GET_FIELD_PTR(entry, ungetc, c),
+               GET_FIELD_PTR(entry, ungetc, stream));
 }
 
-void print_log_entry_fopen64(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", name=%p, mode=%p\n",
-         GET_FIELD_PTR(entry, fopen64, name),
-         GET_FIELD_PTR(entry, fopen64, mode));
+void print_log_entry_fopen64(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", name=%p, mode=%p\n",
+               GET_FIELD_PTR(entry, fopen64, name),
+               GET_FIELD_PTR(entry, fopen64, mode));
 }
 
-void print_log_entry_epoll_create(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", size=%d\n",
-         GET_FIELD_PTR(entry, epoll_create, size));
+void print_log_entry_epoll_create(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", size=%d\n",
+               GET_FIELD_PTR(entry, epoll_create, size));
+}
+
+void print_log_entry_epoll_create1(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", flags=%d\n",
+               GET_FIELD_PTR(entry, epoll_create1, flags));
+}
+
+void print_log_entry_epoll_ctl(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", epfd=%d, op=%d, fd=%d, event=%p\n",
+               GET_FIELD_PTR(entry, epoll_ctl, epfd),
+               GET_FIELD_PTR(entry, epoll_ctl, op),
+               GET_FIELD_PTR(entry, epoll_ctl, fd),
+               GET_FIELD_PTR(entry, epoll_ctl, _event));
+}
+
+void print_log_entry_epoll_wait(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", epfd=%d, events=%p, maxevents:%d, timeout=%d\n",
+               GET_FIELD_PTR(entry, epoll_wait, epfd),
+               GET_FIELD_PTR(entry, epoll_wait, events),
+               GET_FIELD_PTR(entry, epoll_wait, maxevents),
+               GET_FIELD_PTR(entry, epoll_wait, timeout));
+}
+
+void print_log_entry_getpwnam_r(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", name=%p, pwd=%p, buf:%p, buflen:%zu, result:%p\n",
+               GET_FIELD_PTR(entry, getpwnam_r, name),
+               GET_FIELD_PTR(entry, getpwnam_r, pwd),
+               GET_FIELD_PTR(entry, getpwnam_r, buf),
+               GET_FIELD_PTR(entry, getpwnam_r, buflen),
+               GET_FIELD_PTR(entry, getpwnam_r, result));
+}
+
+void print_log_entry_getpwuid_r(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", uid=%d, pwd=%p, buf:%p, buflen:%zu, result:%p\n",
+               GET_FIELD_PTR(entry, getpwuid_r, uid),
+               GET_FIELD_PTR(entry, getpwuid_r, pwd),
+               GET_FIELD_PTR(entry, getpwuid_r, buf),
+               GET_FIELD_PTR(entry, getpwuid_r, buflen),
+               GET_FIELD_PTR(entry, getpwuid_r, result));
+}
+
+void print_log_entry_getgrnam_r(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", name=%p, grp=%p, buf:%p, buflen:%zu, result:%p\n",
+               GET_FIELD_PTR(entry, getgrnam_r, name),
+               GET_FIELD_PTR(entry, getgrnam_r, grp),
+               GET_FIELD_PTR(entry, getgrnam_r, buf),
+               GET_FIELD_PTR(entry, getgrnam_r, buflen),
+               GET_FIELD_PTR(entry, getgrnam_r, result));
+}
+
+void print_log_entry_getgrgid_r(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", gid=%d, grp=%p, buf:%p, buflen:%zu, result:%p\n",
+               GET_FIELD_PTR(entry, getgrgid_r, gid),
+               GET_FIELD_PTR(entry, getgrgid_r, grp),
+               GET_FIELD_PTR(entry, getgrgid_r, buf),
+               GET_FIELD_PTR(entry, getgrgid_r, buflen),
+               GET_FIELD_PTR(entry, getgrgid_r, result));
+}
+
+void print_log_entry_getaddrinfo(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", node=%p, service=%p, hints:%p, res:%p, num_res:%d\n",
+               GET_FIELD_PTR(entry, getaddrinfo, node),
+               GET_FIELD_PTR(entry, getaddrinfo, service),
+               GET_FIELD_PTR(entry, getaddrinfo, hints),
+               GET_FIELD_PTR(entry, getaddrinfo, res),
+               GET_FIELD_PTR(entry, getaddrinfo, num_res));
+}
+
+void print_log_entry_freeaddrinfo(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", res:%p\n",
+               GET_FIELD_PTR(entry, freeaddrinfo, res));
+}
+
+void print_log_entry_getnameinfo(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sa:%p, salen:%d, host:%p, hostlen:%d, serv:%p, servlen:%d,"
+               " flags:%d\n",
+               GET_FIELD_PTR(entry, getnameinfo, sa),
+               GET_FIELD_PTR(entry, getnameinfo, salen),
+               GET_FIELD_PTR(entry, getnameinfo, host),
+               GET_FIELD_PTR(entry, getnameinfo, hostlen),
+               GET_FIELD_PTR(entry, getnameinfo, serv),
+               GET_FIELD_PTR(entry, getnameinfo, servlen),
+               GET_FIELD_PTR(entry, getnameinfo, flags));
+}
+
+void print_log_entry_sendto(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", sockfd:%d, buf:%p, len:%zu, flags:%d, dest_addr:%p, addrlen:%d\n",
+          GET_FIELD_PTR(entry, sendto, sockfd),
+          GET_FIELD_PTR(entry, sendto, buf),
+          GET_FIELD_PTR(entry, sendto, len),
+          GET_FIELD_PTR(entry, sendto, flags),
+          GET_FIELD_PTR(entry, sendto, dest_addr),
+          GET_FIELD_PTR(entry, sendto, addrlen));
+}
+
+void print_log_entry_sendmsg(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd:%d, msg:%p, flags:%d\n",
+               GET_FIELD_PTR(entry, sendmsg, sockfd),
+               GET_FIELD_PTR(entry, sendmsg, msg),
+               GET_FIELD_PTR(entry, sendmsg, flags));
+}
+
+void print_log_entry_recvfrom(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out,
+          ", sockfd:%d, buf:%p, len:%zu, flags:%d, src_addr:%p, addrlen:%p\n",
+          GET_FIELD_PTR(entry, recvfrom, sockfd),
+          GET_FIELD_PTR(entry, recvfrom, buf),
+          GET_FIELD_PTR(entry, recvfrom, len),
+          GET_FIELD_PTR(entry, recvfrom, flags),
+          GET_FIELD_PTR(entry, recvfrom, src_addr),
+          GET_FIELD_PTR(entry, recvfrom, addrlen));
+}
+
+void print_log_entry_recvmsg(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", sockfd:%d, msg:%p, flags:%d\n",
+               GET_FIELD_PTR(entry, recvmsg, sockfd),
+               GET_FIELD_PTR(entry, recvmsg, msg),
+               GET_FIELD_PTR(entry, recvmsg, flags));
+}
+
+void print_log_entry_waitid(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", idtype:%d, id:%d, infop:%p, options:%d\n",
+               GET_FIELD_PTR(entry, waitid, idtype),
+               GET_FIELD_PTR(entry, waitid, id),
+               GET_FIELD_PTR(entry, waitid, infop),
+               GET_FIELD_PTR(entry, waitid, options));
+}
+
+void print_log_entry_wait4(FILE *out, size_t idx, log_entry_t *entry) {
+  print_log_entry_common(out, idx, entry);
+  fprintf(out, ", pid:%d, status:%p, options:%d, rusage:%p\n",
+               GET_FIELD_PTR(entry, wait4, pid),
+               GET_FIELD_PTR(entry, wait4, status),
+               GET_FIELD_PTR(entry, wait4, options),
+               GET_FIELD_PTR(entry, wait4, rusage));
+}
+
+
+typedef void (*print_entry_func_t)(FILE *out, size_t idx, log_entry_t *entry);
+#define PRINT_ENTRY_FUNC(name, ...) print_log_entry_##name,
+static const print_entry_func_t print_entry_table[numTotalEvents] = {
+  NULL, FOREACH_EVENT(PRINT_ENTRY_FUNC)
+};
+
+enum output_format_t {
+  FORMAT_TEXT,
+  FORMAT_JSON,
+  FORMAT_CSV
+};
+
+/* What to print, from the command line. */
+typedef struct read_log_options {
+  size_t first;                      // First entry index.
+  size_t end;                        // Entries from here on are not read.
+  size_t count;                      // Print at most this many entries.
+  std::vector<clone_id_t> threads;   // Sorted; empty for every clone.
+  bool events[numTotalEvents];       // Events to print.
+  bool summary;                      // Print totals instead of entries.
+  output_format_t format;
+  int jobs;
+} read_log_options_t;
+
+/* Entries are read in blocks, by up to 'jobs' threads at once. The output
+   of a block is kept in memory until the blocks before it are written out,
+   so at most READ_LOG_SLOTS_PER_JOB blocks per thread are held at a time,
+   whatever the size of the log. */
+#define READ_LOG_BLOCK_ENTRIES 8192
+#define READ_LOG_SLOTS_PER_JOB 4
+#define READ_LOG_MAX_JOBS 64
+
+/* An entry that passed the filters, for the summary and for -n. */
+typedef struct read_log_match {
+  size_t end;                        // End of its output in the block.
+  clone_id_t clone_id;
+  event_code_t event;
+  int size;
+} read_log_match_t;
+
+typedef struct read_log_block {
+  size_t first;
+  size_t end;
+  bool ready;
+  char *buf;
+  size_t bufSize;
+  std::vector<read_log_match_t> matches;
+} read_log_block_t;
+
+typedef struct read_log_reader {
+  dmtcp::SynchronizationLog *log;
+  const read_log_options_t *options;
+  // Without the index, the single reader thread walks the log.
+  bool indexed;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t numBlocks;
+  size_t nextBlock;                  // Next block to be read.
+  size_t doneBlocks;                 // Blocks written out.
+  bool stop;
+  std::vector<read_log_block_t> slots;
+} read_log_reader_t;
+
+typedef struct read_log_summary {
+  size_t entries[numTotalEvents];
+  size_t bytes[numTotalEvents];
+  std::map<clone_id_t, std::pair<size_t, size_t> > threads;
+} read_log_summary_t;
+
+static bool isSelected(const read_log_options_t *options, clone_id_t clone_id,
+                       int event)
+{
+  if ((unsigned int) event >= (unsigned int) numTotalEvents ||
+      !options->events[event]) {
+    return false;
+  }
+  return options->threads.empty() ||
+         std::binary_search(options->threads.begin(), options->threads.end(),
+                            clone_id);
 }
 
-void print_log_entry_epoll_create1(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", flags=%d\n",
-         GET_FIELD_PTR(entry, epoll_create1, flags));
+static void printEntry(FILE *out, output_format_t format, size_t idx,
+                       log_entry_t *entry, int entrySize)
+{
+  event_code_t event = GET_COMMON_PTR(entry, event);
+  switch (format) {
+    case FORMAT_TEXT:
+      if (print_entry_table[event] != NULL) {
+        print_entry_table[event](out, idx, entry);
+      }
+      break;
+    case FORMAT_JSON:
+      fprintf(out, "{\"index\":%zu,\"clone_id\":%ld,\"event\":\"%s\","
+                   "\"retval\":\"%p\",\"errno\":%d,\"log_offset\":%ld,"
+                   "\"optional\":%d,\"size\":%d}\n",
+              idx, GET_COMMON_PTR(entry, clone_id), event_name_table[event],
+              GET_COMMON_PTR(entry, retval), GET_COMMON_PTR(entry, my_errno),
+              (long) GET_COMMON_PTR(entry, log_offset),
+              GET_COMMON_PTR(entry, isOptional), entrySize);
+      break;
+    case FORMAT_CSV:
+      fprintf(out, "%zu,%ld,%s,%p,%d,%ld,%d,%d\n",
+              idx, GET_COMMON_PTR(entry, clone_id), event_name_table[event],
+              GET_COMMON_PTR(entry, retval), GET_COMMON_PTR(entry, my_errno),
+              (long) GET_COMMON_PTR(entry, log_offset),
+              GET_COMMON_PTR(entry, isOptional), entrySize);
+      break;
+  }
 }
 
-void print_log_entry_epoll_ctl(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", epfd=%d, op=%d, fd=%d, event=%p\n",
-         GET_FIELD_PTR(entry, epoll_ctl, epfd),
-         GET_FIELD_PTR(entry, epoll_ctl, op),
-         GET_FIELD_PTR(entry, epoll_ctl, fd),
-         GET_FIELD_PTR(entry, epoll_ctl, _event));
+/* Reads the entries of a block that pass the filters, and prints them into
+   the block's buffer. */
+static void readBlock(read_log_reader_t *reader, read_log_block_t *block)
+{
+  dmtcp::SynchronizationLog *log = reader->log;
+  const read_log_options_t *options = reader->options;
+  log_entry_t entry = EMPTY_LOG_ENTRY;
+  FILE *out = open_memstream(&block->buf, &block->bufSize);
+  JASSERT(out != NULL) (JASSERT_ERRNO);
+
+  if (!reader->indexed && log->currentEntryIndex() != block->first) {
+    log->seekToEntry(block->first);
+  }
+  for (size_t i = block->first; i < block->end; i++) {
+    int entrySize;
+    if (reader->indexed) {
+      // The index has the clone id and event of the entry: the entries
+      // filtered out are never decoded.
+      const LogIndexEntry *record = log->getIndexEntry(i);
+      if (!isSelected(options, record->cloneId, record->event)) {
+        continue;
+      }
+      entrySize = log->getEntryByIndex(i, entry);
+    } else {
+      entrySize = log->getCurrentEntry(entry);
+      log->advanceToNextEntry();
+    }
+    JASSERT(entrySize > 0) (i) (log->numEntries())
+      .Text("Error reading log file.");
+    clone_id_t clone_id = GET_COMMON(entry, clone_id);
+    event_code_t event = GET_COMMON(entry, event);
+    if (!isSelected(options, clone_id, event)) {
+      continue;
+    }
+    if (!options->summary) {
+      printEntry(out, options->format, i, &entry, entrySize);
+    }
+    read_log_match_t match = { (size_t) ftell(out), clone_id, event,
+                               entrySize };
+    block->matches.push_back(match);
+  }
+  fclose(out);
 }
 
-void print_log_entry_epoll_wait(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", epfd=%d, events=%p, maxevents:%d, timeout=%d\n",
-         GET_FIELD_PTR(entry, epoll_wait, epfd),
-         GET_FIELD_PTR(entry, epoll_wait, events),
-         GET_FIELD_PTR(entry, epoll_wait, maxevents),
-         GET_FIELD_PTR(entry, epoll_wait, timeout));
+static void *readBlocks(void *arg)
+{
+  read_log_reader_t *reader = (read_log_reader_t *) arg;
+  const read_log_options_t *options = reader->options;
+  size_t numSlots = reader->slots.size();
+
+  pthread_mutex_lock(&reader->lock);
+  while (true) {
+    // Wait for the slot of the next block to be written out.
+    while (!reader->stop && reader->nextBlock < reader->numBlocks &&
+           reader->nextBlock >= reader->doneBlocks + numSlots) {
+      pthread_cond_wait(&reader->cond, &reader->lock);
+    }
+    if (reader->stop || reader->nextBlock >= reader->numBlocks) {
+      break;
+    }
+    size_t b = reader->nextBlock++;
+    read_log_block_t *block = &reader->slots[b % numSlots];
+    pthread_mutex_unlock(&reader->lock);
+
+    block->first = options->first + b * READ_LOG_BLOCK_ENTRIES;
+    block->end = std::min(block->first + READ_LOG_BLOCK_ENTRIES,
+                          options->end);
+    readBlock(reader, block);
+
+    pthread_mutex_lock(&reader->lock);
+    block->ready = true;
+    pthread_cond_broadcast(&reader->cond);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
 }
 
-void print_log_entry_getpwnam_r(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", name=%p, pwd=%p, buf:%p, buflen:%zu, result:%p\n",
-         GET_FIELD_PTR(entry, getpwnam_r, name),
-         GET_FIELD_PTR(entry, getpwnam_r, pwd),
-         GET_FIELD_PTR(entry, getpwnam_r, buf),
-         GET_FIELD_PTR(entry, getpwnam_r, buflen),
-         GET_FIELD_PTR(entry, getpwnam_r, result));
-}
-
-void print_log_entry_getpwuid_r(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", uid=%d, pwd=%p, buf:%p, buflen:%zu, result:%p\n",
-         GET_FIELD_PTR(entry, getpwuid_r, uid),
-         GET_FIELD_PTR(entry, getpwuid_r, pwd),
-         GET_FIELD_PTR(entry, getpwuid_r, buf),
-         GET_FIELD_PTR(entry, getpwuid_r, buflen),
-         GET_FIELD_PTR(entry, getpwuid_r, result));
-}
-
-void print_log_entry_getgrnam_r(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", name=%p, grp=%p, buf:%p, buflen:%zu, result:%p\n",
-         GET_FIELD_PTR(entry, getgrnam_r, name),
-         GET_FIELD_PTR(entry, getgrnam_r, grp),
-         GET_FIELD_PTR(entry, getgrnam_r, buf),
-         GET_FIELD_PTR(entry, getgrnam_r, buflen),
-         GET_FIELD_PTR(entry, getgrnam_r, result));
-}
-
-void print_log_entry_getgrgid_r(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", gid=%d, grp=%p, buf:%p, buflen:%zu, result:%p\n",
-         GET_FIELD_PTR(entry, getgrgid_r, gid),
-         GET_FIELD_PTR(entry, getgrgid_r, grp),
-         GET_FIELD_PTR(entry, getgrgid_r, buf),
-         GET_FIELD_PTR(entry, getgrgid_r, buflen),
-         GET_FIELD_PTR(entry, getgrgid_r, result));
-}
-
-void print_log_entry_getaddrinfo(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", node=%p, service=%p, hints:%p, res:%p, num_res:%d\n",
-         GET_FIELD_PTR(entry, getaddrinfo, node),
-         GET_FIELD_PTR(entry, getaddrinfo, service),
-         GET_FIELD_PTR(entry, getaddrinfo, hints),
-         GET_FIELD_PTR(entry, getaddrinfo, res),
-         GET_FIELD_PTR(entry, getaddrinfo, num_res));
-}
-
-void print_log_entry_freeaddrinfo(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", res:%p\n",
-         GET_FIELD_PTR(entry, freeaddrinfo, res));
-}
-
-void print_log_entry_getnameinfo(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sa:%p, salen:%d, host:%p, hostlen:%d, serv:%p, servlen:%d,"
-         " flags:%d\n",
-         GET_FIELD_PTR(entry, getnameinfo, sa),
-         GET_FIELD_PTR(entry, getnameinfo, salen),
-         GET_FIELD_PTR(entry, getnameinfo, host),
-         GET_FIELD_PTR(entry, getnameinfo, hostlen),
-         GET_FIELD_PTR(entry, getnameinfo, serv),
-         GET_FIELD_PTR(entry, getnameinfo, servlen),
-         GET_FIELD_PTR(entry, getnameinfo, flags));
-}
-
-void print_log_entry_sendto(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd:%d, buf:%p, len:%zu, flags:%d, dest_addr:%p, addrlen:%d\n",
-         GET_FIELD_PTR(entry, sendto, sockfd),
-         GET_FIELD_PTR(entry, sendto, buf),
-         GET_FIELD_PTR(entry, sendto, len),
-         GET_FIELD_PTR(entry, sendto, flags),
-         GET_FIELD_PTR(entry, sendto, dest_addr),
-         GET_FIELD_PTR(entry, sendto, addrlen));
-}
-
-void print_log_entry_sendmsg(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd:%d, msg:%p, flags:%d\n",
-         GET_FIELD_PTR(entry, sendmsg, sockfd),
-         GET_FIELD_PTR(entry, sendmsg, msg),
-         GET_FIELD_PTR(entry, sendmsg, flags));
-}
-
-void print_log_entry_recvfrom(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd:%d, buf:%p, len:%zu, flags:%d, src_addr:%p, addrlen:%p\n",
-         GET_FIELD_PTR(entry, recvfrom, sockfd),
-         GET_FIELD_PTR(entry, recvfrom, buf),
-         GET_FIELD_PTR(entry, recvfrom, len),
-         GET_FIELD_PTR(entry, recvfrom, flags),
-         GET_FIELD_PTR(entry, recvfrom, src_addr),
-         GET_FIELD_PTR(entry, recvfrom, addrlen));
-}
-
-void print_log_entry_recvmsg(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", sockfd:%d, msg:%p, flags:%d\n",
-         GET_FIELD_PTR(entry, recvmsg, sockfd),
-         GET_FIELD_PTR(entry, recvmsg, msg),
-         GET_FIELD_PTR(entry, recvmsg, flags));
-}
-
-void print_log_entry_waitid(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", idtype:%d, id:%d, infop:%p, options:%d\n",
-         GET_FIELD_PTR(entry, waitid, idtype),
-         GET_FIELD_PTR(entry, waitid, id),
-         GET_FIELD_PTR(entry, waitid, infop),
-         GET_FIELD_PTR(entry, waitid, options));
-}
-
-void print_log_entry_wait4(int idx, log_entry_t *entry) {
-  print_log_entry_common(idx, entry);
-  printf(", pid:%d, status:%p, options:%d, rusage:%p\n",
-         GET_FIELD_PTR(entry, wait4, pid),
-         GET_FIELD_PTR(entry, wait4, status),
-         GET_FIELD_PTR(entry, wait4, options),
-         GET_FIELD_PTR(entry, wait4, rusage));
-}
-
-
-void printEntry(int idx, log_entry_t *entry)
+static void printSummary(const read_log_summary_t& summary,
+                         output_format_t format)
 {
-  PRINT_ENTRIES(idx, entry);
+  if (format == FORMAT_TEXT) {
+    printf("%-24s %12s %14s\n", "event", "entries", "bytes");
+  } else if (format == FORMAT_CSV) {
+    printf("kind,key,entries,bytes\n");
+  }
+  for (int e = 0; e < numTotalEvents; e++) {
+    if (summary.entries[e] == 0) {
+      continue;
+    }
+    if (format == FORMAT_TEXT) {
+      printf("%-24s %12zu %14zu\n", event_name_table[e], summary.entries[e],
+             summary.bytes[e]);
+    } else if (format == FORMAT_JSON) {
+      printf("{\"event\":\"%s\",\"entries\":%zu,\"bytes\":%zu}\n",
+             event_name_table[e], summary.entries[e], summary.bytes[e]);
+    } else {
+      printf("event,%s,%zu,%zu\n", event_name_table[e], summary.entries[e],
+             summary.bytes[e]);
+    }
+  }
+
+  if (format == FORMAT_TEXT) {
+    printf("\n%-24s %12s %14s\n", "clone_id", "entries", "bytes");
+  }
+  std::map<clone_id_t, std::pair<size_t, size_t> >::const_iterator it;
+  for (it = summary.threads.begin(); it != summary.threads.end(); it++) {
+    if (format == FORMAT_TEXT) {
+      printf("%-24ld %12zu %14zu\n", it->first, it->second.first,
+             it->second.second);
+    } else if (format == FORMAT_JSON) {
+      printf("{\"clone_id\":%ld,\"entries\":%zu,\"bytes\":%zu}\n",
+             it->first, it->second.first, it->second.second);
+    } else {
+      printf("clone_id,%ld,%zu,%zu\n", it->first, it->second.first,
+             it->second.second);
+    }
+  }
 }
 
-void rewriteLog(char *log_path)
+/* Prints the entries of the log selected by 'options', or their summary.
+   The entries are read by options.jobs threads, a block each at a time, and
+   written out in log order. With the entry index, a thread goes straight to
+   its block, and the filters are checked before decoding an entry. */
+void rewriteLog(char *log_path, read_log_options_t& options)
 {
   dmtcp::SynchronizationLog log;
   /* Only need enough room for the metadata. */
@@ -1100,18 +1343,105 @@ void rewriteLog(char *log_path)
   size_t logSize = log.getDataSize();
   log.destroy(SYNC_IS_RECORD);
   log.initialize(log_path, logSize + LOG_OFFSET_FROM_START + 1);
-  printf("Metadata: dataSize=%Zu, numEntries=%Zu\n",
-         log.getDataSize(), log.numEntries());
-  log_entry_t entry = EMPTY_LOG_ENTRY;
-  for (size_t i = 0; i < log.numEntries(); i++) {
-    if (log.getCurrentEntry(entry) == 0) {
-      printf("Error reading log file. numEntries: %zu, entriesRead: %zu\n",
-             log.numEntries(), i);
-      exit(1);
+  if (options.format == FORMAT_TEXT) {
+    printf("Metadata: format=%s, dataSize=%Zu, numEntries=%Zu\n",
+           log.isCompact() ? "compact" : "fixed",
+           log.getDataSize(), log.numEntries());
+  } else if (options.format == FORMAT_JSON) {
+    printf("{\"format\":\"%s\",\"dataSize\":%zu,\"numEntries\":%zu}\n",
+           log.isCompact() ? "compact" : "fixed",
+           log.getDataSize(), log.numEntries());
+  } else if (!options.summary) {
+    printf("index,clone_id,event,retval,errno,log_offset,optional,size\n");
+  }
+
+  // In ring mode, the entries before currentEntryIndex() were retired.
+  options.first = std::max(options.first, log.currentEntryIndex());
+  options.end = std::min(options.end, log.numEntries());
+
+  read_log_reader_t reader;
+  reader.log = &log;
+  reader.options = &options;
+  reader.indexed = options.first >= options.end ||
+                   log.getIndexEntry(options.end - 1) != NULL;
+  if (!reader.indexed) {
+    options.jobs = 1;
+  }
+  pthread_mutex_init(&reader.lock, NULL);
+  pthread_cond_init(&reader.cond, NULL);
+  reader.numBlocks = options.first >= options.end ? 0 :
+    (options.end - options.first + READ_LOG_BLOCK_ENTRIES - 1) /
+    READ_LOG_BLOCK_ENTRIES;
+  reader.nextBlock = 0;
+  reader.doneBlocks = 0;
+  reader.stop = false;
+  read_log_block_t empty = read_log_block_t();
+  reader.slots.resize(options.jobs * READ_LOG_SLOTS_PER_JOB, empty);
+
+  std::vector<pthread_t> threads(options.jobs);
+  for (int i = 0; i < options.jobs; i++) {
+    JASSERT(pthread_create(&threads[i], NULL, readBlocks, &reader) == 0);
+  }
+
+  read_log_summary_t summary;
+  memset(summary.entries, 0, sizeof(summary.entries));
+  memset(summary.bytes, 0, sizeof(summary.bytes));
+  size_t remaining = options.count;
+  for (size_t b = 0; b < reader.numBlocks && remaining > 0; b++) {
+    read_log_block_t *block = &reader.slots[b % reader.slots.size()];
+    pthread_mutex_lock(&reader.lock);
+    while (!block->ready) {
+      pthread_cond_wait(&reader.cond, &reader.lock);
+    }
+    pthread_mutex_unlock(&reader.lock);
+
+    size_t n = std::min(block->matches.size(), remaining);
+    remaining -= n;
+    if (!options.summary && n > 0) {
+      fwrite(block->buf, 1, block->matches[n - 1].end, stdout);
+    }
+    for (size_t i = 0; i < n; i++) {
+      const read_log_match_t& match = block->matches[i];
+      std::pair<size_t, size_t>& thread = summary.threads[match.clone_id];
+      summary.entries[match.event]++;
+      summary.bytes[match.event] += match.size;
+      thread.first++;
+      thread.second += match.size;
     }
-    printEntry(i, &entry);
-    log.advanceToNextEntry();
+    free(block->buf);
+    block->buf = NULL;
+    block->matches.clear();
+    size_t last = block->end - 1;
+
+    pthread_mutex_lock(&reader.lock);
+    block->ready = false;
+    reader.doneBlocks++;
+    pthread_cond_broadcast(&reader.cond);
+    pthread_mutex_unlock(&reader.lock);
+
+    /* The blocks still being read come after this one, so the log behind it
+       need not stay mapped. Walking the log releases it as it goes. */
+    if (reader.indexed) {
+      log.releaseSegmentsBefore(log.getIndexEntry(last)->offset);
+    }
+  }
+
+  pthread_mutex_lock(&reader.lock);
+  reader.stop = true;
+  pthread_cond_broadcast(&reader.cond);
+  pthread_mutex_unlock(&reader.lock);
+  for (int i = 0; i < options.jobs; i++) {
+    pthread_join(threads[i], NULL);
   }
+  // Blocks read past -n.
+  for (size_t i = 0; i < reader.slots.size(); i++) {
+    free(reader.slots[i].buf);
+  }
+
+  if (options.summary) {
+    printSummary(summary, options.format);
+  }
+  fflush(stdout);
 }
 
 
@@ -1151,12 +1481,136 @@ void initializeJalib()
   JASSERT_INIT("");
 }
 
+static void printUsage(const char *name)
+{
+  fprintf(stderr, "USAGE: %s [OPTIONS] /path/to/sync-log\n", name);
+  fprintf(stderr, " Options:\n");
+  fprintf(stderr, "  -s N, --start=N  : Start at log entry index N.\n");
+  fprintf(stderr, "  -E N, --end=N    : Stop before log entry index N.\n");
+  fprintf(stderr, "  -n N, --count=N  : Print at most N entries.\n");
+  fprintf(stderr,
+          "  -t N[,N...], --thread=N[,N...] :"
+          " Only print the entries of these clone ids.\n");
+  fprintf(stderr,
+          "  -e NAME[,NAME...], --event=NAME[,NAME...] :"
+          " Only print these events\n"
+          "                     (e.g. pthread_mutex_lock,read).\n");
+  fprintf(stderr,
+          "  -S, --summary    : Print the number of entries and bytes of"
+          " each event\n"
+          "                     and of each clone id, instead of the"
+          " entries.\n");
+  fprintf(stderr,
+          "  -f FMT, --format=FMT : Output format: text (default), json"
+          " (one object\n"
+          "                     per line) or csv.\n");
+  fprintf(stderr,
+          "  -j N, --jobs=N   : Read the log with N threads"
+          " (default: number of CPUs).\n");
+}
+
+static bool parseEvents(char *list, bool *events)
+{
+  for (char *name = strtok(list, ","); name != NULL;
+       name = strtok(NULL, ",")) {
+    int e;
+    for (e = 1; e < numTotalEvents; e++) {
+      if (strcmp(name, event_name_table[e]) == 0) {
+        events[e] = true;
+        break;
+      }
+    }
+    if (e == numTotalEvents) {
+      fprintf(stderr, "Unknown event: %s\n", name);
+      return false;
+    }
+  }
+  return true;
+}
+
 int main(int argc, char **argv) {
-  if (argc < 2) {
-    fprintf(stderr, "USAGE: %s /path/to/sync-log\n", argv[0]);
+  read_log_options_t options;
+  options.first = 0;
+  options.end = (size_t) -1;
+  options.count = (size_t) -1;
+  options.summary = false;
+  options.format = FORMAT_TEXT;
+  options.jobs = std::max(1L, std::min(sysconf(_SC_NPROCESSORS_ONLN),
+                                       (long) READ_LOG_MAX_JOBS));
+  bool hasEvents = false;
+  memset(options.events, 0, sizeof(options.events));
+  int opt, option_index;
+  static struct option long_options[] =
+    {
+      {"start",     required_argument, 0, 's'},
+      {"end",       required_argument, 0, 'E'},
+      {"count",     required_argument, 0, 'n'},
+      {"thread",    required_argument, 0, 't'},
+      {"event",     required_argument, 0, 'e'},
+      {"summary",   no_argument,       0, 'S'},
+      {"format",    required_argument, 0, 'f'},
+      {"jobs",      required_argument, 0, 'j'},
+      {0, 0, 0, 0} // required (see man getopt)
+    };
+
+  while ((opt = getopt_long(argc, argv, "s:E:n:t:e:Sf:j:", long_options,
+                            &option_index)) != -1) {
+    switch (opt) {
+    case 's':
+      options.first = strtoul(optarg, NULL, 10);
+      break;
+    case 'E':
+      options.end = strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      options.count = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      for (char *id = strtok(optarg, ","); id != NULL;
+           id = strtok(NULL, ",")) {
+        options.threads.push_back(strtol(id, NULL, 10));
+      }
+      break;
+    case 'e':
+      hasEvents = true;
+      if (!parseEvents(optarg, options.events)) {
+        return 1;
+      }
+      break;
+    case 'S':
+      options.summary = true;
+      break;
+    case 'f':
+      if (strcmp(optarg, "text") == 0) {
+        options.format = FORMAT_TEXT;
+      } else if (strcmp(optarg, "json") == 0) {
+        options.format = FORMAT_JSON;
+      } else if (strcmp(optarg, "csv") == 0) {
+        options.format = FORMAT_CSV;
+      } else {
+        printUsage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'j':
+      options.jobs = std::max(1, std::min(atoi(optarg), READ_LOG_MAX_JOBS));
+      break;
+    default:
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    printUsage(argv[0]);
     return 1;
   }
+  if (!hasEvents) {
+    for (int e = 1; e < numTotalEvents; e++) {
+      options.events[e] = true;
+    }
+  }
+  std::sort(options.threads.begin(), options.threads.end());
   initializeJalib();
-  rewriteLog(argv[1]);
+  rewriteLog(argv[optind], options);
   return 0;
 }
@@ -731,6 +731,11 @@ void * _real_libc_memalign(size_t boundary, size_t size) {
   REAL_FUNC_PASSTHROUGH_TYPED (void*, __libc_memalign) (boundary, size);
 }
 
+LIB_PRIVATE
+size_t _real_malloc_usable_size(void *ptr) {
+  REAL_FUNC_PASSTHROUGH_TYPED (size_t, malloc_usable_size) (ptr);
+}
+
 LIB_PRIVATE
 void _real_free(void *ptr) {
   REAL_FUNC_PASSTHROUGH_VOID (free) (ptr);
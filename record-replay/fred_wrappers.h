@@ -96,6 +96,7 @@ LIB_PRIVATE extern __thread int thread_performing_dlopen_dlsym;
   MACRO(free)                               \
   MACRO(__libc_memalign)                    \
   MACRO(realloc)                            \
+  MACRO(malloc_usable_size)                 \
   MACRO(mmap)                               \
   MACRO(mmap64)                             \
   MACRO(mremap)                             \
@@ -452,6 +453,7 @@ LIB_PRIVATE extern __thread int thread_performing_dlopen_dlsym;
   void  _real_free(void *ptr);
   void *_real_realloc(void *ptr, size_t size);
   void *_real_libc_memalign(size_t boundary, size_t size);
+  size_t _real_malloc_usable_size(void *ptr);
   void *_real_mmap(void *addr, size_t length, int prot, int flags,
       int fd, off_t offset);
   void *_real_mmap64(void *addr, size_t length, int prot, int flags,
@@ -32,6 +32,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/falloc.h>
+#include <limits.h>
+#include <algorithm>
 
 #include "constants.h"
 #include "log.h"
@@ -41,6 +46,148 @@
 #include "util.h"
 #include "jassert.h"
 
+/* Not in older headers; the kernel returns EINVAL if it lacks them. */
+#ifndef MADV_COLD
+#define MADV_COLD 20
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/* Per-thread cursor into the chunk that the calling thread is currently
+   filling (per-thread chunk mode only). chunk_generation guards against
+   reusing a chunk that was reserved before the log was last mapped in. */
+static __thread size_t chunk_pos = 0;
+static __thread size_t chunk_end = 0;
+static __thread size_t chunk_generation = 0;
+/* Generations are unique across all log objects of the process. */
+static size_t log_generation = 0;
+
+typedef struct LogChunkEntry {
+  log_seq_t seq;
+  size_t offset;
+  size_t size;
+} LogChunkEntry;
+
+static bool chunkEntryLessThan(const LogChunkEntry& a, const LogChunkEntry& b)
+{
+  return a.seq < b.seq;
+}
+
+/* Layout of an entry in LOG_FORMAT_COMPACT:
+ *
+ *   varint  length of the rest of the entry (0 means no entry)
+ *   byte    event
+ *   byte    COMPACT_* flags
+ *   varint  clone_id
+ *   zigzag varint my_errno, only if COMPACT_HAS_ERRNO
+ *   zigzag varint retval
+ *   event data: a bitmap of the non-zero 8-byte words of the event struct,
+ *               followed by those words as zigzag varints
+ *
+ * log_offset is not stored; it is the offset of the entry itself. Entries
+ * that reserveEntry() places before the real call and commitEntry() fills in
+ * after it are written with COMPACT_PATCHABLE instead: my_errno, retval and
+ * the event struct are then stored raw so that the size of the entry is
+ * known up front. mergeLogs() re-encodes them in the short form.
+ */
+#define COMPACT_OPTIONAL  0x1
+#define COMPACT_HAS_ERRNO 0x2
+#define COMPACT_PATCHABLE 0x4
+
+#define VARINT_MAX_SIZE   10
+
+static inline char *putVarint(char *p, uint64_t value)
+{
+  while (value >= 0x80) {
+    *p++ = (char) (value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (char) value;
+  return p;
+}
+
+static inline size_t varintSize(uint64_t value)
+{
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static inline const char *getVarint(const char *p, uint64_t *value)
+{
+  uint64_t result = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    byte = *p++;
+    result |= (uint64_t) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  *value = result;
+  return p;
+}
+
+/* Small negative values (-1 return values, errno) get short varints too. */
+static inline uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static char *putEventWords(char *p, const char *data, size_t size)
+{
+  size_t numWords = (size + 7) / 8;
+  unsigned char *bitmap = (unsigned char *) p;
+  memset(bitmap, 0, (numWords + 7) / 8);
+  p += (numWords + 7) / 8;
+  for (size_t i = 0; i < numWords; i++) {
+    uint64_t word = 0;
+    memcpy(&word, data + i * 8, std::min((size_t) 8, size - i * 8));
+    if (word != 0) {
+      bitmap[i / 8] |= 1 << (i % 8);
+      p = putVarint(p, zigzag((int64_t) word));
+    }
+  }
+  return p;
+}
+
+static const char *getEventWords(const char *p, char *data, size_t size)
+{
+  size_t numWords = (size + 7) / 8;
+  const unsigned char *bitmap = (const unsigned char *) p;
+  p += (numWords + 7) / 8;
+  for (size_t i = 0; i < numWords; i++) {
+    uint64_t word = 0;
+    if (bitmap[i / 8] & (1 << (i % 8))) {
+      p = getVarint(p, &word);
+      word = (uint64_t) unzigzag(word);
+    }
+    memcpy(data + i * 8, &word, std::min((size_t) 8, size - i * 8));
+  }
+  return p;
+}
+
+/* Events whose entries are reserved before the real call and committed
+   afterwards. */
+static bool isPatchableEvent(event_code_t event)
+{
+  return event == pthread_create_event ||
+         event == pthread_rwlock_unlock_event ||
+         event == pthread_mutex_unlock_event ||
+         event == malloc_event ||
+         event == libc_memalign_event ||
+         event == calloc_event ||
+         event == realloc_event;
+}
+
 void dmtcp::SynchronizationLog::initialize(const char *path, size_t size)
 {
   bool mapWithNoReserveFlag = SYNC_IS_RECORD;
@@ -57,21 +204,51 @@ void dmtcp::SynchronizationLog::initialize(const char *path, size_t size)
   /* map_in calls init_common if appropriate. */
   map_in(path, size, mapWithNoReserveFlag);
 
+  /* Replay (and fred_read_log) walk the log in a single global order. Only
+     merge if the whole log is mapped in, though. The same goes for indexing
+     the entries that are not yet. */
+  if (!SYNC_IS_RECORD && LOG_OFFSET_FROM_START + getDataSize() <= *_size) {
+    if (usesPerThreadChunks()) {
+      /* In a private view, the merged entries only exist in memory: its
+         segments must then stay mapped. */
+      _mergedPrivately = SYNC_IS_NOOP && *_chunkedStart < getDataSize();
+      mergeLogs();
+    }
+    buildIndex();
+  }
+  _chunkGeneration = __sync_add_and_fetch(&log_generation, 1);
+
   init_shm();
 
+  /* Without a marker, replay starts at the oldest entry still in the log. */
+  _index = *_retiredOffset;
+  _entryIndex = *_retiredEntries;
+
   JTRACE ("Initialized global synchronization log path to" )
     (_path) ((long)_startAddr) (*_size) (mapWithNoReserveFlag);
 
+  if (_entryOffsetMarker == INVALID_LOG_OFFSET) {
+    /* We checkpointed while recording into per-thread chunks, so the offset
+       of the marker entry is only known once the chunks have been merged.
+       When we simply resume recording, there is nothing to restore. */
+    if (SYNC_IS_RECORD) {
+      _entryOffsetMarker = 0;
+      _entryIndexMarker = 0;
+    } else {
+      _entryOffsetMarker = offsetOfEntryIndex(_entryIndexMarker);
+    }
+  }
+
   if (_entryOffsetMarker > 0) {
     /* This means we checkpointed during record/replay. Restore the
        log to that point. */
     JASSERT(_entryIndexMarker > 0);
-    log_entry_t temp_entry = EMPTY_LOG_ENTRY;
-    int entrySize = getEntryAtOffset(temp_entry, _entryOffsetMarker);
+    log_entry_header_t header;
+    getHeaderAtOffset(header, _entryOffsetMarker);
 
     _index = _entryOffsetMarker;
     _entryIndex = _entryIndexMarker;
-    _sharedInterfaceInfo->current_clone_id = GET_COMMON(temp_entry, clone_id);
+    _sharedInterfaceInfo->current_clone_id = header.clone_id;
     _sharedInterfaceInfo->current_log_entry_index = _entryIndex;
 
     JTRACE ("Restored log to index and offset from intermediate checkpoint.")
@@ -109,6 +286,8 @@ void dmtcp::SynchronizationLog::init_shm()
 
   _sharedInterfaceInfo->total_entries = *_numEntries;
   _sharedInterfaceInfo->total_threads = *_numThreads;
+  strncpy(_sharedInterfaceInfo->log_path, _path.c_str(),
+          sizeof(_sharedInterfaceInfo->log_path) - 1);
   _sharedInterfaceInfo->breakpoint_at_index = FRED_INTERFACE_NO_BP;
 
   LogMetadata *metadata = (LogMetadata *) _startAddr;
@@ -149,20 +328,74 @@ void dmtcp::SynchronizationLog::init_common(size_t size)
   _dataSize = &(metadata->dataSize);
   _size = &(metadata->size);
   _recordedStartAddr = &(metadata->recordedStartAddr);
+  _format = &(metadata->format);
+  _flags = &(metadata->flags);
+  _chunkedStart = &(metadata->chunkedStart);
+  _segmentSize = &(metadata->segmentSize);
+  _numSegments = &(metadata->numSegments);
+  _retiredOffset = &(metadata->retiredOffset);
+  _retiredEntries = &(metadata->retiredEntries);
+  _mallocArenaAddr = &(metadata->mallocArenaAddr);
+  _nextSequence = &(metadata->nextSequence);
 
   _sharedInterfaceInfo =
     (fred_interface_info_t *) metadata->recordedSharedInterfaceInfoMapAddr;
 
   *_size = size;
   _log = _startAddr + LOG_OFFSET_FROM_START;
+  resetPrefetch();
 
   if (*_recordedStartAddr == NULL) {
     JASSERT(SYNC_IS_RECORD);
     *_numThreads = 0;
+    *_format = LOG_FORMAT_COMPACT;
+    char *format = getenv(ENV_VAR_LOG_FORMAT);
+    if (format != NULL) {
+      *_format = atoi(format);
+    }
+    JASSERT(*_format == LOG_FORMAT_FIXED || *_format == LOG_FORMAT_COMPACT)
+      (*_format);
+    *_flags = 0;
+    char *chunked = getenv(ENV_VAR_LOG_PER_THREAD_CHUNKS);
+    if (chunked != NULL && atoi(chunked) != 0) {
+      *_flags |= LOG_FLAG_PER_THREAD_CHUNKS;
+    }
+    char *ring = getenv(ENV_VAR_LOG_RING);
+    if (ring != NULL && atoi(ring) != 0) {
+      *_flags |= LOG_FLAG_RING;
+    }
+    char *arena = getenv(ENV_VAR_MALLOC_ARENA);
+    if (arena != NULL && atoi(arena) != 0) {
+      *_flags |= LOG_FLAG_MALLOC_ARENA;
+    }
+    char *relaxed = getenv(ENV_VAR_RELAXED_REPLAY);
+    if (relaxed != NULL && atoi(relaxed) != 0) {
+      *_flags |= LOG_FLAG_RELAXED_REPLAY;
+    }
+    char *hugepages = getenv(ENV_VAR_LOG_HUGEPAGES);
+    if (hugepages != NULL && atoi(hugepages) != 0) {
+      *_flags |= LOG_FLAG_HUGEPAGES;
+    }
+    *_chunkedStart = 0;
+    *_segmentSize = LOG_SEGMENT_SIZE;
+    *_numSegments = 0;
+    *_retiredOffset = 0;
+    *_retiredEntries = 0;
+    *_mallocArenaAddr = NULL;
+    *_nextSequence = 1;
     JASSERT(_startAddr != NULL && _startAddr != MAP_FAILED);
     JTRACE("RECORD; filling in _recordedStartAddr.") ((long)_startAddr);
     *_recordedStartAddr = _startAddr;
   }
+
+  if (*_segmentSize == 0) {
+    /* Recorded before the log had segments; its data is one region running
+       to the end of the file. */
+    off_t fileSize = _real_lseek(_fd, 0, SEEK_END);
+    *_segmentSize = LOG_SEGMENT_SIZE;
+    *_numSegments = (fileSize - LOG_OFFSET_FROM_START + LOG_SEGMENT_SIZE - 1) /
+                    LOG_SEGMENT_SIZE;
+  }
 }
 
 void dmtcp::SynchronizationLog::destroy(int mode)
@@ -172,7 +405,12 @@ void dmtcp::SynchronizationLog::destroy(int mode)
      image. For the first checkpoint, this will be 0 to indicate there
      are no entries. For subsequent checkpoints during replay, it will
      be the point in the log from which to start replay. */
-  if (mode == SYNC_RECORD) {
+  if (mode == SYNC_RECORD && usesPerThreadChunks()) {
+    // Checkpoint during RECORD mode, entries are still spread over chunks.
+    // Sequence numbers are entry indices plus one, see mergeLogs().
+    _entryIndexMarker = __sync_fetch_and_add(_nextSequence, 0) - 1;
+    _entryOffsetMarker = _entryIndexMarker > 0 ? INVALID_LOG_OFFSET : 0;
+  } else if (mode == SYNC_RECORD) {
     // Checkpoint during RECORD mode.
     _entryOffsetMarker = getDataSize();
     if (_numEntries != NULL) { // Will be NULL on first checkpoint.
@@ -183,6 +421,13 @@ void dmtcp::SynchronizationLog::destroy(int mode)
     _entryIndexMarker  = _entryIndex;
   }
 
+  /* The chains and streams are only kept across checkpoints taken during
+     replay. */
+  if (mode == SYNC_RECORD) {
+    destroyChains();
+    destroyStreams();
+  }
+
   if (_startAddr != NULL) {
     unmap();
   }
@@ -193,6 +438,15 @@ void dmtcp::SynchronizationLog::destroy(int mode)
   _entryIndex = 0;
   _dataSize = NULL;
   _numEntries = NULL;
+  _format = NULL;
+  _flags = NULL;
+  _chunkedStart = NULL;
+  _segmentSize = NULL;
+  _numSegments = NULL;
+  _retiredOffset = NULL;
+  _retiredEntries = NULL;
+  _mallocArenaAddr = NULL;
+  _nextSequence = NULL;
   destroy_shm();
   _sharedInterfaceInfo = NULL;
 }
@@ -202,9 +456,15 @@ void dmtcp::SynchronizationLog::unmap()
   if (_startAddr == NULL) {
     return;
   }
+  unmapIndex();
   // Save the size in case we want to remap after this unmap:
   _savedSize = *_size;
-  JASSERT(_real_munmap(_startAddr, *_size) == 0) (JASSERT_ERRNO) (*_size) (_startAddr);
+  // Unmaps the metadata, the mapped segments and the reservation around them.
+  JASSERT(_real_munmap(_startAddr, _savedSize) == 0)
+    (JASSERT_ERRNO) (_savedSize) (_startAddr);
+  _real_close(_fd);
+  _fd = -1;
+  _mappedBegin = _mappedEnd = 0;
 }
 
 void dmtcp::SynchronizationLog::map_in(const char *path, size_t size,
@@ -213,16 +473,27 @@ void dmtcp::SynchronizationLog::map_in(const char *path, size_t size,
   int fd;
   int mmapProt = PROT_READ | PROT_WRITE;
   int mmapFlags = MAP_SHARED;
+  int reserveFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
   void *mmapAddr = NULL, *tempAddr = NULL;
   LogMetadata *tempMetadata;
 
   JASSERT(path != NULL);
-  fd = _real_open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-  JASSERT(fd != -1);
+  if (SYNC_IS_NOOP) {
+    /* Tools reading the log (fred_read_log) must leave the recording as it
+       is: they get a private copy-on-write view of it, in which mergeLogs()
+       and the metadata may still be written. */
+    fd = _real_open(path, O_RDONLY);
+    mmapFlags = MAP_PRIVATE;
+  } else {
+    fd = _real_open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  }
+  JASSERT(fd != -1) (JASSERT_ERRNO) (path);
 
-  if (SYNC_IS_RECORD) {
-    JASSERT(_real_lseek(fd, size, SEEK_SET) == (off_t)size);
-    Util::writeAll(fd, "", 1);
+  if (SYNC_IS_RECORD &&
+      _real_lseek(fd, 0, SEEK_END) < (off_t) LOG_OFFSET_FROM_START) {
+    // A new log. Segments are added to the file as recording reaches them.
+    JASSERT(_real_syscall(SYS_ftruncate, fd, LOG_OFFSET_FROM_START) == 0)
+      (JASSERT_ERRNO) (path);
   }
 
   if (mapWithNoReserveFlag) {
@@ -237,20 +508,43 @@ void dmtcp::SynchronizationLog::map_in(const char *path, size_t size,
   tempMetadata = (LogMetadata *) tempAddr;
   mmapAddr = tempMetadata->recordedStartAddr;
   if (mmapAddr != NULL) {
-    mmapFlags |= MAP_FIXED;
+    reserveFlags |= MAP_FIXED;
   }
   _real_munmap(tempAddr, LOG_OFFSET_FROM_START);
 
   SET_IN_MMAP_WRAPPER();
-  _startAddr = (char*) _real_mmap(mmapAddr, size, mmapProt, mmapFlags, fd, 0);
+  /* Reserve the address range of the whole log, then map the metadata page
+     at its start. Segments are mapped into the rest by mapSegments(). */
   if (mmapAddr != NULL) {
+    _startAddr = (char*) _real_mmap(mmapAddr, size, PROT_NONE, reserveFlags,
+                                    -1, 0);
+    JASSERT(_startAddr != MAP_FAILED) (JASSERT_ERRNO) (size);
     JASSERT ( (void *)_startAddr == mmapAddr );
+  } else {
+    /* Start at a huge page boundary (see LOG_HUGEPAGE_SIZE). Replay maps
+       the log at the same address, so it stays aligned. */
+    char *addr = (char*) _real_mmap(NULL, size + LOG_HUGEPAGE_SIZE,
+                                    PROT_NONE, reserveFlags, -1, 0);
+    JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO) (size);
+    _startAddr = (char*) (((uintptr_t) addr + LOG_HUGEPAGE_SIZE - 1) &
+                          ~(uintptr_t) (LOG_HUGEPAGE_SIZE - 1));
+    if (_startAddr > addr) {
+      _real_munmap(addr, _startAddr - addr);
+    }
+    _real_munmap(_startAddr + size, addr + LOG_HUGEPAGE_SIZE - _startAddr);
   }
+  tempAddr = _real_mmap(_startAddr, LOG_OFFSET_FROM_START, mmapProt,
+                        mmapFlags | MAP_FIXED, fd, 0);
+  JASSERT(tempAddr == _startAddr) (JASSERT_ERRNO) (tempAddr);
   UNSET_IN_MMAP_WRAPPER();
 
-  _real_close(fd);
+  _fd = fd;
+  _mappedBegin = _mappedEnd = 0;
+  _droppedBefore = 0;
+  _mergedPrivately = false;
   _path = path == NULL ? "" : path;
   init_common(size);
+  mapIndex();
 }
 
 void dmtcp::SynchronizationLog::map_in()
@@ -262,8 +556,27 @@ void dmtcp::SynchronizationLog::map_in()
   map_in(path_copy, _savedSize, false);
 }
 
+#define TURN_FUTEX_WORD(clone_id) \
+  (&_turnFutex[(unsigned int)(clone_id) % LOG_TURN_FUTEX_SLOTS].word)
+
+static void wakeFutexWord(int *word)
+{
+  __sync_fetch_and_add(word, 1);
+  _real_syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void waitForFutexWord(int *word, int oldValue)
+{
+  struct timespec timeout = {0, LOG_TURN_FUTEX_TIMEOUT_NS};
+  _real_syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, oldValue, &timeout,
+                NULL, 0);
+}
+
 int dmtcp::SynchronizationLog::advanceToNextEntry()
 {
+  if (_chains != NULL) {
+    return advanceChains();
+  }
   if (_sharedInterfaceInfo->breakpoint_at_index == _entryIndex + 1) {
     // A breakpoint has been hit. Don't advance the log yet.
     _sharedInterfaceInfo->breakpoint_at_index = FRED_INTERFACE_BP_HIT;
@@ -277,255 +590,1829 @@ int dmtcp::SynchronizationLog::advanceToNextEntry()
     }
   }
 
-  log_entry_t temp_entry = EMPTY_LOG_ENTRY;
-  int entrySize = getCurrentEntry(temp_entry);
+  log_entry_header_t header;
+  int entrySize = getCurrentHeader(header);
   JASSERT(entrySize > 0);
-  atomicIncrementIndex(entrySize);
-  atomicIncrementEntryIndex();
-  // Load the new entry.
-  entrySize = getCurrentEntry(temp_entry);
+  size_t offset = atomicIncrementIndex(entrySize) + entrySize;
+  releaseSegmentsBefore(offset);
+  size_t entryIndex = atomicIncrementEntryIndex() + 1;
+  // Peek at the new entry.
+  entrySize = getCurrentHeader(header);
 
   /* Keep interface info up to date. */
-  _sharedInterfaceInfo->current_clone_id = GET_COMMON(temp_entry, clone_id);
+  _sharedInterfaceInfo->current_clone_id = header.clone_id;
   _sharedInterfaceInfo->current_log_entry_index = _entryIndex;
 
+  /* Hand the turn to the owner of the new head entry. */
+  if (entrySize > 0) {
+    wakeTurn(header.clone_id);
+    if (header.event == signal_handler_event) {
+      wakeFutexWord(&_signalFutex.word);
+    }
+  }
+  prefetchHeaders(entryIndex, offset);
+
   return entrySize;
 }
 
-int dmtcp::SynchronizationLog::getCurrentEntry(log_entry_t& entry)
+/* Must be read before checking the head of the log, so that an advance
+   happening in between is noticed by waitForTurnChange(). */
+int dmtcp::SynchronizationLog::turnFutexValue(clone_id_t clone_id)
 {
-  int entrySize = getEntryAtOffset(entry, getIndex());
-  return entrySize;
+  return __sync_fetch_and_add(TURN_FUTEX_WORD(clone_id), 0);
 }
 
-// Reads the entry from log and returns the length of entry
-int dmtcp::SynchronizationLog::getEntryAtOffset(log_entry_t& entry, size_t index)
+void dmtcp::SynchronizationLog::waitForTurnChange(clone_id_t clone_id,
+                                                  int oldValue)
 {
-  size_t currentDataSize = getDataSize();
-  if (index == currentDataSize || getEntryHeaderAtOffset(entry, index) == 0) {
-    entry = EMPTY_LOG_ENTRY;
-    return 0;
-  }
-
-  size_t event_size;
-  JASSERT(GET_COMMON(entry, event) > 0);
-  GET_EVENT_SIZE(GET_COMMON(entry, event), event_size);
-
-  if (index + log_event_common_size + event_size > currentDataSize) {
-    JASSERT ((index + log_event_common_size + event_size) <= currentDataSize)
-      (index) (log_event_common_size) (event_size) (currentDataSize);
-  }
-
-#if 1
-  READ_ENTRY_FROM_LOG(&_log[index + log_event_common_size], entry);
-#else
-  void *ptr;
-  GET_EVENT_DATA_PTR(entry, ptr);
-  memcpy(ptr, &_log[index + log_event_common_size], event_size);
-#endif
-
-  return log_event_common_size + event_size;
+  waitForFutexWord(TURN_FUTEX_WORD(clone_id), oldValue);
 }
 
-void dmtcp::SynchronizationLog::appendEntry(log_entry_t& entry)
+void dmtcp::SynchronizationLog::wakeTurn(clone_id_t clone_id)
 {
-  int eventSize = -1;
-  log_off_t offset;
-
-  GET_EVENT_SIZE(GET_COMMON(entry, event), eventSize);
-  JASSERT( eventSize > 0 );
-  eventSize += log_event_common_size;
-  offset = atomicIncrementOffset(eventSize);
-  __sync_fetch_and_add(_numEntries, 1);
-  SET_COMMON2(entry, log_offset, offset);
+  wakeFutexWord(TURN_FUTEX_WORD(clone_id));
+}
 
-  JASSERT(eventSize == writeEntryAtOffset(entry, offset));
+/* The same pair as turnFutexValue() and waitForTurnChange(), for the thread
+   delivering signals on replay: it sleeps until the head of the log reaches
+   a signal_handler entry. */
+int dmtcp::SynchronizationLog::signalFutexValue()
+{
+  return __sync_fetch_and_add(&_signalFutex.word, 0);
 }
 
-void dmtcp::SynchronizationLog::updateEntry(const log_entry_t& entry)
+void dmtcp::SynchronizationLog::waitForSignalEntry(int oldValue)
 {
-  // only allow it for pthread_create and malloc calls
-  JASSERT(GET_COMMON(entry, event) == pthread_create_event ||
-	  GET_COMMON(entry, event) == pthread_rwlock_unlock_event ||
-	  GET_COMMON(entry, event) == pthread_mutex_unlock_event ||
-	  GET_COMMON(entry, event) == malloc_event ||
-	  GET_COMMON(entry, event) == libc_memalign_event ||
-	  GET_COMMON(entry, event) == calloc_event ||
-	  GET_COMMON(entry, event) == realloc_event);
+  waitForFutexWord(&_signalFutex.word, oldValue);
+}
 
-#ifdef DEBUG
-  log_entry_t old_entry = EMPTY_LOG_ENTRY;
-  JASSERT(getEntryAtOffset(old_entry, GET_COMMON(entry, log_offset)) != 0);
+/* Relaxed replay (LOG_FLAG_RELAXED_REPLAY). initChains() walks the rest of
+   the log once and links every entry to the previous entry on each of its
+   resources, see chainKeys(). Each thread keeps a cursor to its own next
+   entry, and replays it as soon as the entries it depends on are done, no
+   matter where the rest of the log is. An entry without a resource is a
+   barrier: it waits until the head of the log reaches it, and every later
+   entry waits for it. The head (_entryIndex, and getIndex()) is the first
+   entry that isn't done yet. It only moves over done entries, so
+   checkpoints, the signal thread and fred_command still see a position in
+   the order of the log. */
+#define CHAIN_KEY_HEAP ((uint64_t) 2)
+#define CHAIN_KEY_FD(fd) (((uint64_t) (fd) << 2) | 1)
+
+static __thread size_t chain_cursor = 0;
+static __thread size_t chain_generation = 0;
+
+/* Stores the resources of the entry in keys and returns how many there are,
+   or -1 if the entry is a barrier. Objects are at least 4-byte aligned, so
+   their addresses don't collide with the other keys. All of the malloc
+   family shares one chain: allocation results depend on the order of all
+   heap operations. */
+static int chainKeys(const log_entry_t& entry, uint64_t keys[2])
+{
+  switch (GET_COMMON(entry, event)) {
+    case pthread_mutex_lock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_mutex_lock, addr);
+      return 1;
+    case pthread_mutex_trylock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_mutex_trylock, addr);
+      return 1;
+    case pthread_mutex_unlock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_mutex_unlock, addr);
+      return 1;
+    case pthread_rwlock_rdlock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_rwlock_rdlock, addr);
+      return 1;
+    case pthread_rwlock_wrlock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_rwlock_wrlock, addr);
+      return 1;
+    case pthread_rwlock_unlock_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_rwlock_unlock, addr);
+      return 1;
+    case pthread_cond_signal_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_cond_signal, addr);
+      return 1;
+    case pthread_cond_broadcast_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_cond_broadcast, addr);
+      return 1;
+    case pthread_cond_wait_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_cond_wait, cond_addr);
+      keys[1] = (uintptr_t) GET_FIELD(entry, pthread_cond_wait, mutex_addr);
+      return 2;
+    case pthread_cond_timedwait_event:
+      keys[0] = (uintptr_t) GET_FIELD(entry, pthread_cond_timedwait,
+                                      cond_addr);
+      keys[1] = (uintptr_t) GET_FIELD(entry, pthread_cond_timedwait,
+                                      mutex_addr);
+      return 2;
+    case read_event:
+      keys[0] = CHAIN_KEY_FD(GET_FIELD(entry, read, fd));
+      return 1;
+    case readv_event:
+      keys[0] = CHAIN_KEY_FD(GET_FIELD(entry, readv, fd));
+      return 1;
+    case write_event:
+      keys[0] = CHAIN_KEY_FD(GET_FIELD(entry, write, fd));
+      return 1;
+    case writev_event:
+      keys[0] = CHAIN_KEY_FD(GET_FIELD(entry, writev, fd));
+      return 1;
+    case malloc_event:
+    case calloc_event:
+    case realloc_event:
+    case libc_memalign_event:
+    case free_event:
+      keys[0] = CHAIN_KEY_HEAP;
+      return 1;
+    default:
+      return -1;
+  }
+}
 
-  // Only allow replacing events of the same type. Allowing it for differing
-  // types (which means differing sizes) would take more work.
-  JASSERT(GET_COMMON(entry, event) == GET_COMMON(old_entry, event));
+void dmtcp::SynchronizationLog::initChains()
+{
+  size_t numEntries = this->numEntries();
+  if (_chains != NULL) {
+    if (_entryIndex >= _chains->base &&
+        _chains->base + _chains->numEntries == numEntries) {
+      /* Restarted from a checkpoint taken during relaxed replay. The entries
+         done past the head, and the cursors of the threads, were saved with
+         it. */
+      return;
+    }
+    destroyChains();
+  }
+  JASSERT(numEntries - _entryIndex < LOG_CHAIN_NONE)
+    (numEntries) (_entryIndex);
+
+  LogChains *chains = new LogChains;
+  chains->base = _entryIndex;
+  chains->numEntries = numEntries - _entryIndex;
+  chains->mapSize = std::max((size_t) 1, chains->numEntries) *
+                    sizeof(LogChainEntry);
+  chains->entries =
+    (LogChainEntry *) _real_mmap(NULL, chains->mapSize,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  JASSERT(chains->entries != MAP_FAILED) (JASSERT_ERRNO) (chains->mapSize);
+
+  /* Last entry on each resource, shifted left by one, with the position of
+     the resource among the keys of that entry in the low bit. */
+  dmtcp::map<uint64_t, uint64_t> lastOnResource;
+  dmtcp::map<clone_id_t, uint32_t> lastOfClone;
+  uint32_t lastBarrier = LOG_CHAIN_NONE;
+  size_t offset = _index;
+  for (uint32_t i = 0; i < chains->numEntries; i++) {
+    log_entry_t entry = EMPTY_LOG_ENTRY;
+    int entrySize = getEntryAtOffset(entry, offset);
+    JASSERT(entrySize > 0) (i) (offset);
+    clone_id_t clone_id = GET_COMMON(entry, clone_id);
+    LogChainEntry *e = &chains->entries[i];
+    e->offset = offset;
+    e->dep[0] = e->dep[1] = LOG_CHAIN_NONE;
+    e->nextInThread = LOG_CHAIN_NONE;
+    e->waiter[0] = e->waiter[1] = LOG_CHAIN_NO_WAITER;
+    e->anyClone = clone_id == CLONE_ID_ANYONE;
+    e->isSignal = GET_COMMON(entry, event) == signal_handler_event;
+    e->done = 0;
+
+    if (!e->anyClone) {
+      dmtcp::map<clone_id_t, uint32_t>::iterator it =
+        lastOfClone.find(clone_id);
+      if (it == lastOfClone.end()) {
+        chains->firstOfClone[clone_id] = i;
+      } else {
+        chains->entries[it->second].nextInThread = i;
+      }
+      lastOfClone[clone_id] = i;
+    }
 
-  if (GET_COMMON(entry, event) == pthread_create_event) {
-    JASSERT(GET_COMMON(entry, log_offset) == GET_COMMON(old_entry, log_offset) &&
-	    IS_EQUAL_FIELD(entry, old_entry, pthread_create, thread) &&
-	    IS_EQUAL_FIELD(entry, old_entry, pthread_create, thread) &&
-	    IS_EQUAL_FIELD(entry, old_entry, pthread_create, start_routine) &&
-	    IS_EQUAL_FIELD(entry, old_entry, pthread_create, attr) &&
-	    IS_EQUAL_FIELD(entry, old_entry, pthread_create, arg));
-  } else if (GET_COMMON(entry, event) == malloc_event) {
-    JASSERT(GET_COMMON(entry, log_offset) == GET_COMMON(old_entry, log_offset) &&
-	    IS_EQUAL_FIELD(entry, old_entry, malloc, size));
+    uint64_t keys[2];
+    int numKeys = chainKeys(entry, keys);
+    e->isBarrier = numKeys < 0;
+    if (e->isBarrier) {
+      lastBarrier = i;
+    }
+    for (int k = 0; k < numKeys; k++) {
+      /* A predecessor older than the last barrier is implied by it. */
+      e->dep[k] = lastBarrier;
+      dmtcp::map<uint64_t, uint64_t>::iterator it =
+        lastOnResource.find(keys[k]);
+      if (it != lastOnResource.end()) {
+        uint32_t pred = it->second >> 1;
+        if (lastBarrier == LOG_CHAIN_NONE || pred > lastBarrier) {
+          e->dep[k] = pred;
+          chains->entries[pred].waiter[it->second & 1] = clone_id;
+        }
+      }
+      lastOnResource[keys[k]] = ((uint64_t) i << 1) | k;
+    }
+    offset += entrySize;
   }
-#endif
 
-  writeEntryAtOffset(entry, GET_COMMON(entry, log_offset));
+  chains->generation = __sync_add_and_fetch(&log_generation, 1);
+  __sync_synchronize();
+  _chains = chains;
+  JTRACE("Built replay chains.") (chains->base) (chains->numEntries);
 }
 
-/* Move appropriate markers to the end, so that we enter "append" mode. */
-void dmtcp::SynchronizationLog::moveMarkersToEnd()
+void dmtcp::SynchronizationLog::destroyChains()
 {
-  _index = getDataSize();
-  _entryIndex = *_numEntries;
+  if (_chains == NULL) {
+    return;
+  }
+  _real_munmap(_chains->entries, _chains->mapSize);
+  delete _chains;
+  _chains = NULL;
 }
 
-int dmtcp::SynchronizationLog::writeEntryAtOffset(const log_entry_t& entry,
-                                                  size_t index)
+/* Returns the next entry of the calling thread, relative to the base of the
+   chains, or LOG_CHAIN_NONE. */
+size_t dmtcp::SynchronizationLog::chainCursor(clone_id_t clone_id)
 {
-  if (__builtin_expect(_startAddr == 0, 0)) {
-    JASSERT(false);
+  if (chain_generation != _chains->generation) {
+    dmtcp::map<clone_id_t, uint32_t>::iterator it =
+      _chains->firstOfClone.find(clone_id);
+    chain_cursor = it == _chains->firstOfClone.end() ? LOG_CHAIN_NONE
+                                                     : it->second;
+    chain_generation = _chains->generation;
   }
+  return chain_cursor;
+}
 
-  int event_size = -1;
-  GET_EVENT_SIZE(GET_COMMON(entry, event), event_size);
-  JASSERT( event_size > 0 );
+int dmtcp::SynchronizationLog::getThreadEntry(clone_id_t clone_id,
+                                              log_entry_t& entry)
+{
+  size_t i = chainCursor(clone_id);
+  if (i == LOG_CHAIN_NONE) {
+    entry = EMPTY_LOG_ENTRY;
+    return 0;
+  }
+  return getEntryAtOffset(entry, _chains->entries[i].offset);
+}
 
-  JASSERT ((LOG_OFFSET_FROM_START + index +
-            log_event_common_size + event_size) < *_size)
-    ( *_size ) .Text ("Log size too small. Please increase MAX_LOG_LENGTH"
-                      " in synchronizationlogging.h");
+int dmtcp::SynchronizationLog::getThreadHeader(clone_id_t clone_id,
+                                               log_entry_header_t& header)
+{
+  size_t i = chainCursor(clone_id);
+  if (i == LOG_CHAIN_NONE) {
+    memset(&header, 0, sizeof(header));
+    return 0;
+  }
+  return getHeaderAtOffset(header, _chains->entries[i].offset);
+}
 
-  writeEntryHeaderAtOffset(entry, index);
+/* Waits until the entry returned by getThreadEntry() may be replayed. */
+void dmtcp::SynchronizationLog::waitForThreadEntryDeps(clone_id_t clone_id)
+{
+  size_t i = chainCursor(clone_id);
+  JASSERT(i != LOG_CHAIN_NONE);
+  LogChainEntry *e = &_chains->entries[i];
+  size_t entryIndex = _chains->base + i;
+
+  while (1) {
+    /* Read before checking, see turnFutexValue(). */
+    int *word = TURN_FUTEX_WORD(clone_id);
+    int turn = __sync_fetch_and_add(word, 0);
+    int chainTurn = __sync_fetch_and_add(&_chainFutex.word, 0);
+    ssize_t bp = _sharedInterfaceInfo->breakpoint_at_index;
+    bool ready = true;
+
+    if (bp == FRED_INTERFACE_BP_HIT ||
+        (bp != FRED_INTERFACE_NO_BP && entryIndex >= (size_t) bp)) {
+      /* Nothing past a breakpoint runs before it is cleared. */
+      ready = false;
+    } else if (e->isBarrier) {
+      ready = __sync_fetch_and_add(&_entryIndex, 0) == entryIndex;
+      word = &_chainFutex.word;
+      turn = chainTurn;
+    } else {
+      for (int k = 0; k < 2 && ready; k++) {
+        uint32_t dep = e->dep[k];
+        if (dep != LOG_CHAIN_NONE && !_chains->entries[dep].done) {
+          ready = false;
+          if (_chains->entries[dep].isBarrier) {
+            word = &_chainFutex.word;
+            turn = chainTurn;
+          }
+        }
+      }
+    }
+    if (ready) {
+      break;
+    }
+    waitForFutexWord(word, turn);
+  }
+  __sync_synchronize();
+}
 
-#if 1
-  WRITE_ENTRY_TO_LOG(&_log[index + log_event_common_size], entry);
-#else
-  void *ptr;
-  GET_EVENT_DATA_PTR(entry, ptr);
-  memcpy(&_log[index + log_event_common_size], ptr, event_size);
-#endif
+/* The exec barrier belongs to no thread: whoever execs takes the head. */
+void dmtcp::SynchronizationLog::takeHeadEntry()
+{
+  chain_cursor = __sync_fetch_and_add(&_entryIndex, 0) - _chains->base;
+  chain_generation = _chains->generation;
+}
 
-  return log_event_common_size + event_size;
+/* Stops like advanceToNextEntry() does: once every entry before this one is
+   done, and until the breakpoint is cleared. */
+void dmtcp::SynchronizationLog::waitForChainBreakpoint(size_t entryIndex)
+{
+  while (__sync_fetch_and_add(&_entryIndex, 0) != entryIndex) {
+    usleep(1);
+  }
+  _sharedInterfaceInfo->breakpoint_at_index = FRED_INTERFACE_BP_HIT;
+  while (_sharedInterfaceInfo->breakpoint_at_index != FRED_INTERFACE_NO_BP) {
+    usleep(1);
+  }
 }
 
-size_t dmtcp::SynchronizationLog::getEntryHeaderAtOffset(log_entry_t& entry,
-                                                      size_t index)
+/* Marks the calling thread's entry done and moves the head over the entries
+   done so far. Returns 0 if that reached the end of the log. */
+int dmtcp::SynchronizationLog::advanceChains()
 {
-  size_t currentDataSize = getDataSize();
-  JASSERT ((index + log_event_common_size) <= currentDataSize)
-    (index) (currentDataSize);
+  size_t i = chain_cursor;
+  JASSERT(chain_generation == _chains->generation && i != LOG_CHAIN_NONE);
+  LogChainEntry *e = &_chains->entries[i];
+  size_t base = _chains->base;
 
-#ifdef NO_LOG_ENTRY_TO_BUFFER
-  memcpy(&entry.header, &_log[index], log_event_common_size);
-#else
-  char* buffer = &_log[index];
+  if (_sharedInterfaceInfo->breakpoint_at_index == (ssize_t) (base + i + 1)) {
+    waitForChainBreakpoint(base + i);
+  }
 
-  memcpy(&GET_COMMON(entry, event), buffer, sizeof(GET_COMMON(entry, event)));
-  buffer += sizeof(GET_COMMON(entry, event));
-  memcpy(&GET_COMMON(entry, isOptional), buffer, sizeof(GET_COMMON(entry, isOptional)));
-  buffer += sizeof(GET_COMMON(entry, isOptional));
-  memcpy(&GET_COMMON(entry, log_offset), buffer, sizeof(GET_COMMON(entry, log_offset)));
-  buffer += sizeof(GET_COMMON(entry, log_offset));
-  memcpy(&GET_COMMON(entry, clone_id), buffer, sizeof(GET_COMMON(entry, clone_id)));
-  buffer += sizeof(GET_COMMON(entry, clone_id));
-  memcpy(&GET_COMMON(entry, my_errno), buffer, sizeof(GET_COMMON(entry, my_errno)));
-  buffer += sizeof(GET_COMMON(entry, my_errno));
-  memcpy(&GET_COMMON(entry, retval), buffer, sizeof(GET_COMMON(entry, retval)));
-  buffer += sizeof(GET_COMMON(entry, retval));
+  chain_cursor = e->nextInThread;
+  if (e->anyClone) {
+    // Look the cursor up again for the next entry of this thread.
+    chain_generation = 0;
+  }
+  __sync_synchronize();
+  e->done = 1;
+  __sync_synchronize();
 
-  JASSERT((buffer - &_log[index]) == log_event_common_size)
-    (index) (log_event_common_size) (buffer);
-#endif
+  for (int k = 0; k < 2; k++) {
+    if (e->waiter[k] != LOG_CHAIN_NO_WAITER) {
+      wakeTurn(e->waiter[k]);
+    }
+  }
+  if (e->isBarrier) {
+    wakeFutexWord(&_chainFutex.word);
+  }
 
-  if (GET_COMMON(entry, clone_id) == 0) {
-    return 0;
+  /* Whoever moves the head past an entry checks the next one, so a done
+     entry never stays behind the head. */
+  int result = 1;
+  while (1) {
+    size_t head = __sync_fetch_and_add(&_entryIndex, 0);
+    size_t j = head - base;
+    if (j == _chains->numEntries || !_chains->entries[j].done) {
+      break;
+    }
+    if (__sync_bool_compare_and_swap(&_entryIndex, head, head + 1)) {
+      if (j + 1 == _chains->numEntries) {
+        result = 0;
+        break;
+      }
+      if (_chains->entries[j + 1].isBarrier) {
+        wakeFutexWord(&_chainFutex.word);
+      }
+      if (_chains->entries[j + 1].isSignal) {
+        wakeFutexWord(&_signalFutex.word);
+      }
+    }
   }
-  return log_event_common_size;
+
+  size_t offset = getIndex();
+  _sharedInterfaceInfo->current_log_entry_index = _entryIndex;
+  releaseSegmentsBefore(offset);
+  return result;
 }
 
-void dmtcp::SynchronizationLog::writeEntryHeaderAtOffset(const log_entry_t& entry,
-                                                        size_t index)
+/* Ticket replay, used unless replay is relaxed. The head of the log
+   (_entryIndex) is the ticket counter, and each entry's number is its
+   ticket. initStreams() links every entry to the next entry of the same
+   clone, using only the entry index. Each thread keeps a cursor to its own
+   next entry. It is its turn when the head reaches that entry, which is one
+   compare of two integers: the thread decodes nothing until then. Without
+   an index covering the rest of the log, threads wait on the head as
+   before. */
+static __thread size_t stream_cursor = 0;
+static __thread size_t stream_generation = 0;
+
+void dmtcp::SynchronizationLog::initStreams()
 {
+  size_t numEntries = this->numEntries();
+  if (_streams != NULL) {
+    if (_entryIndex >= _streams->base &&
+        _streams->base + _streams->numEntries == numEntries) {
+      // Restarted from a checkpoint taken during replay.
+      return;
+    }
+    destroyStreams();
+  }
+  if (_entryIndex >= numEntries || getIndexEntry(_entryIndex) == NULL ||
+      getIndexEntry(numEntries - 1) == NULL) {
+    JTRACE("Log is not indexed; replaying from the head of the log.")
+      (_entryIndex) (numEntries);
+    return;
+  }
+  JASSERT(numEntries - _entryIndex < LOG_CHAIN_NONE)
+    (numEntries) (_entryIndex);
+
+  LogStreams *streams = new LogStreams;
+  streams->base = _entryIndex;
+  streams->numEntries = numEntries - _entryIndex;
+  streams->mapSize = streams->numEntries * sizeof(uint32_t);
+  streams->next = (uint32_t *) _real_mmap(NULL, streams->mapSize,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  JASSERT(streams->next != MAP_FAILED) (JASSERT_ERRNO) (streams->mapSize);
+
+  dmtcp::map<clone_id_t, uint32_t> lastOfClone;
+  const LogIndexEntry *records = &_indexEntries[streams->base];
+  for (uint32_t i = 0; i < streams->numEntries; i++) {
+    clone_id_t clone_id = records[i].cloneId;
+    streams->next[i] = LOG_CHAIN_NONE;
+    if (clone_id == CLONE_ID_ANYONE) {
+      continue;
+    }
+    dmtcp::map<clone_id_t, uint32_t>::iterator it =
+      lastOfClone.find(clone_id);
+    if (it == lastOfClone.end()) {
+      streams->firstOfClone[clone_id] = i;
+      lastOfClone[clone_id] = i;
+    } else {
+      streams->next[it->second] = i;
+      it->second = i;
+    }
+  }
 
-  JASSERT(GET_COMMON(entry, clone_id) > 0);
-
-#ifdef NO_LOG_ENTRY_TO_BUFFER
-  memcpy(&_log[index], &entry.header, log_event_common_size);
-#else
-  char* buffer = &_log[index];
-
-  memcpy(buffer, &GET_COMMON(entry, event), sizeof(GET_COMMON(entry, event)));
-  buffer += sizeof(GET_COMMON(entry, event));
-  memcpy(buffer, &GET_COMMON(entry, isOptional), sizeof(GET_COMMON(entry, isOptional)));
-  buffer += sizeof(GET_COMMON(entry, isOptional));
-  memcpy(buffer, &GET_COMMON(entry, log_offset), sizeof(GET_COMMON(entry, log_offset)));
-  buffer += sizeof(GET_COMMON(entry, log_offset));
-  memcpy(buffer, &GET_COMMON(entry, clone_id), sizeof(GET_COMMON(entry, clone_id)));
-  buffer += sizeof(GET_COMMON(entry, clone_id));
-  memcpy(buffer, &GET_COMMON(entry, my_errno), sizeof(GET_COMMON(entry, my_errno)));
-  buffer += sizeof(GET_COMMON(entry, my_errno));
-  memcpy(buffer, &GET_COMMON(entry, retval), sizeof(GET_COMMON(entry, retval)));
-  buffer += sizeof(GET_COMMON(entry, retval));
+  streams->generation = __sync_add_and_fetch(&log_generation, 1);
+  __sync_synchronize();
+  _streams = streams;
+  JTRACE("Built replay streams.") (streams->base) (streams->numEntries);
+}
 
-  JASSERT((buffer - &_log[index]) == log_event_common_size)
-    (index) (log_event_common_size) (buffer);
-#endif
+void dmtcp::SynchronizationLog::destroyStreams()
+{
+  if (_streams == NULL) {
+    return;
+  }
+  _real_munmap(_streams->next, _streams->mapSize);
+  delete _streams;
+  _streams = NULL;
 }
 
-size_t dmtcp::SynchronizationLog::getIndex()
+/* Returns the next entry of the calling thread, relative to the base of the
+   streams, or LOG_CHAIN_NONE. */
+size_t dmtcp::SynchronizationLog::streamCursor(clone_id_t clone_id)
 {
-  return __sync_fetch_and_add(&_index, 0);
+  if (stream_generation != _streams->generation) {
+    dmtcp::map<clone_id_t, uint32_t>::iterator it =
+      _streams->firstOfClone.find(clone_id);
+    stream_cursor = it == _streams->firstOfClone.end() ? LOG_CHAIN_NONE
+                                                       : it->second;
+    stream_generation = _streams->generation;
+  }
+  return stream_cursor;
 }
 
-size_t dmtcp::SynchronizationLog::atomicIncrementIndex(log_off_t delta)
+/* Whether the head of the log is the next entry of the calling thread. The
+   cursor is moved over the entries of the thread that are already behind
+   the head, instead of when an entry is done: that also covers the entries
+   of the thread that were taken on its behalf, and it is still right when a
+   signal handler replays an entry in the middle of a turn check. */
+bool dmtcp::SynchronizationLog::isThreadTurn(clone_id_t clone_id)
 {
-  return __sync_fetch_and_add(&_index, delta);
+  size_t head = *(volatile size_t *) &_entryIndex - _streams->base;
+  size_t i = streamCursor(clone_id);
+  while (i != LOG_CHAIN_NONE && i < head) {
+    i = _streams->next[i];
+  }
+  stream_cursor = i;
+  return i == head;
 }
 
-size_t dmtcp::SynchronizationLog::atomicIncrementEntryIndex()
+int dmtcp::SynchronizationLog::getCurrentEntry(log_entry_t& entry)
 {
-  return __sync_fetch_and_add(&_entryIndex, 1);
+  LogDecodedHeader decoded;
+  if (_chains == NULL &&
+      getPrefetchedHeader(*(volatile size_t *) &_entryIndex, decoded)) {
+    entry.header = decoded.header;
+    size_t offset = decoded.header.log_offset;
+    pinSegments(offset, offset + decoded.size);
+    getEventData(entry, offset, decoded.size, decoded.data, decoded.raw);
+    unpinSegments(offset, offset + decoded.size);
+    return decoded.size;
+  }
+  int entrySize = getEntryAtOffset(entry, getIndex());
+  return entrySize;
 }
 
-/*
- * This function should be used instead of dereferencing _dataSize directly.
- * It adds error checking for NULL, and correct atomic functionality.
- */
-size_t dmtcp::SynchronizationLog::getDataSize()
+/* Reads only the header of the entry at the head of the log. This is what
+   turn checks need: the event data is decoded once, by getCurrentEntry(),
+   when the turn is ours. */
+int dmtcp::SynchronizationLog::getCurrentHeader(log_entry_header_t& header)
 {
-  if (_dataSize == NULL) {
-    return 0;
-  } else {
-    return __sync_fetch_and_add(_dataSize, 0);
+  LogDecodedHeader decoded;
+  if (_chains == NULL &&
+      getPrefetchedHeader(*(volatile size_t *) &_entryIndex, decoded)) {
+    header = decoded.header;
+    return decoded.size;
   }
+  return getHeaderAtOffset(header, getIndex());
 }
 
-/*
- * This function should be used instead of setting the value of
- * _dataSize directly.  It adds error checking for NULL, and correct
- * atomic functionality.
- */
-void dmtcp::SynchronizationLog::setDataSize(log_off_t newVal)
+void dmtcp::SynchronizationLog::resetPrefetch()
 {
-  JASSERT(_dataSize != NULL);
-  __sync_val_compare_and_swap(_dataSize, *_dataSize, newVal);
+  for (size_t i = 0; i < LOG_PREFETCH_ENTRIES; i++) {
+    _prefetched[i].entryIndex = LOG_PREFETCH_EMPTY;
+  }
+  _prefetchEnd = 0;
+  _prefetchOffset = 0;
+  _prefetchAdvised = 0;
+  _prefetchLock = 0;
 }
 
-void dmtcp::SynchronizationLog::incrementNumberThreads()
+/* FReD only runs on x86 (see memfence()), where stores are not reordered
+   with other stores, nor loads with other loads: the ring slots only need
+   the compiler to keep their accesses in order. */
+static inline void compilerBarrier() { asm volatile ("" ::: "memory"); }
+
+/* Copies the decoded header of the given entry out of the ring. Returns
+   false if the ring doesn't have it (any more). */
+inline bool
+dmtcp::SynchronizationLog::getPrefetchedHeader(size_t entryIndex,
+                                               LogDecodedHeader& decoded)
 {
-  if (_numThreads != NULL) {
-    __sync_fetch_and_add(_numThreads, 1);
+  LogDecodedHeader *slot = &_prefetched[entryIndex % LOG_PREFETCH_ENTRIES];
+  if (slot->entryIndex != entryIndex) {
+    return false;
   }
+  compilerBarrier();
+  decoded.data = slot->data;
+  decoded.size = slot->size;
+  decoded.raw = slot->raw;
+  decoded.header = slot->header;
+  compilerBarrier();
+  return slot->entryIndex == entryIndex;
 }
 
-inline log_off_t
-dmtcp::SynchronizationLog::atomicIncrementOffset(log_off_t delta)
+/* Called by the thread that just moved the head to entry 'entryIndex', at
+   'offset'. Once fewer than half of the ring is decoded ahead of the head,
+   decodes the headers of the entries up to LOG_PREFETCH_ENTRIES past it,
+   and advises in the log pages after them. The threads replaying those
+   entries are woken first, so this is off their path. If another thread is
+   already at it, the ring is left to it. */
+void dmtcp::SynchronizationLog::prefetchHeaders(size_t entryIndex,
+                                                size_t offset)
 {
-  JASSERT(_dataSize != NULL);
-  return __sync_fetch_and_add(_dataSize, delta);
+  if (_prefetchEnd >= entryIndex + LOG_PREFETCH_ENTRIES / 2 &&
+      _prefetchEnd <= entryIndex + LOG_PREFETCH_ENTRIES) {
+    return;
+  }
+  if (__sync_lock_test_and_set(&_prefetchLock, 1)) {
+    return;
+  }
+
+  size_t i = _prefetchEnd;
+  size_t o = _prefetchOffset;
+  if (i < entryIndex || i > entryIndex + LOG_PREFETCH_ENTRIES) {
+    // Behind the head (or the head was moved back): start over at it.
+    i = entryIndex;
+    o = offset;
+  }
+  size_t end = std::min(entryIndex + LOG_PREFETCH_ENTRIES, numEntries());
+  /* Pinned while decoding. The segments stay at the same address, and the
+     consumer of a slot pins its entry again to read the data (see
+     getCurrentEntry()). */
+  size_t pinBegin = o;
+  size_t pinEnd = o + (end - std::min(i, end)) * LOG_ENTRY_BUF_SIZE;
+  if (pinBegin < pinEnd) {
+    pinSegments(pinBegin, pinEnd);
+  }
+  for (; i < end; i++) {
+    LogDecodedHeader *slot = &_prefetched[i % LOG_PREFETCH_ENTRIES];
+    const char *data;
+    bool raw;
+    slot->entryIndex = LOG_PREFETCH_EMPTY;
+    compilerBarrier();
+    int entrySize = getHeaderAtOffset(slot->header, o, &data, &raw);
+    if (entrySize == 0) {
+      break;
+    }
+    slot->data = data;
+    slot->size = entrySize;
+    slot->raw = raw;
+    compilerBarrier();
+    slot->entryIndex = i;
+    o += entrySize;
+  }
+  if (pinBegin < pinEnd) {
+    unpinSegments(pinBegin, pinEnd);
+  }
+  _prefetchEnd = i;
+  _prefetchOffset = o;
+
+  if (o + LOG_PREFETCH_BYTES / 2 > _prefetchAdvised) {
+    size_t pageSize = DMTCP_PAGE_SIZE;
+    size_t begin = std::max(o, _prefetchAdvised) / pageSize * pageSize;
+    size_t adviseEnd = std::min(o + LOG_PREFETCH_BYTES, getDataSize());
+    if (begin < adviseEnd) {
+      ensureMapped(begin, adviseEnd);
+      _real_syscall(SYS_madvise, &_log[begin], adviseEnd - begin,
+                    MADV_WILLNEED);
+      _prefetchAdvised = adviseEnd;
+    }
+  }
+  __sync_lock_release(&_prefetchLock);
+}
+
+// Reads the entry from log and returns the length of entry
+int dmtcp::SynchronizationLog::getEntryAtOffset(log_entry_t& entry, size_t index)
+{
+  const char *data;
+  bool raw;
+  // No entry is longer than LOG_ENTRY_BUF_SIZE.
+  pinSegments(index, index + LOG_ENTRY_BUF_SIZE);
+  int entrySize = getHeaderAtOffset(entry.header, index, &data, &raw);
+  if (entrySize == 0) {
+    entry = EMPTY_LOG_ENTRY;
+  } else {
+    getEventData(entry, index, entrySize, data, raw);
+  }
+  unpinSegments(index, index + LOG_ENTRY_BUF_SIZE);
+  return entrySize;
+}
+
+/* Decodes the event data of the entry at 'index', whose header is already
+   in 'entry', from 'data' (see getHeaderAtOffset()). Returns entrySize. */
+int dmtcp::SynchronizationLog::getEventData(log_entry_t& entry, size_t index,
+                                            int entrySize, const char *data,
+                                            bool raw)
+{
+  size_t event_size = 0;
+  GET_EVENT_SIZE(GET_COMMON(entry, event), event_size);
+  if (!isCompact()) {
+#if 1
+    READ_ENTRY_FROM_LOG(data, entry);
+#else
+    void *ptr;
+    GET_EVENT_DATA_PTR(entry, ptr);
+    memcpy(ptr, data, event_size);
+#endif
+  } else if (raw) {
+    memcpy(&entry.event_data, data, event_size);
+  } else {
+    const char *end = getEventWords(data, (char *) &entry.event_data,
+                                    event_size);
+    JASSERT(end == &_log[index] + entrySize)
+      (index) (entrySize) (GET_COMMON(entry, event));
+  }
+
+  return entrySize;
+}
+
+/* Like getEntryAtOffset(), but reads only the header. If 'data' is not NULL,
+   it is set to the start of the entry's event data, and '*raw' to whether
+   that data is stored as is (fixed format and patchable compact entries);
+   the caller then pins the entry (see pinSegments()) while it reads them. */
+int dmtcp::SynchronizationLog::getHeaderAtOffset(log_entry_header_t& header,
+                                                 size_t index,
+                                                 const char **data, bool *raw)
+{
+  if (data != NULL) {
+    return decodeHeaderAtOffset(header, index, data, raw);
+  }
+  pinSegments(index, index + LOG_ENTRY_BUF_SIZE);
+  int entrySize = decodeHeaderAtOffset(header, index, NULL, NULL);
+  unpinSegments(index, index + LOG_ENTRY_BUF_SIZE);
+  return entrySize;
+}
+
+/* See getHeaderAtOffset(). The caller has pinned the entry. */
+int dmtcp::SynchronizationLog::decodeHeaderAtOffset(log_entry_header_t& header,
+                                                    size_t index,
+                                                    const char **data,
+                                                    bool *raw)
+{
+  size_t currentDataSize = getDataSize();
+  if (index == currentDataSize) {
+    memset(&header, 0, sizeof(header));
+    return 0;
+  }
+  if (isCompact()) {
+    return getCompactHeaderAtOffset(header, index, data, raw);
+  }
+  if (getEntryHeaderAtOffset(header, index) == 0) {
+    memset(&header, 0, sizeof(header));
+    return 0;
+  }
+
+  size_t event_size = 0;
+  JASSERT(header.event > 0);
+  GET_EVENT_SIZE(header.event, event_size);
+
+  if (index + log_event_common_size + event_size > currentDataSize) {
+    JASSERT ((index + log_event_common_size + event_size) <= currentDataSize)
+      (index) (log_event_common_size) (event_size) (currentDataSize);
+  }
+  if (data != NULL) {
+    *data = &_log[index + log_event_common_size];
+    *raw = true;
+  }
+
+  return log_event_common_size + event_size;
+}
+
+int dmtcp::SynchronizationLog::getCompactHeaderAtOffset(
+  log_entry_header_t& header, size_t index, const char **data, bool *raw)
+{
+  size_t currentDataSize = getDataSize();
+  const char *start = &_log[index];
+  uint64_t length, value;
+  const char *p = getVarint(start, &length);
+  if (length == 0) {
+    memset(&header, 0, sizeof(header));
+    return 0;
+  }
+  const char *end = p + length;
+  JASSERT(index + (end - start) <= currentDataSize)
+    (index) (length) (currentDataSize);
+
+  header.event = (event_code_t) (unsigned char) *p++;
+  unsigned char flags = *p++;
+  header.isOptional = (flags & COMPACT_OPTIONAL) ? 1 : 0;
+  header.log_offset = index;
+  p = getVarint(p, &value);
+  header.clone_id = (clone_id_t) value;
+
+  int event_size = -1;
+  JASSERT(header.event > 0);
+  GET_EVENT_SIZE(header.event, event_size);
+  JASSERT(event_size > 0) (header.event) (index);
+
+  if (flags & COMPACT_PATCHABLE) {
+    memcpy(&header.my_errno, p, sizeof(int));
+    p += sizeof(int);
+    memcpy(&header.retval, p, sizeof(void *));
+    p += sizeof(void *);
+    JASSERT(p + event_size == end) (index) (length) (header.event);
+  } else {
+    header.my_errno = 0;
+    if (flags & COMPACT_HAS_ERRNO) {
+      p = getVarint(p, &value);
+      header.my_errno = (int) unzigzag(value);
+    }
+    p = getVarint(p, &value);
+    header.retval = (void *) (intptr_t) unzigzag(value);
+  }
+  if (data != NULL) {
+    *data = p;
+    *raw = (flags & COMPACT_PATCHABLE) != 0;
+  }
+
+  return end - start;
+}
+
+/* Encodes the entry into buf, which must hold LOG_ENTRY_BUF_SIZE bytes, and
+   returns the encoded size. In the compact format, patchable entries have
+   the size that reserveEntry() set aside for them. */
+int dmtcp::SynchronizationLog::encodeEntry(const log_entry_t& entry, char *buf,
+                                           bool patchable)
+{
+  int event_size = -1;
+  GET_EVENT_SIZE(GET_COMMON(entry, event), event_size);
+  JASSERT( event_size > 0 );
+
+  if (!isCompact()) {
+    writeEntryHeader(entry, buf);
+#if 1
+    WRITE_ENTRY_TO_LOG(buf + log_event_common_size, entry);
+#else
+    void *ptr;
+    GET_EVENT_DATA_PTR(entry, ptr);
+    memcpy(buf + log_event_common_size, ptr, event_size);
+#endif
+    return log_event_common_size + event_size;
+  }
+
+  JASSERT(GET_COMMON(entry, clone_id) > 0);
+  JASSERT(GET_COMMON(entry, event) < 256) (GET_COMMON(entry, event));
+
+  int my_errno = GET_COMMON(entry, my_errno);
+  unsigned char flags = 0;
+  if (GET_COMMON(entry, isOptional)) {
+    flags |= COMPACT_OPTIONAL;
+  }
+  if (patchable) {
+    flags |= COMPACT_PATCHABLE;
+  } else if (my_errno != 0) {
+    flags |= COMPACT_HAS_ERRNO;
+  }
+
+  /* Leave room for the length in front of the body. */
+  char *body = buf + VARINT_MAX_SIZE;
+  char *p = body;
+  *p++ = (char) GET_COMMON(entry, event);
+  *p++ = (char) flags;
+  p = putVarint(p, GET_COMMON(entry, clone_id));
+
+  const char *data = (const char *) &entry.event_data;
+  if (patchable) {
+    memcpy(p, &my_errno, sizeof(int));
+    p += sizeof(int);
+    memcpy(p, &GET_COMMON(entry, retval), sizeof(void *));
+    p += sizeof(void *);
+    memcpy(p, data, event_size);
+    p += event_size;
+  } else {
+    if (flags & COMPACT_HAS_ERRNO) {
+      p = putVarint(p, zigzag(my_errno));
+    }
+    p = putVarint(p, zigzag((intptr_t) GET_COMMON(entry, retval)));
+    p = putEventWords(p, data, event_size);
+  }
+
+  size_t length = p - body;
+  char *lengthEnd = putVarint(buf, length);
+  memmove(lengthEnd, body, length);
+  return (lengthEnd - buf) + length;
+}
+
+/* Records where an entry recorded into a per-thread chunk went. */
+inline void dmtcp::SynchronizationLog::indexEntry(size_t entryIndex,
+                                                  log_off_t offset,
+                                                  const log_entry_t& entry)
+{
+  if (_indexHeader == NULL || entryIndex >= LOG_INDEX_MAX_ENTRIES) {
+    return;
+  }
+  if (entryIndex >= _indexHeader->fileEntries) {
+    growIndex(entryIndex + 1);
+  }
+  LogIndexEntry *e = &_indexEntries[entryIndex];
+  e->offset = offset;
+  e->cloneId = GET_COMMON(entry, clone_id);
+  e->event = GET_COMMON(entry, event);
+}
+
+/* Reserves entrySize bytes at the end of the log (or of the calling
+   thread's chunk) and returns their offset. In per-thread chunk mode, the
+   sequence number of the entry goes in front of it, see publishEntry(). */
+log_off_t dmtcp::SynchronizationLog::reserveSpace(int entrySize,
+                                                  log_seq_t *seq)
+{
+  if (!usesPerThreadChunks()) {
+    log_off_t offset = atomicIncrementOffset(entrySize);
+    __sync_fetch_and_add(_numEntries, 1);
+    return offset;
+  }
+
+  size_t needed = sizeof(log_seq_t) + entrySize;
+  JASSERT(needed <= LOG_CHUNK_SIZE) (needed);
+
+  if (chunk_generation != _chunkGeneration || chunk_pos + needed > chunk_end) {
+    // The unused tail of the old chunk stays zero-filled.
+    chunk_pos = atomicIncrementOffset(LOG_CHUNK_SIZE);
+    chunk_end = chunk_pos + LOG_CHUNK_SIZE;
+    chunk_generation = _chunkGeneration;
+    JASSERT((LOG_OFFSET_FROM_START + chunk_end) < *_size)
+      ( *_size ) .Text ("Log size too small. Please increase MAX_LOG_LENGTH"
+                        " in synchronizationlogging.h");
+    ensureMapped(chunk_pos, chunk_end);
+  }
+
+  log_off_t offset = chunk_pos + sizeof(log_seq_t);
+  *seq = __sync_fetch_and_add(_nextSequence, 1);
+  chunk_pos += needed;
+  return offset;
+}
+
+/* Writes the sequence number of the chunk entry at offset. It is written
+   after the entry, so that a sequence number without LOG_SEQ_PENDING always
+   refers to a complete entry. */
+void dmtcp::SynchronizationLog::publishEntry(log_off_t offset, log_seq_t seq)
+{
+  __sync_synchronize();
+  memcpy(&_log[offset - sizeof(log_seq_t)], &seq, sizeof(seq));
+}
+
+void dmtcp::SynchronizationLog::appendEntry(log_entry_t& entry)
+{
+  char buf[LOG_ENTRY_BUF_SIZE];
+  log_seq_t seq = 0;
+
+  beginWrite();
+  int entrySize = encodeEntry(entry, buf, false);
+  log_off_t offset = reserveSpace(entrySize, &seq);
+  SET_COMMON2(entry, log_offset, offset);
+  if (!isCompact()) {
+    // The fixed-size header records the offset.
+    writeEntryHeader(entry, buf);
+  }
+  writeEncodedEntry(buf, entrySize, offset);
+  if (usesPerThreadChunks()) {
+    indexEntry(seq - 1, offset, entry);
+    publishEntry(offset, seq);
+  }
+  endWrite();
+}
+
+/* Size of the entry in the patchable encoding, which doesn't depend on the
+   values that commitEntry() fills in. In the compact format, *bodySize is
+   set to the size after the length. */
+int dmtcp::SynchronizationLog::reservedEntrySize(const log_entry_t& entry,
+                                                 size_t *bodySize)
+{
+  int event_size = -1;
+  GET_EVENT_SIZE(GET_COMMON(entry, event), event_size);
+  JASSERT(event_size > 0);
+  if (!isCompact()) {
+    return log_event_common_size + event_size;
+  }
+  *bodySize = 2 + varintSize(GET_COMMON(entry, clone_id)) +
+              sizeof(int) + sizeof(void *) + event_size;
+  return varintSize(*bodySize) + *bodySize;
+}
+
+/* First half of logging an entry whose fields are only known after the real
+   call (see isPatchableEvent()): takes its place in the log order and sets
+   its log_offset, so that entries logged during the real call come after
+   it. Only the header is written, so that the log stays well-formed if a
+   checkpoint comes before commitEntry(); the rest of the entry is written
+   once, by commitEntry(). In per-thread chunk mode, the sequence number is
+   written with LOG_SEQ_PENDING until then. */
+void dmtcp::SynchronizationLog::reserveEntry(log_entry_t& entry)
+{
+  JASSERT(isPatchableEvent(GET_COMMON(entry, event)));
+  char buf[LOG_ENTRY_BUF_SIZE];
+  log_seq_t seq = 0;
+
+  // The write ends in commitEntry().
+  beginWrite();
+  size_t bodySize = 0;
+  int entrySize = reservedEntrySize(entry, &bodySize);
+  log_off_t offset = reserveSpace(entrySize, &seq);
+  SET_COMMON2(entry, log_offset, offset);
+
+  int headerSize;
+  if (!isCompact()) {
+    writeEntryHeader(entry, buf);
+    headerSize = log_event_common_size;
+  } else {
+    char *p = putVarint(buf, bodySize);
+    *p++ = (char) GET_COMMON(entry, event);
+    *p++ = (char) (COMPACT_PATCHABLE |
+                   (GET_COMMON(entry, isOptional) ? COMPACT_OPTIONAL : 0));
+    p = putVarint(p, GET_COMMON(entry, clone_id));
+    headerSize = p - buf;
+  }
+  writeEncodedEntry(buf, headerSize, offset);
+  if (usesPerThreadChunks()) {
+    indexEntry(seq - 1, offset, entry);
+    publishEntry(offset, seq | LOG_SEQ_PENDING);
+  }
+}
+
+/* Sorts the entries of all per-thread chunks by sequence number and writes
+   them back as a plain sequence starting at chunkedStart. Afterwards the log
+   looks exactly like one recorded without chunks, so that waitForTurn() and
+   the checkpoint markers work unchanged. Must not run while other threads
+   are appending. */
+void dmtcp::SynchronizationLog::mergeLogs()
+{
+  size_t start = *_chunkedStart;
+  size_t end = getDataSize();
+  if (start >= end) {
+    return;
+  }
+
+  ensureMapped(start, end);
+  dmtcp::vector<LogChunkEntry> entries;
+  size_t mergedSize = 0;
+  size_t firstEntry = *_numEntries;
+  size_t numChunked = *_nextSequence - 1 - firstEntry;
+  bool fromIndex = false;
+
+  /* The index has the chunk offset of every entry, in order. An entry it
+     misses (or got wrong) means scanning the chunks and sorting instead. */
+  if (_indexHeader != NULL &&
+      firstEntry + numChunked <= _indexHeader->fileEntries) {
+    for (size_t i = 0; i < numChunked; i++) {
+      LogChunkEntry e;
+      log_seq_t seq = 0;
+      e.seq = firstEntry + i + 1;
+      e.offset = _indexEntries[firstEntry + i].offset;
+      if (e.offset < start + sizeof(log_seq_t) || e.offset >= end) {
+        break;
+      }
+      memcpy(&seq, &_log[e.offset - sizeof(log_seq_t)], sizeof(seq));
+      if ((seq & ~LOG_SEQ_PENDING) != e.seq) {
+        break;
+      }
+      log_entry_header_t header;
+      e.size = getHeaderAtOffset(header, e.offset);
+      JASSERT(e.size > 0) (e.offset) (e.seq);
+      entries.push_back(e);
+      mergedSize += e.size;
+    }
+    fromIndex = numChunked > 0 && entries.size() == numChunked;
+    if (!fromIndex) {
+      entries.clear();
+      mergedSize = 0;
+    }
+  }
+
+  for (size_t chunk = start; !fromIndex && chunk + LOG_CHUNK_SIZE <= end;
+       chunk += LOG_CHUNK_SIZE) {
+    size_t pos = chunk;
+    while (pos + sizeof(log_seq_t) < chunk + LOG_CHUNK_SIZE) {
+      LogChunkEntry e;
+      memcpy(&e.seq, &_log[pos], sizeof(e.seq));
+      if (e.seq == 0) {
+        break;
+      }
+      /* Still pending: reserved before a checkpoint, never committed. It
+         keeps its place in the order. */
+      e.seq &= ~LOG_SEQ_PENDING;
+      log_entry_header_t header;
+      e.offset = pos + sizeof(log_seq_t);
+      e.size = getHeaderAtOffset(header, e.offset);
+      JASSERT(e.size > 0) (e.offset) (e.seq);
+      entries.push_back(e);
+      mergedSize += e.size;
+      pos = e.offset + e.size;
+    }
+  }
+  if (!fromIndex) {
+    std::sort(entries.begin(), entries.end(), chunkEntryLessThan);
+  }
+
+  /* Entries are re-encoded at their new offsets: that keeps log_offset
+     consistent in the fixed format, and drops COMPACT_PATCHABLE in the
+     compact one, so the merged log may be a little larger or smaller. Each
+     entry grows by at most VARINT_MAX_SIZE bytes. */
+  size_t bufSize = mergedSize + entries.size() * VARINT_MAX_SIZE;
+  mergedSize = 0;
+  if (entries.size() > 0) {
+    SET_IN_MMAP_WRAPPER();
+    char *buf = (char*) _real_mmap(NULL, bufSize, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    UNSET_IN_MMAP_WRAPPER();
+    JASSERT(buf != MAP_FAILED) (JASSERT_ERRNO) (bufSize);
+
+    if (_indexHeader != NULL) {
+      growIndex(firstEntry + entries.size());
+    }
+    char *ptr = buf;
+    for (size_t i = 0; i < entries.size(); i++) {
+      log_entry_t temp_entry = EMPTY_LOG_ENTRY;
+      getEntryAtOffset(temp_entry, entries[i].offset);
+      SET_COMMON2(temp_entry, log_offset, start + (ptr - buf));
+      if (_indexHeader != NULL &&
+          firstEntry + i < _indexHeader->fileEntries) {
+        indexEntry(firstEntry + i, start + (ptr - buf), temp_entry);
+      }
+      ptr += encodeEntry(temp_entry, ptr, false);
+    }
+    mergedSize = ptr - buf;
+    JASSERT(mergedSize <= bufSize) (mergedSize) (bufSize);
+    JASSERT((LOG_OFFSET_FROM_START + start + mergedSize) < *_size)
+      ( *_size ) .Text ("Log size too small. Please increase MAX_LOG_LENGTH"
+                        " in synchronizationlogging.h");
+    ensureMapped(start, start + mergedSize);
+    memcpy(&_log[start], buf, mergedSize);
+    _real_munmap(buf, bufSize);
+  }
+  if (start + mergedSize < end) {
+    memset(&_log[start + mergedSize], 0, end - start - mergedSize);
+  }
+
+  *_dataSize = start + mergedSize;
+  *_numEntries += entries.size();
+  *_chunkedStart = *_dataSize;
+  *_nextSequence = *_numEntries + 1;
+  if (_indexHeader != NULL && indexedEntries() == firstEntry) {
+    _indexHeader->numEntries = std::min((size_t) *_numEntries,
+                                        (size_t) _indexHeader->fileEntries);
+  }
+
+  JTRACE("Merged per-thread chunks.")
+    (start) (end) (mergedSize) (entries.size());
+}
+
+/* Ring mode: retires all entries recorded so far. Must be called at a
+   checkpoint, while no thread is appending, and before destroy() saves the
+   markers; replay from that checkpoint starts right at the retired
+   boundary. The file range of the retired entries becomes a hole, which
+   frees their disk blocks and drops them from the page cache.
+
+   Unless a thread was stopped in the middle of writing an entry (see
+   beginWrite()), the log then starts over at offset 0, so that the range of
+   offsets, and of addresses, is reused. Entry numbers keep growing. A
+   thread that was stopped would write its entry into the reused range, so
+   then the offsets go on from where they are, as if nothing was retired,
+   and the entry is dropped (see commitEntry()). */
+void dmtcp::SynchronizationLog::retireEntries()
+{
+  if (_startAddr == NULL || !usesRing()) {
+    return;
+  }
+
+  size_t offset = getDataSize();
+  size_t entries;
+  if (usesPerThreadChunks()) {
+    // Nothing is merged: the unmerged chunks are all retired.
+    entries = __sync_fetch_and_add(_nextSequence, 0) - 1;
+    *_numEntries = entries;
+  } else {
+    entries = __sync_fetch_and_add(_numEntries, 0);
+  }
+  *_retiredEntries = entries;
+
+  /* Starting over needs the whole range zeroed: merging walks the chunks
+     up to the first zero sequence number. Otherwise, the page holding the
+     first live entry is kept. */
+  bool rebase = __sync_fetch_and_add(&_writers, 0) == 0;
+  size_t length = rebase ? offset : offset - offset % DMTCP_PAGE_SIZE;
+  if (length > 0 &&
+      _real_syscall(SYS_fallocate, _fd,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    (off_t) LOG_OFFSET_FROM_START, (off_t) length) != 0) {
+    JTRACE("Could not punch a hole into the log; retired entries keep"
+           " their disk blocks.") (JASSERT_ERRNO) (length);
+    rebase = false;
+  }
+  if (rebase) {
+    offset = 0;
+    *_dataSize = 0;
+  }
+  if (usesPerThreadChunks()) {
+    *_chunkedStart = offset;
+  }
+  *_retiredOffset = offset;
+
+  /* Likewise for the index records of the retired entries, past the page of
+     the index header. */
+  if (_indexHeader != NULL && _indexFd != -1) {
+    size_t begin = (sizeof(LogIndexHeader) + DMTCP_PAGE_SIZE - 1) /
+                   DMTCP_PAGE_SIZE * DMTCP_PAGE_SIZE;
+    size_t end = sizeof(LogIndexHeader) +
+                 std::min(entries, (size_t) _indexHeader->fileEntries) *
+                 sizeof(LogIndexEntry);
+    end -= end % DMTCP_PAGE_SIZE;
+    if (begin < end &&
+        _real_syscall(SYS_fallocate, _indexFd,
+                      FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      (off_t) begin, (off_t) (end - begin)) != 0) {
+      JTRACE("Could not punch a hole into the log index.")
+        (JASSERT_ERRNO) (begin) (end);
+    }
+  }
+  JTRACE("Retired log entries.") (offset) (entries) (rebase);
+}
+
+/* Returns the offset of the entry with the given index: from the index if
+   it has the entry, else by walking the log from the last entry it has (or
+   from the oldest live entry). */
+size_t dmtcp::SynchronizationLog::offsetOfEntryIndex(size_t entryIndex)
+{
+  log_entry_header_t header;
+  JASSERT(entryIndex >= *_retiredEntries) (entryIndex) (*_retiredEntries)
+    .Text("Entry was retired from the log (ring mode).");
+  size_t indexed = _indexHeader == NULL ? 0 : _indexHeader->numEntries;
+  if (entryIndex < indexed) {
+    return _indexEntries[entryIndex].offset;
+  }
+  size_t i = *_retiredEntries;
+  size_t offset = *_retiredOffset;
+  if (indexed > i) {
+    i = indexed - 1;
+    offset = _indexEntries[i].offset;
+  }
+  for (; i < entryIndex; i++) {
+    int entrySize = getHeaderAtOffset(header, offset);
+    JASSERT(entrySize > 0) (i) (entryIndex);
+    offset += entrySize;
+  }
+  return offset;
+}
+
+/* Moves the head of the log to the given entry, for tools walking the log
+   (fred_read_log). Replay itself never skips entries. */
+void dmtcp::SynchronizationLog::seekToEntry(size_t entryIndex)
+{
+  JASSERT(_chains == NULL);
+  JASSERT(entryIndex <= numEntries()) (entryIndex) (numEntries());
+  _index = offsetOfEntryIndex(entryIndex);
+  _entryIndex = entryIndex;
+
+  log_entry_header_t header;
+  getCurrentHeader(header);
+  _sharedInterfaceInfo->current_clone_id = header.clone_id;
+  _sharedInterfaceInfo->current_log_entry_index = _entryIndex;
+}
+
+/* Reads the entry with the given index. Returns 0 past the last entry. */
+int dmtcp::SynchronizationLog::getEntryByIndex(size_t entryIndex,
+                                               log_entry_t& entry)
+{
+  if (entryIndex >= numEntries()) {
+    entry = EMPTY_LOG_ENTRY;
+    return 0;
+  }
+  return getEntryAtOffset(entry, offsetOfEntryIndex(entryIndex));
+}
+
+/* Returns the index record of the entry (its clone id and event), or NULL
+   if the entry is not indexed or was retired. */
+const LogIndexEntry *
+dmtcp::SynchronizationLog::getIndexEntry(size_t entryIndex)
+{
+  if (_indexHeader == NULL || entryIndex < *_retiredEntries ||
+      entryIndex >= _indexHeader->numEntries) {
+    return NULL;
+  }
+  return &_indexEntries[entryIndex];
+}
+
+/* Maps the entry index of the log, creating it if needed. A log without
+   entries starts with an empty index. Without an index, entries are found
+   by walking the log. */
+void dmtcp::SynchronizationLog::mapIndex()
+{
+  LogMetadata *metadata = (LogMetadata *) _startAddr;
+  dmtcp::string path = _path + LOG_INDEX_SUFFIX;
+  size_t length = sizeof(LogIndexHeader) +
+                  LOG_INDEX_MAX_ENTRIES * sizeof(LogIndexEntry);
+  if (SYNC_IS_NOOP) {
+    mapPrivateIndex(path, length);
+    return;
+  }
+
+  int fd = _real_open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    JTRACE("Could not open the log index.") (path) (JASSERT_ERRNO);
+    return;
+  }
+
+  int flags = MAP_SHARED | MAP_NORESERVE;
+  void *addr = metadata->recordedIndexAddr;
+  if (addr != NULL) {
+    flags |= MAP_FIXED;
+  }
+  SET_IN_MMAP_WRAPPER();
+  // The file is grown by growIndex() as entries are added.
+  void *index = _real_mmap(addr, length, PROT_READ | PROT_WRITE, flags,
+                           fd, 0);
+  UNSET_IN_MMAP_WRAPPER();
+  JASSERT(index != MAP_FAILED) (JASSERT_ERRNO) (path) (length);
+  if (SYNC_IS_RECORD) {
+    metadata->recordedIndexAddr = index;
+  }
+
+  _indexFd = fd;
+  _indexHeader = (LogIndexHeader *) index;
+  _indexEntries = (LogIndexEntry *) (_indexHeader + 1);
+
+  off_t fileSize = _real_lseek(fd, 0, SEEK_END);
+  if (fileSize < (off_t) sizeof(LogIndexHeader) ||
+      _indexHeader->magic != LOG_INDEX_MAGIC || getDataSize() == 0) {
+    JASSERT(_real_syscall(SYS_ftruncate, fd, 0) == 0 &&
+            _real_syscall(SYS_ftruncate, fd, sizeof(LogIndexHeader)) == 0)
+      (JASSERT_ERRNO) (path);
+    _indexHeader->magic = LOG_INDEX_MAGIC;
+    _indexHeader->numEntries = 0;
+    _indexHeader->fileEntries = 0;
+  }
+}
+
+/* Tools reading the log (fred_read_log) have their own address space and
+   must not write the index file: they map what there is of it privately,
+   over anonymous memory in which buildIndex() indexes the rest. */
+void dmtcp::SynchronizationLog::mapPrivateIndex(const dmtcp::string& path,
+                                                size_t length)
+{
+  SET_IN_MMAP_WRAPPER();
+  void *index = _real_mmap(NULL, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+  JASSERT(index != MAP_FAILED) (JASSERT_ERRNO) (length);
+  _indexHeader = (LogIndexHeader *) index;
+  _indexEntries = (LogIndexEntry *) (_indexHeader + 1);
+
+  int fd = _real_open(path.c_str(), O_RDONLY);
+  off_t fileSize = fd == -1 ? 0 : _real_lseek(fd, 0, SEEK_END);
+  if (fileSize >= (off_t) sizeof(LogIndexHeader)) {
+    // Bytes past the end of the file in its last page read as zero.
+    size_t fileLength = std::min((size_t) fileSize, length);
+    void *addr = _real_mmap(index, fileLength, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_FIXED, fd, 0);
+    JASSERT(addr == index) (JASSERT_ERRNO) (path) (fileLength);
+  }
+  UNSET_IN_MMAP_WRAPPER();
+  if (fd != -1) {
+    _real_close(fd);
+  }
+
+  if (fileSize < (off_t) sizeof(LogIndexHeader) ||
+      _indexHeader->magic != LOG_INDEX_MAGIC || getDataSize() == 0) {
+    _indexHeader->magic = LOG_INDEX_MAGIC;
+    _indexHeader->numEntries = 0;
+    _indexHeader->fileEntries = 0;
+  }
+}
+
+void dmtcp::SynchronizationLog::unmapIndex()
+{
+  if (_indexHeader == NULL) {
+    return;
+  }
+  _real_munmap(_indexHeader, sizeof(LogIndexHeader) +
+               LOG_INDEX_MAX_ENTRIES * sizeof(LogIndexEntry));
+  if (_indexFd != -1) {
+    _real_close(_indexFd);
+  }
+  _indexFd = -1;
+  _indexHeader = NULL;
+  _indexEntries = NULL;
+}
+
+/* Makes room in the index file for numEntries entries. */
+void dmtcp::SynchronizationLog::growIndex(size_t numEntries)
+{
+  numEntries = std::min(numEntries, (size_t) LOG_INDEX_MAX_ENTRIES);
+  lockSegments();
+  if (numEntries > _indexHeader->fileEntries) {
+    size_t fileEntries = (numEntries + LOG_INDEX_GROW_ENTRIES - 1) /
+                         LOG_INDEX_GROW_ENTRIES * LOG_INDEX_GROW_ENTRIES;
+    fileEntries = std::min(fileEntries, (size_t) LOG_INDEX_MAX_ENTRIES);
+    off_t fileSize = sizeof(LogIndexHeader) +
+                     fileEntries * sizeof(LogIndexEntry);
+    // A private index (see mapPrivateIndex()) has no file to extend.
+    JASSERT(_indexFd == -1 ||
+            _real_syscall(SYS_ftruncate, _indexFd, fileSize) == 0)
+      (JASSERT_ERRNO) (fileSize) .Text("Could not extend the log index.");
+    __sync_synchronize();
+    _indexHeader->fileEntries = fileEntries;
+  }
+  unlockSegments();
+}
+
+/* Entries before this one are in the index, or retired. */
+size_t dmtcp::SynchronizationLog::indexedEntries()
+{
+  if (_indexHeader == NULL) {
+    return 0;
+  }
+  return std::max((size_t) _indexHeader->numEntries, *_retiredEntries);
+}
+
+/* Indexes the entries past the indexed part of the log, by walking them.
+   The whole log must be mapped in. */
+void dmtcp::SynchronizationLog::buildIndex()
+{
+  size_t first = indexedEntries();
+  if (_indexHeader == NULL || first >= numEntries()) {
+    return;
+  }
+  size_t offset = offsetOfEntryIndex(first);
+  growIndex(numEntries());
+  size_t last = std::min(numEntries(), (size_t) _indexHeader->fileEntries);
+  for (size_t i = first; i < last; i++) {
+    log_entry_header_t header;
+    int entrySize = getHeaderAtOffset(header, offset);
+    JASSERT(entrySize > 0) (i) (offset);
+    LogIndexEntry *e = &_indexEntries[i];
+    e->offset = offset;
+    e->cloneId = header.clone_id;
+    e->event = header.event;
+    offset += entrySize;
+  }
+  _indexHeader->numEntries = last;
+  JTRACE("Indexed the log.") (first) (last);
+}
+
+/* Second half of reserveEntry(): writes the whole entry into its slot and
+   publishes it. */
+void dmtcp::SynchronizationLog::commitEntry(const log_entry_t& entry)
+{
+  JASSERT(isPatchableEvent(GET_COMMON(entry, event)));
+  JASSERT(GET_COMMON(entry, log_offset) != INVALID_LOG_OFFSET);
+
+  /* A thread checkpointed between reserveEntry() and commitEntry() must not
+     write its entry once the chunks have been merged: it has moved, and lost
+     its fixed-size encoding. */
+  if (usesPerThreadChunks() && !SYNC_IS_RECORD) {
+    endWrite();
+    return;
+  }
+  /* Likewise, the entry may have been retired at that checkpoint. */
+  if (GET_COMMON(entry, log_offset) < *_retiredOffset) {
+    endWrite();
+    return;
+  }
+
+  log_off_t offset = GET_COMMON(entry, log_offset);
+  size_t bodySize;
+  int entrySize = writeEntryAtOffset(entry, offset, true);
+  JASSERT(entrySize == reservedEntrySize(entry, &bodySize)) (entrySize);
+  if (usesPerThreadChunks()) {
+    log_seq_t seq;
+    memcpy(&seq, &_log[offset - sizeof(log_seq_t)], sizeof(seq));
+    JASSERT(seq & LOG_SEQ_PENDING) (seq) (offset);
+    publishEntry(offset, seq & ~LOG_SEQ_PENDING);
+  }
+  endWrite();
+}
+
+/* Move appropriate markers to the end, so that we enter "append" mode. */
+void dmtcp::SynchronizationLog::moveMarkersToEnd()
+{
+  _index = getDataSize();
+  _entryIndex = *_numEntries;
+}
+
+int dmtcp::SynchronizationLog::writeEntryAtOffset(const log_entry_t& entry,
+                                                  size_t index, bool patchable)
+{
+  char buf[LOG_ENTRY_BUF_SIZE];
+  int entrySize = encodeEntry(entry, buf, patchable);
+  writeEncodedEntry(buf, entrySize, index);
+  return entrySize;
+}
+
+void dmtcp::SynchronizationLog::writeEncodedEntry(char *buf, int entrySize,
+                                                  size_t index)
+{
+  if (__builtin_expect(_startAddr == 0, 0)) {
+    JASSERT(false);
+  }
+
+  JASSERT ((LOG_OFFSET_FROM_START + index + entrySize) < *_size)
+    ( *_size ) .Text ("Log size too small. Please increase MAX_LOG_LENGTH"
+                      " in synchronizationlogging.h");
+
+  ensureMapped(index, index + entrySize);
+  memcpy(&_log[index], buf, entrySize);
+}
+
+size_t dmtcp::SynchronizationLog::getEntryHeaderAtOffset(log_entry_header_t& header,
+                                                      size_t index)
+{
+  size_t currentDataSize = getDataSize();
+  JASSERT ((index + log_event_common_size) <= currentDataSize)
+    (index) (currentDataSize);
+
+#ifdef NO_LOG_ENTRY_TO_BUFFER
+  memcpy(&header, &_log[index], log_event_common_size);
+#else
+  char* buffer = &_log[index];
+
+  memcpy(&header.event, buffer, sizeof(header.event));
+  buffer += sizeof(header.event);
+  memcpy(&header.isOptional, buffer, sizeof(header.isOptional));
+  buffer += sizeof(header.isOptional);
+  memcpy(&header.log_offset, buffer, sizeof(header.log_offset));
+  buffer += sizeof(header.log_offset);
+  memcpy(&header.clone_id, buffer, sizeof(header.clone_id));
+  buffer += sizeof(header.clone_id);
+  memcpy(&header.my_errno, buffer, sizeof(header.my_errno));
+  buffer += sizeof(header.my_errno);
+  memcpy(&header.retval, buffer, sizeof(header.retval));
+  buffer += sizeof(header.retval);
+
+  JASSERT((buffer - &_log[index]) == log_event_common_size)
+    (index) (log_event_common_size) (buffer);
+#endif
+
+  if (header.clone_id == 0) {
+    return 0;
+  }
+  return log_event_common_size;
+}
+
+void dmtcp::SynchronizationLog::writeEntryHeader(const log_entry_t& entry,
+                                                char *start)
+{
+
+  JASSERT(GET_COMMON(entry, clone_id) > 0);
+
+#ifdef NO_LOG_ENTRY_TO_BUFFER
+  memcpy(start, &entry.header, log_event_common_size);
+#else
+  char* buffer = start;
+
+  memcpy(buffer, &GET_COMMON(entry, event), sizeof(GET_COMMON(entry, event)));
+  buffer += sizeof(GET_COMMON(entry, event));
+  memcpy(buffer, &GET_COMMON(entry, isOptional), sizeof(GET_COMMON(entry, isOptional)));
+  buffer += sizeof(GET_COMMON(entry, isOptional));
+  memcpy(buffer, &GET_COMMON(entry, log_offset), sizeof(GET_COMMON(entry, log_offset)));
+  buffer += sizeof(GET_COMMON(entry, log_offset));
+  memcpy(buffer, &GET_COMMON(entry, clone_id), sizeof(GET_COMMON(entry, clone_id)));
+  buffer += sizeof(GET_COMMON(entry, clone_id));
+  memcpy(buffer, &GET_COMMON(entry, my_errno), sizeof(GET_COMMON(entry, my_errno)));
+  buffer += sizeof(GET_COMMON(entry, my_errno));
+  memcpy(buffer, &GET_COMMON(entry, retval), sizeof(GET_COMMON(entry, retval)));
+  buffer += sizeof(GET_COMMON(entry, retval));
+
+  JASSERT((buffer - start) == log_event_common_size)
+    (log_event_common_size) (buffer);
+#endif
+}
+
+size_t dmtcp::SynchronizationLog::getIndex()
+{
+  if (_chains != NULL) {
+    size_t i = __sync_fetch_and_add(&_entryIndex, 0) - _chains->base;
+    return i < _chains->numEntries ? _chains->entries[i].offset
+                                   : getDataSize();
+  }
+  return __sync_fetch_and_add(&_index, 0);
+}
+
+size_t dmtcp::SynchronizationLog::atomicIncrementIndex(log_off_t delta)
+{
+  return __sync_fetch_and_add(&_index, delta);
+}
+
+size_t dmtcp::SynchronizationLog::atomicIncrementEntryIndex()
+{
+  return __sync_fetch_and_add(&_entryIndex, 1);
+}
+
+/*
+ * This function should be used instead of dereferencing _dataSize directly.
+ * It adds error checking for NULL, and correct atomic functionality.
+ */
+size_t dmtcp::SynchronizationLog::getDataSize()
+{
+  if (_dataSize == NULL) {
+    return 0;
+  } else {
+    return __sync_fetch_and_add(_dataSize, 0);
+  }
+}
+
+/*
+ * This function should be used instead of setting the value of
+ * _dataSize directly.  It adds error checking for NULL, and correct
+ * atomic functionality.
+ */
+void dmtcp::SynchronizationLog::setDataSize(log_off_t newVal)
+{
+  JASSERT(_dataSize != NULL);
+  __sync_val_compare_and_swap(_dataSize, *_dataSize, newVal);
+}
+
+void dmtcp::SynchronizationLog::incrementNumberThreads()
+{
+  if (_numThreads != NULL) {
+    __sync_fetch_and_add(_numThreads, 1);
+  }
+}
+
+inline log_off_t
+dmtcp::SynchronizationLog::atomicIncrementOffset(log_off_t delta)
+{
+  JASSERT(_dataSize != NULL);
+  log_off_t offset = __sync_fetch_and_add(_dataSize, delta);
+  size_t window = (offset + delta) / LOG_PREFAULT_BYTES;
+  if (__builtin_expect(offset / LOG_PREFAULT_BYTES != window, 0)) {
+    prefaultAhead((window + 1) * LOG_PREFAULT_BYTES,
+                  (window + 2) * LOG_PREFAULT_BYTES);
+  } else if (__builtin_expect(offset == 0, 0)) {
+    prefaultAhead(0, 2 * LOG_PREFAULT_BYTES);
+  }
+  return offset;
+}
+
+/* Makes the data bytes [begin, end) accessible. */
+inline void dmtcp::SynchronizationLog::ensureMapped(size_t begin, size_t end)
+{
+  if (__builtin_expect(begin >= _mappedBegin && end <= _mappedEnd, 1)) {
+    return;
+  }
+  mapSegments(begin, end);
+}
+
+/* Keeps the segments of the data bytes [begin, end) from being released
+   until unpinSegments(begin, end), and maps the part of them in the log. A
+   reader can hold an offset long after the head has moved on, e.g. when it
+   is preempted in a turn check; the pin is taken before the mapped window
+   is checked, see releaseSegmentsBefore(). */
+void dmtcp::SynchronizationLog::pinSegments(size_t begin, size_t end)
+{
+  size_t segmentSize = *_segmentSize;
+  for (size_t segment = begin / segmentSize;
+       segment <= (end - 1) / segmentSize; segment++) {
+    __sync_fetch_and_add(&_segmentPins[segment % LOG_SEGMENT_PIN_SLOTS].count,
+                         1);
+  }
+  end = std::min(end, getDataSize());
+  if (begin < end) {
+    ensureMapped(begin, end);
+  }
+}
+
+void dmtcp::SynchronizationLog::unpinSegments(size_t begin, size_t end)
+{
+  size_t segmentSize = *_segmentSize;
+  for (size_t segment = begin / segmentSize;
+       segment <= (end - 1) / segmentSize; segment++) {
+    __sync_fetch_and_sub(&_segmentPins[segment % LOG_SEGMENT_PIN_SLOTS].count,
+                         1);
+  }
+}
+
+bool dmtcp::SynchronizationLog::segmentPinned(size_t segment)
+{
+  return _segmentPins[segment % LOG_SEGMENT_PIN_SLOTS].count != 0;
+}
+
+void dmtcp::SynchronizationLog::lockSegments()
+{
+  while (__sync_lock_test_and_set(&_segmentLock, 1)) {
+    _real_syscall(SYS_sched_yield);
+  }
+}
+
+void dmtcp::SynchronizationLog::unlockSegments()
+{
+  __sync_lock_release(&_segmentLock);
+}
+
+/* Grows the mapped window of segments to cover [begin, end), extending the
+   file when recording reaches a new segment. */
+void dmtcp::SynchronizationLog::mapSegments(size_t begin, size_t end)
+{
+  JASSERT(_startAddr != NULL);
+  JASSERT((LOG_OFFSET_FROM_START + end) <= *_size)
+    ( end ) ( *_size ) .Text ("Log size too small. Please increase"
+                              " MAX_LOG_LENGTH in synchronizationlogging.h");
+
+  lockSegments();
+  size_t segmentSize = *_segmentSize;
+  size_t first = begin / segmentSize;
+  size_t last = (end + segmentSize - 1) / segmentSize;
+  size_t mappedFirst = _mappedBegin / segmentSize;
+  size_t mappedLast = _mappedEnd / segmentSize;
+  if (mappedFirst == mappedLast) {
+    mappedFirst = mappedLast = first;
+  }
+
+  if (last > *_numSegments) {
+    JASSERT(SYNC_IS_RECORD) (end) (*_numSegments);
+    off_t fileSize = LOG_OFFSET_FROM_START + last * segmentSize;
+    JASSERT(_real_syscall(SYS_ftruncate, _fd, fileSize) == 0)
+      (JASSERT_ERRNO) (fileSize) .Text("Could not extend the log file.");
+    *_numSegments = last;
+  }
+
+  for (size_t segment = std::min(first, mappedFirst);
+       segment < std::max(last, mappedLast); segment++) {
+    if (segment < mappedFirst || segment >= mappedLast) {
+      mapSegment(segment);
+    }
+  }
+
+  if (SYNC_IS_RECORD && last > mappedLast) {
+    /* Recording appends near the end of the log, so drop the pages of older
+       segments from memory; they are kept in the file. A late write, e.g. by
+       commitEntry() or to the chunk of an idle thread, faults them back. */
+    size_t kept = LOG_SEGMENTS_KEPT_BEHIND + 1;
+    size_t oldKeptFrom = mappedLast > kept ? mappedLast - kept : 0;
+    size_t keptFrom = last - std::min(last, kept);
+    for (size_t segment = std::max(oldKeptFrom, std::min(first, mappedFirst));
+         segment < keptFrom; segment++) {
+      _real_syscall(SYS_madvise, &_log[segment * segmentSize], segmentSize,
+                    MADV_DONTNEED);
+    }
+  }
+
+  __sync_synchronize();
+  _mappedBegin = std::min(first, mappedFirst) * segmentSize;
+  _mappedEnd = std::max(last, mappedLast) * segmentSize;
+  unlockSegments();
+}
+
+void dmtcp::SynchronizationLog::mapSegment(size_t segment)
+{
+  size_t segmentSize = *_segmentSize;
+  size_t offset = segment * segmentSize;
+  // The reserved range may end within the last segment (see fred_read_log).
+  size_t length = std::min(segmentSize,
+                           *_size - LOG_OFFSET_FROM_START - offset);
+  int flags = (SYNC_IS_NOOP ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED |
+              (SYNC_IS_RECORD ? MAP_NORESERVE : 0);
+
+  SET_IN_MMAP_WRAPPER();
+  void *addr = _real_mmap(&_log[offset], length, PROT_READ | PROT_WRITE,
+                          flags, _fd, LOG_OFFSET_FROM_START + offset);
+  UNSET_IN_MMAP_WRAPPER();
+  JASSERT(addr == &_log[offset]) (JASSERT_ERRNO) (segment) (addr);
+
+  if (usesHugepages()) {
+    _real_syscall(SYS_madvise, addr, length, MADV_HUGEPAGE);
+  }
+  if (!SYNC_IS_RECORD) {
+    // Replay reads the log front to back; see also dropPagesBefore().
+    _real_syscall(SYS_madvise, addr, length, MADV_SEQUENTIAL);
+  }
+}
+
+/* Unmaps the segments that replay has left LOG_SEGMENTS_KEPT_BEHIND
+   segments behind, up to the first one pinned by a reader (see
+   pinSegments()).
+   Within the segments still mapped, the pages LOG_DROP_BEHIND_BYTES behind
+   the head are dropped. fred_read_log calls it behind the blocks it has
+   written out. */
+void dmtcp::SynchronizationLog::releaseSegmentsBefore(size_t offset)
+{
+  if (SYNC_IS_RECORD || _mergedPrivately) {
+    return;
+  }
+  if (offset >= _droppedBefore + 2 * LOG_DROP_BEHIND_BYTES) {
+    dropPagesBefore(offset - LOG_DROP_BEHIND_BYTES);
+  }
+  if (offset < _mappedBegin +
+      (LOG_SEGMENTS_KEPT_BEHIND + 1) * *_segmentSize) {
+    return;
+  }
+
+  lockSegments();
+  size_t segmentSize = *_segmentSize;
+  size_t begin = _mappedBegin;
+  size_t end = std::min((offset / segmentSize - LOG_SEGMENTS_KEPT_BEHIND) *
+                        segmentSize, (size_t) _mappedEnd);
+  if (begin < end) {
+    /* A reader pins its segments, then checks _mappedBegin; this moves
+       _mappedBegin, then checks the pins. Either the reader sees the
+       segment gone and maps it again (under _segmentLock, so after this),
+       or the segment is kept. */
+    _mappedBegin = end;
+    __sync_synchronize();
+    for (size_t segment = begin / segmentSize; segment < end / segmentSize;
+         segment++) {
+      if (segmentPinned(segment)) {
+        end = segment * segmentSize;
+        _mappedBegin = end;
+        break;
+      }
+    }
+  }
+  if (begin < end) {
+    // Put the reservation back in place of the segments.
+    SET_IN_MMAP_WRAPPER();
+    void *addr = _real_mmap(&_log[begin], end - begin, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+                            MAP_FIXED, -1, 0);
+    UNSET_IN_MMAP_WRAPPER();
+    JASSERT(addr == &_log[begin]) (JASSERT_ERRNO) (begin) (end);
+  }
+  unlockSegments();
+}
+
+/* Drops the log pages before offset that replay has not dropped yet: they
+   are marked for early reclaim from the page cache (MADV_COLD, which older
+   kernels reject) and unmapped from the process (MADV_DONTNEED). The file
+   keeps them, so a late reader just faults them back in. The caller that
+   moves _droppedBefore drops the range. */
+void dmtcp::SynchronizationLog::dropPagesBefore(size_t offset)
+{
+  size_t begin = _droppedBefore;
+  size_t end = offset / DMTCP_PAGE_SIZE * DMTCP_PAGE_SIZE;
+  if (end <= begin ||
+      !__sync_bool_compare_and_swap(&_droppedBefore, begin, end)) {
+    return;
+  }
+  // Released segments are gone already.
+  begin = std::max(begin, (size_t) _mappedBegin);
+  if (begin < end) {
+    _real_syscall(SYS_madvise, &_log[begin], end - begin, MADV_COLD);
+    _real_syscall(SYS_madvise, &_log[begin], end - begin, MADV_DONTNEED);
+  }
+}
+
+/* Faults in the log pages [begin, end) for writing, so that the recording
+   threads find them mapped. Without MADV_POPULATE_WRITE (Linux 5.14), each
+   page is touched with a locked add of zero, which leaves a concurrent
+   write to the same page intact. */
+void dmtcp::SynchronizationLog::prefaultAhead(size_t begin, size_t end)
+{
+  static bool canPopulate = true;
+
+  end = std::min(end, *_size - LOG_OFFSET_FROM_START);
+  if (begin >= end) {
+    return;
+  }
+  ensureMapped(begin, end);
+  if (canPopulate) {
+    if (_real_syscall(SYS_madvise, &_log[begin], end - begin,
+                      MADV_POPULATE_WRITE) == 0) {
+      return;
+    }
+    canPopulate = false;
+  }
+  for (size_t offset = begin; offset < end; offset += DMTCP_PAGE_SIZE) {
+    __sync_fetch_and_add(&_log[offset], 0);
+  }
 }
@@ -29,6 +29,7 @@
 #include "synchronizationlogging.h"
 #include "fred_interface.h"
 #include <unistd.h>
+#include <stdint.h>
 
 #define DMTCP_PAGE_SIZE sysconf(_SC_PAGESIZE)
 
@@ -41,6 +42,175 @@
 
 #define LOG_OFFSET_FROM_START DMTCP_PAGE_SIZE
 
+/* The log data is a chain of segments of LogMetadata::segmentSize bytes.
+   Segment i is stored at file offset LOG_OFFSET_FROM_START + i * segmentSize
+   and mapped at the same offset from the start of the log. map_in() only
+   reserves the address range of the whole log (LogMetadata::size); segments
+   are mapped into it when they are first accessed, and the file is extended
+   as recording reaches new segments. Entries can therefore straddle segments
+   and are still read and written as _log[offset]. */
+#ifndef LOG_SEGMENT_SIZE
+#define LOG_SEGMENT_SIZE ((size_t)64 * 1024 * 1024)
+#endif
+/* Number of segments behind the current position that stay resident. Older
+   segments are dropped (record) or unmapped (replay). */
+#define LOG_SEGMENTS_KEPT_BEHIND 2
+/* A reader pins the segments of the entries it decodes (see pinSegments()),
+   and releaseSegmentsBefore() keeps a pinned segment and those after it.
+   Segment i is counted in slot i % LOG_SEGMENT_PIN_SLOTS; a segment sharing
+   a slot with a pinned one is only kept a little longer. */
+#define LOG_SEGMENT_PIN_SLOTS 16
+/* A new log reserves its address range at a multiple of this, so that data
+   offsets and file offsets agree on huge page boundaries. */
+#define LOG_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+/* While recording, the thread whose reservation crosses a multiple of
+   LOG_PREFAULT_BYTES in the log faults in the next LOG_PREFAULT_BYTES past
+   it (see prefaultAhead()), so the other threads rarely fault on a new
+   page. */
+#define LOG_PREFAULT_BYTES ((size_t)1024 * 1024)
+/* While replaying, the pages more than LOG_DROP_BEHIND_BYTES behind the head
+   are dropped from the process and marked for early reclaim, that much at a
+   time. Reading them again, e.g. after going back to an earlier checkpoint,
+   simply faults them back in. */
+#define LOG_DROP_BEHIND_BYTES ((size_t)1024 * 1024)
+
+/* Entry encodings, stored in LogMetadata::format. Logs recorded before the
+   format was versioned have 0 there. See log.cpp for the compact layout. */
+#define LOG_FORMAT_FIXED   0
+#define LOG_FORMAT_COMPACT 1
+
+/* Large enough for any entry, encoded in any format. */
+#define LOG_ENTRY_BUF_SIZE (2 * sizeof(log_entry_t))
+
+/* Bits stored in LogMetadata::flags. They are fixed when recording starts
+   and describe how the entries of this log are laid out. */
+#define LOG_FLAG_PER_THREAD_CHUNKS 0x1
+/* Ring mode: at every checkpoint taken while recording, the entries before
+   it are retired with retireEntries(). Their disk blocks and page cache are
+   given back, and so are those of their index records and of the read data
+   they refer to. Offsets then start over at 0, so the address range is
+   reused too; entry numbers keep growing. Replay can then only start from
+   the latest record-mode checkpoint. */
+#define LOG_FLAG_RING 0x2
+/* Arena mode: the malloc family is served by a per-thread arena (see
+   fred_mallocwrappers.cpp) at LogMetadata::mallocArenaAddr, and is not
+   logged. */
+#define LOG_FLAG_MALLOC_ARENA 0x4
+/* Relaxed replay: instead of following the single order of the log, replay
+   follows per-resource happens-before chains (see initChains() in log.cpp).
+   An entry on a mutex, condition variable, rwlock, fd or the heap only waits
+   for the previous entry on the same resource and for the previous entry of
+   its own thread; any other entry is a barrier. */
+#define LOG_FLAG_RELAXED_REPLAY 0x8
+/* Huge pages: the segments are advised MADV_HUGEPAGE. This takes effect
+   where the kernel backs file mappings with transparent huge pages, e.g. a
+   log on tmpfs mounted with huge=advise. */
+#define LOG_FLAG_HUGEPAGES 0x10
+
+/* In per-thread chunk mode, every thread reserves LOG_CHUNK_SIZE bytes of the
+   log with a single atomic add and then writes its entries there without
+   touching any shared word except the sequence counter. Each entry in a chunk
+   is prefixed by its log_seq_t sequence number; a zero sequence number marks
+   the unused tail of a chunk. */
+#define LOG_CHUNK_SIZE ((size_t)64 * 1024)
+#define LOG_CACHE_LINE_SIZE 64
+
+typedef uint64_t log_seq_t;
+/* Set in the sequence number of an entry reserved by reserveEntry() until
+   commitEntry() completes it. */
+#define LOG_SEQ_PENDING ((log_seq_t) 1 << 63)
+
+/* During replay, a thread waiting for its turn sleeps on the futex word of
+   its clone_id slot. advanceToNextEntry() bumps and wakes only the slot of
+   the clone_id owning the new head of the log. Two clone_ids sharing a slot
+   merely cause a spurious wakeup. The timeout is a safety net for turns that
+   arrive without an advance (e.g. the log running out). */
+#define LOG_TURN_FUTEX_SLOTS 256
+#define LOG_TURN_FUTEX_TIMEOUT_NS (10 * 1000 * 1000)
+
+typedef struct LogTurnFutex {
+  int word;
+} __attribute__ ((aligned (LOG_CACHE_LINE_SIZE))) LogTurnFutex;
+
+typedef struct LogSegmentPin {
+  volatile int count;
+} __attribute__ ((aligned (LOG_CACHE_LINE_SIZE))) LogSegmentPin;
+
+/* During replay (in log order), the thread that moves the head of the log
+   also decodes the headers of the entries after it, LOG_PREFETCH_ENTRIES at
+   most, into a ring of LogDecodedHeader slots. Turn checks, the signal
+   thread and advanceToNextEntry() then copy the header from the ring
+   instead of decoding the log, whatever its format. A slot is marked empty
+   while it is written; readers check its entry number before and after
+   copying it. The log pages up to LOG_PREFETCH_BYTES past the decoded
+   entries are advised in (MADV_WILLNEED). */
+#define LOG_PREFETCH_ENTRIES 256
+#define LOG_PREFETCH_BYTES ((size_t)256 * 1024)
+#define LOG_PREFETCH_EMPTY ((size_t) -1)
+
+typedef struct LogDecodedHeader {
+  volatile size_t entryIndex;
+  /* Start of the event data of the entry, see getHeaderAtOffset(). */
+  const char *data;
+  int size;
+  char raw;
+  log_entry_header_t header;
+} __attribute__ ((aligned (LOG_CACHE_LINE_SIZE))) LogDecodedHeader;
+
+/* The sidecar entry index, in the file <log path>LOG_INDEX_SUFFIX: a
+   LogIndexHeader followed by one LogIndexEntry per entry number. It gives the
+   offset of any entry without walking the log (see offsetOfEntryIndex()).
+   Recording into per-thread chunks fills it in as entries are reserved, with
+   their offset in the chunk. mergeLogs() then takes the entries in order from
+   it instead of scanning and sorting the chunks, and writes back the merged
+   offsets. Logs recorded without chunks are indexed in a single pass the
+   first time they are opened for replay. At 16 bytes per entry, the index
+   takes more room than the compact entries it points to (fredbench.py
+   log-index). */
+#define LOG_INDEX_SUFFIX ".idx"
+#define LOG_INDEX_MAGIC 0x3158444944455246ULL /* "FREDIDX1" */
+/* Entries past this number are not indexed, and are found by walking. */
+#define LOG_INDEX_MAX_ENTRIES (MAX_LOG_LENGTH / 4 / sizeof(LogIndexEntry))
+/* The file grows by this many entries at a time. */
+#define LOG_INDEX_GROW_ENTRIES ((size_t)1 << 20)
+
+typedef struct LogIndexHeader {
+  uint64_t magic;
+  /* Entries 0 .. numEntries-1 have their final offsets. Past that, the
+     offsets are in per-thread chunks, and 0 if the entry was not indexed. */
+  uint64_t numEntries;
+  /* The file has room for this many entries. */
+  uint64_t fileEntries;
+  uint64_t unused[5];
+} LogIndexHeader;
+
+typedef struct LogIndexEntry {
+  uint64_t offset;
+  int32_t  cloneId;
+  uint16_t event;
+  uint16_t unused;
+} LogIndexEntry;
+
+/* Entry numbers in the chains are relative to LogChains::base. */
+#define LOG_CHAIN_NONE ((uint32_t) -1)
+#define LOG_CHAIN_NO_WAITER ((clone_id_t) -1)
+
+typedef struct LogChainEntry {
+  size_t offset;
+  /* Entries that must be done before this one, besides the previous entry
+     of the same thread. */
+  uint32_t dep[2];
+  uint32_t nextInThread;
+  /* Clone ids to wake when this entry is done: the owners of the next entry
+     on each of its resources, if that entry depends on this one. */
+  clone_id_t waiter[2];
+  char isBarrier;
+  /* Set for entries that any thread may take (the exec barrier). */
+  char anyClone;
+  char isSignal;
+  volatile char done;
+} LogChainEntry;
+
 namespace dmtcp
 {
   typedef struct LogMetadata {
@@ -50,8 +220,52 @@ namespace dmtcp
     size_t numThreads;
     void * recordedStartAddr;
     void * recordedSharedInterfaceInfoMapAddr;
+    size_t format;
+    size_t flags;
+    /* Offset of the first per-thread chunk. Everything before it is a plain
+       sequence of entries in replay order. */
+    size_t chunkedStart;
+    /* The segment table: segments 0 .. numSegments-1 exist in the file. */
+    size_t segmentSize;
+    size_t numSegments;
+    /* Entries before retiredOffset, retiredEntries of them, were retired
+       (ring mode); the live part of the log starts there. */
+    size_t retiredOffset;
+    size_t retiredEntries;
+    /* Address of the malloc arena reservation (arena mode), or NULL until
+       it is made. */
+    void * mallocArenaAddr;
+    /* Where the entry index is mapped, so that replay maps it at the same
+       place. */
+    void * recordedIndexAddr;
+    /* Next sequence number to hand out. Kept on its own cache line so that
+       recording threads don't bounce the line holding dataSize. */
+    log_seq_t nextSequence __attribute__ ((aligned (LOG_CACHE_LINE_SIZE)));
   } LogMetadata;
 
+  /* Relaxed replay state. It lives in process memory, so a checkpoint taken
+     during relaxed replay carries the done entries past the head with it. */
+  typedef struct LogChains {
+    size_t generation;
+    size_t base;
+    size_t numEntries;
+    size_t mapSize;
+    LogChainEntry *entries;
+    dmtcp::map<clone_id_t, uint32_t> firstOfClone;
+  } LogChains;
+
+  /* Ticket replay state: the stream of entries of each clone, taken from the
+     entry index. next[i] is the next entry of the clone of entry base + i,
+     relative to base. Like the chains, it lives in process memory. */
+  typedef struct LogStreams {
+    size_t generation;
+    size_t base;
+    size_t numEntries;
+    size_t mapSize;
+    uint32_t *next;
+    dmtcp::map<clone_id_t, uint32_t> firstOfClone;
+  } LogStreams;
+
   class SynchronizationLog
   {
     public:
@@ -76,7 +290,38 @@ namespace dmtcp
         , _sharedInterfaceInfo (NULL)
         , _entryOffsetMarker (0)
         , _entryIndexMarker (0)
-      {}
+        , _format (NULL)
+        , _flags (NULL)
+        , _chunkedStart (NULL)
+        , _nextSequence (NULL)
+        , _chunkGeneration (0)
+        , _fd (-1)
+        , _segmentSize (NULL)
+        , _numSegments (NULL)
+        , _retiredOffset (NULL)
+        , _retiredEntries (NULL)
+        , _mallocArenaAddr (NULL)
+        , _mappedBegin (0)
+        , _mappedEnd (0)
+        , _segmentLock (0)
+        , _droppedBefore (0)
+        , _mergedPrivately (false)
+        , _writers (0)
+        , _chains (NULL)
+        , _streams (NULL)
+        , _indexFd (-1)
+        , _indexHeader (NULL)
+        , _indexEntries (NULL)
+        , _prefetchEnd (0)
+        , _prefetchOffset (0)
+        , _prefetchAdvised (0)
+        , _prefetchLock (0)
+      {
+        memset(_turnFutex, 0, sizeof(_turnFutex));
+        memset(_segmentPins, 0, sizeof(_segmentPins));
+        memset(&_chainFutex, 0, sizeof(_chainFutex));
+        memset(&_signalFutex, 0, sizeof(_signalFutex));
+      }
 
       ~SynchronizationLog() {}
 
@@ -103,23 +348,112 @@ namespace dmtcp
       void * getRecordedStartAddr() { return _recordedStartAddr == NULL ? NULL : *_recordedStartAddr; }
       bool   isMappedIn() { return _startAddr != NULL; }
       string getPath() { return _path; }
-      void   mergeLogs(dmtcp::vector<clone_id_t> clone_ids);
+      bool   isCompact()
+      { return _format != NULL && *_format == LOG_FORMAT_COMPACT; }
+      bool   usesPerThreadChunks()
+      { return _flags != NULL && (*_flags & LOG_FLAG_PER_THREAD_CHUNKS); }
+      bool   usesRing()
+      { return _flags != NULL && (*_flags & LOG_FLAG_RING); }
+      bool   usesMallocArena()
+      { return _flags != NULL && (*_flags & LOG_FLAG_MALLOC_ARENA); }
+      void * getMallocArenaAddr() { return *_mallocArenaAddr; }
+      void   setMallocArenaAddr(void *addr) { *_mallocArenaAddr = addr; }
+      bool   usesRelaxedReplay()
+      { return _flags != NULL && (*_flags & LOG_FLAG_RELAXED_REPLAY); }
+      bool   usesHugepages()
+      { return _flags != NULL && (*_flags & LOG_FLAG_HUGEPAGES); }
+      bool   replaysByChains() { return _chains != NULL; }
+      bool   replaysByTickets() { return _streams != NULL; }
+      void   mergeLogs();
+      void   retireEntries();
+      void   seekToEntry(size_t entryIndex);
+      int    getEntryByIndex(size_t entryIndex, log_entry_t& entry);
+      const LogIndexEntry *getIndexEntry(size_t entryIndex);
+      void   releaseSegmentsBefore(size_t offset);
 
+      int    turnFutexValue(clone_id_t clone_id);
+      void   waitForTurnChange(clone_id_t clone_id, int oldValue);
+      int    signalFutexValue();
+      void   waitForSignalEntry(int oldValue);
       int    advanceToNextEntry();
       int    getCurrentEntry(log_entry_t& entry);
+      int    getCurrentHeader(log_entry_header_t& header);
       void   appendEntry(log_entry_t& entry);
-      void   updateEntry(const log_entry_t& entry);
+      void   reserveEntry(log_entry_t& entry);
+      void   commitEntry(const log_entry_t& entry);
       void   moveMarkersToEnd();
 
+      void   initChains();
+      void   initStreams();
+      bool   isThreadTurn(clone_id_t clone_id);
+      int    getThreadEntry(clone_id_t clone_id, log_entry_t& entry);
+      int    getThreadHeader(clone_id_t clone_id, log_entry_header_t& header);
+      void   waitForThreadEntryDeps(clone_id_t clone_id);
+      void   takeHeadEntry();
+
     private:
       void   resetIndex() { _index = 0; _entryIndex = 0; }
+      /* Ring mode counts the threads writing an entry: retireEntries() only
+         reuses the offsets if a checkpoint stopped none of them. */
+      void   beginWrite()
+      { if (usesRing()) __sync_fetch_and_add(&_writers, 1); }
+      void   endWrite()
+      { if (usesRing()) __sync_fetch_and_sub(&_writers, 1); }
       void   resetMarkers()
       { resetIndex(); *_dataSize = 0; *_numEntries = 0; *_numThreads = 0; }
 
-      int    writeEntryAtOffset(const log_entry_t& entry, size_t index);
-      void   writeEntryHeaderAtOffset(const log_entry_t& entry, size_t index);
-      size_t getEntryHeaderAtOffset(log_entry_t& entry, size_t index);
+      void   wakeTurn(clone_id_t clone_id);
+      void   destroyChains();
+      void   destroyStreams();
+      size_t streamCursor(clone_id_t clone_id);
+      int    advanceChains();
+      size_t chainCursor(clone_id_t clone_id);
+      void   waitForChainBreakpoint(size_t entryIndex);
+      log_off_t reserveSpace(int entrySize, log_seq_t *seq);
+      void   publishEntry(log_off_t offset, log_seq_t seq);
+      int    reservedEntrySize(const log_entry_t& entry, size_t *bodySize);
+      size_t offsetOfEntryIndex(size_t entryIndex);
+
+      void   mapIndex();
+      void   mapPrivateIndex(const dmtcp::string& path, size_t length);
+      void   unmapIndex();
+      void   growIndex(size_t numEntries);
+      void   buildIndex();
+      size_t indexedEntries();
+      inline void indexEntry(size_t entryIndex, log_off_t offset,
+                             const log_entry_t& entry);
+
+      inline void ensureMapped(size_t begin, size_t end);
+      void   pinSegments(size_t begin, size_t end);
+      void   unpinSegments(size_t begin, size_t end);
+      bool   segmentPinned(size_t segment);
+      void   mapSegments(size_t begin, size_t end);
+      void   mapSegment(size_t segment);
+      void   dropPagesBefore(size_t offset);
+      void   prefaultAhead(size_t begin, size_t end);
+      void   lockSegments();
+      void   unlockSegments();
+
+      int    encodeEntry(const log_entry_t& entry, char *buf, bool patchable);
+      void   writeEncodedEntry(char *buf, int entrySize, size_t index);
+      int    writeEntryAtOffset(const log_entry_t& entry, size_t index,
+                                bool patchable);
+      void   writeEntryHeader(const log_entry_t& entry, char *buffer);
+      size_t getEntryHeaderAtOffset(log_entry_header_t& header, size_t index);
+      int    getCompactHeaderAtOffset(log_entry_header_t& header, size_t index,
+                                      const char **data, bool *raw);
+      int    getHeaderAtOffset(log_entry_header_t& header, size_t index,
+                               const char **data = NULL, bool *raw = NULL);
+      int    decodeHeaderAtOffset(log_entry_header_t& header, size_t index,
+                                  const char **data, bool *raw);
       int    getEntryAtOffset(log_entry_t& entry, size_t index);
+      int    getEventData(log_entry_t& entry, size_t index, int entrySize,
+                          const char *data, bool raw);
+
+      void   resetPrefetch();
+      void   prefetchHeaders(size_t entryIndex, size_t offset);
+      inline bool getPrefetchedHeader(size_t entryIndex,
+                                      LogDecodedHeader& decoded);
 
       inline log_off_t atomicIncrementOffset(log_off_t delta);
       size_t atomicIncrementIndex(log_off_t delta);
@@ -141,6 +475,46 @@ namespace dmtcp
       fred_interface_info_t *_sharedInterfaceInfo;
       size_t _entryOffsetMarker;
       size_t _entryIndexMarker;
+      size_t *_format;
+      size_t *_flags;
+      size_t *_chunkedStart;
+      log_seq_t *_nextSequence; // Must be modified atomically.
+      size_t _chunkGeneration;
+      int     _fd;          // Kept open to map in and extend segments.
+      size_t *_segmentSize;
+      size_t *_numSegments; // Only modified under _segmentLock.
+      size_t *_retiredOffset;
+      size_t *_retiredEntries;
+      void  **_mallocArenaAddr;
+      /* Data offsets [_mappedBegin, _mappedEnd) are mapped in this process.
+         Both are segment aligned and only change under _segmentLock. */
+      volatile size_t _mappedBegin;
+      volatile size_t _mappedEnd;
+      int     _segmentLock;
+      LogSegmentPin _segmentPins[LOG_SEGMENT_PIN_SLOTS];
+      volatile size_t _droppedBefore; // Pages before it dropped by replay.
+      bool    _mergedPrivately; // Merged in a private view; see map_in().
+      volatile int _writers;    // See beginWrite().
+      LogTurnFutex _turnFutex[LOG_TURN_FUTEX_SLOTS];
+      LogChains *_chains;
+      LogStreams *_streams;
+      /* Waited on for barriers: bumped when a barrier entry is done and when
+         the head reaches one. */
+      LogTurnFutex _chainFutex;
+      /* Waited on by the replay signal thread: bumped when the head reaches
+         a signal_handler entry. */
+      LogTurnFutex _signalFutex;
+      int     _indexFd;
+      LogIndexHeader *_indexHeader;
+      LogIndexEntry *_indexEntries;
+      LogDecodedHeader _prefetched[LOG_PREFETCH_ENTRIES];
+      /* Entries before _prefetchEnd were decoded into the ring; the next one
+         is at _prefetchOffset. Both, and the ring slots, are only written
+         under _prefetchLock. */
+      size_t  _prefetchEnd;
+      size_t  _prefetchOffset;
+      size_t  _prefetchAdvised; // Log pages before this offset were advised.
+      int     _prefetchLock;
   };
 
 }
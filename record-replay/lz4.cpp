@@ -0,0 +1,210 @@
+/****************************************************************************
+ * Copyright (C) 2009, 2010, 2011, 2012 by Kapil Arya, Gene Cooperman,      *
+ *                                     Tyler Denniston, and Ana-Maria Visan *
+ * {kapil,gene,tyler,amvisan}@ccs.neu.edu                                   *
+ *                                                                          *
+ * This file is part of FReD.                                               *
+ *                                                                          *
+ * FReD is free software: you can redistribute it and/or modify             *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, either version 3 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * FReD is distributed in the hope that it will be useful,                  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with FReD.  If not, see <http://www.gnu.org/licenses/>.            *
+ ****************************************************************************/
+
+/* The LZ4 block format is a sequence of (literals, match) pairs. Each one
+   starts with a token byte: the high nibble is the number of literals, the
+   low nibble the match length minus LZ4_MIN_MATCH, and a nibble of 15 means
+   that more length bytes follow (each adding up to 255). The literals come
+   next, then the match offset as two little-endian bytes. The last sequence
+   has literals only. */
+
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+/* The last LZ4_LAST_LITERALS bytes are always literals, and no match starts
+   in the last LZ4_MATCH_LIMIT bytes, as the format requires. */
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+/* The compressor skips ahead faster the longer it hasn't found a match, so
+   that incompressible data costs little. */
+#define LZ4_SKIP_SHIFT 6
+
+static inline uint32_t read32(const char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Writes the part of a length that doesn't fit in the token nibble. */
+static inline char *writeLength(char *op, size_t len)
+{
+  for (len -= 15; len >= 255; len -= 255) {
+    *op++ = (char) 255;
+  }
+  *op++ = (char) len;
+  return op;
+}
+
+static inline bool readLength(const unsigned char **ip,
+                              const unsigned char *iend, size_t *len)
+{
+  unsigned char b;
+  do {
+    if (*ip >= iend) {
+      return false;
+    }
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+size_t lz4Compress(const char *src, size_t srcSize,
+                   char *dst, size_t dstCapacity)
+{
+  // Positions in src, relative to src. Stale entries are harmless: every
+  // candidate match is checked.
+  static __thread uint32_t table[1 << LZ4_HASH_BITS];
+  const char *ip = src;
+  const char *anchor = src;
+  const char *iend = src + srcSize;
+  char *op = dst;
+  char *oend = dst + dstCapacity;
+
+  if (srcSize > LZ4_MATCH_LIMIT && srcSize <= (uint32_t) -1) {
+    const char *mflimit = iend - LZ4_MATCH_LIMIT;
+    const char *matchlimit = iend - LZ4_LAST_LITERALS;
+    memset(table, 0, sizeof(table));
+    ip++;
+    while (ip <= mflimit) {
+      uint32_t h = hash32(read32(ip));
+      const char *ref = src + table[h];
+      table[h] = ip - src;
+      if (ref >= ip || ip - ref > LZ4_MAX_OFFSET ||
+          read32(ref) != read32(ip)) {
+        ip += 1 + ((ip - anchor) >> LZ4_SKIP_SHIFT);
+        continue;
+      }
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const char *mend = ip + LZ4_MIN_MATCH;
+      const char *rend = ref + LZ4_MIN_MATCH;
+      while (mend < matchlimit && *mend == *rend) {
+        mend++;
+        rend++;
+      }
+      size_t litLen = ip - anchor;
+      size_t matchLen = mend - ip - LZ4_MIN_MATCH;
+      if ((size_t) (oend - op) <
+          1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1) {
+        return 0;
+      }
+      char *token = op++;
+      if (litLen >= 15) {
+        *token = (char) (15 << 4);
+        op = writeLength(op, litLen);
+      } else {
+        *token = (char) (litLen << 4);
+      }
+      memcpy(op, anchor, litLen);
+      op += litLen;
+      size_t offset = ip - ref;
+      *op++ = (char) (offset & 0xff);
+      *op++ = (char) (offset >> 8);
+      if (matchLen >= 15) {
+        *token |= 15;
+        op = writeLength(op, matchLen);
+      } else {
+        *token |= (char) matchLen;
+      }
+      ip = anchor = mend;
+    }
+  }
+
+  size_t litLen = iend - anchor;
+  if ((size_t) (oend - op) < 1 + litLen / 255 + 1 + litLen) {
+    return 0;
+  }
+  if (litLen >= 15) {
+    *op++ = (char) (15 << 4);
+    op = writeLength(op, litLen);
+  } else {
+    *op++ = (char) (litLen << 4);
+  }
+  memcpy(op, anchor, litLen);
+  op += litLen;
+  return op - dst;
+}
+
+bool lz4Decompress(const char *src, size_t srcSize, char *dst, size_t dstSize)
+{
+  const unsigned char *ip = (const unsigned char *) src;
+  const unsigned char *iend = ip + srcSize;
+  char *op = dst;
+  char *oend = dst + dstSize;
+
+  while (ip < iend) {
+    unsigned char token = *ip++;
+    size_t len = token >> 4;
+    if (len == 15 && !readLength(&ip, iend, &len)) {
+      return false;
+    }
+    if ((size_t) (iend - ip) < len || (size_t) (oend - op) < len) {
+      return false;
+    }
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      return false;
+    }
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t) (op - dst)) {
+      return false;
+    }
+    len = token & 15;
+    if (len == 15 && !readLength(&ip, iend, &len)) {
+      return false;
+    }
+    len += LZ4_MIN_MATCH;
+    if ((size_t) (oend - op) < len) {
+      return false;
+    }
+    const char *match = op - offset;
+    if (offset >= len) {
+      memcpy(op, match, len);
+      op += len;
+    } else {
+      // The match overlaps the bytes being written (a run).
+      while (len-- > 0) {
+        *op++ = *match++;
+      }
+    }
+  }
+  return op == oend;
+}
@@ -0,0 +1,44 @@
+/****************************************************************************
+ * Copyright (C) 2009, 2010, 2011, 2012 by Kapil Arya, Gene Cooperman,      *
+ *                                     Tyler Denniston, and Ana-Maria Visan *
+ * {kapil,gene,tyler,amvisan}@ccs.neu.edu                                   *
+ *                                                                          *
+ * This file is part of FReD.                                               *
+ *                                                                          *
+ * FReD is free software: you can redistribute it and/or modify             *
+ * it under the terms of the GNU General Public License as published by     *
+ * the Free Software Foundation, either version 3 of the License, or        *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * FReD is distributed in the hope that it will be useful,                  *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU General Public License for more details.                             *
+ *                                                                          *
+ * You should have received a copy of the GNU General Public License        *
+ * along with FReD.  If not, see <http://www.gnu.org/licenses/>.            *
+ ****************************************************************************/
+
+/* A small implementation of the LZ4 block format, used to compress chunks
+   of the read-data log (see synchronizationlogging.cpp). It favors speed
+   over ratio, and needs no memory besides a per-thread hash table. */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+#ifndef LIB_PRIVATE
+#define LIB_PRIVATE __attribute__ ((visibility ("hidden")))
+#endif
+
+/* Compresses srcSize bytes of src into dst. Returns the compressed size, or
+   0 if it would be more than dstCapacity bytes. */
+LIB_PRIVATE size_t lz4Compress(const char *src, size_t srcSize,
+                               char *dst, size_t dstCapacity);
+/* Decompresses srcSize bytes of src into dst. Returns false unless src is
+   valid and decompresses to exactly dstSize bytes. */
+LIB_PRIVATE bool lz4Decompress(const char *src, size_t srcSize,
+                               char *dst, size_t dstSize);
+
+#endif
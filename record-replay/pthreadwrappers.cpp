@@ -19,10 +19,12 @@
  * along with FReD.  If not, see <http://www.gnu.org/licenses/>.            *
  ****************************************************************************/
 
+#include <algorithm>
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -32,6 +34,7 @@
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <time.h>
+#include <linux/futex.h>
 #include "constants.h"
 #include  "jassert.h"
 #include  "jfilesystem.h"
@@ -46,17 +49,58 @@ static void create_reaper_thread();
 static pthread_t reaperThread;
 static int reaper_thread_alive = 0;
 static int signal_thread_alive = 0;
-static volatile int reaper_thread_ready = 0;
-static volatile int thread_create_destroy = 0;
-static volatile pthread_t attributes_were_read = 0;
-static volatile pthread_t arguments_were_decoded = 0;
-static pthread_mutex_t attributes_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t arguments_decode_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t create_destroy_guard = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t  reap_cv = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t reap_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_t       thread_to_reap = 0;
-static dmtcp::vector<pthread_t> threads_with_allocated_stack;
+
+/* A thread running on a stack of ours (see setupThreadStack()), from its
+   start until the user joins it; the reaper will have joined it for real
+   and unmapped the stack by then. */
+struct reapable_thread
+{
+  pthread_t thread;
+  void *stack_addr;
+  size_t stack_size;
+  int arena_span;
+  int exited;
+  struct reapable_thread *next_exited;
+  /* Set by the reaper, which then bumps 'joined' and wakes the user's
+     pthread_join() waiting on it. */
+  pthread_join_retval_t join_retval;
+  int joined;
+  /* Set, under reapable_threads_lock, by the pthread_join() that waits for
+     this thread. That call removes the node from the set and frees it. */
+  int claimed;
+#ifdef JALIB_ALLOCATOR
+  static void* operator new(size_t nbytes) { JALLOC_HELPER_NEW(nbytes); }
+  static void  operator delete(void* p) { JALLOC_HELPER_DELETE(p); }
+#endif
+};
+
+/* Open-addressing hash set of the reapable threads, by pthread_t. Slots of
+   removed threads hold REAPABLE_THREAD_REMOVED until the next rehash. The
+   lock is only held for lookups and updates, never across a logged call. */
+#define REAPABLE_THREADS_MIN_SLOTS 64
+#define REAPABLE_THREAD_REMOVED ((struct reapable_thread *) 1)
+static dmtcp::vector<struct reapable_thread *> reapable_threads;
+static size_t reapable_threads_used = 0;
+static size_t reapable_threads_live = 0;
+static pthread_mutex_t reapable_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Exiting threads push themselves here without taking a lock, and wake the
+   reaper through exit_queue_futex. The reaper takes the whole list at once. */
+static struct reapable_thread *volatile exited_threads = NULL;
+static int exit_queue_futex = 0;
+
+/* Stacks of reaped threads, kept for the next threads instead of unmapped.
+   The pool is only used under the create/destroy lock. That lock is logged,
+   so on replay each new thread gets the same stack as on record, without an
+   mmap entry per thread. */
+#define THREAD_STACK_POOL_MAX 64
+struct pooled_stack
+{
+  void *addr;
+  size_t size;
+};
+static dmtcp::vector<struct pooled_stack> stack_pool;
 
 //static pthread_mutex_t read_mutex = PTHREAD_MUTEX_INITIALIZER;
 static inline void memfence() {  asm volatile ("mfence" ::: "memory"); }
@@ -64,56 +108,158 @@ struct create_arg
 {
   void *(*fn)(void *);
   void *thread_arg;
+  void *stack_addr;
+  size_t stack_size;
+  /* See mallocArenaTakeSpan(). */
+  int arena_span;
+  /* Set by the new thread once it is done with this struct. */
+  int decoded;
 };
 static int internal_pthread_mutex_lock(pthread_mutex_t *);
 static int internal_pthread_mutex_unlock(pthread_mutex_t *);
 
 //extern MtcpFuncPtrs_t mtcpFuncPtrs;
 
+/* Serializes thread creation (so that clone ids are handed out in log
+   order) with the reaper's updates of the clone id tables. The lock is
+   logged, so replay takes it in the recorded order. */
 #define ACQUIRE_THREAD_CREATE_DESTROY_LOCK() \
-  int ready = 0;                                                \
-  while (1) {                                                   \
-    internal_pthread_mutex_lock(&create_destroy_guard);         \
-    memfence();                                                 \
-    if (thread_create_destroy == 0) {                           \
-      ready = 1;                                                \
-      thread_create_destroy = 1;                                \
-    }                                                           \
-    internal_pthread_mutex_unlock(&create_destroy_guard);       \
-    if (ready) break;                                           \
-    usleep(100);                                                \
-  }
+  internal_pthread_mutex_lock(&create_destroy_guard)
 
 #define RELEASE_THREAD_CREATE_DESTROY_LOCK() \
-  internal_pthread_mutex_lock(&create_destroy_guard);   \
-  JASSERT ( thread_create_destroy == 1 );               \
-  thread_create_destroy = 0;                            \
-  internal_pthread_mutex_unlock(&create_destroy_guard); \
+  internal_pthread_mutex_unlock(&create_destroy_guard)
 
-static bool should_reap_thread(pthread_t thd)
+static void wake_futex(int *word)
 {
-  dmtcp::vector<pthread_t>::iterator it;
-  for (it = threads_with_allocated_stack.begin();
-       it < threads_with_allocated_stack.end();
-       it++) {
-    if (pthread_equal(*it, thd)) {
-      return true;
+  __sync_fetch_and_add(word, 1);
+  _real_syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static void wait_futex(int *word, int oldValue)
+{
+  _real_syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, oldValue, NULL, NULL, 0);
+}
+
+static size_t reapable_thread_slot(pthread_t thd, size_t numSlots)
+{
+  uint64_t h = (uint64_t) thd * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (h >> 32) & (numSlots - 1);
+}
+
+/* Caller holds reapable_threads_lock. Returns the slot of thd, or of the
+   first free slot on its probe sequence. */
+static struct reapable_thread **find_reapable_slot(pthread_t thd)
+{
+  size_t numSlots = reapable_threads.size();
+  struct reapable_thread **freeSlot = NULL;
+  for (size_t i = reapable_thread_slot(thd, numSlots); ;
+       i = (i + 1) & (numSlots - 1)) {
+    struct reapable_thread **slot = &reapable_threads[i];
+    if (*slot == NULL) {
+      return freeSlot != NULL ? freeSlot : slot;
+    }
+    if (*slot == REAPABLE_THREAD_REMOVED) {
+      if (freeSlot == NULL) {
+        freeSlot = slot;
+      }
+    } else if (pthread_equal((*slot)->thread, thd)) {
+      return slot;
     }
   }
-  return false;
 }
 
-static void remove_reaped_thread(pthread_t thd)
+/* Caller holds reapable_threads_lock. */
+static void rehash_reapable_threads(size_t numSlots)
 {
-  dmtcp::vector<pthread_t>::iterator it;
-  for (it = threads_with_allocated_stack.begin();
-       it < threads_with_allocated_stack.end();
-       it++) {
-    if (pthread_equal(*it, thd)) {
-      threads_with_allocated_stack.erase(it);
-      break;
+  dmtcp::vector<struct reapable_thread *> old;
+  old.swap(reapable_threads);
+  reapable_threads.assign(numSlots, NULL);
+  for (size_t i = 0; i < old.size(); i++) {
+    if (old[i] != NULL && old[i] != REAPABLE_THREAD_REMOVED) {
+      *find_reapable_slot(old[i]->thread) = old[i];
+    }
+  }
+  reapable_threads_used = reapable_threads_live;
+}
+
+static void add_reapable_thread(struct reapable_thread *t)
+{
+  _real_pthread_mutex_lock(&reapable_threads_lock);
+  /* Keep at least half of the slots free, removed ones included. */
+  if (2 * (reapable_threads_used + 1) > reapable_threads.size()) {
+    size_t numSlots = REAPABLE_THREADS_MIN_SLOTS;
+    while (numSlots < 4 * (reapable_threads_live + 1)) {
+      numSlots *= 2;
     }
+    rehash_reapable_threads(numSlots);
+  }
+  struct reapable_thread **slot = find_reapable_slot(t->thread);
+  if (*slot == NULL) {
+    reapable_threads_used++;
+  }
+  if (*slot == NULL || *slot == REAPABLE_THREAD_REMOVED) {
+    reapable_threads_live++;
+  } else if (!(*slot)->claimed) {
+    /* A reaped thread that was never joined by the user, whose pthread_t
+       is being reused. A claimed node is left to its pthread_join(). */
+    JASSERT((*slot)->joined);
+    delete *slot;
   }
+  *slot = t;
+  _real_pthread_mutex_unlock(&reapable_threads_lock);
+}
+
+static struct reapable_thread *find_reapable_thread(pthread_t thd)
+{
+  struct reapable_thread *t = NULL;
+  _real_pthread_mutex_lock(&reapable_threads_lock);
+  if (reapable_threads.size() > 0) {
+    t = *find_reapable_slot(thd);
+    if (t == REAPABLE_THREAD_REMOVED) {
+      t = NULL;
+    }
+  }
+  _real_pthread_mutex_unlock(&reapable_threads_lock);
+  return t;
+}
+
+/* Marks the node of thd as waited for by the caller, and returns it; NULL
+   if thd is not in the set or another pthread_join() claimed it. The node
+   stays in the set, so that the thread finds it when it exits, until
+   release_reapable_thread(). */
+static struct reapable_thread *claim_reapable_thread(pthread_t thd)
+{
+  struct reapable_thread *t = NULL;
+  _real_pthread_mutex_lock(&reapable_threads_lock);
+  if (reapable_threads.size() > 0) {
+    struct reapable_thread **slot = find_reapable_slot(thd);
+    if (*slot != NULL && *slot != REAPABLE_THREAD_REMOVED &&
+        !(*slot)->claimed) {
+      t = *slot;
+      t->claimed = 1;
+    }
+  }
+  _real_pthread_mutex_unlock(&reapable_threads_lock);
+  return t;
+}
+
+/* Removes the claimed node t from the set, unless a new thread with the
+   same pthread_t already took its slot, and frees it. */
+static void release_reapable_thread(struct reapable_thread *t)
+{
+  _real_pthread_mutex_lock(&reapable_threads_lock);
+  struct reapable_thread **slot = find_reapable_slot(t->thread);
+  if (*slot == t) {
+    *slot = REAPABLE_THREAD_REMOVED;
+    reapable_threads_live--;
+  }
+  _real_pthread_mutex_unlock(&reapable_threads_lock);
+  delete t;
+}
+
+static bool should_reap_thread(pthread_t thd)
+{
+  return find_reapable_thread(thd) != NULL;
 }
 
 static void *start_wrapper(void *arg)
@@ -128,14 +274,24 @@ static void *start_wrapper(void *arg)
   struct create_arg *createArg = (struct create_arg *)arg;
   void *(*user_fnc) (void *) = createArg->fn;
   void *thread_arg = createArg->thread_arg;
-  _real_pthread_mutex_lock(&arguments_decode_mutex);
-  arguments_were_decoded = 1;
-  _real_pthread_mutex_unlock(&arguments_decode_mutex);
+  /* Registered before the user function runs, so that an exit is never
+     missed by the reaper. */
+  struct reapable_thread *self = new struct reapable_thread;
+  self->thread = pthread_self();
+  self->stack_addr = createArg->stack_addr;
+  self->stack_size = createArg->stack_size;
+  self->arena_span = createArg->arena_span;
+  mallocArenaSetThreadSpan(createArg->arena_span);
+  self->exited = 0;
+  self->next_exited = NULL;
+  self->joined = 0;
+  self->claimed = 0;
+  add_reapable_thread(self);
+  wake_futex(&createArg->decoded);
   void *retval;
 
   retval = (*user_fnc)(thread_arg);
   JTRACE ( "User start function over." );
-  ACQUIRE_THREAD_CREATE_DESTROY_LOCK(); // For thread destruction.
   reapThisThread();
   return retval;
 }
@@ -187,6 +343,17 @@ static void setupThreadStack(pthread_attr_t *attr_out,
     mmap_size = size;
   }
 
+  /* Most recently released first: its pages are the likeliest to be
+     resident. */
+  for (size_t i = stack_pool.size(); i > 0; i--) {
+    if (stack_pool[i - 1].size == mmap_size) {
+      void *s = stack_pool[i - 1].addr;
+      stack_pool.erase(stack_pool.begin() + (i - 1));
+      pthread_attr_setstack(attr_out, s, mmap_size);
+      return;
+    }
+  }
+
   // mmap() wrapper handles forcing it to the same place on replay.
   void *s = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
   if (s == MAP_FAILED)  {
@@ -198,8 +365,14 @@ static void setupThreadStack(pthread_attr_t *attr_out,
   pthread_attr_setstack(attr_out, s, mmap_size);
 }
 
+/* Caller holds the create/destroy lock, see stack_pool. */
 static void teardownThreadStack(void *stack_addr, size_t stack_size)
 {
+  if (stack_pool.size() < THREAD_STACK_POOL_MAX) {
+    struct pooled_stack stack = { stack_addr, stack_size };
+    stack_pool.push_back(stack);
+    return;
+  }
   if (munmap(stack_addr, stack_size) == -1) {
     JASSERT ( false ) ( strerror(errno) ) ( stack_addr ) ( stack_size )
       .Text("Unable to munmap user thread stack.");
@@ -259,12 +432,12 @@ static int internal_pthread_mutex_unlock(pthread_mutex_t *mutex)
     }
     WRAPPER_REPLAY_END(pthread_mutex_unlock);
   } else if (SYNC_IS_RECORD) {
-    WRAPPER_LOG_WRITE_ENTRY(my_entry);
+    WRAPPER_LOG_RESERVE_ENTRY(my_entry);
     retval = _real_pthread_mutex_unlock(mutex);
     if (retval == 0) {
       SET_FIELD2(my_entry, pthread_mutex_unlock, mutex, *mutex);
     }
-    WRAPPER_LOG_UPDATE_ENTRY(my_entry);
+    WRAPPER_LOG_COMMIT_ENTRY(my_entry);
   }
   return retval;
 }
@@ -353,20 +526,17 @@ static int internal_pthread_cond_wait(pthread_cond_t *cond,
   return retval;
 }
 
-static inline void waitForChildThreadToInitialize()
+static inline void waitForChildThreadToInitialize(struct create_arg *createArg)
 {
   /* Wait for the newly created thread to decode his arguments (createArg).
      We must ensure that's been done before we return from this
      pthread_create wrapper and the createArg struct goes out of scope. */
   while (1) {
-    _real_pthread_mutex_lock(&arguments_decode_mutex);
-    if (arguments_were_decoded == 1) {
-      arguments_were_decoded = 0;
-      _real_pthread_mutex_unlock(&arguments_decode_mutex);
+    int decoded = __sync_fetch_and_add(&createArg->decoded, 0);
+    if (decoded != 0) {
       break;
     }
-    _real_pthread_mutex_unlock(&arguments_decode_mutex);
-    usleep(100);
+    wait_futex(&createArg->decoded, decoded);
   }
 }
 
@@ -383,10 +553,12 @@ static int internal_pthread_create(pthread_t *thread,
   struct create_arg createArg;
   createArg.fn = start_routine;
   createArg.thread_arg = arg;
+  createArg.decoded = 0;
   log_entry_t my_entry = create_pthread_create_entry(my_clone_id,
                                                      pthread_create_event,
                                                      thread, attr,
                                                      start_routine, arg);
+  stdioThreadCreated();
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START(pthread_create);
     stack_addr = (void *)GET_FIELD(my_entry, pthread_create, stack_addr);
@@ -398,31 +570,48 @@ static int internal_pthread_create(pthread_t *thread,
     pthread_attr_init(&the_attr);
 
     setupThreadStack(&the_attr, attr, stack_size);
+    pthread_attr_getstack(&the_attr, &createArg.stack_addr,
+                          &createArg.stack_size);
+    JASSERT(createArg.stack_addr == stack_addr)
+      (createArg.stack_addr) (stack_addr)
+      .Text("Thread stack differs from record.");
     // Never let the user create a detached thread:
     disableDetachState(&the_attr);
+    createArg.arena_span = mallocArenaTakeSpan();
     retval = _real_pthread_create(thread, &the_attr,
                                   start_wrapper, (void *)&createArg);
-    waitForChildThreadToInitialize();
+    if (retval == 0) {
+      waitForChildThreadToInitialize(&createArg);
+    } else {
+      mallocArenaReleaseSpan(createArg.arena_span);
+    }
 
     RELEASE_THREAD_CREATE_DESTROY_LOCK();
     pthread_attr_destroy(&the_attr);
 
   } else  if (SYNC_IS_RECORD) {
-    WRAPPER_LOG_WRITE_ENTRY(my_entry);
+    WRAPPER_LOG_RESERVE_ENTRY(my_entry);
 
     ACQUIRE_THREAD_CREATE_DESTROY_LOCK();
     pthread_attr_init(&the_attr);
     // Possibly create a thread stack if the user has not provided one:
     setupThreadStack(&the_attr, attr, 0);
+    pthread_attr_getstack(&the_attr, &createArg.stack_addr,
+                          &createArg.stack_size);
     // Never let the user create a detached thread:
     disableDetachState(&the_attr);
 
+    createArg.arena_span = mallocArenaTakeSpan();
     retval = _real_pthread_create(thread, &the_attr,
                                   start_wrapper, (void *)&createArg);
     SET_COMMON2(my_entry, retval, (void*)(unsigned long)retval);
     SET_COMMON2(my_entry, my_errno, errno);
 
-    waitForChildThreadToInitialize();
+    if (retval == 0) {
+      waitForChildThreadToInitialize(&createArg);
+    } else {
+      mallocArenaReleaseSpan(createArg.arena_span);
+    }
 
     RELEASE_THREAD_CREATE_DESTROY_LOCK();
     // Log whatever stack we ended up using:
@@ -431,12 +620,10 @@ static int internal_pthread_create(pthread_t *thread,
     SET_FIELD(my_entry, pthread_create, stack_addr);
     SET_FIELD(my_entry, pthread_create, stack_size);
 
-    // Log annotation on the fly.
-    WRAPPER_LOG_UPDATE_ENTRY(my_entry);
+    // Log annotation on the fly. retval and errno were captured above.
+    commitNextLogEntry(my_entry);
   }
 
-  threads_with_allocated_stack.push_back(*thread);
-
   return retval;
 }
 
@@ -563,12 +750,12 @@ extern "C" int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
     }
     WRAPPER_REPLAY_END(pthread_rwlock_unlock);
   } else if (SYNC_IS_RECORD) {
-    WRAPPER_LOG_WRITE_ENTRY(my_entry);
+    WRAPPER_LOG_RESERVE_ENTRY(my_entry);
     retval = _real_pthread_rwlock_unlock(rwlock);
     if (retval == 0) {
       SET_FIELD2(my_entry, pthread_rwlock_unlock, rwlock, *rwlock);
     }
-    WRAPPER_LOG_UPDATE_ENTRY(my_entry);
+    WRAPPER_LOG_COMMIT_ENTRY(my_entry);
   }
   return retval;
 }
@@ -613,71 +800,119 @@ extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
   return retval;
 }
 
-/* Function to perform cleanup tasks for a user thread exit.
-   Caller is responsible for acquiring reap_mutex. */
-static void reapThread()
+/* Function to perform cleanup tasks for a user thread exit: joins the thread
+   and returns its stack and malloc arena span to their pools. The user's
+   pthread_join() then finds the result in t.
+
+   The real join happens under the create/destroy lock, so that no new
+   thread can get this pthread_t before the result is published. */
+static void reapThread(struct reapable_thread *t)
 {
-  pthread_attr_t attr;
   pthread_join_retval_t join_retval;
   void *value_ptr = NULL;
-  size_t stack_size;
-  void *stack_addr;
   int retval = 0;
   clone_id_t cid_to_reap;
-  /* Only reap threads for which we explicitly created a thread stack. */
-  if (!should_reap_thread(thread_to_reap)) {
-    thread_to_reap = 0;
-    //RELEASE_THREAD_CREATE_DESTROY_LOCK(); // End of thread destruction.
-    return;
-  }
-  pthread_getattr_np(thread_to_reap, &attr); // calls realloc().
-  pthread_attr_getstack(&attr, &stack_addr, &stack_size);
-  pthread_attr_destroy(&attr);
-  _real_pthread_mutex_lock(&attributes_mutex);
-  JASSERT ( attributes_were_read == 0 );
-  attributes_were_read = thread_to_reap;
-  _real_pthread_mutex_unlock(&attributes_mutex);
-  retval = _real_pthread_join(thread_to_reap, &value_ptr);
-  //_real_pthread_join(thread_to_reap, NULL);
+
+  ACQUIRE_THREAD_CREATE_DESTROY_LOCK();
+  retval = _real_pthread_join(t->thread, &value_ptr);
   join_retval.my_errno = errno;
   join_retval.retval = retval;
   join_retval.value_ptr = value_ptr;
-  pthread_join_retvals[thread_to_reap] = join_retval;
-  teardownThreadStack(stack_addr, stack_size);
 
-  if (tid_to_clone_id_table->find(thread_to_reap) !=
-      tid_to_clone_id_table->end()) {
-    cid_to_reap = tid_to_clone_id_table->find(thread_to_reap)->second;
-    clone_id_to_tid_table->erase(cid_to_reap);
+  teardownThreadStack(t->stack_addr, t->stack_size);
+  mallocArenaReleaseSpan(t->arena_span);
+  cid_to_reap = tidToCloneId(t->thread);
+  if (cid_to_reap != 0) {
+    unregisterThread(cid_to_reap);
   }
-  tid_to_clone_id_table->erase(thread_to_reap);
+  t->join_retval = join_retval;
+  /* The user's pthread_join() may free t once it sees this. Until then t
+     stays in the set of reapable threads. */
+  wake_futex(&t->joined);
+  RELEASE_THREAD_CREATE_DESTROY_LOCK();
+}
 
-  //mtcpFuncPtrs.process_pthread_join ( thread_to_reap );
-  // Reset for next thread:
-  thread_to_reap = 0;
-  RELEASE_THREAD_CREATE_DESTROY_LOCK(); // End of thread destruction.
+/* Moves the threads that exited since the last call to the end of 'exited',
+   in the order they exited. */
+static void takeExitedThreads(dmtcp::vector<struct reapable_thread *>& exited)
+{
+  struct reapable_thread *t =
+    __sync_lock_test_and_set(&exited_threads,
+                             (struct reapable_thread *) NULL);
+  size_t first = exited.size();
+  for (; t != NULL; t = t->next_exited) {
+    exited.push_back(t);
+  }
+  std::reverse(exited.begin() + first, exited.end());
+}
+
+/* Returns the thread whose reaping comes next in the log, see
+   thread_reaper(). */
+static TURN_CHECK_P(reap_turn_check)
+{
+  return GET_COMMON_PTR(e1, clone_id) == GET_COMMON_PTR(e2, clone_id) &&
+         GET_COMMON_PTR(e1, event) == GET_COMMON_PTR(e2, event);
+}
+
+static pthread_t nextReapedThread()
+{
+  log_entry_t my_entry = create_pthread_join_entry(my_clone_id,
+      pthread_join_event, 0, NULL);
+  waitForTurn(&my_entry, &reap_turn_check);
+  getNextLogEntry();
+  return GET_FIELD(my_entry, pthread_join, thread);
+}
+
+static void logReapedThread(pthread_t thread)
+{
+  int retval = 0;
+  log_entry_t my_entry = create_pthread_join_entry(my_clone_id,
+      pthread_join_event, thread, NULL);
+  WRAPPER_LOG_WRITE_ENTRY(my_entry);
 }
 
-/* Thread to handle cleanup tasks associated with a user thread exiting.  Note
-   we are not using the _real_ versions of pthread calls -- we want to
-   synchronize these. */
+/* Thread to handle cleanup tasks associated with a user thread exiting.
+   Exited threads are reaped in batches, in the order they were queued. That
+   order is logged as a pthread_join entry of the reaper per thread, and
+   replay follows it. */
 static void *thread_reaper(void *arg)
 {
+  dmtcp::vector<struct reapable_thread *> exited;
   /* Wait until mode is not SYNC_NOOP. */
   while (SYNC_IS_NOOP) { usleep(1000); }
   while (1) {
-    /* Wait until there is a thread that needs to be reaped.  We call the
-    internal_* versions here because we want them to be logged/replayed, but we
-    want to skip the shouldSynchronize() function. That function will refuse to
-    log/replay these because they are not coming from user code. */
-    internal_pthread_mutex_lock(&reap_mutex);
-    reaper_thread_ready = 1;
-    while (thread_to_reap == 0) {
-      internal_pthread_cond_wait(&reap_cv, &reap_mutex);
-    }
-    reaper_thread_ready = 0;
-    reapThread();
-    internal_pthread_mutex_unlock(&reap_mutex);
+    if (SYNC_IS_REPLAY) {
+      pthread_t thread = nextReapedThread();
+      while (1) {
+        int seen = __sync_fetch_and_add(&exit_queue_futex, 0);
+        takeExitedThreads(exited);
+        size_t i = 0;
+        while (i < exited.size() && !pthread_equal(exited[i]->thread, thread)) {
+          i++;
+        }
+        if (i < exited.size()) {
+          struct reapable_thread *t = exited[i];
+          exited.erase(exited.begin() + i);
+          reapThread(t);
+          break;
+        }
+        wait_futex(&exit_queue_futex, seen);
+      }
+      continue;
+    }
+    int seen = __sync_fetch_and_add(&exit_queue_futex, 0);
+    takeExitedThreads(exited);
+    if (exited.empty()) {
+      wait_futex(&exit_queue_futex, seen);
+      continue;
+    }
+    for (size_t i = 0; i < exited.size(); i++) {
+      if (SYNC_IS_RECORD) {
+        logReapedThread(exited[i]->thread);
+      }
+      reapThread(exited[i]);
+    }
+    exited.clear();
   }
   JASSERT(false) .Text("Unreachable");
   return NULL;
@@ -706,27 +941,20 @@ LIB_PRIVATE void reapThisThread()
      - pthread_exit() wrapper
      - end of start_wrapper() (which calls user's start function).
 
-    We call the internal_* versions here because we want them to be
-    logged/replayed, but we want to skip the shouldSynchronize() function. That
-    function will refuse to log/replay these because they are not coming from
-    user code.
+    Queues the thread for the reaper and returns at once: the reaper joins
+    the thread before it unmaps the stack. Only the first call for a thread
+    queues it.
   */
-  // Make sure reaper thread has called cond_wait() before we signal:
-  while (!reaper_thread_ready) usleep(100);
-  internal_pthread_mutex_lock(&reap_mutex);
-  thread_to_reap = pthread_self();
-  internal_pthread_cond_signal(&reap_cv);
-  internal_pthread_mutex_unlock(&reap_mutex);
-  // Wait for reaper thread to read the thread attributes before we return,
-  // letting the thread terminate.
-  while (1) {
-    _real_pthread_mutex_lock(&attributes_mutex);
-    if (attributes_were_read == pthread_self()) break;
-    _real_pthread_mutex_unlock(&attributes_mutex);
-    usleep(100);
+  struct reapable_thread *t = find_reapable_thread(pthread_self());
+  if (t == NULL || !__sync_bool_compare_and_swap(&t->exited, 0, 1)) {
+    return;
   }
-  attributes_were_read = 0;
-  _real_pthread_mutex_unlock(&attributes_mutex);
+  struct reapable_thread *head;
+  do {
+    head = exited_threads;
+    t->next_exited = head;
+  } while (!__sync_bool_compare_and_swap(&exited_threads, head, t));
+  wake_futex(&exit_queue_futex);
 }
 
 extern "C" int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
@@ -735,9 +963,9 @@ extern "C" int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
   /* Here I've split apart WRAPPER_HEADER_RAW because we need to create the
    * reaper thread even if the current mode is SYNC_IS_NOOP. */
   void *return_addr = GET_RETURN_ADDRESS();
-  if (!dmtcp_is_running_state() ||
-      !validAddress(return_addr) ||
-      jalib::Filesystem::GetProgramName() == "gdb") {
+  if (isProcessGDB() ||
+      !dmtcp_is_running_state() ||
+      !validAddress(return_addr)) {
     return _real_pthread_create(thread, attr, start_routine, arg);
   }
   /* Create the reaper thread always, even if we are not in SYNC_RECORD mode
@@ -761,13 +989,11 @@ extern "C" void pthread_exit(void *value_ptr)
   if (SYNC_IS_REPLAY) {
     waitForTurn(&my_entry, &pthread_exit_turn_check);
     getNextLogEntry();
-    ACQUIRE_THREAD_CREATE_DESTROY_LOCK();
     reapThisThread();
     _real_pthread_exit(value_ptr);
   } else  if (SYNC_IS_RECORD) {
     // Not restart; we should be logging.
     addNextLogEntry(my_entry);
-    ACQUIRE_THREAD_CREATE_DESTROY_LOCK();
     reapThisThread();
     _real_pthread_exit(value_ptr);
   }
@@ -790,22 +1016,30 @@ extern "C" int pthread_detach(pthread_t thread)
   return retval;
 }
 
+/* On replay, sends the signal of each signal_handler entry to its thread
+   when the head of the log reaches it. Sleeps on the log in between, see
+   SynchronizationLog::waitForSignalEntry(). */
 static void *signal_thread(void *arg)
 {
-  size_t signal_sent_on = 0;
+  size_t signal_sent_on = (size_t) -1;
+  log_entry_header_t header;
   log_entry_t temp_entry = EMPTY_LOG_ENTRY;
   while (1) {
-    // Lock this so it doesn't change from underneath:
-    global_log.getCurrentEntry(temp_entry);
-    if (__builtin_expect(GET_COMMON(temp_entry,event) == signal_handler_event, 0)) {
+    /* Read before checking, so that the head reaching a signal entry in
+       between is not missed. */
+    int seen = global_log.signalFutexValue();
+    // Only the header, until there is a signal to send:
+    global_log.getCurrentHeader(header);
+    if (__builtin_expect(header.event == signal_handler_event, 0)) {
       if (signal_sent_on != global_log.currentEntryIndex()) {
         // Only send one signal per sig_handler entry.
         signal_sent_on = global_log.currentEntryIndex();
-        _real_pthread_kill((*clone_id_to_tid_table)[GET_COMMON(temp_entry,clone_id)],
+        global_log.getCurrentEntry(temp_entry);
+        _real_pthread_kill(cloneIdToTid(GET_COMMON(temp_entry,clone_id)),
             GET_FIELD(temp_entry, signal_handler, sig));
       }
     }
-    usleep(20);
+    global_log.waitForSignalEntry(seen);
   }
   JASSERT(false) .Text("Unreachable");
   return NULL;
@@ -841,6 +1075,25 @@ extern "C" int pthread_kill(pthread_t thread, int sig)
 }
 
 
+/* Waits for the reaper to have joined t, and returns the result. */
+static int waitForReapedThread(struct reapable_thread *t, void **value_ptr)
+{
+  int joined;
+  while ((joined = __sync_fetch_and_add(&t->joined, 0)) == 0) {
+    wait_futex(&t->joined, joined);
+  }
+  int retval = 0;
+  if (value_ptr != NULL) {
+    // If the user cares about the return value.
+    retval = t->join_retval.retval;
+    *value_ptr = t->join_retval.value_ptr;
+    if (retval == -1) {
+      errno = t->join_retval.my_errno;
+    }
+  }
+  return retval;
+}
+
 extern "C" int pthread_join (pthread_t thread, void **value_ptr)
 {
   /* We change things up a bit here. Since we don't allow the user's
@@ -851,8 +1104,11 @@ extern "C" int pthread_join (pthread_t thread, void **value_ptr)
      We DO need to call it from the thread reaper reapThread(), however, which
      is in pthreadwrappers.cpp. */
   void *return_addr = GET_RETURN_ADDRESS();
-  if (!shouldSynchronize(return_addr) ||
-      !should_reap_thread(thread)) {
+  struct reapable_thread *t = NULL;
+  if (shouldSynchronize(return_addr)) {
+    t = claim_reapable_thread(thread);
+  }
+  if (t == NULL) {
     int retval = _real_pthread_join(thread, value_ptr);
     return retval;
   }
@@ -862,46 +1118,14 @@ extern "C" int pthread_join (pthread_t thread, void **value_ptr)
       pthread_join_event, thread, value_ptr);
   if (SYNC_IS_REPLAY) {
     WRAPPER_REPLAY_START(pthread_join);
-    while (pthread_join_retvals.find(thread) == pthread_join_retvals.end()) {
-      usleep(100);
-    }
-    if (pthread_join_retvals.find(thread) != pthread_join_retvals.end()) {
-      // We joined it as part of the thread reaping.
-      if (value_ptr != NULL) {
-        // If the user cares about the return value.
-        retval = pthread_join_retvals[thread].retval;
-        *value_ptr = pthread_join_retvals[thread].value_ptr;
-        if (retval == -1) {
-          errno = pthread_join_retvals[thread].my_errno;
-        }
-      }
-      pthread_join_retvals.erase(thread);
-    } else {
-      JASSERT ( false ) .Text("A thread was not joined by reaper thread.");
-    }
+    retval = waitForReapedThread(t, value_ptr);
     WRAPPER_REPLAY_END(pthread_join);
   } else if (SYNC_IS_RECORD) {
     // Not restart; we should be logging.
-    while (pthread_join_retvals.find(thread) == pthread_join_retvals.end()) {
-      usleep(100);
-    }
-    if (pthread_join_retvals.find(thread) != pthread_join_retvals.end()) {
-      // We joined it as part of the thread reaping.
-      if (value_ptr != NULL) {
-        // If the user cares about the return value.
-        retval = pthread_join_retvals[thread].retval;
-        *value_ptr = pthread_join_retvals[thread].value_ptr;
-        if (retval == -1) {
-          errno = pthread_join_retvals[thread].my_errno;
-        }
-      }
-      pthread_join_retvals.erase(thread);
-    } else {
-      JASSERT ( false ) .Text("A thread was not joined by reaper thread.");
-    }
+    retval = waitForReapedThread(t, value_ptr);
     WRAPPER_LOG_WRITE_ENTRY(my_entry);
   }
-  remove_reaped_thread(thread);
+  release_reapable_thread(t);
   return retval;
 }
 
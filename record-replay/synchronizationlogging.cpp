@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
 #include <time.h>
 #include <algorithm>
 #include "fred_wrappers.h"
@@ -36,28 +37,33 @@
 #include <sys/select.h>
 #include "synchronizationlogging.h"
 #include "log.h"
+#include "lz4.h"
 #include <sys/resource.h>
 
 
 // TODO: Do we need LIB_PRIVATE again here if we had already specified it in
 // the header file?
 /* Library private: */
-LIB_PRIVATE dmtcp::map<clone_id_t, pthread_t> *clone_id_to_tid_table = NULL;
-LIB_PRIVATE dmtcp::map<pthread_t, clone_id_t> *tid_to_clone_id_table = NULL;
-LIB_PRIVATE dmtcp::map<pthread_t, pthread_join_retval_t> pthread_join_retvals;
 LIB_PRIVATE char RECORD_LOG_PATH[RECORD_LOG_PATH_MAX];
 LIB_PRIVATE char RECORD_READ_DATA_LOG_PATH[RECORD_LOG_PATH_MAX];
 LIB_PRIVATE int             read_data_fd = -1;
 LIB_PRIVATE int             sync_logging_branch = 0;
+/* sync_logging_branch != SYNC_NOOP, and this process is not gdb. Kept by
+   set_sync_mode(), for shouldSynchronize(). */
+LIB_PRIVATE int             sync_wrappers_active = 0;
 
 /* Setting this will log/replay *ALL* malloc family
    functions (i.e. including ones from DMTCP, std C++ lib, etc.). */
 LIB_PRIVATE int             log_all_allocs = 0;
 LIB_PRIVATE pthread_mutex_t global_clone_counter_mutex = PTHREAD_MUTEX_INITIALIZER;
-LIB_PRIVATE pthread_mutex_t read_data_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 LIB_PRIVATE dmtcp::SynchronizationLog global_log;
 
+#define EVENT_SIZE(name, ...) log_event_##name##_size,
+const int log_event_size_table[numTotalEvents] = {
+  0, FOREACH_EVENT(EVENT_SIZE)
+};
+
 /* Thread locals: */
 LIB_PRIVATE __thread clone_id_t my_clone_id = -1;
 LIB_PRIVATE __thread int in_mmap_wrapper = 0;
@@ -117,6 +123,7 @@ inline void set_sync_mode(int mode)
   }
   x[1] = '\0';
   sync_logging_branch = mode;
+  sync_wrappers_active = mode != SYNC_NOOP && !isProcessGDB();
 }
 
 int get_sync_mode()
@@ -129,29 +136,304 @@ static inline clone_id_t get_next_clone_id()
   return __sync_fetch_and_add (&global_clone_counter, 1);
 }
 
-int shouldSynchronize(void *return_addr)
+/* The live threads of this process, by clone id and by pthread_t. Both are
+   open-addressing tables of table->numSlots slots. Writers serialize on
+   thread_table_lock. Readers take no lock: a slot's value is written before
+   its key, and a reader checks the key again after reading the value.
+   Removed slots keep a tombstone key, unless nothing follows them on the
+   probe sequence. When the tables get half full, larger ones are built and
+   published in one pointer store; the old ones are never unmapped, since a
+   reader may still be probing them. */
+#define THREAD_TABLE_INITIAL_SLOTS 4096
+#define CLONE_ID_FREE ((clone_id_t) 0)
+#define CLONE_ID_REMOVED ((clone_id_t) -1)
+#define TID_FREE ((pthread_t) 0)
+#define TID_REMOVED ((pthread_t) -1)
+typedef struct {
+  volatile clone_id_t clone_id;
+  volatile pthread_t tid;
+} thread_table_slot_t;
+typedef struct {
+  size_t numSlots;
+  thread_table_slot_t *cloneIds;
+  thread_table_slot_t *tids;
+} thread_table_t;
+static thread_table_slot_t initial_clone_id_table[THREAD_TABLE_INITIAL_SLOTS];
+static thread_table_slot_t initial_tid_table[THREAD_TABLE_INITIAL_SLOTS];
+static thread_table_t initial_thread_table = {
+  THREAD_TABLE_INITIAL_SLOTS, initial_clone_id_table, initial_tid_table
+};
+static thread_table_t *volatile thread_table = &initial_thread_table;
+static size_t thread_table_live = 0;
+static pthread_mutex_t thread_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t nextThreadSlot(const thread_table_t *table, size_t i)
+{
+  return (i + 1) & (table->numSlots - 1);
+}
+
+static inline size_t prevThreadSlot(const thread_table_t *table, size_t i)
+{
+  return (i - 1) & (table->numSlots - 1);
+}
+
+/* Clone ids are handed out in order, so indexing by the id itself spreads
+   the live threads without collisions until numSlots of them. */
+static inline size_t cloneIdSlot(const thread_table_t *table,
+                                 clone_id_t clone_id)
+{
+  return (size_t) clone_id & (table->numSlots - 1);
+}
+
+static inline size_t tidSlot(const thread_table_t *table, pthread_t tid)
+{
+  uint64_t h = (uint64_t) tid * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (h >> 32) & (table->numSlots - 1);
+}
+
+/* Caller holds thread_table_lock. Returns the slot of clone_id, or NULL. If
+   insertAt is given, it gets the first reusable slot on the probe sequence. */
+static thread_table_slot_t *findCloneIdSlot(thread_table_t *table,
+                                            clone_id_t clone_id,
+                                            thread_table_slot_t **insertAt)
 {
-  // Returns 1 if we should synchronize this call, instead of calling _real
-  // version. 0 if we should not.
-  if (!dmtcp_is_running_state()) {
-    return 0;
+  size_t i = cloneIdSlot(table, clone_id);
+  for (size_t n = 0; n < table->numSlots;
+       n++, i = nextThreadSlot(table, i)) {
+    thread_table_slot_t *slot = &table->cloneIds[i];
+    if (insertAt != NULL && *insertAt == NULL &&
+        (slot->clone_id == CLONE_ID_FREE ||
+         slot->clone_id == CLONE_ID_REMOVED)) {
+      *insertAt = slot;
+    }
+    if (slot->clone_id == CLONE_ID_FREE) {
+      break;
+    }
+    if (slot->clone_id == clone_id) {
+      return slot;
+    }
   }
-  if (SYNC_IS_NOOP) {
-    return 0;
+  return NULL;
+}
+
+/* Same as findCloneIdSlot(), by pthread_t. */
+static thread_table_slot_t *findTidSlot(thread_table_t *table, pthread_t tid,
+                                        thread_table_slot_t **insertAt)
+{
+  size_t i = tidSlot(table, tid);
+  for (size_t n = 0; n < table->numSlots;
+       n++, i = nextThreadSlot(table, i)) {
+    thread_table_slot_t *slot = &table->tids[i];
+    if (insertAt != NULL && *insertAt == NULL &&
+        (slot->tid == TID_FREE || slot->tid == TID_REMOVED)) {
+      *insertAt = slot;
+    }
+    if (slot->tid == TID_FREE) {
+      break;
+    }
+    if (pthread_equal(slot->tid, tid)) {
+      return slot;
+    }
   }
-  if (isProcessGDB()) {
-    return 0;
+  return NULL;
+}
+
+/* Caller holds thread_table_lock. */
+static void removeCloneIdSlot(thread_table_t *table, thread_table_slot_t *slot)
+{
+  size_t i = slot - table->cloneIds;
+  if (table->cloneIds[nextThreadSlot(table, i)].clone_id != CLONE_ID_FREE) {
+    slot->clone_id = CLONE_ID_REMOVED;
+    return;
+  }
+  // Nothing probes past here: free this slot and the tombstones before it.
+  slot->clone_id = CLONE_ID_FREE;
+  for (i = prevThreadSlot(table, i);
+       table->cloneIds[i].clone_id == CLONE_ID_REMOVED;
+       i = prevThreadSlot(table, i)) {
+    table->cloneIds[i].clone_id = CLONE_ID_FREE;
+  }
+}
+
+/* Caller holds thread_table_lock. */
+static void removeTidSlot(thread_table_t *table, thread_table_slot_t *slot)
+{
+  size_t i = slot - table->tids;
+  if (table->tids[nextThreadSlot(table, i)].tid != TID_FREE) {
+    slot->tid = TID_REMOVED;
+    return;
   }
-  if (ok_to_log_next_func) {
-    ok_to_log_next_func = false;
-    return 1;
+  slot->tid = TID_FREE;
+  for (i = prevThreadSlot(table, i);
+       table->tids[i].tid == TID_REMOVED;
+       i = prevThreadSlot(table, i)) {
+    table->tids[i].tid = TID_FREE;
+  }
+}
+
+/* Caller holds thread_table_lock. Inserts clone_id and tid, which are not in
+   the table. */
+static void insertThread(thread_table_t *table, clone_id_t clone_id,
+                         pthread_t tid)
+{
+  thread_table_slot_t *insertAt = NULL;
+  findCloneIdSlot(table, clone_id, &insertAt);
+  insertAt->tid = tid;
+  __sync_synchronize();
+  insertAt->clone_id = clone_id;
+
+  insertAt = NULL;
+  findTidSlot(table, tid, &insertAt);
+  insertAt->clone_id = clone_id;
+  __sync_synchronize();
+  insertAt->tid = tid;
+}
+
+/* Caller holds thread_table_lock. Moves the live threads to tables twice as
+   large, which readers then find through thread_table. */
+static void growThreadTable()
+{
+  thread_table_t *old = thread_table;
+  size_t numSlots = 2 * old->numSlots;
+  size_t size = sizeof(thread_table_t) + 2 * numSlots *
+                sizeof(thread_table_slot_t);
+  void *addr = _real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO) (numSlots);
+  thread_table_t *table = (thread_table_t *) addr;
+  table->numSlots = numSlots;
+  table->cloneIds = (thread_table_slot_t *) (table + 1);
+  table->tids = table->cloneIds + numSlots;
+  for (size_t i = 0; i < old->numSlots; i++) {
+    clone_id_t clone_id = old->cloneIds[i].clone_id;
+    if (clone_id != CLONE_ID_FREE && clone_id != CLONE_ID_REMOVED) {
+      insertThread(table, clone_id, old->cloneIds[i].tid);
+    }
+  }
+  __sync_synchronize();
+  thread_table = table;
+}
+
+void clearThreadTable()
+{
+  _real_pthread_mutex_lock(&thread_table_lock);
+  thread_table_t *table = thread_table;
+  memset(table->cloneIds, 0, table->numSlots * sizeof(thread_table_slot_t));
+  memset(table->tids, 0, table->numSlots * sizeof(thread_table_slot_t));
+  thread_table_live = 0;
+  _real_pthread_mutex_unlock(&thread_table_lock);
+}
+
+void registerThread(clone_id_t clone_id, pthread_t tid)
+{
+  _real_pthread_mutex_lock(&thread_table_lock);
+  thread_table_t *table = thread_table;
+  thread_table_slot_t *insertAt = NULL;
+  thread_table_slot_t *slot = findCloneIdSlot(table, clone_id, &insertAt);
+  if (slot == NULL) {
+    if (2 * (thread_table_live + 1) > table->numSlots) {
+      growThreadTable();
+      table = thread_table;
+      insertAt = NULL;
+      findCloneIdSlot(table, clone_id, &insertAt);
+    }
+    thread_table_live++;
+    slot = insertAt;
   }
-  if (!validAddress(return_addr)) {
-    return 0;
+  slot->tid = tid;
+  __sync_synchronize();
+  slot->clone_id = clone_id;
+
+  insertAt = NULL;
+  slot = findTidSlot(table, tid, &insertAt);
+  if (slot == NULL) {
+    slot = insertAt;
   }
-  return 1;
+  slot->clone_id = clone_id;
+  __sync_synchronize();
+  slot->tid = tid;
+  _real_pthread_mutex_unlock(&thread_table_lock);
 }
 
+void unregisterThread(clone_id_t clone_id)
+{
+  _real_pthread_mutex_lock(&thread_table_lock);
+  thread_table_t *table = thread_table;
+  thread_table_slot_t *slot = findCloneIdSlot(table, clone_id, NULL);
+  if (slot != NULL) {
+    thread_table_slot_t *tidEntry = findTidSlot(table, slot->tid, NULL);
+    if (tidEntry != NULL && tidEntry->clone_id == clone_id) {
+      removeTidSlot(table, tidEntry);
+    }
+    removeCloneIdSlot(table, slot);
+    thread_table_live--;
+  }
+  _real_pthread_mutex_unlock(&thread_table_lock);
+}
+
+/* Returns 0 if clone_id is not a live thread. */
+pthread_t cloneIdToTid(clone_id_t clone_id)
+{
+  const thread_table_t *table = thread_table;
+  size_t i = cloneIdSlot(table, clone_id);
+  for (size_t n = 0; n < table->numSlots;
+       n++, i = nextThreadSlot(table, i)) {
+    const thread_table_slot_t *slot = &table->cloneIds[i];
+    clone_id_t key = slot->clone_id;
+    if (key == CLONE_ID_FREE) {
+      break;
+    }
+    if (key == clone_id) {
+      pthread_t tid = slot->tid;
+      __sync_synchronize();
+      if (slot->clone_id == clone_id) {
+        return tid;
+      }
+    }
+  }
+  return TID_FREE;
+}
+
+/* Returns 0 if tid is not a live thread. */
+clone_id_t tidToCloneId(pthread_t tid)
+{
+  const thread_table_t *table = thread_table;
+  size_t i = tidSlot(table, tid);
+  for (size_t n = 0; n < table->numSlots;
+       n++, i = nextThreadSlot(table, i)) {
+    const thread_table_slot_t *slot = &table->tids[i];
+    pthread_t key = slot->tid;
+    if (key == TID_FREE) {
+      break;
+    }
+    if (pthread_equal(key, tid)) {
+      clone_id_t clone_id = slot->clone_id;
+      __sync_synchronize();
+      if (pthread_equal(slot->tid, tid)) {
+        return clone_id;
+      }
+    }
+  }
+  return CLONE_ID_FREE;
+}
+
+/* Unregisters the threads that no longer exist. Called with only the
+   checkpoint thread running. */
+void unregisterExitedThreads()
+{
+  const thread_table_t *table = thread_table;
+  dmtcp::vector<clone_id_t> stale_clone_ids;
+  for (size_t i = 0; i < table->numSlots; i++) {
+    clone_id_t clone_id = table->cloneIds[i].clone_id;
+    if (clone_id != CLONE_ID_FREE && clone_id != CLONE_ID_REMOVED &&
+        _real_pthread_kill(table->cloneIds[i].tid, 0) != 0) {
+      stale_clone_ids.push_back(clone_id);
+    }
+  }
+  for (size_t i = 0; i < stale_clone_ids.size(); i++) {
+    unregisterThread(stale_clone_ids[i]);
+  }
+}
 
 /* Initializes log pathnames. One log per process. */
 void initializeLogNames()
@@ -164,16 +446,25 @@ void initializeLogNames()
       "%s/synchronization-read-log-%d", tmpdir.c_str(), pid);
 }
 
+static void remapReadDataLog();
+static void enableReadDataStore();
+
 void initLogsForRecordReplay()
 {
   global_log.initialize(RECORD_LOG_PATH, MAX_LOG_LENGTH);
+  if (SYNC_IS_REPLAY && global_log.usesRelaxedReplay()) {
+    global_log.initChains();
+  } else if (SYNC_IS_REPLAY) {
+    global_log.initStreams();
+  }
 
   if (read_data_fd == -1) {
     int fd;
     JASSERT(SYNC_IS_RECORD || SYNC_IS_REPLAY);
     if (SYNC_IS_RECORD) {
+      // Read and write: the log is mapped, see logReadDataVector().
       fd = _real_open(RECORD_READ_DATA_LOG_PATH,
-                      O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+                      O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
     } else if (SYNC_IS_REPLAY) {
       fd = _real_open(RECORD_READ_DATA_LOG_PATH, O_RDONLY, 0);
     } else {
@@ -183,12 +474,19 @@ void initLogsForRecordReplay()
     read_data_fd = _real_dup2(fd, dmtcp_get_readlog_fd());
     _real_close(fd);
   }
+  if (SYNC_IS_RECORD) {
+    remapReadDataLog();
+    enableReadDataStore();
+  }
 }
 
 
-#define MAX_PROC_MAPS_AREAS 32
-static dmtcp::Util::ProcMapsArea areasToNotLog[MAX_PROC_MAPS_AREAS];
-static size_t areasToNotLogLen = 0;
+/* Every rebuild of the classifier maps a new one. The old ones are never
+   unmapped, since a wrapper may still be reading them; rebuilds are rare
+   (see initSyncAddresses()), and one that finds the same untracked areas
+   keeps the current classifier. */
+static pthread_mutex_t sync_addr_lock = PTHREAD_MUTEX_INITIALIZER;
+LIB_PRIVATE const SyncAddrClassifier *volatile sync_addr_classifier = NULL;
 
 /* Specify the patterns that you do not wish to log. The current logic uses
  * strStartsWith() and so add accordingly.
@@ -224,19 +522,36 @@ static bool shouldLogArea(char *area_name)
   return true;
 }
 
+static void addUntrackedGranule(SyncAddrClassifier *classifier,
+                                uintptr_t granule, uintptr_t state)
+{
+  size_t i = SYNC_ADDR_HASH(granule, classifier->tableSize);
+  while (classifier->table[i] != 0 &&
+         classifier->table[i] >> SYNC_ADDR_STATE_BITS != granule) {
+    i = (i + 1) & (classifier->tableSize - 1);
+  }
+  // Two areas sharing a granule leave parts of it uncovered.
+  if (classifier->table[i] != 0) {
+    state = SYNC_ADDR_MIXED;
+  }
+  classifier->table[i] = (granule << SYNC_ADDR_STATE_BITS) | state;
+}
+
+/* (Re)builds the return-address classifier from /proc/self/maps. Called on
+   exec, fork, dlopen/dlclose and when resuming from a checkpoint. */
 LIB_PRIVATE
 void initSyncAddresses()
 {
   int mapsFd = -1;
   dmtcp::Util::ProcMapsArea area;
+  dmtcp::vector<SyncAddrArea> areas;
+  size_t numGranules = 0;
 
   if (isProcessGDB()) {
     return;
   }
-  if (areasToNotLogLen > 0) {
-    return;
-  }
 
+  _real_pthread_mutex_lock(&sync_addr_lock);
   if ((mapsFd = _real_open("/proc/self/maps", O_RDONLY, S_IRUSR)) == -1) {
     perror("open");
     exit(1);
@@ -245,51 +560,75 @@ void initSyncAddresses()
   while (dmtcp::Util::readProcMapsLine(mapsFd, &area)) {
     if ((area.prot & PROT_EXEC) != 0  && strlen(area.name) != 0 &&
         shouldLogArea(area.name) == false) {
-      JASSERT(areasToNotLogLen < MAX_PROC_MAPS_AREAS) (areasToNotLogLen);
-      areasToNotLog[areasToNotLogLen++] = area;
+      SyncAddrArea untracked = { area.addr, area.endAddr };
+      areas.push_back(untracked);
+      numGranules +=
+        (((uintptr_t) area.endAddr - 1) >> SYNC_ADDR_GRANULE_SHIFT) -
+        ((uintptr_t) area.addr >> SYNC_ADDR_GRANULE_SHIFT) + 1;
     }
   }
   _real_close(mapsFd);
 
-  for (int i = 1; i < areasToNotLogLen; i++) {
-    JASSERT(areasToNotLog[i].addr >= areasToNotLog[i-1].endAddr)
-      (areasToNotLog[i].name) (areasToNotLog[i].addr) (areasToNotLog[i].endAddr)
-      (areasToNotLog[i-1].name) (areasToNotLog[i-1].addr)
-      (areasToNotLog[i-1].endAddr)
-      .Text ("ERROR: Blacklisted library addresses not in ascending order.");
+  const SyncAddrClassifier *current = sync_addr_classifier;
+  if (current != NULL && current->numAreas == areas.size() &&
+      (areas.empty() || memcmp(current->areas, &areas[0],
+                               areas.size() * sizeof(SyncAddrArea)) == 0)) {
+    _real_pthread_mutex_unlock(&sync_addr_lock);
+    return;
   }
-}
 
-LIB_PRIVATE
-bool validAddress(void *addr)
-{
-  if (areasToNotLogLen == 0) {
-    initSyncAddresses();
+  // At most half full, so that probes stay short and end on a free slot.
+  size_t tableSize = SYNC_ADDR_MIN_TABLE_SIZE;
+  while (tableSize < 2 * numGranules) {
+    tableSize *= 2;
   }
-
-  // Most user libraries are loaded at a lower memory address than the
-  // blacklisted libraries.
-  if (addr < areasToNotLog[0].addr ||
-      addr >= areasToNotLog[areasToNotLogLen - 1].endAddr) {
-    return true;
+  if (tableSize > SYNC_ADDR_MAX_TABLE_SIZE) {
+    tableSize = 0;
   }
-
-  // Now do a binary search
-  int min = 0;
-  int max = areasToNotLogLen - 1;
-  while (max >= min) {
-    int mid = (min + max) / 2;
-    if (addr >= areasToNotLog[mid].addr &&
-        addr <  areasToNotLog[mid].endAddr) {
-      return false;
+  size_t size = sizeof(SyncAddrClassifier) + tableSize * sizeof(uintptr_t) +
+                areas.size() * sizeof(SyncAddrArea);
+  void *addr = _real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO) (size);
+  SyncAddrClassifier *classifier = (SyncAddrClassifier *) addr;
+  classifier->tableSize = tableSize;
+  classifier->table = (uintptr_t *) (classifier + 1);
+  classifier->numAreas = areas.size();
+  classifier->areas = (SyncAddrArea *) (classifier->table + tableSize);
+
+  for (size_t n = 0; n < areas.size(); n++) {
+    classifier->areas[n] = areas[n];
+    if (tableSize == 0) {
+      continue;
     }
-    if (addr < areasToNotLog[mid].addr) {
-      max = mid - 1;
-    } else {
-      min = mid + 1;
+    uintptr_t begin = (uintptr_t) areas[n].addr;
+    uintptr_t end = (uintptr_t) areas[n].endAddr;
+    for (uintptr_t granule = begin >> SYNC_ADDR_GRANULE_SHIFT;
+         granule <= (end - 1) >> SYNC_ADDR_GRANULE_SHIFT;
+         granule++) {
+      uintptr_t granuleBegin = granule << SYNC_ADDR_GRANULE_SHIFT;
+      uintptr_t granuleEnd = granuleBegin + (1UL << SYNC_ADDR_GRANULE_SHIFT);
+      bool covered = begin <= granuleBegin && granuleEnd <= end;
+      addUntrackedGranule(classifier, granule,
+                          covered ? SYNC_ADDR_UNTRACKED : SYNC_ADDR_MIXED);
     }
   }
 
+  __sync_synchronize();
+  sync_addr_classifier = classifier;
+  _real_pthread_mutex_unlock(&sync_addr_lock);
+}
+
+/* For granules only partly covered by untracked code. */
+LIB_PRIVATE
+bool validAddressInAreas(const SyncAddrClassifier *classifier, void *addr)
+{
+  for (size_t i = 0; i < classifier->numAreas; i++) {
+    if (addr >= classifier->areas[i].addr &&
+        addr <  classifier->areas[i].endAddr) {
+      return false;
+    }
+  }
   return true;
 }
 
@@ -311,11 +650,17 @@ void copyFdSet(fd_set *src, fd_set *dest)
 
 void addNextLogEntry(log_entry_t& e)
 {
-  if (GET_COMMON(e, log_offset) == INVALID_LOG_OFFSET) {
-    global_log.appendEntry(e);
-  } else {
-    global_log.updateEntry(e);
-  }
+  global_log.appendEntry(e);
+}
+
+void reserveNextLogEntry(log_entry_t& e)
+{
+  global_log.reserveEntry(e);
+}
+
+void commitNextLogEntry(log_entry_t& e)
+{
+  global_log.commitEntry(e);
 }
 
 void getNextLogEntry()
@@ -326,20 +671,437 @@ void getNextLogEntry()
   }
   if (global_log.advanceToNextEntry() == 0) {
     JTRACE ( "Switching back to record." );
+    moveReadDataToEnd();
+    stdioSwitchToRecord();
     set_sync_mode(SYNC_RECORD);
   }
 }
 
-void logReadData(void *buf, int count)
+/* While recording, the read-data log is mapped like the synchronization
+   log, so that logging read data takes neither a lock nor a system call.
+   Every thread copies small payloads into its own READ_DATA_CHUNK_SIZE
+   chunk of the mapping, and only touches read_log_pos to reserve the next
+   chunk. Larger payloads get a range of their own and are written with a
+   single pwritev(). The kernel writes the dirty pages back in large batches,
+   and they are not lost if the process is killed (as fred does to its peers
+   before restarting). The file grows READ_DATA_SEGMENT_SIZE bytes at a
+   time; only the last few segments stay resident. During replay, the log is
+   mapped read-only and payloads are copied straight out of the mapping by
+   their offset, see getReadData(). */
+#define READ_DATA_CHUNK_SIZE ((size_t)64 * 1024)
+#define READ_DATA_DIRECT_WRITE_SIZE (READ_DATA_CHUNK_SIZE / 4)
+#define READ_DATA_SEGMENT_SIZE ((size_t)64 * 1024 * 1024)
+
+/* The address is kept across checkpoints, so that a thread interrupted while
+   copying into its chunk finds it mapped again on resume. */
+static char *read_data_addr = NULL;
+/* Offsets [0, read_data_mapped_end) are mapped. Only grows, and only under
+   read_data_lock, until the log is unmapped at a checkpoint. */
+static volatile size_t read_data_mapped_end = 0;
+static size_t read_data_resume_end = 0;
+static int read_data_lock = 0;
+/* Bumped at every checkpoint, so that threads reserve new chunks after it. */
+static size_t read_data_generation = 1;
+/* Ring mode: the threads logging read data, see retireReadData(). */
+static volatile int read_data_writers = 0;
+static __thread off_t read_data_chunk_pos = 0;
+static __thread off_t read_data_chunk_end = 0;
+static __thread size_t read_data_chunk_generation = 0;
+
+/* Makes read-data log offsets [0, end) accessible through read_data_addr:
+   writable while recording, extending the file as needed, and read-only
+   during replay. */
+static void mapReadData(size_t end)
+{
+  if (__builtin_expect(end <= read_data_mapped_end, 1)) {
+    return;
+  }
+  JASSERT(end <= MAX_LOG_LENGTH) (end) .Text("Read data log too large.");
+
+  while (__sync_lock_test_and_set(&read_data_lock, 1)) {
+    _real_syscall(SYS_sched_yield);
+  }
+  size_t mappedEnd = read_data_mapped_end;
+  if (end > mappedEnd) {
+    SET_IN_MMAP_WRAPPER();
+    if (mappedEnd == 0) {
+      // Reserve the address range of the whole log.
+      void *addr = _real_mmap(read_data_addr, MAX_LOG_LENGTH, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+      JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO);
+      JWARNING(read_data_addr == NULL || addr == read_data_addr)
+        (addr) (read_data_addr);
+      read_data_addr = (char *) addr;
+    }
+    size_t newEnd = (end + READ_DATA_SEGMENT_SIZE - 1) /
+                    READ_DATA_SEGMENT_SIZE * READ_DATA_SEGMENT_SIZE;
+    off_t fileSize = _real_lseek(read_data_fd, 0, SEEK_END);
+    int prot = PROT_READ;
+    int flags = MAP_SHARED | MAP_FIXED;
+    if (SYNC_IS_RECORD) {
+      if (fileSize < (off_t) newEnd) {
+        JASSERT(_real_syscall(SYS_ftruncate, read_data_fd, newEnd) == 0)
+          (JASSERT_ERRNO) (newEnd) .Text("Could not extend the read data log.");
+      }
+      prot |= PROT_WRITE;
+      flags |= MAP_NORESERVE;
+    } else {
+      JASSERT(end <= (size_t) fileSize) (end) (fileSize)
+        .Text("Read data log is truncated.");
+    }
+    void *addr = _real_mmap(read_data_addr + mappedEnd, newEnd - mappedEnd,
+                            prot, flags, read_data_fd, mappedEnd);
+    UNSET_IN_MMAP_WRAPPER();
+    JASSERT(addr == read_data_addr + mappedEnd) (JASSERT_ERRNO) (addr);
+
+    // Record and replay move forward, so drop the pages of older segments.
+    size_t kept = (LOG_SEGMENTS_KEPT_BEHIND + 1) * READ_DATA_SEGMENT_SIZE;
+    size_t dropFrom = mappedEnd > kept ? mappedEnd - kept : 0;
+    if (newEnd > kept && dropFrom < newEnd - kept) {
+      _real_syscall(SYS_madvise, read_data_addr + dropFrom,
+                    newEnd - kept - dropFrom, MADV_DONTNEED);
+    }
+    __sync_synchronize();
+    read_data_mapped_end = newEnd;
+  }
+  __sync_lock_release(&read_data_lock);
+}
+
+/* Called at a checkpoint, when no thread is logging. Everything logged so
+   far is in the file already. */
+void unmapReadDataLog()
+{
+  if (read_data_mapped_end == 0) {
+    return;
+  }
+  _real_munmap(read_data_addr, MAX_LOG_LENGTH);
+  read_data_resume_end = read_data_mapped_end;
+  read_data_mapped_end = 0;
+  read_data_generation++;
+}
+
+/* Called when replay runs out of entries and recording resumes. The mapping
+   may be read-only, and the offsets after read_log_pos may still be used by
+   entries recorded in an earlier run, so new data goes after the end of the
+   file. */
+void moveReadDataToEnd()
+{
+  if (read_data_mapped_end > 0) {
+    _real_munmap(read_data_addr, MAX_LOG_LENGTH);
+    read_data_mapped_end = 0;
+  }
+  if (read_data_fd != -1) {
+    off_t end = _real_lseek(read_data_fd, 0, SEEK_END);
+    if (end > read_log_pos) {
+      read_log_pos = end;
+    }
+  }
+  read_data_generation++;
+}
+
+/* Maps the log back in where it was before the checkpoint. */
+static void remapReadDataLog()
+{
+  if (read_data_resume_end > 0) {
+    mapReadData(read_data_resume_end);
+    read_data_resume_end = 0;
+  }
+}
+
+/* Reserves count bytes of the read-data log and returns their offset. */
+static off_t reserveReadData(size_t count)
+{
+  if (count > READ_DATA_DIRECT_WRITE_SIZE) {
+    return __sync_fetch_and_add(&read_log_pos, count);
+  }
+  if (read_data_chunk_generation != read_data_generation ||
+      read_data_chunk_pos + (off_t) count > read_data_chunk_end) {
+    // The unused tail of the old chunk stays a hole in the file.
+    read_data_chunk_pos = __sync_fetch_and_add(&read_log_pos,
+                                               READ_DATA_CHUNK_SIZE);
+    read_data_chunk_end = read_data_chunk_pos + READ_DATA_CHUNK_SIZE;
+    read_data_chunk_generation = read_data_generation;
+  }
+  off_t offset = read_data_chunk_pos;
+  read_data_chunk_pos += count;
+  return offset;
+}
+
+/* Optional content-addressed store for large read-data payloads, enabled
+   by DMTCP_READ_DATA_STORE. A payload of at least READ_DATA_STORE_THRESHOLD
+   bytes is logged as a chunk: a ReadDataChunk header, then the payload,
+   LZ4-compressed if that saves at least an eighth of it. The entry refers to
+   the chunk by its offset tagged with READ_DATA_STORE_REF, and later entries
+   with the same payload (found by its hash in read_data_store) refer to the
+   same chunk. getReadData() resolves both kinds of offsets, so a log can be
+   replayed whether or not it was recorded with the store. */
+#define READ_DATA_STORE_THRESHOLD 4096
+#define READ_DATA_STORE_REF ((off_t)1 << 62)
+#define READ_DATA_STORE_SLOTS 4096
+
+struct ReadDataChunk {
+  uint32_t size;
+  // Bytes that follow the header; the payload is compressed if less than size.
+  uint32_t storedSize;
+};
+
+/* One recently logged chunk per slot, indexed by the hash of its payload.
+   A newer chunk replaces the older one on collision. size is 0 if unused. */
+struct ReadDataStoreSlot {
+  uint64_t hash;
+  uint32_t size;
+  off_t chunk;
+};
+
+static bool read_data_store_enabled = false;
+static ReadDataStoreSlot read_data_store[READ_DATA_STORE_SLOTS];
+static int read_data_store_lock = 0;
+/* Per-thread buffer for gathering, compressing and decompressing payloads.
+   It only grows. */
+static __thread char *read_data_scratch = NULL;
+static __thread size_t read_data_scratch_size = 0;
+
+static void enableReadDataStore()
+{
+  char *store = getenv(ENV_VAR_READ_DATA_STORE);
+  read_data_store_enabled = store != NULL && atoi(store) != 0;
+}
+
+static char *readDataScratch(size_t size)
+{
+  if (size > read_data_scratch_size) {
+    if (read_data_scratch != NULL) {
+      _real_munmap(read_data_scratch, read_data_scratch_size);
+    }
+    size_t newSize = std::max(size, 2 * read_data_scratch_size);
+    newSize = (newSize + DMTCP_PAGE_SIZE - 1) / DMTCP_PAGE_SIZE *
+              DMTCP_PAGE_SIZE;
+    void *addr = _real_mmap(NULL, newSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    JASSERT(addr != MAP_FAILED) (JASSERT_ERRNO) (newSize);
+    read_data_scratch = (char *) addr;
+    read_data_scratch_size = newSize;
+  }
+  return read_data_scratch;
+}
+
+/* A fast 64-bit hash (MurmurHash3's mixing, eight bytes at a time). */
+static uint64_t hashReadData(const char *data, size_t size)
+{
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t k;
+    memcpy(&k, data + i, sizeof(k));
+    k *= c1;
+    k = (k << 31) | (k >> 33);
+    k *= c2;
+    h ^= k;
+    h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+  }
+  uint64_t k = 0;
+  memcpy(&k, data + i, size - i);
+  h ^= k * c1;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* Returns the payload of the chunk at offset, which must be size bytes. The
+   pointer is valid until the calling thread uses the store again. */
+static const char *getReadDataChunk(off_t offset, size_t size,
+                                    char *scratch)
+{
+  ReadDataChunk header;
+  mapReadData(offset + sizeof(header));
+  memcpy(&header, read_data_addr + offset, sizeof(header));
+  JASSERT(header.size == size) (header.size) (size) (offset);
+  off_t stored = offset + sizeof(header);
+  mapReadData(stored + header.storedSize);
+  if (header.storedSize == header.size) {
+    return read_data_addr + stored;
+  }
+  JASSERT(lz4Decompress(read_data_addr + stored, header.storedSize,
+                        scratch, size))
+    (offset) (size) .Text("Corrupt compressed chunk in the read-data log.");
+  return scratch;
+}
+
+/* Logs the payload through the store, and returns its tagged offset. */
+static off_t storeReadData(const char *payload, size_t size, char *scratch)
+{
+  uint64_t hash = hashReadData(payload, size);
+  ReadDataStoreSlot *slot = &read_data_store[hash % READ_DATA_STORE_SLOTS];
+  while (__sync_lock_test_and_set(&read_data_store_lock, 1)) {
+    _real_syscall(SYS_sched_yield);
+  }
+  ReadDataStoreSlot cached = *slot;
+  __sync_lock_release(&read_data_store_lock);
+  if (cached.size == size && cached.hash == hash &&
+      memcmp(getReadDataChunk(cached.chunk, size, scratch), payload,
+             size) == 0) {
+    return cached.chunk | READ_DATA_STORE_REF;
+  }
+
+  ReadDataChunk header;
+  header.size = size;
+  header.storedSize = lz4Compress(payload, size, scratch, size - size / 8);
+  const char *stored = scratch;
+  if (header.storedSize == 0) {
+    header.storedSize = size;
+    stored = payload;
+  }
+  size_t count = sizeof(header) + header.storedSize;
+  off_t offset = reserveReadData(count);
+  mapReadData(offset + count);
+  memcpy(read_data_addr + offset, &header, sizeof(header));
+  memcpy(read_data_addr + offset + sizeof(header), stored, header.storedSize);
+
+  while (__sync_lock_test_and_set(&read_data_store_lock, 1)) {
+    _real_syscall(SYS_sched_yield);
+  }
+  slot->hash = hash;
+  slot->size = size;
+  slot->chunk = offset;
+  __sync_lock_release(&read_data_store_lock);
+  return offset | READ_DATA_STORE_REF;
+}
+
+/* Appends the buffers to the read-data log, one after the other, and returns
+   the offset of the first byte there, or the tagged offset of the chunk
+   holding them if they go through the store. */
+static off_t writeReadDataVector(const struct iovec *iov, int iovcnt)
+{
+  size_t count = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    count += iov[i].iov_len;
+  }
+  if (read_data_store_enabled && count >= READ_DATA_STORE_THRESHOLD &&
+      count <= (uint32_t) -1) {
+    // Room for the gathered payload, then for compressing or verifying it.
+    char *scratch = readDataScratch(iovcnt > 1 ? 2 * count : count);
+    const char *payload = (const char *) iov[0].iov_base;
+    if (iovcnt > 1) {
+      char *dest = scratch;
+      for (int i = 0; i < iovcnt; i++) {
+        memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+        dest += iov[i].iov_len;
+      }
+      payload = scratch;
+      scratch += count;
+    }
+    return storeReadData(payload, count, scratch);
+  }
+  off_t offset = reserveReadData(count);
+  mapReadData(offset + count);
+
+  size_t skip = 0;
+  if (count > READ_DATA_DIRECT_WRITE_SIZE) {
+    ssize_t written = _real_pwritev(read_data_fd, iov, iovcnt, offset);
+    JASSERT(written != -1) (JASSERT_ERRNO) (count);
+    // Copy whatever a short write left over.
+    skip = written;
+  }
+  char *dest = read_data_addr + offset + skip;
+  for (int i = 0; i < iovcnt; i++) {
+    if (skip >= iov[i].iov_len) {
+      skip -= iov[i].iov_len;
+      continue;
+    }
+    memcpy(dest, (char *) iov[i].iov_base + skip, iov[i].iov_len - skip);
+    dest += iov[i].iov_len - skip;
+    skip = 0;
+  }
+  return offset;
+}
+
+off_t logReadDataVector(const struct iovec *iov, int iovcnt)
 {
   if (SYNC_IS_REPLAY) {
     JASSERT (false).Text("Asked to log read data while in replay. "
         "This is probably not intended.");
   }
   JASSERT(read_data_fd != -1);
-  int written = _real_write(read_data_fd, buf, count);
-  JASSERT ( written == count );
-  read_log_pos += written;
+  // See retireReadData().
+  bool ring = global_log.usesRing();
+  if (ring) {
+    __sync_fetch_and_add(&read_data_writers, 1);
+  }
+  off_t offset = writeReadDataVector(iov, iovcnt);
+  if (ring) {
+    __sync_fetch_and_sub(&read_data_writers, 1);
+  }
+  return offset;
+}
+
+off_t logReadData(const void *buf, size_t count)
+{
+  struct iovec iov;
+  iov.iov_base = (void *) buf;
+  iov.iov_len = count;
+  return logReadDataVector(&iov, 1);
+}
+
+/* Returns the count bytes logged at offset, in the mapped read-data log or,
+   for a compressed chunk, in a per-thread buffer. */
+const char *getReadData(off_t offset, size_t count)
+{
+  JASSERT(read_data_fd != -1);
+  if (offset & READ_DATA_STORE_REF) {
+    return getReadDataChunk(offset & ~READ_DATA_STORE_REF, count,
+                            readDataScratch(count));
+  }
+  mapReadData(offset + count);
+  return read_data_addr + offset;
+}
+
+/* Copies the bytes logged at offset into the buffers, filling each one in
+   turn. */
+void getReadDataVector(off_t offset, const struct iovec *iov, int iovcnt)
+{
+  size_t count = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    count += iov[i].iov_len;
+  }
+  const char *src = getReadData(offset, count);
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(iov[i].iov_base, src, iov[i].iov_len);
+    src += iov[i].iov_len;
+  }
+}
+
+/* Ring mode: the read data logged so far is only referenced by retired log
+   entries. It becomes a hole in the file, and new payloads start over at
+   offset 0, within the same mapping; the threads take new chunks after the
+   checkpoint (see unmapReadDataLog()). A thread stopped by the checkpoint
+   while logging read data would write it into the reused range, so then
+   the offsets go on from where they are, and only whole pages are freed. */
+void retireReadData()
+{
+  bool rebase = read_data_writers == 0;
+  off_t length = rebase ? read_log_pos :
+                 read_log_pos - read_log_pos % DMTCP_PAGE_SIZE;
+  if (read_data_fd == -1 || length == 0) {
+    return;
+  }
+  // Later payloads must not refer to chunks in the hole.
+  memset(read_data_store, 0, sizeof(read_data_store));
+  if (_real_syscall(SYS_fallocate, read_data_fd,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    (off_t) 0, length) != 0) {
+    JTRACE("Could not punch a hole into the read data log; its offsets keep"
+           " growing.") (JASSERT_ERRNO) (length);
+    return;
+  }
+  if (rebase) {
+    read_log_pos = 0;
+  }
 }
 
 static void setupCommonFields(log_entry_t *e, clone_id_t clone_id, event_code_t event)
@@ -3025,8 +3787,10 @@ static inline bool is_optional_event_for(event_code_t event,
   case fseek_event:
   case fwrite_event:
   case fread_event:
-  case getc_event:
     return query || opt_event == mmap_event;
+  case getc_event:
+    // A refill may allocate the stream buffer (see stdio_refill()).
+    return query || opt_event == mmap_event || opt_event == malloc_event;
   case fdopen_event:
     return query || opt_event == mmap_event || opt_event == malloc_event;
   case fopen64_event:
@@ -3054,12 +3818,11 @@ static inline bool is_optional_event_for(event_code_t event,
   }
 }
 
-/* Given the event number of an optional event, executes the action to fulfill
-   that event. */
-static void execute_optional_event(int opt_event_num)
+/* Given the decoded entry of an optional event, executes the action to
+   fulfill that event. */
+static void execute_optional_event(const log_entry_t& temp_entry)
 {
-  log_entry_t temp_entry = EMPTY_LOG_ENTRY;
-  global_log.getCurrentEntry(temp_entry);
+  int opt_event_num = GET_COMMON(temp_entry, event);
 
   if (opt_event_num == mmap_event) {
     size_t length = GET_FIELD(temp_entry, mmap, length);
@@ -3097,48 +3860,154 @@ static void execute_optional_event(int opt_event_num)
   }
 }
 
+/* Copies the header and event data of 'src', and nothing past them. */
+static void copyLogEntry(log_entry_t *dst, const log_entry_t *src)
+{
+  int event_size = -1;
+  GET_EVENT_SIZE(GET_COMMON_PTR(src, event), event_size);
+  dst->header = src->header;
+  memcpy(&dst->event_data, &src->event_data, event_size);
+}
+
+/* Every turn predicate checks the clone id and event first (see
+   base_turn_check()), so those are checked on the header alone, and the
+   rest of the entry is decoded only when they match. */
+static bool headerMatches(const log_entry_header_t& header,
+                          log_entry_t *my_entry)
+{
+  return header.clone_id == GET_COMMON_PTR(my_entry, clone_id) &&
+         header.event == GET_COMMON_PTR(my_entry, event);
+}
+
+/* Relaxed replay: waitForTurn(), but with this thread's next entry instead of
+   the head of the log, and once it matches, waiting for the entries it
+   depends on instead of for the head to reach it. */
+static void waitForChainTurn(log_entry_t *my_entry, turn_pred_t pred)
+{
+  log_entry_t temp_entry = EMPTY_LOG_ENTRY;
+  log_entry_header_t header;
+
+  while (1) {
+    int turn = global_log.turnFutexValue(my_clone_id);
+    if (global_log.getThreadHeader(my_clone_id, header) > 0) {
+      if (headerMatches(header, my_entry)) {
+        global_log.getThreadEntry(my_clone_id, temp_entry);
+        if ((*pred)(&temp_entry, my_entry)) {
+          global_log.waitForThreadEntryDeps(my_clone_id);
+          break;
+        }
+      }
+      if (header.isOptional == 1) {
+        if (!is_optional_event_for((event_code_t)GET_COMMON_PTR(my_entry, event),
+                                   (event_code_t)header.event,
+                                   false)) {
+          JASSERT(false);
+        }
+        // The optional entry is this thread's next one, not the head's.
+        global_log.getThreadEntry(my_clone_id, temp_entry);
+        execute_optional_event(temp_entry);
+        continue;
+      }
+    }
+    global_log.waitForTurnChange(my_clone_id, turn);
+  }
+
+  copyLogEntry(my_entry, &temp_entry);
+}
+
+/* Ticket replay: the same, but until the head of the log is this thread's
+   next entry, the thread only compares two integers (see isThreadTurn()),
+   instead of decoding the head and checking it against its own entry. */
+static void waitForTicketTurn(log_entry_t *my_entry, turn_pred_t pred)
+{
+  log_entry_t temp_entry = EMPTY_LOG_ENTRY;
+  log_entry_header_t header;
+
+  while (1) {
+    int turn = global_log.turnFutexValue(my_clone_id);
+    if (global_log.isThreadTurn(my_clone_id)) {
+      global_log.getCurrentHeader(header);
+      if (headerMatches(header, my_entry)) {
+        global_log.getCurrentEntry(temp_entry);
+        if ((*pred)(&temp_entry, my_entry))
+          break;
+      }
+      if (header.isOptional == 1) {
+        if (!is_optional_event_for((event_code_t)GET_COMMON_PTR(my_entry, event),
+                                   (event_code_t)header.event,
+                                   false)) {
+          JASSERT(false);
+        }
+        global_log.getCurrentEntry(temp_entry);
+        execute_optional_event(temp_entry);
+        continue;
+      }
+    }
+    global_log.waitForTurnChange(my_clone_id, turn);
+  }
+
+  copyLogEntry(my_entry, &temp_entry);
+}
+
 /* Waits until the head of the log contains an entry matching pertinent fields
    of 'my_entry'. When it does, 'my_entry' is modified to point to the head of
    the log. */
 void waitForTurn(log_entry_t *my_entry, turn_pred_t pred)
 {
   log_entry_t temp_entry = EMPTY_LOG_ENTRY;
+  log_entry_header_t header;
   memfence();
 
+  if (global_log.replaysByChains()) {
+    waitForChainTurn(my_entry, pred);
+    return;
+  }
+  if (global_log.replaysByTickets()) {
+    waitForTicketTurn(my_entry, pred);
+    return;
+  }
+
   while (1) {
-    global_log.getCurrentEntry(temp_entry);
-    if ((*pred)(&temp_entry, my_entry))
-      break;
+    int turn = global_log.turnFutexValue(my_clone_id);
+    global_log.getCurrentHeader(header);
+    if (headerMatches(header, my_entry)) {
+      global_log.getCurrentEntry(temp_entry);
+      if ((*pred)(&temp_entry, my_entry))
+        break;
+    }
     /* Also check for an optional event for this clone_id. */
-    if (GET_COMMON(temp_entry, clone_id) == my_clone_id &&
-        GET_COMMON(temp_entry, isOptional) == 1) {
+    if (header.clone_id == my_clone_id && header.isOptional == 1) {
       if (!is_optional_event_for((event_code_t)GET_COMMON_PTR(my_entry, event),
-                                 (event_code_t)GET_COMMON(temp_entry, event),
+                                 (event_code_t)header.event,
                                  false)) {
         JASSERT(false);
       }
-      execute_optional_event(GET_COMMON(temp_entry, event));
+      global_log.getCurrentEntry(temp_entry);
+      execute_optional_event(temp_entry);
+      continue;
     }
 
-    memfence();
-    usleep(1);
+    global_log.waitForTurnChange(my_clone_id, turn);
   }
 
-  global_log.getCurrentEntry(*my_entry);
+  copyLogEntry(my_entry, &temp_entry);
 }
 
 void waitForExecBarrier()
 {
-  log_entry_t temp_entry = EMPTY_LOG_ENTRY;
+  log_entry_header_t header;
   while (1) {
-    global_log.getCurrentEntry(temp_entry);
-    if (GET_COMMON(temp_entry, event) == exec_barrier_event) {
+    global_log.getCurrentHeader(header);
+    if (header.event == exec_barrier_event) {
       // We don't check clone ids because anyone can do an exec.
       break;
     }
     memfence();
     usleep(20);
   }
+  if (global_log.replaysByChains()) {
+    global_log.takeHeadEntry();
+  }
 }
 
 /* A do-nothing event that can be called from user-space via
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 // Needed for readdir:
 #include <sys/types.h>
+#include <stdint.h>
 #include <dirent.h>
 #include <stdio.h>
 #include <sys/time.h>
@@ -65,8 +66,12 @@ static inline bool isProcessGDB() {
 
 #define LIB_PRIVATE __attribute__ ((visibility ("hidden")))
 
-#define MAX_LOG_LENGTH ((size_t)250 * 1024 * 1024)
-#define INVALID_LOG_OFFSET (~0U)
+/* Size of the address range reserved for the synchronization log: 256 GB, or
+   1 GB on 32-bit. Only the segments in use are backed by the log file (see
+   LOG_SEGMENT_SIZE in log.h), so this bounds the log, not its memory or disk
+   usage. */
+#define MAX_LOG_LENGTH ((size_t)1 << (sizeof(void *) == 8 ? 38 : 30))
+#define INVALID_LOG_OFFSET (~(log_off_t)0)
 #define SYNC_NOOP   0
 #define SYNC_RECORD 1
 #define SYNC_REPLAY 2
@@ -107,8 +112,7 @@ static inline bool isProcessGDB() {
 #define WRAPPER_HEADER_VOID_RAW(name, real_func, ...)                   \
   void *return_addr = GET_RETURN_ADDRESS();                             \
   do {                                                                  \
-    if (!shouldSynchronize(return_addr) ||                              \
-        jalib::Filesystem::GetProgramName() == "gdb") {                 \
+    if (!shouldSynchronize(return_addr)) {                              \
       real_func(__VA_ARGS__);                                           \
       return;                                                           \
     }                                                                   \
@@ -117,16 +121,14 @@ static inline bool isProcessGDB() {
 #define WRAPPER_HEADER_RAW(ret_type, name, real_func, ...)              \
   void *return_addr = GET_RETURN_ADDRESS();                             \
   do {                                                                  \
-    if (!shouldSynchronize(return_addr) ||                              \
-        jalib::Filesystem::GetProgramName() == "gdb") {                 \
+    if (!shouldSynchronize(return_addr)) {                              \
       return real_func(__VA_ARGS__);                                    \
     }                                                                   \
   } while(0)
 
 #define WRAPPER_HEADER_NO_ARGS(ret_type, name, real_func)                  \
   void *return_addr = GET_RETURN_ADDRESS();                             \
-  if (!shouldSynchronize(return_addr) ||                                \
-      jalib::Filesystem::GetProgramName() == "gdb") {                   \
+  if (!shouldSynchronize(return_addr)) {                                \
     return real_func();                                             \
   }                                                                     \
   ret_type retval;                                                      \
@@ -135,8 +137,7 @@ static inline bool isProcessGDB() {
 
 #define WRAPPER_HEADER_NO_RETURN(name, real_func, ...)                  \
   void *return_addr = GET_RETURN_ADDRESS();                             \
-  if (!shouldSynchronize(return_addr) ||                                \
-      jalib::Filesystem::GetProgramName() == "gdb") {                   \
+  if (!shouldSynchronize(return_addr)) {                                \
     real_func(__VA_ARGS__);                                             \
   }                                                                     \
   log_entry_t my_entry = create_##name##_entry(my_clone_id,             \
@@ -151,8 +152,7 @@ static inline bool isProcessGDB() {
 #define WRAPPER_HEADER_CKPT_DISABLED(ret_type, name, real_func, ...)    \
   void *return_addr = GET_RETURN_ADDRESS();                             \
   ret_type retval;                                                      \
-  if (!shouldSynchronize(return_addr) ||                                \
-      jalib::Filesystem::GetProgramName() == "gdb") {                   \
+  if (!shouldSynchronize(return_addr)) {                                \
     retval = real_func(__VA_ARGS__);                                    \
     WRAPPER_EXECUTION_ENABLE_CKPT();                                    \
     return retval;                                                      \
@@ -205,44 +205,28 @@ static inline bool isProcessGDB() {
 
 #define WRAPPER_REPLAY_READ_FROM_READ_LOG(name, ptr, len)           \
   do {                                                              \
-    JASSERT ( read_data_fd != -1 );                                 \
-    lseek(read_data_fd,                                             \
-          GET_FIELD(my_entry, name, data_offset), SEEK_SET);        \
-    dmtcp::Util::readAll(read_data_fd, ptr, len);                   \
+    memcpy(ptr, getReadData(GET_FIELD(my_entry, name, data_offset), \
+                            len), len);                             \
   } while (0)
 
 #define WRAPPER_LOG_WRITE_INTO_READ_LOG(name, ptr, len)             \
   do {                                                              \
     int saved_errno = errno;                                        \
-    _real_pthread_mutex_lock(&read_data_mutex);                     \
-    SET_FIELD2(my_entry, name, data_offset, read_log_pos);          \
-    logReadData(ptr, len);                                          \
-    _real_pthread_mutex_unlock(&read_data_mutex);                   \
+    SET_FIELD2(my_entry, name, data_offset, logReadData(ptr, len)); \
     errno = saved_errno;                                            \
   } while (0)
 
-#define WRAPPER_REPLAY_READ_VECTOR_FROM_READ_LOG(name, iov, iovcnt)           \
+#define WRAPPER_REPLAY_READ_VECTOR_FROM_READ_LOG(name, iov, iovcnt)  \
   do {                                                              \
-    JASSERT ( read_data_fd != -1 );                                 \
-    lseek(read_data_fd,                                             \
-          GET_FIELD(my_entry, name, data_offset), SEEK_SET);        \
-    JASSERT(_real_readv(read_data_fd, iov, iovcnt) != -1);          \
+    getReadDataVector(GET_FIELD(my_entry, name, data_offset),       \
+                      iov, iovcnt);                                 \
   } while (0)
 
-#define WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(name, iov, iovcnt, retval) \
+#define WRAPPER_LOG_WRITE_VECTOR_INTO_READ_LOG(name, iov, iovcnt)   \
   do {                                                              \
     int saved_errno = errno;                                        \
-    if (SYNC_IS_REPLAY) {                                           \
-      JASSERT (false).Text("Asked to log read data while in replay."\
-                           "\nThis is probably not intended.");     \
-    }                                                               \
-    JASSERT ( read_data_fd != -1 );                                 \
-    _real_pthread_mutex_lock(&read_data_mutex);                     \
-    SET_FIELD2(my_entry, name, data_offset, read_log_pos);          \
-    int written = _real_writev(read_data_fd, iov, iovcnt);          \
-    JASSERT ( written >= retval );                                  \
-    read_log_pos += written;                                        \
-    _real_pthread_mutex_unlock(&read_data_mutex);                   \
+    SET_FIELD2(my_entry, name, data_offset,                         \
+               logReadDataVector(iov, iovcnt));                     \
     errno = saved_errno;                                            \
   } while (0)
 
@@ -261,7 +245,22 @@ static inline bool isProcessGDB() {
     WRAPPER_LOG_WRITE_ENTRY_VOID(my_entry);                         \
   } while (0)
 
-#define WRAPPER_LOG_UPDATE_ENTRY WRAPPER_LOG_WRITE_ENTRY
+/* For entries whose fields are only known after the real call: reserve the
+   entry's place in the log before the call, and commit it after. */
+#define WRAPPER_LOG_RESERVE_ENTRY(my_entry)                         \
+  do {                                                              \
+    SET_COMMON2(my_entry, isOptional, isOptionalEvent);             \
+    reserveNextLogEntry(my_entry);                                  \
+  } while (0)
+
+#define WRAPPER_LOG_COMMIT_ENTRY(my_entry)                          \
+  do {                                                              \
+    SET_COMMON2(my_entry, retval, (void*)(unsigned long)retval);    \
+    SET_COMMON2(my_entry, my_errno, errno);                         \
+    SET_COMMON2(my_entry, isOptional, isOptionalEvent);             \
+    commitNextLogEntry(my_entry);                                   \
+    errno = GET_COMMON(my_entry, my_errno);                         \
+  } while (0)
 
 #define WRAPPER_LOG(real_func, ...)                                 \
   do {                                                              \
@@ -333,290 +332,161 @@ static inline bool isProcessGDB() {
     }                                                               \
   } while (0)
 
+/* Every event, in event_code_t order (the first one is accept_event = 1).
+   Tables indexed by event code are initialized from this list, so new events
+   must be added at the end. */
+#define FOREACH_EVENT(MACRO, ...)                                              \
+  MACRO(accept, __VA_ARGS__)                                                   \
+  MACRO(accept4, __VA_ARGS__)                                                  \
+  MACRO(access, __VA_ARGS__)                                                   \
+  MACRO(bind, __VA_ARGS__)                                                     \
+  MACRO(calloc, __VA_ARGS__)                                                   \
+  MACRO(chmod, __VA_ARGS__)                                                    \
+  MACRO(chown, __VA_ARGS__)                                                    \
+  MACRO(close, __VA_ARGS__)                                                    \
+  MACRO(closedir, __VA_ARGS__)                                                 \
+  MACRO(connect, __VA_ARGS__)                                                  \
+  MACRO(dup, __VA_ARGS__)                                                      \
+  MACRO(dup2, __VA_ARGS__)                                                     \
+  MACRO(dup3, __VA_ARGS__)                                                     \
+  MACRO(exec_barrier, __VA_ARGS__)                                             \
+  MACRO(fclose, __VA_ARGS__)                                                   \
+  MACRO(fchdir, __VA_ARGS__)                                                   \
+  MACRO(fcntl, __VA_ARGS__)                                                    \
+  MACRO(fdatasync, __VA_ARGS__)                                                \
+  MACRO(fdopen, __VA_ARGS__)                                                   \
+  MACRO(fdopendir, __VA_ARGS__)                                                \
+  MACRO(fgets, __VA_ARGS__)                                                    \
+  MACRO(ferror, __VA_ARGS__)                                                   \
+  MACRO(feof, __VA_ARGS__)                                                     \
+  MACRO(fileno, __VA_ARGS__)                                                   \
+  MACRO(fflush, __VA_ARGS__)                                                   \
+  MACRO(setvbuf, __VA_ARGS__)                                                  \
+  MACRO(fopen, __VA_ARGS__)                                                    \
+  MACRO(fopen64, __VA_ARGS__)                                                  \
+  MACRO(freopen, __VA_ARGS__)                                                  \
+  MACRO(fprintf, __VA_ARGS__)                                                  \
+  MACRO(fscanf, __VA_ARGS__)                                                   \
+  MACRO(fseek, __VA_ARGS__)                                                    \
+  MACRO(fputs, __VA_ARGS__)                                                    \
+  MACRO(fputc, __VA_ARGS__)                                                    \
+  MACRO(free, __VA_ARGS__)                                                     \
+  MACRO(fsync, __VA_ARGS__)                                                    \
+  MACRO(ftell, __VA_ARGS__)                                                    \
+  MACRO(fwrite, __VA_ARGS__)                                                   \
+  MACRO(fread, __VA_ARGS__)                                                    \
+  MACRO(fxstat, __VA_ARGS__)                                                   \
+  MACRO(fxstat64, __VA_ARGS__)                                                 \
+  MACRO(getc, __VA_ARGS__)                                                     \
+  MACRO(getcwd, __VA_ARGS__)                                                   \
+  MACRO(gettimeofday, __VA_ARGS__)                                             \
+  MACRO(ioctl, __VA_ARGS__)                                                    \
+  MACRO(fgetc, __VA_ARGS__)                                                    \
+  MACRO(ungetc, __VA_ARGS__)                                                   \
+  MACRO(getline, __VA_ARGS__)                                                  \
+  MACRO(getpeername, __VA_ARGS__)                                              \
+  MACRO(getsockname, __VA_ARGS__)                                              \
+  MACRO(getsockopt, __VA_ARGS__)                                               \
+  MACRO(libc_memalign, __VA_ARGS__)                                            \
+  MACRO(link, __VA_ARGS__)                                                     \
+  MACRO(symlink, __VA_ARGS__)                                                  \
+  MACRO(listen, __VA_ARGS__)                                                   \
+  MACRO(localtime, __VA_ARGS__)                                                \
+  MACRO(lseek, __VA_ARGS__)                                                    \
+  MACRO(lseek64, __VA_ARGS__)                                                  \
+  MACRO(llseek, __VA_ARGS__)                                                   \
+  MACRO(lxstat, __VA_ARGS__)                                                   \
+  MACRO(lxstat64, __VA_ARGS__)                                                 \
+  MACRO(malloc, __VA_ARGS__)                                                   \
+  MACRO(mkdir, __VA_ARGS__)                                                    \
+  MACRO(mkstemp, __VA_ARGS__)                                                  \
+  MACRO(mmap, __VA_ARGS__)                                                     \
+  MACRO(mmap64, __VA_ARGS__)                                                   \
+  MACRO(mremap, __VA_ARGS__)                                                   \
+  MACRO(munmap, __VA_ARGS__)                                                   \
+  MACRO(open, __VA_ARGS__)                                                     \
+  MACRO(open64, __VA_ARGS__)                                                   \
+  MACRO(openat, __VA_ARGS__)                                                   \
+  MACRO(opendir, __VA_ARGS__)                                                  \
+  MACRO(pread, __VA_ARGS__)                                                    \
+  MACRO(preadv, __VA_ARGS__)                                                   \
+  MACRO(putc, __VA_ARGS__)                                                     \
+  MACRO(pwrite, __VA_ARGS__)                                                   \
+  MACRO(pwritev, __VA_ARGS__)                                                  \
+  MACRO(pthread_detach, __VA_ARGS__)                                           \
+  MACRO(pthread_create, __VA_ARGS__)                                           \
+  MACRO(pthread_cond_broadcast, __VA_ARGS__)                                   \
+  MACRO(pthread_mutex_lock, __VA_ARGS__)                                       \
+  MACRO(pthread_mutex_trylock, __VA_ARGS__)                                    \
+  MACRO(pthread_cond_signal, __VA_ARGS__)                                      \
+  MACRO(pthread_mutex_unlock, __VA_ARGS__)                                     \
+  MACRO(pthread_cond_wait, __VA_ARGS__)                                        \
+  MACRO(pthread_cond_timedwait, __VA_ARGS__)                                   \
+  MACRO(pthread_exit, __VA_ARGS__)                                             \
+  MACRO(pthread_join, __VA_ARGS__)                                             \
+  MACRO(pthread_kill, __VA_ARGS__) /* no return event -- asynchronous */    \
+  MACRO(pthread_rwlock_unlock, __VA_ARGS__)                                    \
+  MACRO(pthread_rwlock_rdlock, __VA_ARGS__)                                    \
+  MACRO(pthread_rwlock_wrlock, __VA_ARGS__)                                    \
+  MACRO(rand, __VA_ARGS__)                                                     \
+  MACRO(read, __VA_ARGS__)                                                     \
+  MACRO(readv, __VA_ARGS__)                                                    \
+  MACRO(readdir, __VA_ARGS__)                                                  \
+  MACRO(readdir_r, __VA_ARGS__)                                                \
+  MACRO(readlink, __VA_ARGS__)                                                 \
+  MACRO(realloc, __VA_ARGS__)                                                  \
+  MACRO(rename, __VA_ARGS__)                                                   \
+  MACRO(rewind, __VA_ARGS__)                                                   \
+  MACRO(rmdir, __VA_ARGS__)                                                    \
+  MACRO(select, __VA_ARGS__)                                                   \
+  MACRO(ppoll, __VA_ARGS__)                                                    \
+  MACRO(signal_handler, __VA_ARGS__)                                           \
+  MACRO(sigwait, __VA_ARGS__)                                                  \
+  MACRO(setsockopt, __VA_ARGS__)                                               \
+  MACRO(socket, __VA_ARGS__)                                                   \
+  MACRO(socketpair, __VA_ARGS__)                                               \
+  MACRO(srand, __VA_ARGS__)                                                    \
+  MACRO(time, __VA_ARGS__)                                                     \
+  MACRO(tmpfile, __VA_ARGS__)                                                  \
+  MACRO(truncate, __VA_ARGS__)                                                 \
+  MACRO(unlink, __VA_ARGS__)                                                   \
+  MACRO(user, __VA_ARGS__)                                                     \
+  MACRO(write, __VA_ARGS__)                                                    \
+  MACRO(writev, __VA_ARGS__)                                                   \
+  MACRO(xstat, __VA_ARGS__)                                                    \
+  MACRO(xstat64, __VA_ARGS__)                                                  \
+  MACRO(epoll_create, __VA_ARGS__)                                             \
+  MACRO(epoll_create1, __VA_ARGS__)                                            \
+  MACRO(epoll_ctl, __VA_ARGS__)                                                \
+  MACRO(epoll_wait, __VA_ARGS__)                                               \
+  MACRO(getpwnam_r, __VA_ARGS__)                                               \
+  MACRO(getpwuid_r, __VA_ARGS__)                                               \
+  MACRO(getgrnam_r, __VA_ARGS__)                                               \
+  MACRO(getgrgid_r, __VA_ARGS__)                                               \
+  MACRO(getaddrinfo, __VA_ARGS__)                                              \
+  MACRO(freeaddrinfo, __VA_ARGS__)                                             \
+  MACRO(getnameinfo, __VA_ARGS__)                                              \
+  MACRO(sendto, __VA_ARGS__)                                                   \
+  MACRO(sendmsg, __VA_ARGS__)                                                  \
+  MACRO(recvfrom, __VA_ARGS__)                                                 \
+  MACRO(recvmsg, __VA_ARGS__)                                                  \
+                                                                               \
+  MACRO(wait4, __VA_ARGS__)                                                    \
+  MACRO(waitid, __VA_ARGS__)
+
+#define FOREACH_NAME_STMT(name, MACRO, ...) MACRO(name, __VA_ARGS__);
 #define FOREACH_NAME(MACRO, ...)                                               \
   do {                                                                         \
-    MACRO(accept, __VA_ARGS__);                                                \
-    MACRO(accept4, __VA_ARGS__);                                               \
-    MACRO(access, __VA_ARGS__);                                                \
-    MACRO(bind, __VA_ARGS__);                                                  \
-    MACRO(calloc, __VA_ARGS__);                                                \
-    MACRO(chmod, __VA_ARGS__);                                                 \
-    MACRO(chown, __VA_ARGS__);                                                 \
-    MACRO(close, __VA_ARGS__);                                                 \
-    MACRO(closedir, __VA_ARGS__);                                              \
-    MACRO(connect, __VA_ARGS__);                                               \
-    MACRO(dup, __VA_ARGS__);                                                   \
-    MACRO(dup2, __VA_ARGS__);                                                  \
-    MACRO(dup3, __VA_ARGS__);                                                  \
-    MACRO(exec_barrier, __VA_ARGS__);                                          \
-    MACRO(fclose, __VA_ARGS__);                                                \
-    MACRO(fchdir, __VA_ARGS__);                                                \
-    MACRO(fcntl, __VA_ARGS__);                                                 \
-    MACRO(fdatasync, __VA_ARGS__);                                             \
-    MACRO(fdopen, __VA_ARGS__);                                                \
-    MACRO(fdopendir, __VA_ARGS__);                                             \
-    MACRO(fgets, __VA_ARGS__);                                                 \
-    MACRO(ferror, __VA_ARGS__);                                                \
-    MACRO(feof, __VA_ARGS__);                                                  \
-    MACRO(fileno, __VA_ARGS__);                                                \
-    MACRO(fflush, __VA_ARGS__);                                                \
-    MACRO(setvbuf, __VA_ARGS__);                                               \
-    MACRO(setvbuf, __VA_ARGS__);                                               \
-    MACRO(fopen, __VA_ARGS__);                                                 \
-    MACRO(fopen64, __VA_ARGS__);                                               \
-    MACRO(freopen, __VA_ARGS__);                                               \
-    MACRO(fprintf, __VA_ARGS__);                                               \
-    MACRO(fscanf, __VA_ARGS__);                                                \
-    MACRO(fseek, __VA_ARGS__);                                                 \
-    MACRO(fputs, __VA_ARGS__);                                                 \
-    MACRO(fputc, __VA_ARGS__);                                                 \
-    MACRO(free, __VA_ARGS__);                                                  \
-    MACRO(fsync, __VA_ARGS__);                                                 \
-    MACRO(ftell, __VA_ARGS__);                                                 \
-    MACRO(fwrite, __VA_ARGS__);                                                \
-    MACRO(fread, __VA_ARGS__);                                                 \
-    MACRO(fxstat, __VA_ARGS__);                                                \
-    MACRO(fxstat64, __VA_ARGS__);                                              \
-    MACRO(getc, __VA_ARGS__);                                                  \
-    MACRO(getcwd, __VA_ARGS__);                                                \
-    MACRO(getsockopt, __VA_ARGS__);                                            \
-    MACRO(gettimeofday, __VA_ARGS__);                                          \
-    MACRO(fgetc, __VA_ARGS__);                                                 \
-    MACRO(ungetc, __VA_ARGS__);                                                \
-    MACRO(getline, __VA_ARGS__);                                               \
-    MACRO(getpeername, __VA_ARGS__);                                           \
-    MACRO(getsockname, __VA_ARGS__);                                           \
-    MACRO(ioctl, __VA_ARGS__);                                                 \
-    MACRO(libc_memalign, __VA_ARGS__);                                         \
-    MACRO(lseek, __VA_ARGS__);                                                 \
-    MACRO(lseek64, __VA_ARGS__);                                               \
-    MACRO(llseek, __VA_ARGS__);                                                \
-    MACRO(link, __VA_ARGS__);                                                  \
-    MACRO(symlink, __VA_ARGS__);                                               \
-    MACRO(listen, __VA_ARGS__);                                                \
-    MACRO(localtime, __VA_ARGS__);                                             \
-    MACRO(lxstat, __VA_ARGS__);                                                \
-    MACRO(lxstat64, __VA_ARGS__);                                              \
-    MACRO(malloc, __VA_ARGS__);                                                \
-    MACRO(mkdir, __VA_ARGS__);                                                 \
-    MACRO(mkstemp, __VA_ARGS__);                                               \
-    MACRO(mmap, __VA_ARGS__);                                                  \
-    MACRO(mmap64, __VA_ARGS__);                                                \
-    MACRO(mremap, __VA_ARGS__);                                                \
-    MACRO(munmap, __VA_ARGS__);                                                \
-    MACRO(open, __VA_ARGS__);                                                  \
-    MACRO(open64, __VA_ARGS__);                                                \
-    MACRO(openat, __VA_ARGS__);                                                \
-    MACRO(opendir, __VA_ARGS__);                                               \
-    MACRO(pread, __VA_ARGS__);                                                 \
-    MACRO(preadv, __VA_ARGS__);                                                \
-    MACRO(putc, __VA_ARGS__);                                                  \
-    MACRO(pwrite, __VA_ARGS__);                                                \
-    MACRO(pwritev, __VA_ARGS__);                                               \
-    MACRO(pthread_detach, __VA_ARGS__);                                        \
-    MACRO(pthread_create, __VA_ARGS__);                                        \
-    MACRO(pthread_cond_broadcast, __VA_ARGS__);                                \
-    MACRO(pthread_cond_signal, __VA_ARGS__);                                   \
-    MACRO(pthread_mutex_lock, __VA_ARGS__);                                    \
-    MACRO(pthread_mutex_trylock, __VA_ARGS__);                                 \
-    MACRO(pthread_mutex_unlock, __VA_ARGS__);                                  \
-    MACRO(pthread_cond_wait, __VA_ARGS__);                                     \
-    MACRO(pthread_cond_timedwait, __VA_ARGS__);                                \
-    MACRO(pthread_exit, __VA_ARGS__);                                          \
-    MACRO(pthread_join, __VA_ARGS__);                                          \
-    MACRO(pthread_kill, __VA_ARGS__);                                          \
-    MACRO(pthread_rwlock_unlock, __VA_ARGS__);                                 \
-    MACRO(pthread_rwlock_rdlock, __VA_ARGS__);                                 \
-    MACRO(pthread_rwlock_wrlock, __VA_ARGS__);                                 \
-    MACRO(rand, __VA_ARGS__);                                                  \
-    MACRO(read, __VA_ARGS__);                                                  \
-    MACRO(readv, __VA_ARGS__);                                                 \
-    MACRO(readdir, __VA_ARGS__);                                               \
-    MACRO(readdir_r, __VA_ARGS__);                                             \
-    MACRO(readlink, __VA_ARGS__);                                              \
-    MACRO(realloc, __VA_ARGS__);                                               \
-    MACRO(rename, __VA_ARGS__);                                                \
-    MACRO(rewind, __VA_ARGS__);                                                \
-    MACRO(rmdir, __VA_ARGS__);                                                 \
-    MACRO(select, __VA_ARGS__);                                                \
-    MACRO(ppoll, __VA_ARGS__);                                                \
-    MACRO(signal_handler, __VA_ARGS__);                                        \
-    MACRO(sigwait, __VA_ARGS__);                                               \
-    MACRO(setsockopt, __VA_ARGS__);                                            \
-    MACRO(srand, __VA_ARGS__);                                                 \
-    MACRO(socket, __VA_ARGS__);                                                \
-    MACRO(socketpair, __VA_ARGS__);                                            \
-    MACRO(time, __VA_ARGS__);                                                  \
-    MACRO(tmpfile, __VA_ARGS__);                                               \
-    MACRO(truncate, __VA_ARGS__);                                              \
-    MACRO(unlink, __VA_ARGS__);                                                \
-    MACRO(write, __VA_ARGS__);                                                 \
-    MACRO(writev, __VA_ARGS__);                                                \
-    MACRO(xstat, __VA_ARGS__);                                                 \
-    MACRO(xstat64, __VA_ARGS__);                                               \
-    MACRO(user, __VA_ARGS__);                                                  \
-    MACRO(epoll_create, __VA_ARGS__);                                          \
-    MACRO(epoll_create1, __VA_ARGS__);                                         \
-    MACRO(epoll_ctl, __VA_ARGS__);                                             \
-    MACRO(epoll_wait, __VA_ARGS__);                                            \
-    MACRO(getpwnam_r, __VA_ARGS__);                                            \
-    MACRO(getpwuid_r, __VA_ARGS__);                                            \
-    MACRO(getgrnam_r, __VA_ARGS__);                                            \
-    MACRO(getgrgid_r, __VA_ARGS__);                                            \
-    MACRO(getaddrinfo, __VA_ARGS__);                                           \
-    MACRO(freeaddrinfo, __VA_ARGS__);                                          \
-    MACRO(getnameinfo, __VA_ARGS__);                                           \
-                                                                               \
-    MACRO(sendto, __VA_ARGS__);                                                \
-    MACRO(sendmsg, __VA_ARGS__);                                               \
-    MACRO(recvfrom, __VA_ARGS__);                                              \
-    MACRO(recvmsg, __VA_ARGS__);                                               \
-                                                                               \
-    MACRO(wait4, __VA_ARGS__);                                                 \
-    MACRO(waitid, __VA_ARGS__);                                               \
+    FOREACH_EVENT(FOREACH_NAME_STMT, MACRO, __VA_ARGS__)                       \
   } while(0)
 
 /* Event codes: */
+#define EVENT_CODE(name, ...) name##_event,
 typedef enum {
   unknown_event = -1,
   empty_event = 0,
-  accept_event = 1,
-  accept4_event,
-  access_event,
-  bind_event,
-  calloc_event,
-  chmod_event,
-  chown_event,
-  close_event,
-  closedir_event,
-  connect_event,
-  dup_event,
-  dup2_event,
-  dup3_event,
-  exec_barrier_event,
-  fclose_event,
-  fchdir_event,
-  fcntl_event,
-  fdatasync_event,
-  fdopen_event,
-  fdopendir_event,
-  fgets_event,
-  ferror_event,
-  feof_event,
-  fileno_event,
-  fflush_event,
-  setvbuf_event,
-  fopen_event,
-  fopen64_event,
-  freopen_event,
-  fprintf_event,
-  fscanf_event,
-  fseek_event,
-  fputs_event,
-  fputc_event,
-  free_event,
-  fsync_event,
-  ftell_event,
-  fwrite_event,
-  fread_event,
-  fxstat_event,
-  fxstat64_event,
-  getc_event,
-  getcwd_event,
-  gettimeofday_event,
-  ioctl_event,
-  fgetc_event,
-  ungetc_event,
-  getline_event,
-  getpeername_event,
-  getsockname_event,
-  getsockopt_event,
-  libc_memalign_event,
-  link_event,
-  symlink_event,
-  listen_event,
-  localtime_event,
-  lseek_event,
-  lseek64_event,
-  llseek_event,
-  lxstat_event,
-  lxstat64_event,
-  malloc_event,
-  mkdir_event,
-  mkstemp_event,
-  mmap_event,
-  mmap64_event,
-  mremap_event,
-  munmap_event,
-  open_event,
-  open64_event,
-  openat_event,
-  opendir_event,
-  pread_event,
-  preadv_event,
-  putc_event,
-  pwrite_event,
-  pwritev_event,
-  pthread_detach_event,
-  pthread_create_event,
-  pthread_cond_broadcast_event,
-  pthread_mutex_lock_event,
-  pthread_mutex_trylock_event,
-  pthread_cond_signal_event,
-  pthread_mutex_unlock_event,
-  pthread_cond_wait_event,
-  pthread_cond_timedwait_event,
-  pthread_exit_event,
-  pthread_join_event,
-  pthread_kill_event, // no return event -- asynchronous
-  pthread_rwlock_unlock_event,
-  pthread_rwlock_rdlock_event,
-  pthread_rwlock_wrlock_event,
-  rand_event,
-  read_event,
-  readv_event,
-  readdir_event,
-  readdir_r_event,
-  readlink_event,
-  realloc_event,
-  rename_event,
-  rewind_event,
-  rmdir_event,
-  select_event,
-  ppoll_event,
-  signal_handler_event,
-  sigwait_event,
-  setsockopt_event,
-  socket_event,
-  socketpair_event,
-  srand_event,
-  time_event,
-  tmpfile_event,
-  truncate_event,
-  unlink_event,
-  user_event,
-  write_event,
-  writev_event,
-  xstat_event,
-  xstat64_event,
-  epoll_create_event,
-  epoll_create1_event,
-  epoll_ctl_event,
-  epoll_wait_event,
-  getpwnam_r_event,
-  getpwuid_r_event,
-  getgrnam_r_event,
-  getgrgid_r_event,
-  getaddrinfo_event,
-  freeaddrinfo_event,
-  getnameinfo_event,
-  sendto_event,
-  sendmsg_event,
-  recvfrom_event,
-  recvmsg_event,
-
-  wait4_event,
-  waitid_event
+  FOREACH_EVENT(EVENT_CODE)
+  numTotalEvents
 } event_code_t;
 /* end event codes */
 
@@ -1163,6 +1033,16 @@ static const int log_event_fputc_size = sizeof(log_event_fputc_t);
 typedef struct {
   // For getc():
   FILE *stream;
+  // For a refill of the stream buffer (see stdio_refill()): the bytes left
+  // in the buffer after the call, at read_ptr, the buffer itself (NULL if
+  // the stream reads from its ungetc() backup area), and the offset of the
+  // file descriptor after the call.
+  char *read_ptr;
+  size_t buffered;
+  char *buf_base;
+  char *buf_end;
+  off_t file_offset;
+  off_t data_offset;
 } log_event_getc_t;
 
 static const int log_event_getc_size = sizeof(log_event_getc_t);
@@ -2054,41 +1934,28 @@ typedef struct {
 #define IS_EQUAL_FIELD_PTR(e1, e2, event, field) \
   (GET_FIELD_PTR(e1, event, field) == GET_FIELD_PTR(e2, event, field))
 
-#define IFNAME_GET_EVENT_SIZE(name, event, event_size)                  \
-  do {                                                                  \
-    if (event == name##_event)          \
-      event_size = log_event_##name##_size;                             \
-  } while(0)
-
-#define IFNAME_READ_ENTRY_FROM_LOG(name, source, entry)                    \
-  do {                                                                  \
-    if (GET_COMMON(entry,event) == name##_event) {           \
-      memcpy(&entry.event_data.log_event_##name, source,      \
-             log_event_##name##_size);                                     \
-    }                                                                   \
-  } while(0)
-
-#define IFNAME_WRITE_ENTRY_TO_LOG(name, dest, entry)                \
-  do {                                                                  \
-    if (GET_COMMON(entry,event) == name##_event) {               \
-      memcpy(dest, &entry.event_data.log_event_##name,              \
-             log_event_##name##_size);                                     \
-    }                                                                   \
-  } while(0)
-
+/* Indexes log_event_size_table; leaves event_size alone for codes that
+   aren't events. */
 #define GET_EVENT_SIZE(event, event_size)                               \
   do {                                                                  \
-    FOREACH_NAME(IFNAME_GET_EVENT_SIZE, event, event_size);             \
+    if ((unsigned int) (event) < (unsigned int) numTotalEvents)         \
+      event_size = log_event_size_table[event];                         \
   } while(0)
 
-#define READ_ENTRY_FROM_LOG(source, entry)                          \
+/* All event structs are members of the event_data union, so they all start
+   at the same address. */
+#define READ_ENTRY_FROM_LOG(source, entry)                              \
   do {                                                                  \
-    FOREACH_NAME(IFNAME_READ_ENTRY_FROM_LOG, source, entry);        \
+    int rw_event_size = 0;                                              \
+    GET_EVENT_SIZE(GET_COMMON(entry, event), rw_event_size);            \
+    memcpy(&entry.event_data, source, rw_event_size);                   \
   } while(0)
 
-#define WRITE_ENTRY_TO_LOG(dest, entry)                      \
+#define WRITE_ENTRY_TO_LOG(dest, entry)                                 \
   do {                                                                  \
-    FOREACH_NAME(IFNAME_WRITE_ENTRY_TO_LOG, dest, entry);    \
+    int rw_event_size = 0;                                              \
+    GET_EVENT_SIZE(GET_COMMON(entry, event), rw_event_size);            \
+    memcpy(dest, &entry.event_data, rw_event_size);                     \
   } while(0)
 
 /* Typedefs */
@@ -2109,15 +1976,14 @@ static const int         GLOBAL_CLONE_COUNTER_INIT = 1;
 static const int         RECORD_LOG_PATH_MAX = 256;
 
 /* Library private: */
-LIB_PRIVATE extern dmtcp::map<clone_id_t, pthread_t> *clone_id_to_tid_table;
-LIB_PRIVATE extern dmtcp::map<pthread_t, clone_id_t> *tid_to_clone_id_table;
-LIB_PRIVATE extern dmtcp::map<pthread_t, pthread_join_retval_t> pthread_join_retvals;
+/* log_event_<name>_size, indexed by event code. 0 for empty_event. */
+extern LIB_PRIVATE const int log_event_size_table[numTotalEvents];
 LIB_PRIVATE extern char RECORD_LOG_PATH[RECORD_LOG_PATH_MAX];
 LIB_PRIVATE extern char RECORD_READ_DATA_LOG_PATH[RECORD_LOG_PATH_MAX];
 LIB_PRIVATE extern int             read_data_fd;
 LIB_PRIVATE extern int             sync_logging_branch;
+LIB_PRIVATE extern int             sync_wrappers_active;
 LIB_PRIVATE extern int             log_all_allocs;
-LIB_PRIVATE extern pthread_mutex_t read_data_mutex;
 
 LIB_PRIVATE extern dmtcp::SynchronizationLog global_log;
 
@@ -2131,28 +1997,129 @@ LIB_PRIVATE extern __thread int in_mmap_wrapper;
 LIB_PRIVATE extern __thread unsigned char isOptionalEvent;
 LIB_PRIVATE extern __thread bool ok_to_log_next_func;
 
+/* The return-address classifier. Addresses are grouped in granules of
+   2^SYNC_ADDR_GRANULE_SHIFT bytes. The table, an open-addressing hash,
+   holds every granule that overlaps the code of an untracked library, with
+   SYNC_ADDR_MIXED set if the granule is only partly covered; for those, the
+   areas are checked one by one. It is sized for the granules found, up to
+   SYNC_ADDR_MAX_TABLE_SIZE slots; past that there is no table and every
+   address is checked against the areas. initSyncAddresses() builds a new
+   classifier next to the current one and publishes it with a single pointer
+   store, so readers take no lock. */
+#define SYNC_ADDR_GRANULE_SHIFT 16
+#define SYNC_ADDR_MIN_TABLE_SIZE 1024
+#define SYNC_ADDR_MAX_TABLE_SIZE 32768
+#define SYNC_ADDR_STATE_BITS 2
+#define SYNC_ADDR_UNTRACKED 0x1
+#define SYNC_ADDR_MIXED 0x2
+#define SYNC_ADDR_HASH(granule, tableSize) \
+  (((granule) * 2654435761UL) & ((tableSize) - 1))
+
+typedef struct SyncAddrArea {
+  void *addr;
+  void *endAddr;
+} SyncAddrArea;
+
+typedef struct SyncAddrClassifier {
+  // A power of two, or 0 for no table.
+  size_t tableSize;
+  uintptr_t *table;
+  size_t numAreas;
+  SyncAddrArea *areas;
+} SyncAddrClassifier;
+
+LIB_PRIVATE extern const SyncAddrClassifier *volatile sync_addr_classifier;
+
 /* Volatiles: */
 LIB_PRIVATE extern volatile clone_id_t    global_clone_counter;
 LIB_PRIVATE extern volatile off_t         read_log_pos;
 
 /* Functions */
 LIB_PRIVATE void   addNextLogEntry(log_entry_t&);
+LIB_PRIVATE void   reserveNextLogEntry(log_entry_t&);
+LIB_PRIVATE void   commitNextLogEntry(log_entry_t&);
 LIB_PRIVATE void   set_sync_mode(int mode);
 LIB_PRIVATE int    get_sync_mode();
 LIB_PRIVATE void   copyFdSet(fd_set *src, fd_set *dest);
 LIB_PRIVATE void   getNextLogEntry();
 LIB_PRIVATE void   initializeLogNames();
+LIB_PRIVATE void   clearThreadTable();
+LIB_PRIVATE void   registerThread(clone_id_t clone_id, pthread_t tid);
+LIB_PRIVATE void   unregisterThread(clone_id_t clone_id);
+LIB_PRIVATE void   unregisterExitedThreads();
+LIB_PRIVATE pthread_t  cloneIdToTid(clone_id_t clone_id);
+LIB_PRIVATE clone_id_t tidToCloneId(pthread_t tid);
 LIB_PRIVATE void   initLogsForRecordReplay();
-LIB_PRIVATE void   logReadData(void *buf, int count);
+LIB_PRIVATE off_t  logReadData(const void *buf, size_t count);
+LIB_PRIVATE off_t  logReadDataVector(const struct iovec *iov, int iovcnt);
+LIB_PRIVATE void   unmapReadDataLog();
+LIB_PRIVATE void   moveReadDataToEnd();
+LIB_PRIVATE const char *getReadData(off_t offset, size_t count);
+LIB_PRIVATE void   getReadDataVector(off_t offset, const struct iovec *iov,
+                                     int iovcnt);
+LIB_PRIVATE void   retireReadData();
 LIB_PRIVATE void   reapThisThread();
 LIB_PRIVATE void   recordDataStackLocations();
-LIB_PRIVATE int    shouldSynchronize(void *return_addr);
+LIB_PRIVATE void   stdioThreadCreated();
+LIB_PRIVATE void   stdioSwitchToRecord();
 LIB_PRIVATE void   initSyncAddresses();
+LIB_PRIVATE int    mallocArenaTakeSpan();
+LIB_PRIVATE void   mallocArenaReleaseSpan(int span);
+LIB_PRIVATE void   mallocArenaSetThreadSpan(int span);
 LIB_PRIVATE void   userSynchronizedEvent();
 LIB_PRIVATE void   userSynchronizedEventBegin();
 LIB_PRIVATE void   userSynchronizedEventEnd();
 LIB_PRIVATE ssize_t writeAll(int fd, const void *buf, size_t count);
-LIB_PRIVATE bool validAddress(void *addr);
+LIB_PRIVATE bool validAddressInAreas(const SyncAddrClassifier *classifier,
+                                     void *addr);
+
+/* Returns false if addr is in the code of a library whose calls are not
+   synchronized (libc, DMTCP, ...), see initSyncAddresses(). */
+static inline bool validAddress(void *addr)
+{
+  const SyncAddrClassifier *classifier = sync_addr_classifier;
+  if (classifier == NULL) {
+    initSyncAddresses();
+    classifier = sync_addr_classifier;
+    if (classifier == NULL) {
+      return true;
+    }
+  }
+  if (classifier->tableSize == 0) {
+    return validAddressInAreas(classifier, addr);
+  }
+  uintptr_t granule = (uintptr_t) addr >> SYNC_ADDR_GRANULE_SHIFT;
+  size_t i = SYNC_ADDR_HASH(granule, classifier->tableSize);
+  while (true) {
+    uintptr_t entry = classifier->table[i];
+    if (entry == 0) {
+      return true;
+    }
+    if (entry >> SYNC_ADDR_STATE_BITS == granule) {
+      return (entry & SYNC_ADDR_MIXED) != 0 &&
+             validAddressInAreas(classifier, addr);
+    }
+    i = (i + 1) & (classifier->tableSize - 1);
+  }
+}
+
+/* Returns 1 if we should synchronize this call, instead of calling the _real
+   version. 0 if we should not. Untracked calls in SYNC_NOOP mode, and all
+   calls in gdb, only test sync_wrappers_active. */
+static inline int shouldSynchronize(void *return_addr)
+{
+  if (!sync_wrappers_active) {
+    return 0;
+  }
+  if (!dmtcp_is_running_state()) {
+    return 0;
+  }
+  if (ok_to_log_next_func) {
+    ok_to_log_next_func = false;
+    return 1;
+  }
+  return validAddress(return_addr);
+}
 
 /* These 'create_XXX_entry' functions are used library-wide by their
    respective wrapper functions. Their usages are hidden by the
@@ -0,0 +1,126 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+/* Usage: fscanf-formats file [rounds]
+ * Reads rounds (default 1000) groups of four lines with fscanf(), one
+ * format per line, covering the integer and floating point conversions with
+ * their length modifiers, %c with a width, %[, %n, %ls and '*'. The
+ * fourth line only partly matches its format. Every variable is reset before
+ * each call, and the return values and the values scanned are folded into a
+ * checksum. fredtest.py compares it between record and replay. The input
+ * is "rounds" times:
+ *   -12 -300 4000000000 -5000000000 77 88 -99 ff 17 0x1f
+ *   1.5 2.25 3.125 4e2 5.5 0x1p3
+ *   abcdeword_one 42 rest wide
+ *   7 x y
+ */
+
+unsigned long solution = 0;
+int rounds_read = 0;
+
+void print_solution()
+{
+  printf("Solution is: %lu\n", solution);
+}
+
+static void mix(unsigned long value)
+{
+  solution = solution * 31 + value;
+}
+
+static void mix_double(long double value)
+{
+  mix((unsigned long) (long long) (value * 1000));
+}
+
+static void mix_bytes(const void *buf, size_t len)
+{
+  size_t i;
+  for (i = 0; i < len; i++) {
+    mix(((const unsigned char *) buf)[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  FILE *fp;
+  long rounds = 1000;
+  long r;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file [rounds]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2) {
+    rounds = atol(argv[2]);
+  }
+  fp = fopen(argv[1], "r");
+  if (fp == NULL) {
+    perror("fopen");
+    return 1;
+  }
+  for (r = 0; r < rounds; r++) {
+    signed char hh = 0;
+    short h = 0;
+    unsigned int u = 0;
+    long long ll = 0;
+    intmax_t j = 0;
+    size_t z = 0;
+    ptrdiff_t t = 0;
+    unsigned int x = 0, o = 0;
+    int i = 0, n = 0, a = 0, b = 0;
+    float f = 0;
+    double lf = 0, e = 0;
+    long double L = 0;
+    float g = 0, hexf = 0;
+    char c5[5];
+    char set[32];
+    char s[32];
+    wchar_t ws[32];
+    int ret;
+
+    memset(c5, 0, sizeof(c5));
+    memset(set, 0, sizeof(set));
+    memset(s, 0, sizeof(s));
+    memset(ws, 0, sizeof(ws));
+
+    ret = fscanf(fp, "%hhd %hd %u %lld %jd %zu %td %x %o %i",
+                 &hh, &h, &u, &ll, &j, &z, &t, &x, &o, &i);
+    mix(ret);
+    mix(hh); mix(h); mix(u); mix(ll); mix(j); mix(z); mix(t);
+    mix(x); mix(o); mix(i);
+
+    ret = fscanf(fp, "%f %lf %Lf %le %g %a", &f, &lf, &L, &e, &g, &hexf);
+    mix(ret);
+    mix_double(f); mix_double(lf); mix_double(L); mix_double(e);
+    mix_double(g); mix_double(hexf);
+
+    ret = fscanf(fp, " %5c%[a-z_]%n %*d %s %ls", c5, set, &n, s, ws);
+    mix(ret);
+    mix_bytes(c5, sizeof(c5));
+    mix_bytes(set, strlen(set));
+    mix(n);
+    mix_bytes(s, strlen(s));
+    mix_bytes(ws, wcslen(ws) * sizeof(wchar_t));
+
+    /* Matches the first number only. */
+    ret = fscanf(fp, "%d %d %31s", &a, &b, s);
+    mix(ret);
+    mix(a); mix(b);
+    mix_bytes(s, strlen(s));
+    /* Assigns nothing: skips the rest of the line. */
+    ret = fscanf(fp, "%*[^\n]");
+    mix(ret);
+    if (ret == EOF) {
+      break;
+    }
+    rounds_read++;
+  }
+  fclose(fp);
+  print_solution();
+  printf("rounds: %d\n", rounds_read);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/* Usage: fscanf-numbers file
+ * Parses a file of lines "<int> <double> <hex> <word>" with one fscanf() per
+ * line and prints the sums of the numbers, the number of lines and the
+ * elapsed time. fredbench.py uses it to measure the record and replay cost
+ * of fscanf(). */
+
+long lines = 0;
+long long int_sum = 0;
+double double_sum = 0;
+unsigned long hex_sum = 0;
+long chars_read = 0;
+
+static void print_sums()
+{
+  printf("lines: %ld, ints: %lld, doubles: %.6f, hex: %lu, chars: %ld\n",
+         lines, int_sum, double_sum, hex_sum, chars_read);
+}
+
+int main(int argc, char **argv)
+{
+  struct timeval start, end;
+  FILE *fp;
+  long long i;
+  double d;
+  unsigned long x;
+  char word[64];
+  int n;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file\n", argv[0]);
+    return 1;
+  }
+  fp = fopen(argv[1], "r");
+  if (fp == NULL) {
+    perror("fopen");
+    return 1;
+  }
+  gettimeofday(&start, NULL);
+  while (fscanf(fp, "%lld %lf %lx %63s%n", &i, &d, &x, word, &n) == 4) {
+    lines++;
+    int_sum += i;
+    double_sum += d;
+    hex_sum += x;
+    chars_read += n;
+  }
+  gettimeofday(&end, NULL);
+  fclose(fp);
+  print_sums();
+  printf("elapsed_us: %ld\n", (end.tv_sec - start.tv_sec) * 1000000L +
+         (end.tv_usec - start.tv_usec));
+  return 0;
+}
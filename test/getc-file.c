@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* Usage: getc-file file [getc|fgetc|getc_unlocked|mixed [num_threads]]
+ * Every thread opens the file and reads all of it one character at a time
+ * with the given function (default getc), counting lines. "mixed" is getc,
+ * with an fgets() of the rest of the line after every 1000th character
+ * (pushed back first with ungetc()), and a '#' pushed back and read again
+ * after every 3000th. Prints a checksum of what was read, the number of
+ * bytes and lines read and the elapsed time. fredbench.py uses it to
+ * measure the log size and record overhead of character-level stdio, and
+ * fredtest.py to check that replay reads the same. */
+
+const char *path;
+const char *function = "getc";
+long total = 0;
+long lines = 0;
+unsigned long solution = 0;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void print_solution()
+{
+  printf("Solution is: %lu\n", solution);
+}
+
+void *reader(void *arg)
+{
+  long bytes = 0;
+  long newlines = 0;
+  unsigned long sum = 0;
+  char line[256];
+  int c;
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    perror("fopen");
+    exit(1);
+  }
+  if (strcmp(function, "fgetc") == 0) {
+    while ((c = fgetc(fp)) != EOF) {
+      bytes++;
+      newlines += c == '\n';
+      sum = sum * 31 + c;
+    }
+  } else if (strcmp(function, "getc_unlocked") == 0) {
+    while ((c = getc_unlocked(fp)) != EOF) {
+      bytes++;
+      newlines += c == '\n';
+      sum = sum * 31 + c;
+    }
+  } else if (strcmp(function, "mixed") == 0) {
+    while ((c = getc(fp)) != EOF) {
+      bytes++;
+      newlines += c == '\n';
+      sum = sum * 31 + c;
+      if (bytes % 3000 == 0) {
+        ungetc('#', fp);
+        sum = sum * 31 + getc(fp);
+      } else if (bytes % 1000 == 0) {
+        ungetc(c, fp);
+        if (fgets(line, sizeof(line), fp) != NULL) {
+          sum = sum * 31 + strlen(line);
+          sum = sum * 31 + line[strlen(line) - 1];
+        }
+      }
+    }
+  } else {
+    while ((c = getc(fp)) != EOF) {
+      bytes++;
+      newlines += c == '\n';
+      sum = sum * 31 + c;
+    }
+  }
+  fclose(fp);
+  pthread_mutex_lock(&mutex);
+  total += bytes;
+  lines += newlines;
+  solution += sum;
+  pthread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t *threads;
+  struct timeval start, end;
+  long num_threads = 1;
+  long i;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s file [getc|fgetc|getc_unlocked|mixed"
+            " [num_threads]]\n", argv[0]);
+    return 1;
+  }
+  path = argv[1];
+  if (argc > 2) {
+    function = argv[2];
+  }
+  if (argc > 3) {
+    num_threads = atol(argv[3]);
+  }
+  gettimeofday(&start, NULL);
+  if (num_threads == 1) {
+    // No thread, so that character reads are not logged one by one.
+    reader(NULL);
+  } else {
+    threads = malloc(num_threads * sizeof(pthread_t));
+    for (i = 0; i < num_threads; i++) {
+      if (pthread_create(&threads[i], NULL, reader, NULL)) {
+        perror("pthread_create");
+        return 1;
+      }
+    }
+    for (i = 0; i < num_threads; i++) {
+      if (pthread_join(threads[i], NULL)) {
+        perror("pthread_join");
+        return 1;
+      }
+    }
+    free(threads);
+  }
+  gettimeofday(&end, NULL);
+  print_solution();
+  printf("threads: %ld, function: %s, bytes: %ld, lines: %ld,"
+         " elapsed_us: %ld\n", num_threads, function, total, lines,
+         (end.tv_sec - start.tv_sec) * 1000000L +
+         (end.tv_usec - start.tv_usec));
+  return 0;
+}
@@ -1,8 +1,31 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #define NUM_THREADS 250
 
+/* Usage: many-threads [num_threads iterations [num_mutexes]]
+ * Without arguments, creates and joins NUM_THREADS threads one at a time.
+ * With arguments, runs num_threads threads concurrently, each doing
+ * 'iterations' malloc/free and mutex lock/unlock pairs, and prints the
+ * elapsed time and the page faults taken meanwhile, and the peak RSS.
+ * Thread i locks mutex i % num_mutexes (default 1, a single mutex shared by
+ * all threads). fredbench.py uses the second form. */
+
+#define MAX_MUTEXES 64
+
+pthread_mutex_t mutexes[MAX_MUTEXES];
+long counters[MAX_MUTEXES];
+long num_mutexes = 1;
+long iterations = 0;
+
+long elapsed_us = 0;
+long minor_faults = 0;
+long major_faults = 0;
+long max_rss_kb = 0;
+
 void *worker(void *arg)
 {
   long i = (long)arg;
@@ -11,11 +34,89 @@ void *worker(void *arg)
   printf("aaaaand thread %ld exiting.\n", i);
 }
 
-int main()
+void *stress_worker(void *arg)
+{
+  long m = (long)arg % num_mutexes;
+  long i;
+  for (i = 0; i < iterations; i++) {
+    void *p = malloc(16 + i % 64);
+    pthread_mutex_lock(&mutexes[m]);
+    counters[m]++;
+    pthread_mutex_unlock(&mutexes[m]);
+    free(p);
+  }
+  return NULL;
+}
+
+void print_stats(long num_threads, long counter)
+{
+  printf("threads: %ld, iterations: %ld, counter: %ld, elapsed_us: %ld\n",
+         num_threads, iterations, counter, elapsed_us);
+  printf("minor_faults: %ld, major_faults: %ld, max_rss_kb: %ld\n",
+         minor_faults, major_faults, max_rss_kb);
+}
+
+int stress(long num_threads)
+{
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  struct timeval start, end;
+  struct rusage usage;
+  long i = 0;
+  long counter = 0;
+  int rc = 0;
+  for (i = 0; i < num_mutexes; i++) {
+    pthread_mutex_init(&mutexes[i], NULL);
+  }
+  getrusage(RUSAGE_SELF, &usage);
+  minor_faults = -usage.ru_minflt;
+  major_faults = -usage.ru_majflt;
+  gettimeofday(&start, NULL);
+  for (i = 0; i < num_threads; i++) {
+    rc = pthread_create(&threads[i], NULL, stress_worker, (void *)i);
+    if (rc) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  for (i = 0; i < num_threads; i++) {
+    rc = pthread_join(threads[i], NULL);
+    if (rc) {
+      perror("pthread_join");
+      return 1;
+    }
+  }
+  gettimeofday(&end, NULL);
+  getrusage(RUSAGE_SELF, &usage);
+  minor_faults += usage.ru_minflt;
+  major_faults += usage.ru_majflt;
+  max_rss_kb = usage.ru_maxrss;
+  elapsed_us = (end.tv_sec - start.tv_sec) * 1000000L +
+               (end.tv_usec - start.tv_usec);
+  for (i = 0; i < num_mutexes; i++) {
+    counter += counters[i];
+  }
+  print_stats(num_threads, counter);
+  free(threads);
+  return 0;
+}
+
+int main(int argc, char **argv)
 {
   pthread_t threads[NUM_THREADS];
   long i = 0;
   int rc = 0;
+  if (argc > 2) {
+    iterations = atol(argv[2]);
+    if (argc > 3) {
+      num_mutexes = atol(argv[3]);
+      if (num_mutexes < 1 || num_mutexes > MAX_MUTEXES) {
+        fprintf(stderr, "num_mutexes must be between 1 and %d\n",
+                MAX_MUTEXES);
+        return 1;
+      }
+    }
+    return stress(atol(argv[1]));
+  }
   for (i = 0; i < NUM_THREADS; i++) {
     rc = pthread_create(&threads[i], NULL, worker, (void *)i);
     if (rc) {
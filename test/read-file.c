@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* Usage: read-file file block_size [num_threads]
+ * Every thread opens the file and read()s all of it, block_size bytes at a
+ * time. Prints the number of bytes read and the elapsed time. fredbench.py
+ * uses it to time recording and replay of read-heavy programs. */
+
+const char *path;
+long block_size;
+long total = 0;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *reader(void *arg)
+{
+  char *buf = malloc(block_size);
+  long bytes = 0;
+  ssize_t rc;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("open");
+    exit(1);
+  }
+  while ((rc = read(fd, buf, block_size)) > 0) {
+    bytes += rc;
+  }
+  close(fd);
+  free(buf);
+  pthread_mutex_lock(&mutex);
+  total += bytes;
+  pthread_mutex_unlock(&mutex);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t *threads;
+  struct timeval start, end;
+  long num_threads = 1;
+  long i;
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s file block_size [num_threads]\n", argv[0]);
+    return 1;
+  }
+  path = argv[1];
+  block_size = atol(argv[2]);
+  if (argc > 3) {
+    num_threads = atol(argv[3]);
+  }
+  threads = malloc(num_threads * sizeof(pthread_t));
+  gettimeofday(&start, NULL);
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, reader, NULL)) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_join(threads[i], NULL)) {
+      perror("pthread_join");
+      return 1;
+    }
+  }
+  gettimeofday(&end, NULL);
+  printf("threads: %ld, block_size: %ld, bytes: %ld, elapsed_us: %ld\n",
+         num_threads, block_size, total,
+         (end.tv_sec - start.tv_sec) * 1000000L +
+         (end.tv_usec - start.tv_usec));
+  free(threads);
+  return 0;
+}
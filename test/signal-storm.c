@@ -0,0 +1,85 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define NUM_SIGNALS 5000
+
+/* Usage: signal-storm [num_signals]
+ * A thread sends SIGUSR1 to the main thread num_signals times, waiting for
+ * each one to be handled before sending the next. Prints the latency from
+ * pthread_kill() to the handler, and the CPU time of the whole process,
+ * which includes the thread delivering signals on replay. */
+
+static pthread_t main_thread;
+static sem_t handled;
+static int num_signals = NUM_SIGNALS;
+
+static volatile long solution = 0;
+static volatile int received = 0;
+static volatile double sent_at = 0;
+static double latency_avg_us = 0;
+static double latency_max_us = 0;
+static double cpu_s = 0;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_solution() {
+  printf("Solution is: %ld\n", solution);
+  printf("signals: %d, latency avg %.1f us, max %.1f us, cpu %.3f s\n",
+         received, latency_avg_us, latency_max_us, cpu_s);
+}
+
+static void handler(int sig)
+{
+  double latency_us = (now() - sent_at) * 1e6;
+  latency_avg_us += latency_us;
+  if (latency_us > latency_max_us) {
+    latency_max_us = latency_us;
+  }
+  solution = solution * 31 + received++;
+  sem_post(&handled);
+}
+
+static void *sender(void *arg)
+{
+  int i;
+  for (i = 0; i < num_signals; i++) {
+    sent_at = now();
+    pthread_kill(main_thread, SIGUSR1);
+    while (sem_wait(&handled) == -1 && errno == EINTR);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t t;
+  struct rusage usage;
+
+  if (argc > 1) {
+    num_signals = atoi(argv[1]);
+  }
+  main_thread = pthread_self();
+  sem_init(&handled, 0, 0);
+  signal(SIGUSR1, handler);
+
+  pthread_create(&t, NULL, sender, NULL);
+  while (pthread_join(t, NULL) == EINTR);
+
+  latency_avg_us /= num_signals;
+  getrusage(RUSAGE_SELF, &usage);
+  cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+          usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  print_solution();
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_THREADS 2000
+
+/* Usage: thread-join [num_threads]
+ * Creates and joins num_threads threads one at a time. Prints the latency
+ * from the thread function returning to pthread_join() returning, and the
+ * time of a whole create/join cycle. */
+
+static int num_threads = NUM_THREADS;
+
+static volatile long solution = 0;
+static volatile double returned_at = 0;
+static double join_avg_us = 0;
+static double join_max_us = 0;
+static double cycle_avg_us = 0;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_solution() {
+  printf("Solution is: %ld\n", solution);
+  printf("threads: %d, join latency avg %.1f us, max %.1f us, "
+         "cycle %.1f us\n",
+         num_threads, join_avg_us, join_max_us, cycle_avg_us);
+}
+
+static void *worker(void *arg)
+{
+  long i = (long)arg;
+  returned_at = now();
+  return (void *)(i * 7);
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t t;
+  void *value;
+  double start;
+  long i;
+
+  if (argc > 1) {
+    num_threads = atoi(argv[1]);
+  }
+  start = now();
+  for (i = 0; i < num_threads; i++) {
+    if (pthread_create(&t, NULL, worker, (void *)i) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+    pthread_join(t, &value);
+    double latency_us = (now() - returned_at) * 1e6;
+    join_avg_us += latency_us;
+    if (latency_us > join_max_us) {
+      join_max_us = latency_us;
+    }
+    solution = solution * 31 + (long)value;
+  }
+  cycle_avg_us = (now() - start) * 1e6 / num_threads;
+  join_avg_us /= num_threads;
+  print_solution();
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define ITERATIONS 10000000
+
+/* Usage: wrapper-overhead [iterations]
+ * Times malloc/free pairs and one-byte read()s from /dev/zero, and prints
+ * the nanoseconds per call. fredbench.py runs it natively and under fred
+ * with logging off, to measure what the wrappers cost on untracked calls. */
+
+long elapsed_ns(struct timeval *start)
+{
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start->tv_sec) * 1000000000L +
+         (end.tv_usec - start->tv_usec) * 1000L;
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : ITERATIONS;
+  struct timeval start;
+  char buf[1];
+  long i;
+  int fd = open("/dev/zero", O_RDONLY);
+  if (fd == -1) {
+    perror("open");
+    return 1;
+  }
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < iterations; i++) {
+    free(malloc(32));
+  }
+  printf("malloc+free: %.1f ns\n", (double) elapsed_ns(&start) / iterations);
+
+  gettimeofday(&start, NULL);
+  for (i = 0; i < iterations; i++) {
+    if (read(fd, buf, 1) != 1) {
+      perror("read");
+      return 1;
+    }
+  }
+  printf("read: %.1f ns\n", (double) elapsed_ns(&start) / iterations);
+  close(fd);
+  return 0;
+}